@@ -0,0 +1,7 @@
+set(PYTHON_EXECUTABLE "${THALAMUS_PYTHON}")
+set(Python_EXECUTABLE "${THALAMUS_PYTHON}")
+
+FetchContent_Declare(
+  pybind11
+  URL https://github.com/pybind/pybind11/archive/refs/tags/v2.13.6.tar.gz)
+FetchContent_MakeAvailable(pybind11)
@@ -0,0 +1,437 @@
+#include <thalamus/tracing.hpp>
+#include <execute.hpp>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+#include <thalamus_config.h>
+
+#include "thalamus/grpc_impl.hpp"
+#include "thalamus/node_graph_impl.hpp"
+#include <thalamus/analog_node.hpp>
+#include <thalamus/async.hpp>
+#include <thalamus/record_reader.hpp>
+#include <thalamus/shared_library.hpp>
+#include <thalamus/state.hpp>
+#include <thalamus/thread.hpp>
+#include <thalamus/thread_pool.hpp>
+#include <thalamus/vulkan.hpp>
+
+#ifdef __clang__
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Weverything"
+#endif
+#include <absl/strings/str_split.h>
+#include <absl/strings/strip.h>
+#include <boost/asio.hpp>
+#include <boost/program_options.hpp>
+#ifdef __clang__
+#pragma clang diagnostic pop
+#endif
+
+namespace execute {
+using namespace thalamus;
+using namespace std::chrono_literals;
+
+namespace {
+/**
+ * Counts what a node publishes and how long its ready subscribers take.  The
+ * subscriber time is measured between a slot at the front of the ready signal
+ * and one at the back, so it covers the subscribers that connected before the
+ * node was attached.  pool_drops is the work the node dropped because the
+ * ThreadPool was full.
+ */
+struct NodeStats {
+  std::string name;
+  std::string type;
+  const Node *node = nullptr;
+  size_t events = 0;
+  size_t samples = 0;
+  size_t pool_drops = 0;
+  std::chrono::nanoseconds downstream = 0ns;
+  std::chrono::steady_clock::time_point begin;
+  thalamus::ScopedConnection front_connection;
+  thalamus::ScopedConnection back_connection;
+};
+
+size_t count_samples(AnalogNode *node) {
+  if (!node->has_analog_data()) {
+    return 0;
+  }
+  size_t result = 0;
+  for (auto i = 0; i < node->num_channels(); ++i) {
+    if (node->is_short_data()) {
+      result += node->short_data(i).size();
+    } else if (node->is_int_data()) {
+      result += node->int_data(i).size();
+    } else if (node->is_ulong_data()) {
+      result += node->ulong_data(i).size();
+    } else {
+      result += node->data(i).size();
+    }
+  }
+  return result;
+}
+
+void attach(NodeStats &stats, std::shared_ptr<Node> node) {
+  stats.node = node.get();
+  auto analog = std::dynamic_pointer_cast<AnalogNode>(node);
+  stats.front_connection = node->ready.connect(
+      boost::signals2::at_front, [&stats, analog](Node *) {
+        ++stats.events;
+        if (analog) {
+          stats.samples += count_samples(analog.get());
+        }
+        stats.begin = std::chrono::steady_clock::now();
+      });
+  stats.back_connection = node->ready.connect([&stats](Node *) {
+    stats.downstream += std::chrono::steady_clock::now() - stats.begin;
+  });
+}
+
+void print_report(const std::vector<std::unique_ptr<NodeStats>> &all_stats,
+                  std::chrono::nanoseconds wall_time,
+                  std::chrono::nanoseconds capture_time, std::ostream &out) {
+  auto wall_seconds = std::chrono::duration<double>(wall_time).count();
+  auto capture_seconds = std::chrono::duration<double>(capture_time).count();
+  out << "Processed " << capture_seconds << "s of capture in " << wall_seconds
+      << "s (" << (wall_seconds > 0 ? capture_seconds / wall_seconds : 0)
+      << "x real time)" << std::endl;
+  out << std::left << std::setw(24) << "Node" << std::setw(16) << "Type"
+      << std::right << std::setw(12) << "Events" << std::setw(14) << "Events/s"
+      << std::setw(14) << "Samples" << std::setw(14) << "Samples/s"
+      << std::setw(16) << "Downstream (s)" << std::setw(12) << "Pool Drops"
+      << std::endl;
+  size_t pool_drops = 0;
+  for (auto &stats : all_stats) {
+    out << std::left << std::setw(24) << stats->name << std::setw(16)
+        << stats->type << std::right << std::setw(12) << stats->events
+        << std::setw(14) << std::fixed << std::setprecision(1)
+        << double(stats->events) / wall_seconds << std::setw(14)
+        << stats->samples << std::setw(14)
+        << double(stats->samples) / wall_seconds << std::setw(16)
+        << std::setprecision(3)
+        << std::chrono::duration<double>(stats->downstream).count()
+        << std::setw(12) << stats->pool_drops << std::defaultfloat
+        << std::endl;
+    pool_drops += stats->pool_drops;
+  }
+  if (pool_drops) {
+    out << "Warning: " << pool_drops
+        << " frames were dropped because the ThreadPool was full, the output "
+           "is incomplete"
+        << std::endl;
+  }
+}
+
+void write_report(const std::vector<std::unique_ptr<NodeStats>> &all_stats,
+                  std::chrono::nanoseconds wall_time,
+                  std::chrono::nanoseconds capture_time,
+                  const std::string &filename) {
+  boost::json::object report;
+  report["wall_seconds"] = std::chrono::duration<double>(wall_time).count();
+  report["capture_seconds"] =
+      std::chrono::duration<double>(capture_time).count();
+  boost::json::array nodes;
+  for (auto &stats : all_stats) {
+    boost::json::object node;
+    node["name"] = stats->name;
+    node["type"] = stats->type;
+    node["events"] = stats->events;
+    node["samples"] = stats->samples;
+    node["downstream_seconds"] =
+        std::chrono::duration<double>(stats->downstream).count();
+    node["pool_drops"] = stats->pool_drops;
+    nodes.push_back(std::move(node));
+  }
+  report["nodes"] = std::move(nodes);
+  std::ofstream output(filename);
+  output << boost::json::serialize(report) << std::endl;
+}
+
+/**
+ * The nodes that have records in the capture.  Every record is rejected by
+ * the filter so only the headers of uncompressed records are parsed.
+ */
+std::set<std::string, std::less<>>
+capture_nodes(const std::filesystem::path &path) {
+  std::set<std::string, std::less<>> result;
+  RecordReader reader(path, false);
+  RecordReader::Filter filter;
+  filter.node = [&](std::string_view node) {
+    if (!result.contains(node)) {
+      result.emplace(node);
+    }
+    return false;
+  };
+  reader.set_filter(filter);
+  while (reader.read_record()) {
+  }
+  return result;
+}
+} // namespace
+
+/**
+ * Runs a node graph over a capture without a UI or gRPC server.  The capture
+ * is played by a REPLAY node as fast as the graph consumes it and STORAGE2
+ * nodes in the configuration record the results.  Records carry their capture
+ * timestamps and move the movable clocks, but timers and ThreadPool jobs
+ * still run on wall time so runs aren't deterministic.  REPLAY waits for the
+ * ThreadPool to go idle before each image so nodes that drop frames when it
+ * is full see every frame; any drops are still reported and fail the run.
+ */
+int run(boost::json::value &config, const Options &options,
+        std::vector<SharedLibrary> &extensions) {
+  if (!config.is_object() || !config.as_object().contains("nodes")) {
+    std::cout << "Configuration has no nodes" << std::endl;
+    return 1;
+  }
+
+  // Without --sources every configured node that has records in the capture
+  // is replayed.
+  std::set<std::string, std::less<>> sources;
+  for (auto token :
+       absl::StrSplit(options.sources, ',', absl::SkipWhitespace())) {
+    sources.emplace(absl::StripAsciiWhitespace(token));
+  }
+  if (sources.empty()) {
+    sources = capture_nodes(options.input);
+  }
+
+  // Replayed nodes become REPLAY_SOURCE nodes, STORAGE2 nodes write to the
+  // requested output and nothing starts until the graph is built.
+  auto &config_nodes = config.as_object()["nodes"].as_array();
+  size_t storage_count = 0;
+  for (auto &node : config_nodes) {
+    auto &node_object = node.as_object();
+    if (node_object["type"].as_string() == "STORAGE2") {
+      ++storage_count;
+    }
+  }
+  for (auto &node : config_nodes) {
+    auto &node_object = node.as_object();
+    std::string name(node_object["name"].as_string());
+    if (sources.contains(name)) {
+      node_object = boost::json::object{{"name", name},
+                                        {"type", "REPLAY_SOURCE"}};
+      continue;
+    }
+    if (node_object.contains("Running")) {
+      node_object["Running"] = false;
+    }
+    if (node_object["type"].as_string() == "STORAGE2" && options.output) {
+      std::filesystem::path output(*options.output);
+      if (storage_count > 1) {
+        output.replace_filename(output.stem().string() + "_" + name +
+                                output.extension().string());
+      }
+      node_object["Output File"] = output.string();
+    }
+  }
+  auto replay_name = std::string("Executor Replay");
+  config_nodes.push_back(boost::json::object{
+      {"name", replay_name},
+      {"type", "REPLAY"},
+      {"File", options.input},
+      {"Nodes", options.sources},
+      {"Clock", "As Fast As Possible"},
+      {"Virtual Clock", true},
+      {"Wait For Pool", true},
+      {"Running", false}});
+
+  auto steady_start = std::chrono::steady_clock::now();
+  auto system_start = std::chrono::system_clock::now();
+  boost::asio::io_context io_context;
+
+  auto state =
+      std::get<ObservableDictPtr>(ObservableCollection::from_json(config));
+  ObservableListPtr nodes = state->at("nodes");
+  std::unique_ptr<NodeGraphImpl> node_graph(
+      new NodeGraphImpl(nodes, io_context, system_start, steady_start, nullptr,
+                        extensions, Vulkan{}));
+  Service service(state, io_context, *node_graph, "");
+  node_graph->set_service(&service);
+
+  // Let nodes finish connecting to each other before measuring them.
+  io_context.poll();
+
+  std::vector<std::unique_ptr<NodeStats>> all_stats;
+  std::set<std::string> attached;
+  auto attach_all = [&] {
+    for (auto i = 0ull; i < nodes->size(); ++i) {
+      ObservableDictPtr node_state = nodes->at(i);
+      std::string name = node_state->at("name");
+      std::string type = node_state->at("type");
+      auto node = node_graph->get_node(name).lock();
+      if (!node || attached.contains(name)) {
+        continue;
+      }
+      attached.insert(name);
+      auto &stats = all_stats.emplace_back(new NodeStats());
+      stats->name = name;
+      stats->type = type;
+      attach(*stats, node);
+    }
+  };
+  attach_all();
+  // REPLAY_SOURCE nodes added during playback are attached once the nodes
+  // that subscribe to them have connected.
+  boost::signals2::scoped_connection nodes_connection =
+      nodes->changed.connect([&](auto, auto &, auto &) {
+        boost::asio::post(io_context, attach_all);
+      });
+
+  auto capture_begin = std::chrono::nanoseconds::max();
+  auto capture_end = std::chrono::nanoseconds::min();
+  boost::signals2::scoped_connection clock_connection =
+      MovableSteadyClock::time_changed->connect([&] {
+        auto now = MovableSteadyClock::now().time_since_epoch();
+        capture_begin = std::min(capture_begin, now);
+        capture_end = std::max(capture_end, now);
+      });
+
+  ObservableDictPtr replay_state = nodes->at(nodes->size() - 1);
+  std::chrono::steady_clock::time_point wall_begin;
+  std::chrono::steady_clock::time_point wall_end;
+  auto finished = false;
+  boost::signals2::scoped_connection replay_connection =
+      replay_state->changed.connect([&](auto, auto &k, auto &v) {
+        if (std::get<std::string>(k) != "Running" || std::get<bool>(v)) {
+          return;
+        }
+        wall_end = std::chrono::steady_clock::now();
+        finished = true;
+        for (auto i = 0ull; i < nodes->size(); ++i) {
+          ObservableDictPtr node_state = nodes->at(i);
+          std::string type = node_state->at("type");
+          if (type == "STORAGE2") {
+            (*node_state)["Running"].assign(false, [] {});
+          }
+        }
+        node_graph->predrop([&] {
+          boost::asio::post(io_context, [&] {
+            auto &pool = node_graph->get_thread_pool();
+            for (auto &stats : all_stats) {
+              stats->pool_drops = pool.drops(stats->node);
+            }
+            node_graph.reset();
+            io_context.stop();
+          });
+        });
+      });
+
+  for (auto i = 0ull; i < nodes->size(); ++i) {
+    ObservableDictPtr node_state = nodes->at(i);
+    std::string type = node_state->at("type");
+    if (type == "STORAGE2") {
+      (*node_state)["Running"].assign(true, [] {});
+    }
+  }
+  wall_begin = std::chrono::steady_clock::now();
+  (*replay_state)["Running"].assign(true, [] {});
+
+  io_context.run();
+
+  nodes_connection.disconnect();
+  clock_connection.disconnect();
+  all_stats.erase(std::remove_if(all_stats.begin(), all_stats.end(),
+                                 [&](auto &stats) {
+                                   return stats->name == replay_name;
+                                 }),
+                  all_stats.end());
+  auto wall_time = finished ? wall_end - wall_begin : 0ns;
+  auto capture_time =
+      capture_end > capture_begin ? capture_end - capture_begin : 0ns;
+  print_report(all_stats, wall_time, capture_time, std::cout);
+  if (options.report) {
+    write_report(all_stats, wall_time, capture_time, *options.report);
+  }
+  auto dropped = std::any_of(all_stats.begin(), all_stats.end(),
+                             [](auto &stats) { return stats->pool_drops > 0; });
+  return dropped ? 1 : 0;
+}
+
+int main(int argc, char **argv) {
+  boost::program_options::options_description desc(
+      "Thalamus offline graph executor, version " GIT_COMMIT_HASH);
+  desc.add_options()("help,h", "produce help message")(
+      "config,c", boost::program_options::value<std::string>(),
+      "Thalamus configuration to execute")(
+      "input,i", boost::program_options::value<std::string>(),
+      "Capture to replay")(
+      "output,o", boost::program_options::value<std::string>(),
+      "Output file for the configuration's STORAGE2 nodes")(
+      "sources,s", boost::program_options::value<std::string>(),
+      "Comma separated nodes to replay from the capture, these replace nodes "
+      "of the same name in the configuration.  Defaults to every node in the "
+      "capture.")("report,r", boost::program_options::value<std::string>(),
+                  "Also write the throughput report to this JSON file")(
+      "ext,e",
+      boost::program_options::value<std::vector<std::string>>()->multitoken(),
+      "Shared libraries to extend thalamus");
+
+  boost::program_options::variables_map vm;
+  try {
+    boost::program_options::store(
+        boost::program_options::command_line_parser(argc, argv)
+            .options(desc)
+            .run(),
+        vm);
+  } catch (std::exception &e) {
+    std::cout << e.what() << std::endl;
+    return 1;
+  }
+  boost::program_options::notify(vm);
+
+  if (vm.count("help")) {
+    std::cout << desc << std::endl;
+    return 0;
+  }
+  if (!vm.count("config") || !vm.count("input")) {
+    std::cout << desc << std::endl;
+    return 1;
+  }
+
+  std::vector<SharedLibrary> extensions;
+  if (vm.count("ext") > 0) {
+    auto exts = vm["ext"].as<std::vector<std::string>>();
+    for (std::filesystem::path ext_path : exts) {
+      if (std::filesystem::exists(ext_path)) {
+        extensions.emplace_back(ext_path.string());
+      }
+    }
+  }
+
+  std::ifstream config_stream(vm["config"].as<std::string>());
+  if (!config_stream) {
+    std::cout << "Failed to open " << vm["config"].as<std::string>()
+              << std::endl;
+    return 1;
+  }
+  auto parsed = boost::json::parse(config_stream);
+
+  Options options;
+  options.input = vm["input"].as<std::string>();
+  if (vm.count("output")) {
+    options.output = vm["output"].as<std::string>();
+  }
+  if (vm.count("sources")) {
+    options.sources = vm["sources"].as<std::string>();
+  }
+  if (vm.count("report")) {
+    options.report = vm["report"].as<std::string>();
+  }
+
+  init_movable_clocks();
+  set_current_thread_name("main");
+  auto result = run(parsed, options, extensions);
+  cleanup_movable_clocks();
+  return result;
+}
+} // namespace execute
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <vector>
+#include <thalamus/shared_library.hpp>
+
+#ifdef __clang__
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Weverything"
+#endif
+#include <boost/json.hpp>
+#ifdef __clang__
+#pragma clang diagnostic pop
+#endif
+
+namespace execute {
+struct Options {
+  std::string input;
+  std::optional<std::string> output;
+  // Comma separated nodes to replay, empty replays every node in the capture
+  std::string sources;
+  std::optional<std::string> report;
+};
+
+/**
+ * Runs config over the capture in options.input and prints the throughput
+ * report.  The movable clocks must already be initialized.
+ */
+int run(boost::json::value &config, const Options &options,
+        std::vector<thalamus::SharedLibrary> &extensions);
+int main(int argc, char **argv);
+}
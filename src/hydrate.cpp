@@ -1,9 +1,15 @@
 #include <chrono>
 #include <fstream>
 #include <hydrate.hpp>
+#include <hydrate_csv.hpp>
+#include <hydrate_video.hpp>
 #include <iostream>
 #include <optional>
 #include <cstdio>
+#include <filesystem>
+#include <algorithm>
+#include <functional>
+#include <string_view>
 #include <thalamus_config.h>
 #ifdef _WIN32
 #include <WinSock2.h>
@@ -19,9 +25,7 @@
 #endif
 
 #include <absl/strings/str_replace.h>
-#include <boost/dll.hpp>
 #include <boost/endian.hpp>
-#include <boost/process.hpp>
 #include <boost/program_options.hpp>
 #include <boost/qvm/quat.hpp>
 #include <boost/qvm/vec.hpp>
@@ -31,14 +35,6 @@
 #define ZLIB_CONST
 #include <zlib.h>
 
-extern "C" {
-#include <libavcodec/avcodec.h>
-#include <libavdevice/avdevice.h>
-#include <libavformat/avformat.h>
-#include <libavutil/mem.h>
-#include <libavutil/opt.h>
-}
-
 #ifdef __clang__
 #pragma clang diagnostic pop
 #endif
@@ -181,14 +177,102 @@ struct DataCount {
   size_t max_pose_length = 0;
 };
 
+/**
+ * Matches name against a glob pattern, * matches any run of characters and ?
+ * any single character.
+ */
+static bool glob_match(std::string_view pattern, std::string_view name) {
+  size_t p = 0;
+  size_t n = 0;
+  std::optional<std::pair<size_t, size_t>> backtrack;
+  while (n < name.size()) {
+    if (p < pattern.size() && pattern[p] == '*') {
+      backtrack = std::make_pair(++p, n);
+    } else if (p < pattern.size() &&
+               (pattern[p] == '?' || pattern[p] == name[n])) {
+      ++p;
+      ++n;
+    } else if (backtrack) {
+      p = backtrack->first;
+      n = ++backtrack->second;
+    } else {
+      return false;
+    }
+  }
+  while (p < pattern.size() && pattern[p] == '*') {
+    ++p;
+  }
+  return p == pattern.size();
+}
+
+/**
+ * Accepts names that match any of a comma separated list of globs.
+ */
+static std::function<bool(std::string_view)>
+glob_filter(const std::string &text) {
+  std::vector<std::string> patterns = absl::StrSplit(text, ',');
+  return [patterns](std::string_view name) {
+    return std::any_of(
+        patterns.begin(), patterns.end(),
+        [&](const std::string &pattern) { return glob_match(pattern, name); });
+  };
+}
+
+/**
+ * Time of the first record in the capture, --start and --end are relative to
+ * it.
+ */
+static std::chrono::nanoseconds capture_start(const std::string &filename) {
+  RecordReader reader(std::filesystem::path(filename), false);
+  std::optional<thalamus_grpc::StorageRecord> record;
+  while ((record = reader.read_record())) {
+    if (record->time()) {
+      return std::chrono::nanoseconds(record->time());
+    }
+  }
+  return 0ns;
+}
+
+/**
+ * Builds the reader filter from --start, --end, --nodes and --channels.
+ * Records the filter rejects are skipped by the reader without being parsed
+ * and rejected channels are never inflated.
+ */
+static RecordReader::Filter
+make_filter(boost::program_options::variables_map &vm,
+            const std::string &filename) {
+  RecordReader::Filter filter;
+  if (vm.contains("start") || vm.contains("end")) {
+    auto origin = capture_start(filename);
+    auto offset = [&](const std::string &option) {
+      return origin + std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          std::chrono::duration<double>(vm[option].as<double>()));
+    };
+    if (vm.contains("start")) {
+      filter.start = offset("start");
+    }
+    if (vm.contains("end")) {
+      filter.end = offset("end");
+    }
+  }
+  if (vm.contains("nodes")) {
+    filter.node = glob_filter(vm["nodes"].as<std::string>());
+  }
+  if (vm.contains("channels")) {
+    filter.channel = glob_filter(vm["channels"].as<std::string>());
+  }
+  return filter;
+}
+
 static DataCount count_data(const std::string &filename,
-                            const std::optional<std::string> slash_replace) {
+                            const std::optional<std::string> slash_replace,
+                            const RecordReader::Filter &filter) {
   std::optional<thalamus_grpc::StorageRecord> record;
-  std::ifstream input_stream(filename, std::ios::binary);
   DataCount result;
   std::map<std::string, size_t> &counts = result.counts;
   auto last_time = std::chrono::steady_clock::now();
-  RecordReader reader(input_stream);
+  RecordReader reader{std::filesystem::path(filename)};
+  reader.set_filter(filter);
 
   while ((record = reader.read_record())) {
     auto now = std::chrono::steady_clock::now();
@@ -326,6 +410,8 @@ static DataCount count_data(const std::string &filename,
       }
       case thalamus_grpc::Image::Format::Image_Format_MPEG1:
       case thalamus_grpc::Image::Format::Image_Format_MPEG4:
+      case thalamus_grpc::Image::Format::Image_Format_FFV1:
+      case thalamus_grpc::Image::Format::Image_Format_H264:
       case thalamus_grpc::Image::Format::
           Image_Format_Image_Format_INT_MIN_SENTINEL_DO_NOT_USE_:
       case thalamus_grpc::Image::Format::
@@ -343,6 +429,8 @@ static DataCount count_data(const std::string &filename,
     case thalamus_grpc::StorageRecord::kCompressed:
     case thalamus_grpc::StorageRecord::kMetadata:
     case thalamus_grpc::StorageRecord::kFile:
+    case thalamus_grpc::StorageRecord::kAnalogSchema:
+    case thalamus_grpc::StorageRecord::kAnalogBlock:
       break;
       // std::cout << "Unhandled record type " << record->body_case() <<
       // std::endl;
@@ -431,384 +519,40 @@ void write_data(size_t time, size_t remote_time, size_t length, hid_t data,
 
 int generate_video(boost::program_options::variables_map &vm);
 int generate_video(boost::program_options::variables_map &vm) {
-  auto video =
-      vm.contains("video") ? vm["video"].as<std::string>() : std::string();
   std::string input = vm["input"].as<std::string>();
-
-  std::string output;
-  if (vm.count("output")) {
-    output = vm["output"].as<std::string>();
-  } else {
-    output = input + "_" + video + ".mkv";
-  }
-
-  unsigned int width = 0;
-  unsigned int height = 0;
-  std::string pixel_format;
-  std::string video_format;
-  std::set<size_t> times;
-  {
-    std::ifstream input_stream(input, std::ios::binary);
-    RecordReader reader(input_stream, false);
-    std::optional<thalamus_grpc::StorageRecord> record;
-    while ((record = reader.read_record())) {
-      if (record->body_case() == thalamus_grpc::StorageRecord::kImage &&
-          record->node() == video) {
-        times.insert(record->time());
-        if (width) {
-          continue;
-        }
-        auto image = record->image();
-        width = image.width();
-        height = image.height();
-        switch (image.format()) {
-        case thalamus_grpc::Image::Format::Image_Format_Gray:
-          pixel_format = "gray";
-          break;
-        case thalamus_grpc::Image::Format::Image_Format_RGB:
-          pixel_format = "rgb24";
-          break;
-        case thalamus_grpc::Image::Format::Image_Format_YUYV422:
-          pixel_format = "yuyv422";
-          break;
-        case thalamus_grpc::Image::Format::Image_Format_YUV420P:
-          pixel_format = "yuv420p";
-          break;
-        case thalamus_grpc::Image::Format::Image_Format_YUVJ420P:
-          pixel_format = "yuvj420p";
-          break;
-        case thalamus_grpc::Image::Format::Image_Format_Gray16:
-          pixel_format = image.bigendian() ? "gray16be" : "gray16le";
-          break;
-        case thalamus_grpc::Image::Format::Image_Format_RGB16:
-          pixel_format = image.bigendian() ? "rgb48be" : "rgb48le";
-          break;
-        case thalamus_grpc::Image::Format::Image_Format_MPEG1:
-          video_format = "mpeg1video";
-          break;
-        case thalamus_grpc::Image::Format::Image_Format_MPEG4:
-          video_format = "mpeg4video";
-          break;
-        case thalamus_grpc::Image::Format::
-            Image_Format_Image_Format_INT_MIN_SENTINEL_DO_NOT_USE_:
-        case thalamus_grpc::Image::Format::
-            Image_Format_Image_Format_INT_MAX_SENTINEL_DO_NOT_USE_:
-          THALAMUS_ASSERT(false, "Unexpected image format %d", image.format());
-        }
-      }
-    }
-  }
-  THALAMUS_ASSERT(width > 0 && height > 0, "Failed to detect video dimensions");
-  size_t total_diffs = 0;
-  size_t last_time = 0;
-  for (auto time : times) {
-    if (last_time > 0) {
-      total_diffs += time - last_time;
-    }
-    last_time = time;
-  }
-  auto average_interval = total_diffs / (times.size() - 1);
-
-  std::vector<std::pair<double, std::string>> framerates = {
-      {24000.0 / 1001, "24000/1001"},
-      {24, "24"},
-      {25, "25"},
-      {30000.0 / 1001, "30000/1001"},
-      {30, "30"},
-      {50, "50"},
-      {60000.0 / 1001, "60000/1001"},
-      {60, "60"},
-      {15, "15"},
-      {5, "5"},
-      {10, "10"},
-      {12, "12"},
-      {15, "15"}};
-  std::sort(framerates.begin(), framerates.end());
-  auto framerate = 1e9 / double(average_interval);
-  auto framerate_i =
-      std::lower_bound(framerates.begin(), framerates.end(),
-                       std::make_pair(framerate, std::string("")));
-  std::string ffmpeg_framerate;
-  if (framerate_i == framerates.begin()) {
-    ffmpeg_framerate = framerates.front().second;
-  } else if (framerate_i == framerates.end()) {
-    ffmpeg_framerate = framerates.back().second;
-  } else {
-    if (framerate - (framerate_i - 1)->first < framerate_i->first - framerate) {
-      ffmpeg_framerate = (framerate_i - 1)->second;
+  std::vector<std::string> nodes =
+      absl::StrSplit(vm["video"].as<std::string>(), ',');
+
+  VideoExport options;
+  options.input = input;
+  options.filter = make_filter(vm, input);
+  for (auto &node : nodes) {
+    if (nodes.size() == 1 && vm.count("output")) {
+      options.outputs[node] = vm["output"].as<std::string>();
     } else {
-      ffmpeg_framerate = framerate_i->second;
+      auto prefix =
+          vm.count("output") ? vm["output"].as<std::string>() : input;
+      options.outputs[node] = prefix + "_" + node + ".mkv";
     }
   }
-
-  AVRational time_base;
-  std::vector<std::string> tokens = absl::StrSplit(ffmpeg_framerate, '/');
-  if (tokens.size() == 1) {
-    tokens.push_back("1");
-  }
-  auto success = absl::SimpleAtoi(tokens[0], &time_base.den);
-  THALAMUS_ASSERT(success, "SimpleAtoi failed %s", tokens[0]);
-  success = absl::SimpleAtoi(tokens[1], &time_base.num);
-  THALAMUS_ASSERT(success, "SimpleAtoi failed %s", tokens[1]);
-
-  auto location = boost::dll::program_location();
-  std::string command;
-  if (!video_format.empty()) {
-    command = absl::StrFormat("%s ffmpeg -y -i pipe: -c:v copy \"%s\"",
-                              location.string(), output);
-  } else {
-    command = absl::StrFormat(
-        "%s ffmpeg -y -f rawvideo -r %s -pixel_format %s -video_size %dx%d -i pipe: "
-        "-codec mpeg1video -f matroska -qscale:v 2 -b:v 100M \"%s\"",
-        location.string(), ffmpeg_framerate, pixel_format, width, height, 
-        output);
-  }
-  std::cout << "command " << command;
-  boost::process::opstream in;
-  boost::process::child ffmpeg(
-      command, boost::process::std_in<in, boost::process::std_out> stdout,
-      boost::process::std_err > stderr);
-  {
-    std::ifstream input_stream(input, std::ios::binary);
-    std::optional<thalamus_grpc::StorageRecord> record;
-    RecordReader reader(input_stream, false);
-    while ((record = reader.read_record())) {
-      if (record->body_case() == thalamus_grpc::StorageRecord::kImage &&
-          record->node() == video) {
-        auto image = record->image();
-        width = image.width();
-        height = image.height();
-        switch (image.format()) {
-        case thalamus_grpc::Image::Format::Image_Format_Gray: {
-          auto data = image.data(0);
-          auto image_width = image.width();
-          auto image_height = image.height();
-          auto linesize = data.size() / image_height;
-          auto char_ptr = reinterpret_cast<const char *>(data.data());
-          for (auto i = 0u; i < image_height; ++i) {
-            in.write(char_ptr + i * linesize, image_width);
-          }
-          break;
-        }
-        case thalamus_grpc::Image::Format::Image_Format_RGB: {
-          auto data = image.data(0);
-          auto image_width = image.width();
-          auto image_height = image.height();
-          auto linesize = data.size() / image_height;
-          auto char_ptr = reinterpret_cast<const char *>(data.data());
-          for (auto i = 0u; i < image_height; ++i) {
-            in.write(char_ptr + i * linesize, 3 * image_width);
-          }
-          break;
-        }
-        case thalamus_grpc::Image::Format::Image_Format_YUYV422: {
-          auto data = image.data(0);
-          auto image_width = image.width();
-          auto image_height = image.height();
-          auto linesize = data.size() / image_height;
-          auto char_ptr = reinterpret_cast<const char *>(data.data());
-          for (auto i = 0u; i < image_height; ++i) {
-            in.write(char_ptr + i * linesize, 2 * image_width);
-          }
-          break;
-        }
-        case thalamus_grpc::Image::Format::Image_Format_YUV420P: {
-          for (auto i = 0; i < 3; ++i) {
-            auto data = image.data(i);
-            auto image_width = image.width();
-            auto image_height = image.height();
-            if (i) {
-              image_width /= 2;
-              image_height /= 2;
-            }
-            auto linesize = data.size() / image_height;
-            auto char_ptr = reinterpret_cast<const char *>(data.data());
-            for (auto j = 0u; j < image_height; ++j) {
-              in.write(char_ptr + j * linesize, image_width);
-            }
-          }
-          break;
-        }
-        case thalamus_grpc::Image::Format::Image_Format_YUVJ420P: {
-          for (auto i = 0; i < 3; ++i) {
-            auto data = image.data(i);
-            auto image_width = image.width();
-            auto image_height = image.height();
-            if (i) {
-              image_width /= 2;
-              image_height /= 2;
-            }
-            auto linesize = data.size() / image_height;
-            auto char_ptr = reinterpret_cast<const char *>(data.data());
-            for (auto j = 0u; j < image_height; ++j) {
-              in.write(char_ptr + j * linesize, image_width);
-            }
-          }
-          break;
-        }
-        case thalamus_grpc::Image::Format::Image_Format_Gray16: {
-          auto data = image.data(0);
-          auto image_width = image.width();
-          auto image_height = image.height();
-          auto linesize = data.size() / image_height;
-          auto char_ptr = reinterpret_cast<const char *>(data.data());
-          for (auto i = 0u; i < image_height; ++i) {
-            in.write(char_ptr + i * linesize, 2 * image_width);
-          }
-          break;
-        }
-        case thalamus_grpc::Image::Format::Image_Format_RGB16: {
-          auto data = image.data(0);
-          auto image_width = image.width();
-          auto image_height = image.height();
-          auto linesize = data.size() / image_height;
-          auto char_ptr = reinterpret_cast<const char *>(data.data());
-          for (auto i = 0u; i < image_height; ++i) {
-            in.write(char_ptr + i * linesize, 6 * image_width);
-          }
-          break;
-        }
-        case thalamus_grpc::Image::Format::Image_Format_MPEG1:
-        case thalamus_grpc::Image::Format::Image_Format_MPEG4:
-          in.write(image.data(0).data(), int64_t(image.data(0).size()));
-          break;
-        case thalamus_grpc::Image::Format::
-            Image_Format_Image_Format_INT_MIN_SENTINEL_DO_NOT_USE_:
-        case thalamus_grpc::Image::Format::
-            Image_Format_Image_Format_INT_MAX_SENTINEL_DO_NOT_USE_:
-          THALAMUS_ASSERT(false, "Unexpected image format %d", image.format());
-        }
-      }
-    }
-  }
-
-  in.flush();
-  in.pipe().close();
-  ffmpeg.join();
-  return 0;
+  return export_videos(options);
 }
 
 int generate_csv(boost::program_options::variables_map &vm);
 int generate_csv(boost::program_options::variables_map &vm) {
-  auto csv = vm.contains("csv") ? vm["csv"].as<std::string>() : std::string();
-  std::string input = vm["input"].as<std::string>();
-
-  std::set<std::string> channels;
-  if (vm.contains("channels")) {
-    auto text = vm["channels"].as<std::string>();
-    auto tokens = absl::StrSplit(text, ',');
-    channels.insert(tokens.begin(), tokens.end());
-  }
-
-  std::string output;
+  CsvExport options;
+  options.node = vm["csv"].as<std::string>();
+  options.input = vm["input"].as<std::string>();
   if (vm.count("output")) {
-    output = vm["output"].as<std::string>();
+    options.output = vm["output"].as<std::string>();
   } else {
-    output = input + "_" + csv + ".csv";
-  }
-
-  std::map<std::string, FILE*> column_files;
-  std::ifstream input_stream(input, std::ios::binary);
-  RecordReader reader(input_stream);
-  std::optional<thalamus_grpc::StorageRecord> record;
-  auto last_time = std::chrono::steady_clock::now();
-  auto line_count = 0l;
-
-  std::cout << "Extracting Channel CSVs" << std::endl;
-  while ((record = reader.read_record())) {
-    auto now = std::chrono::steady_clock::now();
-    if (now - last_time >= 5s) {
-      std::cout << reader.progress() << "%" << std::endl;
-      last_time = now;
-    }
-
-    auto node_name = record->node();
-    if (node_name != csv) {
-      continue;
-    }
-    switch (record->body_case()) {
-    case thalamus_grpc::StorageRecord::kAnalog: {
-      auto analog = record->analog();
-      auto spans = analog.spans();
-
-      for (auto &span : spans) {
-        auto span_name = span.name().empty() ? "" : span.name();
-        if (!channels.empty() && !channels.contains(span_name)) {
-          continue;
-        }
-        if (!column_files.contains(span_name)) {
-          column_files[span_name] = std::tmpfile();
-          fprintf(column_files[span_name], "Time (ns),%s,\n", span_name.c_str());
-          ++line_count;
-        }
-
-        uint64_t record_time = record->time();
-        if (analog.is_int_data()) {
-          for (auto i = span.begin(); i < span.end(); ++i) {
-            fprintf(column_files[span_name], "%" PRIu64 ",%d,\n", record_time, analog.int_data(int(i)));
-          }
-        } else if (analog.is_ulong_data()) {
-          for (auto i = span.begin(); i < span.end(); ++i) {
-            fprintf(column_files[span_name], "%" PRIu64 ",%" PRIu64 ",\n", record_time, analog.ulong_data(int(i)));
-          }
-        } else {
-          for (auto i = span.begin(); i < span.end(); ++i) {
-            fprintf(column_files[span_name], "%" PRIu64 ",%f,\n", record_time, analog.data(int(i)));
-          }
-        }
-        line_count += span.end() - span.begin();
-      }
-      break;
-    }
-    case thalamus_grpc::StorageRecord::kXsens:
-    case thalamus_grpc::StorageRecord::kEvent:
-    case thalamus_grpc::StorageRecord::kImage:
-    case thalamus_grpc::StorageRecord::kText:
-    case thalamus_grpc::StorageRecord::kCompressed:
-    case thalamus_grpc::StorageRecord::kMetadata:
-    case thalamus_grpc::StorageRecord::kFile:
-    case thalamus_grpc::StorageRecord::BODY_NOT_SET:
-      break;
-    }
-  }
-
-  for (auto &pair : column_files) {
-    fseek(pair.second, 0, SEEK_SET);
-  }
-
-  std::cout << "Merging Channel CSVs" << std::endl;
-  std::ofstream total_output = std::ofstream(output);
-  char buffer[1024];
-  auto working = true;
-  auto merged_lines = 0;
-
-  last_time = std::chrono::steady_clock::now();
-  while (working) {
-    auto now = std::chrono::steady_clock::now();
-    if (now - last_time >= 5s) {
-      std::cout << (100.0 * double(merged_lines) / double(line_count)) << "%" << std::endl;
-      last_time = now;
-    }
-
-    working = false;
-    for (auto &pair : column_files) {
-      if (feof(pair.second)) {
-        total_output << ",,";
-      } else {
-        fgets(buffer, sizeof(buffer), pair.second);
-        auto std_line = absl::StripAsciiWhitespace(buffer);
-        if (std_line.empty()) {
-          total_output << ",,";
-          continue;
-        }
-        total_output << std_line;
-        working = true;
-        ++merged_lines;
-      }
-    }
-    total_output << std::endl;
+    options.output = options.input + "_" + options.node + ".csv";
   }
-  return 0;
+  options.filter = make_filter(vm, options.input);
+  options.filter.node = [&node = options.node](std::string_view name) {
+    return name == node;
+  };
+  return export_csv(options);
 }
 
 int main(int argc, char **argv) {
@@ -828,9 +572,16 @@ int main(int argc, char **argv) {
       "Input file")("csv", boost::program_options::value<std::string>(),
                     "Output this node's data as csv")(
       "video", boost::program_options::value<std::string>(),
-      "Output this node's data as video")(
+      "Output these nodes' data as video, comma separated")(
       "channels", boost::program_options::value<std::string>(),
-      "Channels to output")("slash-replace",
+      "Comma separated globs of the channels to output")(
+      "nodes", boost::program_options::value<std::string>(),
+      "Comma separated globs of the nodes to output")(
+      "start", boost::program_options::value<double>(),
+      "Start of the window to output, in seconds from the first record")(
+      "end", boost::program_options::value<double>(),
+      "End of the window to output, in seconds from the first record")(
+      "slash-replace",
                             boost::program_options::value<std::string>(),
                             "Text to replace slashes with")(
       "output,o", boost::program_options::value<std::string>(), "Output file");
@@ -897,7 +648,8 @@ int main(int argc, char **argv) {
     auto start = std::chrono::steady_clock::now();
 
     std::cout << "Measuring Capture File" << std::endl;
-    DataCount data_count = count_data(input, slash_replace);
+    auto filter = make_filter(vm, input);
+    DataCount data_count = count_data(input, slash_replace, filter);
     auto &dataset_counts = data_count.counts;
     std::map<std::string, H5Handle> datasets;
     std::map<std::string, size_t> written;
@@ -1045,8 +797,8 @@ int main(int argc, char **argv) {
       }
     }
 
-    std::ifstream input_stream(input, std::ios::binary);
-    RecordReader reader(input_stream);
+    RecordReader reader{std::filesystem::path(input)};
+    reader.set_filter(filter);
 
     std::optional<thalamus_grpc::StorageRecord> record;
     auto last_time = std::chrono::steady_clock::now();
@@ -1439,6 +1191,8 @@ int main(int argc, char **argv) {
         }
         case thalamus_grpc::Image::Format::Image_Format_MPEG1:
         case thalamus_grpc::Image::Format::Image_Format_MPEG4:
+        case thalamus_grpc::Image::Format::Image_Format_FFV1:
+        case thalamus_grpc::Image::Format::Image_Format_H264:
         case thalamus_grpc::Image::Format::
             Image_Format_Image_Format_INT_MIN_SENTINEL_DO_NOT_USE_:
         case thalamus_grpc::Image::Format::
@@ -1475,6 +1229,8 @@ int main(int argc, char **argv) {
       case thalamus_grpc::StorageRecord::kCompressed:
       case thalamus_grpc::StorageRecord::kMetadata:
       case thalamus_grpc::StorageRecord::kFile:
+      case thalamus_grpc::StorageRecord::kAnalogSchema:
+      case thalamus_grpc::StorageRecord::kAnalogBlock:
         break;
         // std::cout << "Unhandled record type " << record->body_case() <<
         // std::endl;
@@ -0,0 +1,407 @@
+#include <hydrate_csv.hpp>
+#include <thalamus/assert.hpp>
+#include <thalamus/bounded_queue.hpp>
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <variant>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+namespace hydrate {
+namespace {
+struct Sample {
+  uint64_t time;
+  std::variant<int, uint64_t, double> value;
+};
+
+// Samples written to a spill file at once
+const size_t spill_chunk = 4096;
+
+/**
+ * The samples of a channel that haven't been formatted yet, in order.  Once
+ * limit samples are held in memory newer ones are spilled to a temporary
+ * file and read back as older ones are taken, so a channel that runs ahead of
+ * slower ones doesn't grow without bound.
+ */
+struct Column {
+  size_t count = 0;
+  size_t taken = 0;
+  size_t limit = std::numeric_limits<size_t>::max();
+  // Oldest samples, then spilled samples, then the newest samples that
+  // haven't filled a chunk yet.
+  std::deque<Sample> samples;
+  std::FILE *spill = nullptr;
+  std::fpos_t spill_read;
+  std::fpos_t spill_write;
+  size_t spilled = 0;
+  std::vector<Sample> tail;
+
+  Column() = default;
+  Column(const Column &) = delete;
+  Column &operator=(const Column &) = delete;
+  ~Column() {
+    if (spill) {
+      std::fclose(spill);
+    }
+  }
+
+  size_t available() const {
+    return taken + samples.size() + spilled + tail.size();
+  }
+
+  void push(const Sample &sample) {
+    if (!spilled && tail.empty() && samples.size() < limit) {
+      samples.push_back(sample);
+      return;
+    }
+    tail.push_back(sample);
+    if (tail.size() < spill_chunk) {
+      return;
+    }
+    if (!spill) {
+      spill = std::tmpfile();
+      THALAMUS_ASSERT(spill, "Failed to create a spill file");
+      std::fgetpos(spill, &spill_read);
+      std::fgetpos(spill, &spill_write);
+    }
+    std::fsetpos(spill, &spill_write);
+    auto written = std::fwrite(tail.data(), sizeof(Sample), tail.size(), spill);
+    THALAMUS_ASSERT(written == tail.size(), "Failed to spill samples");
+    std::fgetpos(spill, &spill_write);
+    spilled += tail.size();
+    tail.clear();
+  }
+
+  /**
+   * Moves the oldest rows samples to output.
+   */
+  void take(size_t rows, std::vector<Sample> &output) {
+    output.reserve(rows);
+    while (rows) {
+      if (samples.empty()) {
+        refill();
+      }
+      auto moved = std::min(rows, samples.size());
+      output.insert(output.end(), samples.begin(),
+                    samples.begin() + int64_t(moved));
+      samples.erase(samples.begin(), samples.begin() + int64_t(moved));
+      taken += moved;
+      rows -= moved;
+    }
+  }
+
+private:
+  void refill() {
+    if (!spilled) {
+      samples.insert(samples.end(), tail.begin(), tail.end());
+      tail.clear();
+      return;
+    }
+    std::vector<Sample> chunk(std::min(spilled, std::max(limit, spill_chunk)));
+    std::fsetpos(spill, &spill_read);
+    auto read = std::fread(chunk.data(), sizeof(Sample), chunk.size(), spill);
+    THALAMUS_ASSERT(read == chunk.size(), "Failed to read spilled samples");
+    std::fgetpos(spill, &spill_read);
+    spilled -= chunk.size();
+    samples.insert(samples.end(), chunk.begin(), chunk.end());
+  }
+};
+
+/**
+ * Samples of rows [first_row, first_row + rows), columns that end inside the
+ * batch are shorter.
+ */
+struct Batch {
+  size_t first_row = 0;
+  size_t rows = 0;
+  std::vector<std::vector<Sample>> columns;
+};
+
+// Longest cell: a 20 digit time and a double in fixed notation with 6
+// decimals, plus separators.
+const size_t max_cell_size =
+    32 + size_t(std::numeric_limits<double>::max_exponent10) + 8;
+
+char *write_value(char *out, char *end, int value) {
+  return std::to_chars(out, end, value).ptr;
+}
+char *write_value(char *out, char *end, uint64_t value) {
+  return std::to_chars(out, end, value).ptr;
+}
+char *write_value(char *out, char *end, double value) {
+  // Same text as printf's %f, without the locale.
+  return std::to_chars(out, end, value, std::chars_format::fixed, 6).ptr;
+}
+
+/**
+ * Formats rows [begin, end) of the batch into buffer, which keeps its
+ * capacity between batches.  Returns the number of bytes written.
+ */
+size_t format_rows(const Batch &batch, size_t begin, size_t end,
+                   std::vector<char> &buffer) {
+  auto row_size = batch.columns.size() * max_cell_size + 1;
+  size_t used = 0;
+  for (auto k = begin; k < end; ++k) {
+    if (buffer.size() < used + row_size) {
+      buffer.resize(std::max(2 * buffer.size(), used + row_size));
+    }
+    auto out = buffer.data() + used;
+    auto last = buffer.data() + buffer.size();
+    for (auto &column : batch.columns) {
+      if (k < column.size()) {
+        auto &sample = column[k];
+        out = std::to_chars(out, last, sample.time).ptr;
+        *out++ = ',';
+        out = std::visit(
+            [&](auto value) { return write_value(out, last, value); },
+            sample.value);
+        *out++ = ',';
+      } else {
+        *out++ = ',';
+        *out++ = ',';
+      }
+    }
+    *out++ = '\n';
+    used = size_t(out - buffer.data());
+  }
+  return used;
+}
+
+template <typename T>
+void append(Column &column, uint64_t time, const T &data, size_t begin,
+            size_t end) {
+  end = std::min(end, size_t(data.size()));
+  for (auto i = begin; i < end; ++i) {
+    column.push(Sample{time, data[int(i)]});
+  }
+}
+
+/**
+ * Threads that each format a slice of a batch.  They are started once and
+ * wait for the next batch rather than being created for every batch.
+ */
+class FormatPool {
+  std::vector<std::thread> threads;
+  std::vector<std::vector<char>> buffers;
+  std::vector<size_t> sizes;
+  const Batch *batch = nullptr;
+  size_t generation = 0;
+  size_t remaining = 0;
+  bool stopping = false;
+  std::mutex mutex;
+  std::condition_variable started;
+  std::condition_variable finished;
+
+  void thread_target(size_t index) {
+    size_t seen = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+      started.wait(lock, [&] { return stopping || generation != seen; });
+      if (stopping) {
+        return;
+      }
+      seen = generation;
+      auto current = batch;
+      lock.unlock();
+
+      auto rows_per_thread = (current->rows + threads.size() - 1) /
+                             threads.size();
+      auto begin = std::min(current->rows, index * rows_per_thread);
+      auto end = std::min(current->rows, begin + rows_per_thread);
+      sizes[index] =
+          begin < end ? format_rows(*current, begin, end, buffers[index]) : 0;
+
+      lock.lock();
+      if (--remaining == 0) {
+        finished.notify_one();
+      }
+    }
+  }
+
+public:
+  explicit FormatPool(size_t count) : buffers(count), sizes(count) {
+    for (size_t i = 0; i < count; ++i) {
+      threads.emplace_back([this, i] { thread_target(i); });
+    }
+  }
+
+  ~FormatPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    started.notify_all();
+    for (auto &thread : threads) {
+      thread.join();
+    }
+  }
+
+  /**
+   * Formats the batch across the threads and writes it to file in order.
+   */
+  void write(const Batch &next, std::FILE *file) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      batch = &next;
+      remaining = threads.size();
+      ++generation;
+      started.notify_all();
+      finished.wait(lock, [&] { return remaining == 0; });
+    }
+    for (size_t i = 0; i < threads.size(); ++i) {
+      std::fwrite(buffers[i].data(), 1, sizes[i], file);
+    }
+  }
+};
+} // namespace
+
+int export_csv(const CsvExport &options) {
+  std::map<std::string, Column> columns_by_name;
+
+  std::cout << "Measuring Capture File" << std::endl;
+  {
+    thalamus::RecordReader reader(std::filesystem::path(options.input), false);
+    reader.set_filter(options.filter);
+    for (auto batch = reader.read_batch(4096); !batch.empty();
+         batch = reader.read_batch(4096)) {
+      for (auto record : batch) {
+        if (record->node() != options.node || !record->has_analog()) {
+          continue;
+        }
+        for (auto &span : record->analog().spans()) {
+          columns_by_name[span.name()].count += span.end() - span.begin();
+        }
+      }
+    }
+  }
+
+  std::vector<Column *> columns;
+  size_t total_rows = 0;
+  for (auto &[name, column] : columns_by_name) {
+    columns.push_back(&column);
+    total_rows = std::max(total_rows, column.count);
+  }
+  if (!columns.empty()) {
+    auto limit = std::max(options.batch_rows,
+                          options.buffered_samples / columns.size());
+    for (auto column : columns) {
+      column->limit = limit;
+    }
+  }
+
+  auto file = std::fopen(options.output.c_str(), "wb");
+  THALAMUS_ASSERT(file, "Failed to open %s", options.output);
+  std::string header;
+  for (auto &[name, column] : columns_by_name) {
+    header += "Time (ns)," + name + ",";
+  }
+  header += "\n";
+  std::fwrite(header.data(), 1, header.size(), file);
+
+  auto threads = options.threads
+                     ? options.threads
+                     : std::max(size_t(1),
+                                size_t(std::thread::hardware_concurrency()));
+  thalamus::BoundedQueue<Batch> batches(2);
+  std::thread formatter([&] {
+    FormatPool pool(threads);
+    auto last_time = std::chrono::steady_clock::now();
+    while (auto batch = batches.pop()) {
+      pool.write(*batch, file);
+
+      auto now = std::chrono::steady_clock::now();
+      if (now - last_time >= 5s) {
+        std::cout << "Written " << batch->first_row + batch->rows << " of "
+                  << total_rows << " rows" << std::endl;
+        last_time = now;
+      }
+    }
+  });
+
+  size_t rows = 0;
+  // Hands the rows every channel has reached to the formatter.  A channel
+  // that has all of its samples doesn't hold rows back.
+  auto flush = [&](bool finished) {
+    auto limit = std::numeric_limits<size_t>::max();
+    size_t ready = 0;
+    for (auto column : columns) {
+      auto available = column->available();
+      ready = std::max(ready, available);
+      if (!finished && available < column->count) {
+        limit = std::min(limit, available);
+      }
+    }
+    if (limit != std::numeric_limits<size_t>::max()) {
+      ready = limit;
+    }
+    if (ready <= rows || (!finished && ready - rows < options.batch_rows)) {
+      return;
+    }
+
+    Batch batch;
+    batch.first_row = rows;
+    batch.rows = ready - rows;
+    batch.columns.resize(columns.size());
+    for (size_t i = 0; i < columns.size(); ++i) {
+      auto count = std::min(batch.rows, columns[i]->available() - rows);
+      columns[i]->take(count, batch.columns[i]);
+    }
+    rows = ready;
+    batches.push(std::move(batch));
+  };
+
+  std::cout << "Extracting Channel CSVs" << std::endl;
+  {
+    thalamus::RecordReader reader(std::filesystem::path(options.input), false);
+    reader.set_filter(options.filter);
+    auto last_time = std::chrono::steady_clock::now();
+    for (auto batch = reader.read_batch(4096); !batch.empty();
+         batch = reader.read_batch(4096)) {
+      auto now = std::chrono::steady_clock::now();
+      if (now - last_time >= 5s) {
+        std::cout << reader.progress() << "%" << std::endl;
+        last_time = now;
+      }
+      for (auto record : batch) {
+        if (record->node() != options.node || !record->has_analog()) {
+          continue;
+        }
+        auto &analog = record->analog();
+        for (auto &span : analog.spans()) {
+          auto i = columns_by_name.find(span.name());
+          if (i == columns_by_name.end()) {
+            continue;
+          }
+          if (analog.is_int_data()) {
+            append(i->second, record->time(), analog.int_data(), span.begin(),
+                   span.end());
+          } else if (analog.is_ulong_data()) {
+            append(i->second, record->time(), analog.ulong_data(),
+                   span.begin(), span.end());
+          } else {
+            append(i->second, record->time(), analog.data(), span.begin(),
+                   span.end());
+          }
+        }
+      }
+      flush(false);
+    }
+  }
+  flush(true);
+  batches.close();
+  formatter.join();
+  std::fclose(file);
+  return 0;
+}
+} // namespace hydrate
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <thalamus/record_reader.hpp>
+#include <string>
+
+namespace hydrate {
+struct CsvExport {
+  std::string input;
+  std::string output;
+  std::string node;
+  thalamus::RecordReader::Filter filter;
+  /**
+   * Threads formatting rows, 0 uses one per core.
+   */
+  size_t threads = 0;
+  /**
+   * Rows handed to the formatting threads at once.
+   */
+  size_t batch_rows = 16384;
+  /**
+   * Samples held in memory across all channels, split evenly between them but
+   * never fewer than batch_rows per channel.  Channels that run further ahead
+   * of slower ones spill to temporary files.
+   */
+  size_t buffered_samples = size_t(1) << 24;
+};
+
+/**
+ * Writes the analog channels of a node as CSV.  Every channel gets a time and
+ * a value column, row k holds the k-th sample of every channel.  The capture
+ * is measured first so the columns are known, then rows are formatted in
+ * parallel and streamed to the output as soon as every channel has reached
+ * them.  Samples of fast channels wait for slower channels to catch up, beyond
+ * buffered_samples they wait in temporary files.
+ */
+int export_csv(const CsvExport &options);
+} // namespace hydrate
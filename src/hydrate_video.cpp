@@ -0,0 +1,832 @@
+#include <hydrate_video.hpp>
+#include <thalamus/assert.hpp>
+#include <thalamus/bounded_queue.hpp>
+#include <thalamus/log.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#ifdef __clang__
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Weverything"
+#endif
+
+#include <thalamus.pb.h>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavcodec/bsf.h>
+#include <libavformat/avformat.h>
+#include <libavutil/mem.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+}
+
+static const int error_again = AVERROR(EAGAIN);
+static const int error_eof = AVERROR_EOF;
+static const int error_no_memory = AVERROR(ENOMEM);
+static const int error_invalid = AVERROR(EINVAL);
+static const int error_decoder_not_found = AVERROR_DECODER_NOT_FOUND;
+static const int error_encoder_not_found = AVERROR_ENCODER_NOT_FOUND;
+static const int64_t no_pts = AV_NOPTS_VALUE;
+
+#ifdef __clang__
+#pragma clang diagnostic pop
+#endif
+
+using namespace std::chrono_literals;
+
+namespace hydrate {
+namespace {
+struct FrameDeleter {
+  void operator()(AVFrame *frame) const { av_frame_free(&frame); }
+};
+using FramePtr = std::unique_ptr<AVFrame, FrameDeleter>;
+
+/**
+ * Pixel format of an uncompressed image, AV_PIX_FMT_NONE for stored video.
+ */
+AVPixelFormat raw_format(const thalamus_grpc::Image &image) {
+  switch (image.format()) {
+  case thalamus_grpc::Image::Format::Image_Format_Gray:
+    return AV_PIX_FMT_GRAY8;
+  case thalamus_grpc::Image::Format::Image_Format_RGB:
+    return AV_PIX_FMT_RGB24;
+  case thalamus_grpc::Image::Format::Image_Format_YUYV422:
+    return AV_PIX_FMT_YUYV422;
+  case thalamus_grpc::Image::Format::Image_Format_YUV420P:
+    return AV_PIX_FMT_YUV420P;
+  case thalamus_grpc::Image::Format::Image_Format_YUVJ420P:
+    return AV_PIX_FMT_YUVJ420P;
+  case thalamus_grpc::Image::Format::Image_Format_Gray16:
+    return image.bigendian() ? AV_PIX_FMT_GRAY16BE : AV_PIX_FMT_GRAY16LE;
+  case thalamus_grpc::Image::Format::Image_Format_RGB16:
+    return image.bigendian() ? AV_PIX_FMT_RGB48BE : AV_PIX_FMT_RGB48LE;
+  default:
+    return AV_PIX_FMT_NONE;
+  }
+}
+
+AVCodecID video_codec(thalamus_grpc::Image::Format format) {
+  switch (format) {
+  case thalamus_grpc::Image::Format::Image_Format_MPEG4:
+    return AV_CODEC_ID_MPEG4;
+  case thalamus_grpc::Image::Format::Image_Format_FFV1:
+    return AV_CODEC_ID_FFV1;
+  case thalamus_grpc::Image::Format::Image_Format_H264:
+    return AV_CODEC_ID_H264;
+  default:
+    return AV_CODEC_ID_MPEG1VIDEO;
+  }
+}
+
+/**
+ * Wraps the planes of an uncompressed image in a frame without copying them,
+ * the frame owns the record.
+ */
+FramePtr wrap_image(thalamus_grpc::StorageRecord &&record,
+                    AVPixelFormat format) {
+  auto owner = new thalamus_grpc::StorageRecord(std::move(record));
+  FramePtr frame(av_frame_alloc());
+  frame->buf[0] = av_buffer_create(
+      nullptr, 0,
+      [](void *opaque, uint8_t *) {
+        delete static_cast<thalamus_grpc::StorageRecord *>(opaque);
+      },
+      owner, AV_BUFFER_FLAG_READONLY);
+  THALAMUS_ASSERT(frame->buf[0], "av_buffer_create failed");
+
+  auto &image = owner->image();
+  auto descriptor = av_pix_fmt_desc_get(format);
+  for (auto p = 0; p < std::min(image.data_size(), 4); ++p) {
+    auto rows = p == 1 || p == 2
+                    ? AV_CEIL_RSHIFT(int(image.height()),
+                                     descriptor->log2_chroma_h)
+                    : int(image.height());
+    frame->data[p] =
+        reinterpret_cast<uint8_t *>(const_cast<char *>(image.data(p).data()));
+    frame->linesize[p] = int(image.data(p).size()) / rows;
+  }
+  frame->format = format;
+  frame->width = int(image.width());
+  frame->height = int(image.height());
+  frame->pts = int64_t(owner->time());
+  return frame;
+}
+
+/**
+ * The global header an extract_extradata filter finds in a keyframe packet,
+ * empty if it has none.
+ */
+std::string extract_extradata(AVCodecID codec_id, const uint8_t *data,
+                              int size) {
+  std::string result;
+  auto filter = av_bsf_get_by_name("extract_extradata");
+  AVBSFContext *context = nullptr;
+  if (!filter || av_bsf_alloc(filter, &context) < 0) {
+    return result;
+  }
+  context->par_in->codec_id = codec_id;
+  AVPacket *packet = av_packet_alloc();
+  if (av_bsf_init(context) >= 0 && av_new_packet(packet, size) >= 0) {
+    std::copy(data, data + size, packet->data);
+    if (av_bsf_send_packet(context, packet) >= 0 &&
+        av_bsf_receive_packet(context, packet) >= 0) {
+      size_t extradata_size = 0;
+      auto extradata = av_packet_get_side_data(
+          packet, AV_PKT_DATA_NEW_EXTRADATA, &extradata_size);
+      if (extradata) {
+        result.assign(reinterpret_cast<char *>(extradata), extradata_size);
+      }
+    }
+  }
+  av_packet_free(&packet);
+  av_bsf_free(&context);
+  return result;
+}
+
+/**
+ * Pipeline of one exported node.  Frames carry the record time in
+ * nanoseconds as their pts until the encode stage.
+ */
+struct NodeExport {
+  std::string node;
+  std::string output;
+  std::optional<int64_t> start;
+  // Threads the node may use, split between its decoder and encoder when it
+  // has both.
+  int thread_budget;
+  std::atomic_int encoder_threads;
+  // Set when the stored video is FFV1, which is then re-encoded as FFV1
+  std::atomic_bool lossless = false;
+  std::atomic_bool failed = false;
+  thalamus::BoundedQueue<thalamus_grpc::StorageRecord> records;
+  thalamus::BoundedQueue<FramePtr> decoded;
+  thalamus::BoundedQueue<FramePtr> scaled;
+  size_t frames = 0;
+  bool remuxed = false;
+  std::vector<std::thread> threads;
+
+  NodeExport(const std::string &_node, const std::string &_output,
+             std::optional<int64_t> _start, int _thread_budget,
+             size_t queue_depth)
+      : node(_node), output(_output), start(_start),
+        thread_budget(_thread_budget), encoder_threads(_thread_budget),
+        records(queue_depth), decoded(queue_depth), scaled(queue_depth) {
+    threads.emplace_back([this] { decode_stage(); });
+    threads.emplace_back([this] { scale_stage(); });
+    threads.emplace_back([this] { encode_stage(); });
+  }
+
+  void finish() {
+    records.close();
+    for (auto &thread : threads) {
+      thread.join();
+    }
+  }
+
+  /**
+   * Logs a failed call and stops every stage of the node.  The rest of its
+   * records are dropped and the output keeps the frames written so far.
+   */
+  void fail(const char *call, int ret) {
+    char message[AV_ERROR_MAX_STRING_SIZE] = {0};
+    av_strerror(ret, message, sizeof(message));
+    THALAMUS_LOG(error) << "Skipping the video of " << node << ", " << call
+                        << " failed: " << message;
+    failed = true;
+    records.close();
+    decoded.close();
+    scaled.close();
+  }
+
+  /**
+   * Turns records into frames.  Stored video is decoded with half of the
+   * node's threads, uncompressed images are wrapped as they are.  Frames
+   * before the window are decoded but dropped since the frames after them
+   * depend on them.  Without a window start stored video is remuxed instead.
+   */
+  void decode_stage() {
+    AVCodecContext *context = nullptr;
+    AVCodecParserContext *parser = nullptr;
+    AVPacket *packet = av_packet_alloc();
+    // Storage2Node doesn't use B-frames, so frames leave the decoder in the
+    // order their records went in.
+    std::deque<int64_t> pending;
+
+    auto receive = [&] {
+      while (true) {
+        FramePtr frame(av_frame_alloc());
+        auto ret = avcodec_receive_frame(context, frame.get());
+        if (ret == error_again || ret == error_eof) {
+          return true;
+        }
+        if (ret < 0) {
+          fail("avcodec_receive_frame", ret);
+          return false;
+        }
+        if (pending.empty()) {
+          continue;
+        }
+        frame->pts = pending.front();
+        pending.pop_front();
+        if (start && frame->pts < *start) {
+          continue;
+        }
+        if (!decoded.push(std::move(frame))) {
+          return false;
+        }
+      }
+    };
+    auto send = [&](const uint8_t *data, int size) {
+      packet->data = const_cast<uint8_t *>(data);
+      packet->size = size;
+      auto ret = avcodec_send_packet(context, size ? packet : nullptr);
+      if (ret < 0 && ret != error_eof) {
+        fail("avcodec_send_packet", ret);
+        return false;
+      }
+      return receive();
+    };
+    auto open = [&](const thalamus_grpc::Image &image) {
+      auto codec = avcodec_find_decoder(video_codec(image.format()));
+      if (!codec) {
+        fail("avcodec_find_decoder", error_decoder_not_found);
+        return false;
+      }
+      // FFV1 has no parser, Storage2Node writes one packet per record.
+      parser = av_parser_init(codec->id);
+      context = avcodec_alloc_context3(codec);
+      if (!context) {
+        fail("avcodec_alloc_context3", error_no_memory);
+        return false;
+      }
+      if (!image.codec_extradata().empty()) {
+        auto &extradata = image.codec_extradata();
+        context->extradata = static_cast<uint8_t *>(
+            av_mallocz(extradata.size() + AV_INPUT_BUFFER_PADDING_SIZE));
+        std::copy(extradata.begin(), extradata.end(), context->extradata);
+        context->extradata_size = int(extradata.size());
+      }
+      auto decoder_threads = std::max(1, thread_budget / 2);
+      encoder_threads = std::max(1, thread_budget - decoder_threads);
+      lossless = codec->id == AV_CODEC_ID_FFV1;
+      context->thread_count = decoder_threads;
+      context->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+      auto ret = avcodec_open2(context, codec, nullptr);
+      if (ret < 0) {
+        fail("avcodec_open2", ret);
+        return false;
+      }
+      return true;
+    };
+
+    auto running = true;
+    while (running) {
+      auto record = records.pop();
+      if (!record) {
+        break;
+      }
+      auto &image = record->image();
+      auto format = raw_format(image);
+      if (format != AV_PIX_FMT_NONE) {
+        if (start && int64_t(record->time()) < *start) {
+          continue;
+        }
+        running = decoded.push(wrap_image(std::move(*record), format));
+        continue;
+      }
+
+      if (!context) {
+        if (!start) {
+          remux_stage(std::move(*record));
+          break;
+        }
+        running = open(image);
+        if (!running) {
+          break;
+        }
+      }
+
+      if (image.width() > 0) {
+        pending.push_back(int64_t(record->time()));
+      }
+      if (image.data_size() == 0) {
+        continue;
+      }
+      auto &data = image.data(0);
+      auto bytes = reinterpret_cast<const uint8_t *>(data.data());
+      if (!parser) {
+        running = data.empty() || send(bytes, int(data.size()));
+        continue;
+      }
+      size_t offset = 0;
+      while (running && offset < data.size()) {
+        uint8_t *parsed;
+        int parsed_size;
+        auto ret = av_parser_parse2(parser, context, &parsed, &parsed_size,
+                                    bytes + offset, int(data.size() - offset),
+                                    no_pts, no_pts, 0);
+        if (ret < 0) {
+          fail("av_parser_parse2", ret);
+          running = false;
+          break;
+        }
+        offset += size_t(ret);
+        if (parsed_size) {
+          running = send(parsed, parsed_size);
+        }
+      }
+    }
+
+    if (context && running) {
+      if (parser) {
+        uint8_t *parsed;
+        int parsed_size;
+        av_parser_parse2(parser, context, &parsed, &parsed_size, nullptr, 0,
+                         no_pts, no_pts, 0);
+        if (parsed_size) {
+          running = send(parsed, parsed_size);
+        }
+      }
+      if (running) {
+        send(nullptr, 0);
+      }
+    }
+    decoded.close();
+    // Unblocks the reader if a later stage stopped early.
+    records.close();
+
+    if (parser) {
+      av_parser_close(parser);
+    }
+    avcodec_free_context(&context);
+    av_packet_free(&packet);
+  }
+
+  /**
+   * Copies the packets of stored video into a matroska file without decoding
+   * them, so FFV1 captures stay lossless.  MPEG and H.264 streams are split
+   * into packets by their parsers, FFV1 records hold one packet each, and
+   * packets are timed by their records like decoded frames are.
+   */
+  void remux_stage(thalamus_grpc::StorageRecord &&first) {
+    remuxed = true;
+    auto codec_id = video_codec(first.image().format());
+    AVFormatContext *format_context = nullptr;
+    AVStream *stream = nullptr;
+    AVCodecParserContext *parser = av_parser_init(codec_id);
+    AVCodecContext *context = avcodec_alloc_context3(nullptr);
+    AVPacket *packet = av_packet_alloc();
+    std::deque<int64_t> pending;
+    std::string extradata;
+    auto width = 0;
+    auto height = 0;
+    int64_t first_time = 0;
+    int64_t last_time = 0;
+    int64_t last_pts = -1;
+    auto header_written = false;
+    context->codec_id = codec_id;
+
+    auto open = [&](const uint8_t *data, int size) {
+      if (extradata.empty() && parser) {
+        // Stored MPEG and H.264 carry their headers in band, matroska also
+        // wants them as the track's codec private data.
+        extradata = extract_extradata(codec_id, data, size);
+      }
+      auto ret = avformat_alloc_output_context2(&format_context, nullptr,
+                                                "matroska", output.c_str());
+      if (ret < 0 || !format_context) {
+        fail("avformat_alloc_output_context2", ret);
+        return false;
+      }
+      stream = avformat_new_stream(format_context, nullptr);
+      if (!stream) {
+        fail("avformat_new_stream", error_no_memory);
+        return false;
+      }
+      stream->codecpar->codec_type = AVMEDIA_TYPE_VIDEO;
+      stream->codecpar->codec_id = codec_id;
+      stream->codecpar->width = width;
+      stream->codecpar->height = height;
+      if (!extradata.empty()) {
+        stream->codecpar->extradata = static_cast<uint8_t *>(
+            av_mallocz(extradata.size() + AV_INPUT_BUFFER_PADDING_SIZE));
+        std::copy(extradata.begin(), extradata.end(),
+                  stream->codecpar->extradata);
+        stream->codecpar->extradata_size = int(extradata.size());
+      }
+      stream->time_base = {1, 1000};
+      ret = avio_open(&format_context->pb, output.c_str(), AVIO_FLAG_WRITE);
+      if (ret < 0) {
+        fail("avio_open", ret);
+        return false;
+      }
+      ret = avformat_write_header(format_context, nullptr);
+      if (ret < 0) {
+        fail("avformat_write_header", ret);
+        return false;
+      }
+      header_written = true;
+      return true;
+    };
+
+    auto write = [&](const uint8_t *data, int size, bool key) {
+      auto time = last_time;
+      if (!pending.empty()) {
+        time = pending.front();
+        pending.pop_front();
+      }
+      if (!format_context) {
+        if (!open(data, size)) {
+          return false;
+        }
+        first_time = time;
+      }
+      last_time = time;
+      packet->data = const_cast<uint8_t *>(data);
+      packet->size = size;
+      packet->pts = std::max(av_rescale_q(time - first_time,
+                                          {1, 1'000'000'000},
+                                          stream->time_base),
+                             last_pts + 1);
+      packet->dts = packet->pts;
+      last_pts = packet->pts;
+      packet->flags = key ? AV_PKT_FLAG_KEY : 0;
+      packet->stream_index = stream->index;
+      auto ret = av_interleaved_write_frame(format_context, packet);
+      if (ret < 0) {
+        fail("av_interleaved_write_frame", ret);
+        return false;
+      }
+      ++frames;
+      return true;
+    };
+
+    auto handle = [&](const thalamus_grpc::StorageRecord &record) {
+      auto &image = record.image();
+      if (raw_format(image) != AV_PIX_FMT_NONE) {
+        return true;
+      }
+      if (extradata.empty()) {
+        extradata = image.codec_extradata();
+      }
+      if (image.width() > 0) {
+        pending.push_back(int64_t(record.time()));
+        if (!width) {
+          width = int(image.width());
+          height = int(image.height());
+        }
+      }
+      if (image.data_size() == 0 || image.data(0).empty()) {
+        return true;
+      }
+      auto &data = image.data(0);
+      auto bytes = reinterpret_cast<const uint8_t *>(data.data());
+      if (!parser) {
+        return write(bytes, int(data.size()), true);
+      }
+      size_t offset = 0;
+      while (offset < data.size()) {
+        uint8_t *parsed;
+        int parsed_size;
+        auto ret = av_parser_parse2(parser, context, &parsed, &parsed_size,
+                                    bytes + offset, int(data.size() - offset),
+                                    no_pts, no_pts, 0);
+        if (ret < 0) {
+          fail("av_parser_parse2", ret);
+          return false;
+        }
+        offset += size_t(ret);
+        auto key = parser->key_frame == 1 ||
+                   parser->pict_type == AV_PICTURE_TYPE_I;
+        if (parsed_size && !write(parsed, parsed_size, key)) {
+          return false;
+        }
+      }
+      return true;
+    };
+
+    auto running = handle(first);
+    while (running) {
+      auto record = records.pop();
+      if (!record) {
+        break;
+      }
+      running = handle(*record);
+    }
+    if (running && parser) {
+      uint8_t *parsed;
+      int parsed_size;
+      av_parser_parse2(parser, context, &parsed, &parsed_size, nullptr, 0,
+                       no_pts, no_pts, 0);
+      auto key =
+          parser->key_frame == 1 || parser->pict_type == AV_PICTURE_TYPE_I;
+      if (parsed_size) {
+        write(parsed, parsed_size, key);
+      }
+    }
+    if (header_written) {
+      auto ret = av_write_trailer(format_context);
+      if (ret < 0) {
+        fail("av_write_trailer", ret);
+      }
+    }
+    if (format_context) {
+      avio_closep(&format_context->pb);
+    }
+
+    avformat_free_context(format_context);
+    if (parser) {
+      av_parser_close(parser);
+    }
+    avcodec_free_context(&context);
+    av_packet_free(&packet);
+  }
+
+  /**
+   * Converts frames to the size of the first frame and to the encoder's
+   * format, YUV420P for MPEG-4 and the first frame's format for FFV1.
+   */
+  void scale_stage() {
+    SwsContext *sws_context = nullptr;
+    auto width = 0;
+    auto height = 0;
+    auto format = AV_PIX_FMT_YUV420P;
+    while (auto frame = decoded.pop()) {
+      auto input = frame->get();
+      if (!width) {
+        width = input->width;
+        height = input->height;
+        if (lossless) {
+          format = AVPixelFormat(input->format);
+        }
+      }
+      if (input->format == format && input->width == width &&
+          input->height == height) {
+        if (!scaled.push(std::move(*frame))) {
+          break;
+        }
+        continue;
+      }
+
+      sws_context = sws_getCachedContext(
+          sws_context, input->width, input->height,
+          AVPixelFormat(input->format), width, height, format, SWS_BILINEAR,
+          nullptr, nullptr, nullptr);
+      if (!sws_context) {
+        fail("sws_getCachedContext", error_invalid);
+        break;
+      }
+      FramePtr output(av_frame_alloc());
+      output->format = format;
+      output->width = width;
+      output->height = height;
+      auto ret = av_frame_get_buffer(output.get(), 0);
+      if (ret < 0) {
+        fail("av_frame_get_buffer", ret);
+        break;
+      }
+      sws_scale(sws_context, input->data, input->linesize, 0, input->height,
+                output->data, output->linesize);
+      output->pts = input->pts;
+      if (!scaled.push(std::move(output))) {
+        break;
+      }
+    }
+    scaled.close();
+    decoded.close();
+    sws_freeContext(sws_context);
+  }
+
+  /**
+   * Re-encodes frames into a matroska file, FFV1 captures as FFV1 and
+   * everything else as MPEG-4 at the quality of ffmpeg's -qscale:v 2.  The
+   * encoder is opened on the first frame, pts are the record times relative
+   * to it.
+   */
+  void encode_stage() {
+    AVFormatContext *format_context = nullptr;
+    AVCodecContext *context = nullptr;
+    AVStream *stream = nullptr;
+    AVPacket *packet = av_packet_alloc();
+    int64_t first_time = 0;
+    int64_t last_pts = -1;
+    auto header_written = false;
+
+    auto open = [&](const AVFrame *frame) {
+      auto codec = avcodec_find_encoder(lossless ? AV_CODEC_ID_FFV1
+                                                 : AV_CODEC_ID_MPEG4);
+      if (!codec) {
+        fail("avcodec_find_encoder", error_encoder_not_found);
+        return false;
+      }
+      context = avcodec_alloc_context3(codec);
+      if (!context) {
+        fail("avcodec_alloc_context3", error_no_memory);
+        return false;
+      }
+      context->width = frame->width;
+      context->height = frame->height;
+      context->pix_fmt = AVPixelFormat(frame->format);
+      // MPEG-4 caps the time base denominator at 65535, 0.1ms keeps the
+      // record timing without assuming a frame rate.
+      context->time_base = {1, 10000};
+      context->thread_count = encoder_threads;
+      context->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+      if (lossless) {
+        // Version 3 is required for slices, which is how FFV1 spreads a
+        // frame across threads.  FFV1 only takes some slice counts, so it
+        // picks its own.
+        context->level = 3;
+      } else {
+        context->flags |= AV_CODEC_FLAG_QSCALE;
+        context->global_quality = FF_QP2LAMBDA * 2;
+      }
+
+      auto ret = avformat_alloc_output_context2(&format_context, nullptr,
+                                                "matroska", output.c_str());
+      if (ret < 0 || !format_context) {
+        fail("avformat_alloc_output_context2", ret);
+        return false;
+      }
+      if (format_context->oformat->flags & AVFMT_GLOBALHEADER) {
+        context->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+      }
+      ret = avcodec_open2(context, codec, nullptr);
+      if (ret < 0) {
+        fail("avcodec_open2", ret);
+        return false;
+      }
+
+      stream = avformat_new_stream(format_context, nullptr);
+      if (!stream) {
+        fail("avformat_new_stream", error_no_memory);
+        return false;
+      }
+      ret = avcodec_parameters_from_context(stream->codecpar, context);
+      if (ret < 0) {
+        fail("avcodec_parameters_from_context", ret);
+        return false;
+      }
+      stream->time_base = context->time_base;
+      ret = avio_open(&format_context->pb, output.c_str(), AVIO_FLAG_WRITE);
+      if (ret < 0) {
+        fail("avio_open", ret);
+        return false;
+      }
+      ret = avformat_write_header(format_context, nullptr);
+      if (ret < 0) {
+        fail("avformat_write_header", ret);
+        return false;
+      }
+      header_written = true;
+      return true;
+    };
+
+    auto drain = [&] {
+      while (true) {
+        auto ret = avcodec_receive_packet(context, packet);
+        if (ret == error_again || ret == error_eof) {
+          return true;
+        }
+        if (ret < 0) {
+          fail("avcodec_receive_packet", ret);
+          return false;
+        }
+        av_packet_rescale_ts(packet, context->time_base, stream->time_base);
+        packet->stream_index = stream->index;
+        ret = av_interleaved_write_frame(format_context, packet);
+        if (ret < 0) {
+          fail("av_interleaved_write_frame", ret);
+          return false;
+        }
+      }
+    };
+
+    auto running = true;
+    while (running) {
+      auto frame = scaled.pop();
+      if (!frame) {
+        break;
+      }
+      auto input = frame->get();
+      if (!context) {
+        if (!open(input)) {
+          break;
+        }
+        first_time = input->pts;
+      }
+      auto pts = av_rescale_q(input->pts - first_time, {1, 1'000'000'000},
+                              context->time_base);
+      input->pts = std::max(pts, last_pts + 1);
+      last_pts = input->pts;
+      // Decoded frames keep the type the decoder gave them, let the encoder
+      // pick its own.
+      input->pict_type = AV_PICTURE_TYPE_NONE;
+      input->quality = context->global_quality;
+      auto ret = avcodec_send_frame(context, input);
+      if (ret < 0) {
+        fail("avcodec_send_frame", ret);
+        break;
+      }
+      running = drain();
+      ++frames;
+    }
+
+    if (header_written) {
+      if (!failed) {
+        auto ret = avcodec_send_frame(context, nullptr);
+        if (ret < 0) {
+          fail("avcodec_send_frame", ret);
+        } else {
+          drain();
+        }
+      }
+      auto ret = av_write_trailer(format_context);
+      if (ret < 0) {
+        fail("av_write_trailer", ret);
+      }
+    }
+    if (format_context) {
+      avio_closep(&format_context->pb);
+    }
+    scaled.close();
+
+    avformat_free_context(format_context);
+    avcodec_free_context(&context);
+    av_packet_free(&packet);
+  }
+};
+} // namespace
+
+int export_videos(const VideoExport &options) {
+  if (options.outputs.empty()) {
+    return 0;
+  }
+  // The decoders and encoders of all nodes share the machine.
+  auto thread_budget = int(std::max(
+      1u, std::thread::hardware_concurrency() /
+              unsigned(options.outputs.size())));
+
+  std::map<std::string, std::unique_ptr<NodeExport>, std::less<>> exports;
+  for (auto &[node, output] : options.outputs) {
+    std::optional<int64_t> start;
+    if (options.filter.start) {
+      start = options.filter.start->count();
+    }
+    exports[node] = std::make_unique<NodeExport>(
+        node, output, start, thread_budget, options.queue_depth);
+  }
+
+  // Stored video has to be decoded from its first frame, the window start is
+  // applied after decoding.  Without a start it is remuxed from its first
+  // frame.
+  auto filter = options.filter;
+  filter.start.reset();
+  filter.node = [&exports](std::string_view name) {
+    return exports.contains(name);
+  };
+  thalamus::RecordReader reader(std::filesystem::path(options.input), false);
+  reader.set_filter(filter);
+
+  std::cout << "Extracting video" << std::endl;
+  auto last_time = std::chrono::steady_clock::now();
+  std::optional<thalamus_grpc::StorageRecord> record;
+  while ((record = reader.read_record())) {
+    auto now = std::chrono::steady_clock::now();
+    if (now - last_time >= 5s) {
+      std::cout << reader.progress() << "%" << std::endl;
+      last_time = now;
+    }
+    if (!record->has_image()) {
+      continue;
+    }
+    auto i = exports.find(record->node());
+    if (i != exports.end()) {
+      i->second->records.push(std::move(*record));
+    }
+  }
+
+  auto result = 0;
+  for (auto &[node, node_export] : exports) {
+    node_export->finish();
+    std::cout << node << ": " << node_export->frames << " frames "
+              << (node_export->remuxed ? "copied" : "encoded") << " to "
+              << node_export->output
+              << (node_export->failed ? " before failing" : "") << std::endl;
+    if (node_export->failed) {
+      result = 1;
+    }
+  }
+  return result;
+}
+} // namespace hydrate
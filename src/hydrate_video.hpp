@@ -0,0 +1,30 @@
+#pragma once
+
+#include <thalamus/record_reader.hpp>
+#include <map>
+#include <string>
+
+namespace hydrate {
+struct VideoExport {
+  std::string input;
+  /**
+   * Output file of each exported node.
+   */
+  std::map<std::string, std::string> outputs;
+  thalamus::RecordReader::Filter filter;
+  /**
+   * Records or frames buffered between consecutive stages of a node.
+   */
+  size_t queue_depth = 8;
+};
+
+/**
+ * Exports the image records of several nodes to video files in a single pass
+ * over the capture.  Every node gets its own decode, scale and encode stage,
+ * each on its own thread and connected by bounded queues, while the capture
+ * is read on the calling thread.  Stored video is copied without re-encoding
+ * unless the filter has a start.  A node whose video fails to decode or
+ * encode is logged and skipped, and 1 is returned once the others finish.
+ */
+int export_videos(const VideoExport &options);
+} // namespace hydrate
@@ -1,3 +1,4 @@
+#include <execute.hpp>
 #include <functional>
 #include <hydrate.hpp>
 #include <iostream>
@@ -10,6 +11,7 @@
 const auto HELP = "Thalamus native program, version " GIT_COMMIT_HASH "\n"
                   "  thalamus         Signal tool\n"
                   "  hydrate          Thalamus capture parsing\n"
+                  "  execute          Offline graph execution\n"
                   "  ffmpeg           ffmpeg\n"
                   "  ffprobe          ffprobe\n";
 
@@ -22,6 +24,7 @@ int main(int argc, char *argv[]) {
   std::map<std::string, std::function<int(int, char **)>> COMMANDS = {
       {"thalamus", thalamus::main},
       {"hydrate", hydrate::main},
+      {"execute", execute::main},
       {"ffmpeg", ffmpeg_main_impl},
       {"ffprobe", ffprobe_main_impl}};
 
@@ -0,0 +1,280 @@
+#include <thalamus/record_reader.hpp>
+#include <algorithm>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <variant>
+#include <vector>
+
+#ifdef __clang__
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Weverything"
+#endif
+#include <pybind11/numpy.h>
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+#include <pybind11/stl/filesystem.h>
+#ifdef __clang__
+#pragma clang diagnostic pop
+#endif
+
+namespace py = pybind11;
+
+namespace {
+/**
+ * Samples of one channel.  The sample type is taken from the first record the
+ * channel appears in, later records of another type are converted to it.
+ */
+struct Channel {
+  std::variant<std::vector<double>, std::vector<int>, std::vector<uint64_t>>
+      data;
+  /**
+   * (index of the last sample of a record, time of the record), times of the
+   * samples in between are interpolated like DataFrameBuilder does.
+   */
+  std::vector<std::pair<size_t, int64_t>> knots;
+  size_t size = 0;
+  int64_t sample_interval = 0;
+  bool is_transformed = false;
+  double scale = 1;
+  double offset = 0;
+};
+
+struct Node {
+  std::map<std::string, Channel> channels;
+  /**
+   * Channel names in the order they first appeared in.
+   */
+  std::vector<std::string> order;
+  std::vector<int64_t> text_time;
+  std::vector<std::string> text;
+};
+
+struct Filter {
+  std::optional<std::set<std::string>> nodes;
+  // Whether a channel is read, decided once per name by Python's re.match so
+  // channels are selected exactly like DataFrameBuilder selects them.
+  std::function<bool(const std::string &)> channels;
+  bool analog = true;
+  bool text = true;
+};
+
+/**
+ * Appends input[begin:end], clamped to input like a Python slice.
+ */
+template <typename T, typename S>
+size_t append(std::vector<T> &output, const S &input, size_t begin,
+              size_t end) {
+  end = std::min(end, size_t(input.size()));
+  begin = std::min(begin, end);
+  output.insert(output.end(), input.begin() + int(begin),
+                input.begin() + int(end));
+  return end - begin;
+}
+
+void read_analog(Node &node, const thalamus_grpc::StorageRecord &record,
+                 const Filter &filter) {
+  auto &analog = record.analog();
+  for (auto i = 0; i < analog.spans_size(); ++i) {
+    auto &span = analog.spans(i);
+    if (filter.channels && !filter.channels(span.name())) {
+      continue;
+    }
+    auto sample_interval = i < analog.sample_intervals_size()
+                               ? int64_t(analog.sample_intervals(i))
+                               : 0;
+    auto time = int64_t(analog.time());
+
+    auto [entry, inserted] = node.channels.try_emplace(span.name());
+    auto &channel = entry->second;
+    if (inserted) {
+      node.order.push_back(span.name());
+      if (analog.is_int_data()) {
+        channel.data = std::vector<int>();
+      } else if (analog.is_ulong_data()) {
+        channel.data = std::vector<uint64_t>();
+      }
+      channel.sample_interval = sample_interval;
+      channel.is_transformed = analog.is_transformed();
+      channel.scale = span.scale();
+      channel.offset = span.offset();
+    }
+
+    auto count = int64_t(std::visit(
+        [&](auto &samples) {
+          if (analog.is_int_data()) {
+            return append(samples, analog.int_data(), span.begin(), span.end());
+          } else if (analog.is_ulong_data()) {
+            return append(samples, analog.ulong_data(), span.begin(),
+                          span.end());
+          } else {
+            return append(samples, analog.data(), span.begin(), span.end());
+          }
+        },
+        channel.data));
+    if (count == 0) {
+      continue;
+    }
+
+    if (channel.knots.empty()) {
+      channel.knots.emplace_back(0, time - (count - 1) * sample_interval);
+    }
+    channel.size += size_t(count);
+    if (channel.size > 1) {
+      channel.knots.emplace_back(channel.size - 1, time);
+    }
+  }
+}
+
+/**
+ * Per sample timestamps, linear between knots and clamped outside of them.
+ */
+std::vector<int64_t> interpolate(const Channel &channel) {
+  std::vector<int64_t> result(channel.size);
+  if (channel.knots.empty()) {
+    return result;
+  }
+  auto &knots = channel.knots;
+  size_t k = 0;
+  for (size_t i = 0; i < result.size(); ++i) {
+    while (k + 1 < knots.size() && knots[k + 1].first < i) {
+      ++k;
+    }
+    if (k + 1 == knots.size() || i <= knots[k].first) {
+      result[i] = knots[k].second;
+      continue;
+    }
+    auto [left_index, left_time] = knots[k];
+    auto [right_index, right_time] = knots[k + 1];
+    auto fraction = double(i - left_index) / double(right_index - left_index);
+    result[i] = left_time + int64_t(fraction * double(right_time - left_time));
+  }
+  return result;
+}
+
+std::map<std::string, Node> read(const std::filesystem::path &path,
+                                 const Filter &filter) {
+  std::map<std::string, Node> result;
+  thalamus::RecordReader reader(path, false);
+  while (true) {
+    auto batch = reader.read_batch(4096);
+    if (batch.empty()) {
+      break;
+    }
+    for (auto record : batch) {
+      if (filter.nodes && !filter.nodes->contains(record->node())) {
+        continue;
+      }
+      if (record->has_analog() && filter.analog) {
+        read_analog(result[record->node()], *record, filter);
+      } else if (record->has_text() && filter.text) {
+        auto &node = result[record->node()];
+        node.text_time.push_back(int64_t(record->text().time()));
+        node.text.push_back(record->text().text());
+      }
+    }
+  }
+  return result;
+}
+
+/**
+ * Hands the vector to numpy without copying, the array owns it afterwards.
+ */
+template <typename T> py::array_t<T> to_array(std::vector<T> &&data) {
+  auto owner = new std::vector<T>(std::move(data));
+  py::capsule capsule(owner, [](void *pointer) {
+    delete static_cast<std::vector<T> *>(pointer);
+  });
+  return py::array_t<T>(py::ssize_t(owner->size()), owner->data(), capsule);
+}
+} // namespace
+
+PYBIND11_MODULE(_record_reader, m) {
+  m.doc() = "Native capture reader that returns numpy arrays";
+
+  m.def(
+      "read",
+      [](const std::filesystem::path &path,
+         std::optional<std::vector<std::string>> nodes,
+         py::object channels, bool analog, bool text) {
+        Filter filter;
+        if (nodes) {
+          filter.nodes = std::set<std::string>(nodes->begin(), nodes->end());
+        }
+        if (!channels.is_none()) {
+          auto pattern = py::isinstance<py::str>(channels)
+                             ? py::module_::import("re").attr("compile")(
+                                   channels)
+                             : channels;
+          std::map<std::string, bool> decisions;
+          filter.channels = [pattern, decisions](
+                                const std::string &name) mutable {
+            auto decision = decisions.find(name);
+            if (decision == decisions.end()) {
+              py::gil_scoped_acquire acquire;
+              auto match = !pattern.attr("match")(name).is_none();
+              decision = decisions.emplace(name, match).first;
+            }
+            return decision->second;
+          };
+        }
+        filter.analog = analog;
+        filter.text = text;
+
+        std::map<std::string, Node> captured;
+        std::map<std::string, std::map<std::string, std::vector<int64_t>>>
+            times;
+        {
+          py::gil_scoped_release release;
+          captured = read(path, filter);
+          for (auto &[name, node] : captured) {
+            for (auto &[channel_name, channel] : node.channels) {
+              times[name][channel_name] = interpolate(channel);
+            }
+          }
+        }
+
+        py::dict result;
+        for (auto &[name, node] : captured) {
+          py::dict channels_dict;
+          for (auto &channel_name : node.order) {
+            auto &channel = node.channels.at(channel_name);
+            py::dict channel_dict;
+            channel_dict["data"] = std::visit(
+                [](auto &samples) -> py::object {
+                  return to_array(std::move(samples));
+                },
+                channel.data);
+            channel_dict["time"] =
+                to_array(std::move(times[name][channel_name]));
+            channel_dict["sample_interval"] = channel.sample_interval;
+            if (channel.is_transformed) {
+              channel_dict["scale"] = channel.scale;
+              channel_dict["offset"] = channel.offset;
+            }
+            channels_dict[py::str(channel_name)] = channel_dict;
+          }
+          py::dict node_dict;
+          node_dict["analog"] = channels_dict;
+          node_dict["text_time"] = to_array(std::move(node.text_time));
+          node_dict["text"] = py::cast(node.text);
+          result[py::str(name)] = node_dict;
+        }
+        return result;
+      },
+      py::arg("path"), py::arg("nodes") = py::none(),
+      py::arg("channels") = py::none(), py::arg("analog") = true,
+      py::arg("text") = true,
+      R"(Reads the analog and text data of a capture.
+
+Returns {node: {"analog": {channel: {"data": ndarray, "time": ndarray,
+"sample_interval": int}}, "text_time": ndarray, "text": [str]}}.  Times are in
+nanoseconds, sample times are interpolated between the times of the records a
+channel was received in.  nodes limits the nodes that are read and channels is
+a str or compiled Python re pattern whose match() must accept a channel's name,
+as in DataFrameBuilder.  The GIL is released while the capture is read and only
+taken to match each channel name once.)");
+}
@@ -0,0 +1,402 @@
+// An example plugin that exchanges analog data with Thalamus through both
+// versions of the analog ABI, also used by the plugin benchmark in test.cpp.
+//
+// SAMPLE_SOURCE publishes "Channels" channels of "Samples" samples every time
+// it receives a request.  With "Frame API" it publishes ThalamusAnalogFrames,
+// otherwise only the per channel functions.  With "Interleaved" the samples
+// are kept sample major like most acquisition hardware delivers them, which
+// frames can describe with a stride while the per channel functions need
+// every channel copied out first.
+//
+// SAMPLE_SUM reads the node named by "Source" on every ready, either through
+// frames or the per channel functions, and publishes the sum of all samples
+// as its single channel.
+
+#include <thalamus/plugin.h>
+
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+ThalamusAPI *api = nullptr;
+uint64_t capabilities = 0;
+
+ThalamusCharSpan to_span(std::string_view text) {
+  return ThalamusCharSpan{text.data(), text.size(), 0};
+}
+
+ThalamusState *get_setting(ThalamusState *state, std::string_view key) {
+  auto key_span = to_span(key);
+  return api->state_get_at_name(state, &key_span);
+}
+
+int64_t get_int(ThalamusState *state, std::string_view key, int64_t fallback) {
+  auto value = get_setting(state, key);
+  if (value == nullptr) {
+    return fallback;
+  }
+  auto result = api->state_is_int(value) ? api->state_get_int(value) : fallback;
+  api->state_dec_ref(value);
+  return result;
+}
+
+bool get_bool(ThalamusState *state, std::string_view key, bool fallback) {
+  auto value = get_setting(state, key);
+  if (value == nullptr) {
+    return fallback;
+  }
+  auto result =
+      api->state_is_bool(value) ? api->state_get_bool(value) != 0 : fallback;
+  api->state_dec_ref(value);
+  return result;
+}
+
+std::string get_string(ThalamusState *state, std::string_view key) {
+  auto value = get_setting(state, key);
+  if (value == nullptr) {
+    return "";
+  }
+  std::string result;
+  if (api->state_is_string(value)) {
+    ThalamusCharSpan span;
+    api->state_get_string(&span, value);
+    result.assign(span.data, span.size);
+  }
+  api->state_dec_ref(value);
+  return result;
+}
+
+bool use_frames(ThalamusState *state) {
+  return (capabilities & THALAMUS_CAPABILITY_ANALOG_FRAME) &&
+         get_bool(state, "Frame API", true);
+}
+
+struct Source {
+  ThalamusNode node;
+  ThalamusAnalogNode analog;
+  ThalamusJson *null_response;
+  size_t num_channels;
+  size_t num_samples;
+  bool interleaved;
+  uint64_t time_ns = 0;
+  uint64_t published = 0;
+  std::vector<double> buffer;
+  std::vector<std::vector<double>> split;
+  std::vector<std::string> names;
+  std::vector<ThalamusAnalogChannel> channels;
+  ThalamusAnalogFrame frame;
+};
+
+Source *get_source(ThalamusNode *node) {
+  return static_cast<Source *>(node->plugin_impl);
+}
+
+void source_process(ThalamusNode *node, ThalamusRequestHandle *handle,
+                    ThalamusJson *) {
+  auto source = get_source(node);
+  auto first = double(source->published % 1000);
+  for (size_t c = 0; c < source->num_channels; ++c) {
+    for (size_t s = 0; s < source->num_samples; ++s) {
+      auto value = first + double(c + s);
+      if (source->interleaved) {
+        source->buffer[s * source->num_channels + c] = value;
+      } else {
+        source->buffer[c * source->num_samples + s] = value;
+      }
+    }
+  }
+  source->time_ns = api->time_ns();
+  source->frame.time_ns = source->time_ns;
+  source->published += source->num_samples;
+  if (source->interleaved && !source->split.empty()) {
+    for (size_t c = 0; c < source->num_channels; ++c) {
+      for (size_t s = 0; s < source->num_samples; ++s) {
+        source->split[c][s] = source->buffer[s * source->num_channels + c];
+      }
+    }
+  }
+  api->node_ready(node);
+  api->request_respond(handle, source->null_response);
+}
+
+uint64_t source_time_ns(ThalamusNode *node) { return get_source(node)->time_ns; }
+
+void source_data(ThalamusDoubleSpan *output, ThalamusNode *node, int channel) {
+  auto source = get_source(node);
+  auto index = size_t(channel);
+  output->data = source->interleaved
+                     ? source->split[index].data()
+                     : source->buffer.data() + index * source->num_samples;
+  output->size = source->num_samples;
+}
+
+int source_num_channels(ThalamusNode *node) {
+  return int(get_source(node)->num_channels);
+}
+
+uint64_t source_sample_interval_ns(ThalamusNode *, int) { return 1000000; }
+
+char source_has_analog_data(ThalamusNode *) { return 1; }
+
+char source_false(ThalamusNode *) { return 0; }
+
+double source_scale(ThalamusNode *, int) { return 1; }
+
+double source_offset(ThalamusNode *, int) { return 0; }
+
+void source_name(ThalamusCharSpan *output, ThalamusNode *node, int channel) {
+  *output = to_span(get_source(node)->names[size_t(channel)]);
+}
+
+void source_frame(ThalamusAnalogFrame *output, ThalamusNode *node) {
+  *output = get_source(node)->frame;
+}
+
+ThalamusNode *source_create(ThalamusNodeFactory *, ThalamusState *state,
+                            ThalamusIoContext *, ThalamusNodeGraph *) {
+  auto source = new Source();
+  source->num_channels = size_t(get_int(state, "Channels", 384));
+  source->num_samples = size_t(get_int(state, "Samples", 16));
+  source->interleaved = get_bool(state, "Interleaved", false);
+  auto null_text = to_span("null");
+  source->null_response = api->json_from_string(&null_text);
+  source->buffer.resize(source->num_channels * source->num_samples);
+  for (size_t c = 0; c < source->num_channels; ++c) {
+    source->names.push_back("Channel " + std::to_string(c));
+  }
+
+  auto frames = use_frames(state);
+  if (source->interleaved && !frames) {
+    source->split.assign(source->num_channels,
+                         std::vector<double>(source->num_samples));
+  }
+  if (frames) {
+    int64_t stride = source->interleaved
+                         ? int64_t(source->num_channels * sizeof(double))
+                         : int64_t(sizeof(double));
+    for (size_t c = 0; c < source->num_channels; ++c) {
+      auto offset = source->interleaved ? c : c * source->num_samples;
+      source->channels.push_back(ThalamusAnalogChannel{
+          source->buffer.data() + offset, source->num_samples, stride, 1000000,
+          1, 0, to_span(source->names[c])});
+    }
+    source->frame.version = 1;
+    source->frame.type = ThalamusSampleType::SampleDouble;
+    source->frame.num_channels = source->channels.size();
+    source->frame.channels = source->channels.data();
+  }
+
+  memset(&source->analog, 0, sizeof(source->analog));
+  source->analog.data = source_data;
+  source->analog.num_channels = source_num_channels;
+  source->analog.sample_interval_ns = source_sample_interval_ns;
+  source->analog.has_analog_data = source_has_analog_data;
+  source->analog.is_short_data = source_false;
+  source->analog.is_int_data = source_false;
+  source->analog.is_ulong_data = source_false;
+  source->analog.is_transformed = source_false;
+  source->analog.scale = source_scale;
+  source->analog.offset = source_offset;
+  source->analog.name = source_name;
+  source->analog.frame = frames ? source_frame : nullptr;
+
+  memset(&source->node, 0, sizeof(source->node));
+  source->node.plugin_impl = source;
+  source->node.time_ns = source_time_ns;
+  source->node.analog = &source->analog;
+  source->node.process = source_process;
+  return &source->node;
+}
+
+void source_destroy(ThalamusNodeFactory *, ThalamusNode *node) {
+  auto source = get_source(node);
+  api->json_dec_ref(source->null_response);
+  delete source;
+}
+
+struct Sum {
+  ThalamusNode node;
+  ThalamusAnalogNode analog;
+  bool frames;
+  ThalamusNodeGetConnection *get_connection = nullptr;
+  ThalamusNodeReadyConnection *ready_connection = nullptr;
+  uint64_t time_ns = 0;
+  double sum = 0;
+};
+
+Sum *get_sum(ThalamusNode *node) {
+  return static_cast<Sum *>(node->plugin_impl);
+}
+
+template <typename T> double sum_samples(const ThalamusAnalogChannel &channel) {
+  double result = 0;
+  if (channel.stride == sizeof(T)) {
+    auto data = static_cast<const T *>(channel.data);
+    for (uint64_t i = 0; i < channel.size; ++i) {
+      result += double(data[i]);
+    }
+    return result;
+  }
+  auto data = static_cast<const char *>(channel.data);
+  for (uint64_t i = 0; i < channel.size; ++i) {
+    T sample;
+    memcpy(&sample, data + int64_t(i) * channel.stride, sizeof(T));
+    result += double(sample);
+  }
+  return result;
+}
+
+double sum_frame(ThalamusNode *source) {
+  ThalamusAnalogFrame frame;
+  source->analog->frame(&frame, source);
+  double result = 0;
+  for (uint64_t c = 0; c < frame.num_channels; ++c) {
+    switch (frame.type) {
+    case ThalamusSampleType::SampleDouble:
+      result += sum_samples<double>(frame.channels[c]);
+      break;
+    case ThalamusSampleType::SampleShort:
+      result += sum_samples<short>(frame.channels[c]);
+      break;
+    case ThalamusSampleType::SampleInt:
+      result += sum_samples<int>(frame.channels[c]);
+      break;
+    case ThalamusSampleType::SampleULong:
+      result += sum_samples<uint64_t>(frame.channels[c]);
+      break;
+    }
+  }
+  return result;
+}
+
+double sum_channels(ThalamusNode *source) {
+  auto analog = source->analog;
+  double result = 0;
+  auto count = analog->num_channels(source);
+  for (auto c = 0; c < count; ++c) {
+    if (analog->is_short_data(source)) {
+      ThalamusShortSpan span;
+      analog->short_data(&span, source, c);
+      for (uint64_t i = 0; i < span.size; ++i) {
+        result += span.data[i];
+      }
+    } else if (analog->is_int_data(source)) {
+      ThalamusIntSpan span;
+      analog->int_data(&span, source, c);
+      for (uint64_t i = 0; i < span.size; ++i) {
+        result += span.data[i];
+      }
+    } else if (analog->is_ulong_data(source)) {
+      ThalamusULongSpan span;
+      analog->ulong_data(&span, source, c);
+      for (uint64_t i = 0; i < span.size; ++i) {
+        result += double(span.data[i]);
+      }
+    } else {
+      ThalamusDoubleSpan span;
+      analog->data(&span, source, c);
+      for (uint64_t i = 0; i < span.size; ++i) {
+        result += span.data[i];
+      }
+    }
+  }
+  return result;
+}
+
+void sum_on_ready(ThalamusNode *source, void *data) {
+  auto sum = static_cast<Sum *>(data);
+  if (!source->analog->has_analog_data(source)) {
+    return;
+  }
+  sum->sum = sum->frames ? sum_frame(source) : sum_channels(source);
+  sum->time_ns = source->time_ns(source);
+  api->node_ready(&sum->node);
+}
+
+void sum_on_node(ThalamusNode *source, void *data) {
+  auto sum = static_cast<Sum *>(data);
+  if (source == nullptr || source->analog == nullptr) {
+    return;
+  }
+  if (sum->ready_connection) {
+    api->node_ready_disconnect(sum->ready_connection);
+  }
+  sum->ready_connection = api->node_ready_connect(source, sum_on_ready, sum);
+}
+
+uint64_t sum_time_ns(ThalamusNode *node) { return get_sum(node)->time_ns; }
+
+void sum_data(ThalamusDoubleSpan *output, ThalamusNode *node, int) {
+  output->data = &get_sum(node)->sum;
+  output->size = 1;
+}
+
+int sum_num_channels(ThalamusNode *) { return 1; }
+
+void sum_name(ThalamusCharSpan *output, ThalamusNode *, int) {
+  *output = to_span("Sum");
+}
+
+ThalamusNode *sum_create(ThalamusNodeFactory *, ThalamusState *state,
+                         ThalamusIoContext *, ThalamusNodeGraph *) {
+  auto sum = new Sum();
+  sum->frames = use_frames(state);
+
+  memset(&sum->analog, 0, sizeof(sum->analog));
+  sum->analog.data = sum_data;
+  sum->analog.num_channels = sum_num_channels;
+  sum->analog.sample_interval_ns = source_sample_interval_ns;
+  sum->analog.has_analog_data = source_has_analog_data;
+  sum->analog.is_short_data = source_false;
+  sum->analog.is_int_data = source_false;
+  sum->analog.is_ulong_data = source_false;
+  sum->analog.is_transformed = source_false;
+  sum->analog.scale = source_scale;
+  sum->analog.offset = source_offset;
+  sum->analog.name = sum_name;
+
+  memset(&sum->node, 0, sizeof(sum->node));
+  sum->node.plugin_impl = sum;
+  sum->node.time_ns = sum_time_ns;
+  sum->node.analog = &sum->analog;
+
+  auto source_name = get_string(state, "Source");
+  ThalamusNodeSelector selector;
+  memset(&selector, 0, sizeof(selector));
+  selector.name = to_span(source_name);
+  sum->get_connection = api->node_get_node(&selector, sum_on_node, sum);
+  return &sum->node;
+}
+
+void sum_destroy(ThalamusNodeFactory *, ThalamusNode *node) {
+  auto sum = get_sum(node);
+  api->node_get_node_disconnect(sum->get_connection);
+  if (sum->ready_connection) {
+    api->node_ready_disconnect(sum->ready_connection);
+  }
+  delete sum;
+}
+
+ThalamusNodeFactory source_factory = {
+    {"SAMPLE_SOURCE", 13, 0}, source_create, source_destroy, nullptr, nullptr,
+    nullptr};
+ThalamusNodeFactory sum_factory = {
+    {"SAMPLE_SUM", 10, 0}, sum_create, sum_destroy, nullptr, nullptr, nullptr};
+ThalamusNodeFactory *factories[] = {&source_factory, &sum_factory, nullptr};
+} // namespace
+
+extern "C" {
+#ifdef _WIN32
+__declspec(dllexport)
+#endif
+ThalamusNodeFactory **thalamus_get_node_factories(ThalamusAPI *_api) {
+  api = _api;
+  if (api->version >= 92) {
+    capabilities =
+        api->negotiate_capabilities(THALAMUS_CAPABILITY_ANALOG_FRAME);
+  }
+  return factories;
+}
+}
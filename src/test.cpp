@@ -1,4 +1,17 @@
+#include <algorithm>
 #include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <complex>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <map>
+#include <numbers>
+#include <numeric>
+#include <random>
+#include <set>
+#include <thread>
 #include <thalamus/modalities.h>
 
 #ifdef __clang__
@@ -7,6 +20,8 @@
 #endif
 #include <gtest/gtest.h>
 #include <boost/asio.hpp>
+#include <boost/endian.hpp>
+#include <zlib.h>
 
 #include <boost/log/expressions.hpp>
 #include <boost/log/support/date_time.hpp>
@@ -14,6 +29,11 @@
 #include <boost/log/utility/setup/common_attributes.hpp>
 #include <boost/log/utility/setup/console.hpp>
 #include <boost/log/utility/setup/file.hpp>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+}
 #ifdef __clang__
 #pragma clang diagnostic pop
 #endif
@@ -21,6 +41,24 @@
 #include "node_graph_impl.hpp"
 #include <wallclock_node.hpp>
 #include <thalamus/async.hpp>
+#include <thalamus/analog_history.hpp>
+#include <thalamus/analog_node.hpp>
+#include <thalamus/async_writer.hpp>
+#include <thalamus/correlation.hpp>
+#include <thalamus/decimate_node.hpp>
+#include <thalamus/decimator.hpp>
+#include <thalamus/filter.hpp>
+#include <thalamus/modalities_util.hpp>
+#include <thalamus/record_reader.hpp>
+#include <thalamus/replay_node.hpp>
+#include <thalamus/signal.hpp>
+#include <thalamus/spike_detect_node.hpp>
+#include <thalamus/spike_detector.hpp>
+#include <thalamus/sync_node.hpp>
+#include <thalamus/node_util.hpp>
+#include <execute.hpp>
+#include <hydrate_csv.hpp>
+#include <hydrate_video.hpp>
 
 using namespace std::chrono_literals;
 using namespace thalamus;
@@ -80,6 +118,2468 @@ TEST(WallClockNodeTest, Test) {
   ASSERT_NEAR(system_times.back(), 15, 1e-6);
 }
 
+TEST(NodeGraphTest, StartupReport) {
+  boost::asio::io_context io_context;
+  ObservableListPtr nodes = std::make_shared<ObservableList>();
+  for (auto type : {"WALLCLOCK", "WAVE", "WAVE"}) {
+    ObservableDictPtr node_config = std::make_shared<ObservableDict>();
+    (*node_config)["name"].assign(std::string(type) + std::to_string(nodes->size()));
+    (*node_config)["type"].assign(type);
+    nodes->push_back(node_config);
+  }
+  std::vector<SharedLibrary> extensions;
+  NodeGraphImpl node_graph(nodes, io_context, std::chrono::system_clock::now(),
+                           std::chrono::steady_clock::now(), nullptr,
+                           extensions, Vulkan{});
+
+  auto report = node_graph.get_startup_report();
+  ASSERT_EQ(report.nodes_size(), 3);
+  EXPECT_EQ(report.nodes(0).name(), "WALLCLOCK0");
+  EXPECT_EQ(report.nodes(1).type(), "WAVE");
+  EXPECT_LE(report.nodes(1).created_ns(), report.nodes(2).created_ns());
+  std::set<std::string> types;
+  for (auto &type : report.types()) {
+    EXPECT_TRUE(type.prepared());
+    types.insert(type.type());
+  }
+  EXPECT_EQ(types, std::set<std::string>({"WALLCLOCK", "WAVE"}));
+  EXPECT_EQ(node_graph.get_type_name("WAVE"), "WAVE");
+}
+
+static void write_record(std::ofstream &output,
+                         const thalamus_grpc::StorageRecord &record) {
+  auto serialized = record.SerializeAsString();
+  auto size = boost::endian::native_to_big(uint64_t(serialized.size()));
+  output.write(reinterpret_cast<char *>(&size), sizeof(size));
+  output.write(serialized.data(), std::streamsize(serialized.size()));
+}
+
+static thalamus_grpc::StorageRecord make_analog_record(size_t index) {
+  thalamus_grpc::StorageRecord record;
+  record.set_node("analog");
+  record.set_time(index * 1'000'000);
+  auto analog = record.mutable_analog();
+  auto span = analog->add_spans();
+  span->set_name("0");
+  span->set_begin(0);
+  span->set_end(1024);
+  analog->add_sample_intervals(1'000'000);
+  for (auto i = 0; i < 1024; ++i) {
+    analog->add_data(std::sin(double(index * 1024 + size_t(i)) / 100));
+  }
+  return record;
+}
+
+enum class CaptureType { UNCOMPRESSED, ZLIB, VIDEO };
+
+/**
+ * Writes a synthetic capture of roughly 64MB in the same layout Storage2Node
+ * uses and returns the number of records a reader should produce.
+ */
+static size_t write_capture(const std::filesystem::path &path,
+                            CaptureType type) {
+  std::ofstream output(path, std::ios::binary);
+  size_t count = 0;
+  z_stream zstream = {};
+  if (type == CaptureType::ZLIB) {
+#ifdef __clang__
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wold-style-cast"
+#endif
+    deflateInit(&zstream, 1);
+#ifdef __clang__
+#pragma clang diagnostic pop
+#endif
+  }
+  auto deflate_into = [&](thalamus_grpc::Compressed *compressed,
+                          const std::string &serialized, int flush) {
+    auto data = compressed->mutable_data();
+    zstream.avail_in = uint32_t(serialized.size());
+    zstream.next_in =
+        reinterpret_cast<unsigned char *>(const_cast<char *>(serialized.data()));
+    size_t offset = 0;
+    do {
+      data->resize(offset + serialized.size() + 1024);
+      zstream.avail_out = uint32_t(data->size() - offset);
+      zstream.next_out = reinterpret_cast<unsigned char *>(data->data()) + offset;
+      deflate(&zstream, flush);
+      offset = data->size() - zstream.avail_out;
+    } while (zstream.avail_out == 0);
+    data->resize(offset);
+  };
+
+  for (size_t i = 0; i < 8192; ++i) {
+    auto record = make_analog_record(i);
+    if (type == CaptureType::ZLIB) {
+      thalamus_grpc::StorageRecord compressed_record;
+      compressed_record.set_time(record.time());
+      auto compressed = compressed_record.mutable_compressed();
+      compressed->set_type(
+          thalamus_grpc::Compressed::Type::Compressed_Type_ANALOG);
+      compressed->set_size(int(record.ByteSizeLong()));
+      deflate_into(compressed, record.SerializeAsString(),
+                   i % 64 == 63 ? Z_SYNC_FLUSH : Z_NO_FLUSH);
+      write_record(output, compressed_record);
+    } else {
+      write_record(output, record);
+    }
+    ++count;
+
+    if (type == CaptureType::VIDEO && i % 64 == 0) {
+      thalamus_grpc::StorageRecord image_record;
+      image_record.set_node("camera");
+      image_record.set_time(record.time());
+      auto image = image_record.mutable_image();
+      image->set_width(1280);
+      image->set_height(720);
+      image->set_format(thalamus_grpc::Image::Format::Image_Format_Gray);
+      image->set_frame_interval(16'666'667);
+      image->add_data()->assign(1280 * 720, char(i));
+      write_record(output, image_record);
+      ++count;
+    }
+  }
+
+  if (type == CaptureType::ZLIB) {
+    thalamus_grpc::StorageRecord final_record;
+    auto compressed = final_record.mutable_compressed();
+    compressed->set_type(thalamus_grpc::Compressed::Type::Compressed_Type_NONE);
+    deflate_into(compressed, std::string(), Z_FINISH);
+    write_record(output, final_record);
+    deflateEnd(&zstream);
+  }
+  return count;
+}
+
+static void benchmark_capture(CaptureType type, const std::string &label) {
+  auto path = std::filesystem::temp_directory_path() /
+              ("thalamus_read_benchmark_" + label + ".tha");
+  auto expected = write_capture(path, type);
+  auto bytes = double(std::filesystem::file_size(path));
+
+  auto measure = [&](const std::string &reader_name, auto &&read_all) {
+    auto start = std::chrono::steady_clock::now();
+    auto count = read_all();
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    std::cout << label << " " << reader_name << ": "
+              << bytes / elapsed.count() / 1e9 << " GB/s" << std::endl;
+    EXPECT_EQ(count, expected);
+  };
+
+  measure("istream", [&] {
+    std::ifstream input(path, std::ios::binary);
+    RecordReader reader(input);
+    size_t count = 0;
+    while (reader.read_record()) {
+      ++count;
+    }
+    return count;
+  });
+  measure("mmap", [&] {
+    RecordReader reader(path);
+    size_t count = 0;
+    while (reader.read_record()) {
+      ++count;
+    }
+    return count;
+  });
+  measure("mmap batch", [&] {
+    RecordReader reader(path);
+    size_t count = 0;
+    for (auto batch = reader.read_batch(256); !batch.empty();
+         batch = reader.read_batch(256)) {
+      count += batch.size();
+    }
+    return count;
+  });
+
+  std::filesystem::remove(path);
+}
+
+TEST(RecordReaderBenchmark, Uncompressed) {
+  benchmark_capture(CaptureType::UNCOMPRESSED, "uncompressed");
+}
+
+TEST(RecordReaderBenchmark, Zlib) {
+  benchmark_capture(CaptureType::ZLIB, "zlib");
+}
+
+TEST(RecordReaderBenchmark, Video) {
+  benchmark_capture(CaptureType::VIDEO, "video");
+}
+
+static std::string read_file(const std::filesystem::path &path) {
+  std::ifstream input(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(input),
+                     std::istreambuf_iterator<char>());
+}
+
+static const std::vector<AsyncWriter::Backend> ASYNC_WRITER_BACKENDS = {
+    AsyncWriter::Backend::STREAM, AsyncWriter::Backend::THREAD,
+    AsyncWriter::Backend::IO_URING};
+
+TEST(AsyncWriterTest, RoundTrip) {
+  auto path =
+      std::filesystem::temp_directory_path() / "thalamus_async_writer.bin";
+  std::mt19937 generator(1);
+  std::string expected(200000, 0);
+  for (auto &c : expected) {
+    c = char(generator());
+  }
+  // Sizes that straddle the slabs and the 4096 byte alignment
+  std::vector<size_t> sizes = {1, 7, 4095, 4097, 8192, 13, 30000};
+
+  for (auto backend : ASYNC_WRITER_BACKENDS) {
+    AsyncWriter::Options options;
+    options.backend = backend;
+    options.slab_size = 8192;
+    options.slab_count = 2;
+    options.sync_interval = 1ms;
+    AsyncWriter writer(path, options);
+    ASSERT_TRUE(writer.is_open());
+    size_t offset = 0;
+    for (size_t i = 0; offset < expected.size(); ++i) {
+      auto size = std::min(sizes[i % sizes.size()], expected.size() - offset);
+      writer.write(expected.data() + offset, size);
+      offset += size;
+    }
+    writer.close();
+    EXPECT_FALSE(writer.failed());
+    EXPECT_EQ(read_file(path), expected) << int(writer.backend());
+  }
+  std::filesystem::remove(path);
+}
+
+TEST(AsyncWriterTest, DirectTail) {
+  auto path = std::filesystem::temp_directory_path() /
+              "thalamus_async_writer_direct.bin";
+  // Whole slabs go through O_DIRECT, the unaligned tail is written buffered
+  // on close and the file ends at the last byte written, not the padded slab.
+  std::string expected(3 * 4096 + 123, 0);
+  for (size_t i = 0; i < expected.size(); ++i) {
+    expected[i] = char(i * 31);
+  }
+  for (auto backend :
+       {AsyncWriter::Backend::THREAD, AsyncWriter::Backend::IO_URING}) {
+    AsyncWriter::Options options;
+    options.backend = backend;
+    options.direct = true;
+    options.slab_size = 4096;
+    AsyncWriter writer(path, options);
+    ASSERT_TRUE(writer.is_open());
+    writer.write(expected.data(), 5000);
+    writer.write(expected.data() + 5000, expected.size() - 5000);
+    writer.close();
+    EXPECT_FALSE(writer.failed());
+    EXPECT_EQ(std::filesystem::file_size(path), expected.size());
+    EXPECT_EQ(read_file(path), expected) << int(writer.backend());
+  }
+  std::filesystem::remove(path);
+}
+
+#ifdef __linux__
+TEST(AsyncWriterTest, WriteFailure) {
+  // Every write to /dev/full fails with ENOSPC
+  std::string data(20000, 'x');
+  for (auto backend : ASYNC_WRITER_BACKENDS) {
+    AsyncWriter::Options options;
+    options.backend = backend;
+    options.slab_size = 4096;
+    AsyncWriter writer("/dev/full", options);
+    ASSERT_TRUE(writer.is_open());
+    writer.write(data.data(), data.size());
+    writer.close();
+    EXPECT_TRUE(writer.failed()) << int(writer.backend());
+  }
+}
+#endif
+
+TEST(ReplaySourceNodeTest, CompressedCapture) {
+  auto path = std::filesystem::temp_directory_path() /
+              "thalamus_replay_compressed.tha";
+  // Storage2Node gives each channel its own zlib stream, so every record
+  // holds one channel.
+  {
+    std::ofstream output(path, std::ios::binary);
+    std::vector<z_stream> zstreams(3);
+    for (auto &zstream : zstreams) {
+#ifdef __clang__
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wold-style-cast"
+#endif
+      deflateInit(&zstream, 1);
+#ifdef __clang__
+#pragma clang diagnostic pop
+#endif
+    }
+    for (size_t i = 0; i < 12; ++i) {
+      auto channel = i % zstreams.size();
+      thalamus_grpc::StorageRecord record;
+      record.set_node("analog");
+      record.set_time(i * 1'000'000);
+      auto analog = record.mutable_analog();
+      auto span = analog->add_spans();
+      span->set_name(std::to_string(channel));
+      span->set_begin(0);
+      span->set_end(4);
+      analog->add_sample_intervals(1'000'000);
+      for (auto j = 0; j < 4; ++j) {
+        analog->add_data(double(i * 4 + size_t(j)));
+      }
+      auto serialized = record.SerializeAsString();
+
+      thalamus_grpc::StorageRecord compressed_record;
+      compressed_record.set_time(record.time());
+      auto compressed = compressed_record.mutable_compressed();
+      compressed->set_type(
+          thalamus_grpc::Compressed::Type::Compressed_Type_ANALOG);
+      compressed->set_stream(int(channel));
+      compressed->set_size(int(serialized.size()));
+      auto &zstream = zstreams[channel];
+      auto data = compressed->mutable_data();
+      data->resize(serialized.size() + 1024);
+      zstream.avail_in = uint32_t(serialized.size());
+      zstream.next_in = reinterpret_cast<unsigned char *>(serialized.data());
+      zstream.avail_out = uint32_t(data->size());
+      zstream.next_out = reinterpret_cast<unsigned char *>(data->data());
+      deflate(&zstream, Z_SYNC_FLUSH);
+      data->resize(data->size() - zstream.avail_out);
+      write_record(output, compressed_record);
+    }
+    for (auto &zstream : zstreams) {
+      deflateEnd(&zstream);
+    }
+  }
+
+  boost::asio::io_context io_context;
+  auto state = std::make_shared<ObservableDict>();
+  ReplaySourceNode node(state, io_context, nullptr);
+  auto changes = 0;
+  std::vector<double> played;
+  node.channels_changed.connect([&](auto) { ++changes; });
+  node.ready.connect([&](auto) {
+    for (auto channel = 0; channel < node.num_channels(); ++channel) {
+      auto data = node.data(channel);
+      played.insert(played.end(), data.begin(), data.end());
+    }
+  });
+
+  RecordReader reader(path);
+  size_t records = 0;
+  while (auto record = reader.read_record()) {
+    node.publish(*record, std::chrono::nanoseconds(record->time()));
+    ++records;
+  }
+  std::filesystem::remove(path);
+
+  ASSERT_EQ(records, 12);
+  EXPECT_EQ(changes, 3);
+  ASSERT_EQ(node.num_channels(), 3);
+  EXPECT_EQ(node.name(2), "2");
+  std::vector<double> expected(48);
+  std::iota(expected.begin(), expected.end(), 0.0);
+  EXPECT_EQ(played, expected);
+}
+
+TEST(ExecuteTest, ReplaysCaptureThroughGraph) {
+  auto directory = std::filesystem::temp_directory_path();
+  auto input = directory / "thalamus_execute_test.tha";
+  auto report = directory / "thalamus_execute_test.json";
+  {
+    std::ofstream output(input, std::ios::binary);
+    for (size_t i = 0; i < 64; ++i) {
+      write_record(output, make_analog_record(i));
+    }
+  }
+  // Without sources the configured node named like the capture's node is
+  // replaced by a REPLAY_SOURCE.
+  auto config = boost::json::parse(R"({"nodes": [
+    {"name": "analog", "type": "WAVE"},
+    {"name": "decimated", "type": "DECIMATE", "Source": "analog", "Ratio": 4}
+  ]})");
+  execute::Options options;
+  options.input = input.string();
+  options.report = report.string();
+  std::vector<SharedLibrary> extensions;
+  SteadyClockGuard steady_guard;
+  ClockGuard<MovableSystemClock> system_guard;
+  ASSERT_EQ(execute::run(config, options, extensions), 0);
+
+  std::ifstream report_stream(report);
+  auto parsed = boost::json::parse(report_stream);
+  report_stream.close();
+  std::filesystem::remove(input);
+  std::filesystem::remove(report);
+  std::map<std::string, boost::json::object> nodes;
+  for (auto &node : parsed.as_object().at("nodes").as_array()) {
+    auto &node_object = node.as_object();
+    nodes[std::string(node_object.at("name").as_string())] = node_object;
+  }
+  ASSERT_TRUE(nodes.contains("analog"));
+  ASSERT_TRUE(nodes.contains("decimated"));
+  auto number = [&](const std::string &name, const char *key) {
+    return nodes[name].at(key).to_number<uint64_t>();
+  };
+  EXPECT_EQ(nodes["analog"].at("type").as_string(), "REPLAY_SOURCE");
+  EXPECT_EQ(number("analog", "events"), 64);
+  EXPECT_EQ(number("analog", "samples"), 64 * 1024);
+  EXPECT_EQ(number("decimated", "events"), 64);
+  EXPECT_GT(number("decimated", "samples"), 64 * 256 - 64);
+  EXPECT_LE(number("decimated", "samples"), 64 * 256);
+}
+
+TEST(RecordReaderTest, ShardedCapture) {
+  auto directory = std::filesystem::temp_directory_path();
+  auto primary = directory / "thalamus_sharded_test.tha";
+  auto shard = directory / "thalamus_sharded_test.tha.shard1";
+  {
+    std::ofstream primary_output(primary, std::ios::binary);
+    std::ofstream shard_output(shard, std::ios::binary);
+    thalamus_grpc::StorageRecord metadata;
+    metadata.mutable_metadata()->add_keyvalues()->set_key("Rec");
+    write_record(primary_output, metadata);
+    metadata.mutable_metadata()->add_keyvalues()->set_key("Shard");
+    write_record(shard_output, metadata);
+    for (size_t i = 0; i < 100; ++i) {
+      auto record = make_analog_record(i);
+      record.set_node(i % 2 ? "b" : "a");
+      write_record(i % 2 ? shard_output : primary_output, record);
+    }
+  }
+  {
+    std::ofstream manifest(primary.string() + ".manifest.json");
+    manifest << R"({"shards":["thalamus_sharded_test.tha",)"
+             << R"("thalamus_sharded_test.tha.shard1"],)"
+             << R"("steady_start":0,"system_start":0})";
+  }
+
+  for (auto path : {primary, std::filesystem::path(primary.string() +
+                                                    ".manifest.json")}) {
+    RecordReader reader(path);
+    auto metadata = reader.read_record();
+    ASSERT_TRUE(metadata);
+    ASSERT_TRUE(metadata->has_metadata());
+    uint64_t last_time = 0;
+    size_t count = 0;
+    for (auto record = reader.read_record(); record;
+         record = reader.read_record()) {
+      ASSERT_TRUE(record->has_analog());
+      ASSERT_GE(record->time(), last_time);
+      last_time = record->time();
+      ++count;
+    }
+    EXPECT_EQ(count, 100);
+    EXPECT_DOUBLE_EQ(reader.progress(), 100);
+  }
+
+  std::filesystem::remove(primary);
+  std::filesystem::remove(shard);
+  std::filesystem::remove(primary.string() + ".manifest.json");
+}
+
+TEST(RecordReaderTest, Filter) {
+  auto path =
+      std::filesystem::temp_directory_path() / "thalamus_filter_test.tha";
+  for (auto type : {CaptureType::UNCOMPRESSED, CaptureType::ZLIB}) {
+    write_capture(path, type);
+    auto count = [&](const RecordReader::Filter &filter) {
+      RecordReader reader(path);
+      reader.set_filter(filter);
+      size_t result = 0;
+      for (auto batch = reader.read_batch(256); !batch.empty();
+           batch = reader.read_batch(256)) {
+        for (auto record : batch) {
+          EXPECT_TRUE(record->has_analog());
+          EXPECT_GE(record->time(), 1'000'000'000);
+          EXPECT_LT(record->time(), 2'000'000'000);
+          ++result;
+        }
+      }
+      return result;
+    };
+    auto is_analog = [](std::string_view name) { return name == "analog"; };
+    auto is_zero = [](std::string_view name) { return name == "0"; };
+    auto never = [](std::string_view) { return false; };
+    EXPECT_EQ(count({.start = 1s, .end = 2s}), 1000);
+    EXPECT_EQ(count({.start = 1s, .end = 2s, .node = is_analog}), 1000);
+    EXPECT_EQ(count({.start = 1s, .end = 2s, .channel = is_zero}), 1000);
+    EXPECT_EQ(count({.node = never}), 0);
+    EXPECT_EQ(count({.channel = never}), 0);
+
+    std::ifstream input(path, std::ios::binary);
+    RecordReader reader(input);
+    reader.set_filter({.start = 1s, .end = 2s});
+    size_t streamed = 0;
+    while (reader.read_record()) {
+      ++streamed;
+    }
+    EXPECT_EQ(streamed, 1000);
+  }
+  std::filesystem::remove(path);
+}
+
+/**
+ * Writes the same 2 channel analog updates as Storage2Node does normally and
+ * in columnar mode, channel b only has samples in every other update.
+ */
+static void write_columnar_captures(const std::filesystem::path &normal_path,
+                                    const std::filesystem::path &columnar_path) {
+  std::ofstream normal(normal_path, std::ios::binary);
+  std::ofstream columnar(columnar_path, std::ios::binary);
+  thalamus_grpc::StorageRecord schema_record;
+  schema_record.set_node("analog");
+  auto schema = schema_record.mutable_analog_schema();
+  schema->set_id(1);
+  schema->set_sample_type(thalamus_grpc::AnalogSchema::FLOAT64);
+  for (auto name : {"a", "b"}) {
+    auto channel = schema->add_channels();
+    channel->set_name(name);
+    channel->set_sample_interval(name == std::string("a") ? 1'000'000
+                                                          : 2'000'000);
+  }
+  write_record(columnar, schema_record);
+
+  std::vector<thalamus_grpc::AnalogBlock> blocks(2);
+  auto flush = [&] {
+    for (auto &block : blocks) {
+      if (block.chunk_ends().empty()) {
+        continue;
+      }
+      thalamus_grpc::StorageRecord record;
+      record.set_node("analog");
+      record.set_time(block.chunk_times(block.chunk_times_size() - 1));
+      block.set_size(block.data().size());
+      *record.mutable_analog_block() = block;
+      write_record(columnar, record);
+      block.Clear();
+    }
+  };
+
+  for (size_t i = 0; i < 40; ++i) {
+    auto time = uint64_t(i) * 10'000'000;
+    thalamus_grpc::StorageRecord record;
+    record.set_node("analog");
+    record.set_time(time);
+    auto analog = record.mutable_analog();
+    analog->set_time(time);
+    analog->set_remote_time(time + 1);
+    for (auto c = 0u; c < 2; ++c) {
+      std::vector<double> samples;
+      if (c == 0 || i % 2 == 0) {
+        samples.resize(c == 0 ? 10 : 5);
+        for (size_t j = 0; j < samples.size(); ++j) {
+          samples[j] = double(i * 100 + c * 10 + j);
+        }
+      }
+      auto span = analog->add_spans();
+      span->set_name(schema->channels(int(c)).name());
+      span->set_begin(uint32_t(analog->data_size()));
+      analog->mutable_data()->Add(samples.begin(), samples.end());
+      span->set_end(uint32_t(analog->data_size()));
+      analog->add_sample_intervals(schema->channels(int(c)).sample_interval());
+
+      if (samples.empty()) {
+        continue;
+      }
+      auto &block = blocks[c];
+      block.set_schema(1);
+      block.set_channel(c);
+      block.mutable_data()->append(reinterpret_cast<char *>(samples.data()),
+                                   samples.size() * sizeof(double));
+      block.add_chunk_ends(uint32_t(block.data().size() / sizeof(double)));
+      block.add_chunk_times(time);
+      block.add_chunk_remote_times(time + 1);
+    }
+    write_record(normal, record);
+    if (i % 8 == 7) {
+      flush();
+    }
+  }
+  flush();
+}
+
+TEST(RecordReaderTest, ColumnarMatchesNormal) {
+  auto directory = std::filesystem::temp_directory_path();
+  auto normal_path = directory / "thalamus_columnar_test_normal.tha";
+  auto columnar_path = directory / "thalamus_columnar_test.tha";
+  write_columnar_captures(normal_path, columnar_path);
+
+  RecordReader normal(normal_path);
+  RecordReader columnar(columnar_path);
+  size_t count = 0;
+  for (auto expected = normal.read_record(); expected;
+       expected = normal.read_record()) {
+    auto actual = columnar.read_record();
+    ASSERT_TRUE(actual);
+    ASSERT_TRUE(actual->has_analog());
+    EXPECT_EQ(actual->node(), expected->node());
+    EXPECT_EQ(actual->time(), expected->time());
+    auto &expected_analog = expected->analog();
+    auto &actual_analog = actual->analog();
+    EXPECT_EQ(actual_analog.remote_time(), expected_analog.remote_time());
+    ASSERT_EQ(actual_analog.spans_size(), expected_analog.spans_size());
+    for (auto i = 0; i < expected_analog.spans_size(); ++i) {
+      auto &expected_span = expected_analog.spans(i);
+      auto &actual_span = actual_analog.spans(i);
+      EXPECT_EQ(actual_span.name(), expected_span.name());
+      EXPECT_EQ(actual_span.end() - actual_span.begin(),
+                expected_span.end() - expected_span.begin());
+      for (auto j = 0u; j < expected_span.end() - expected_span.begin(); ++j) {
+        EXPECT_EQ(actual_analog.data(int(actual_span.begin() + j)),
+                  expected_analog.data(int(expected_span.begin() + j)));
+      }
+      EXPECT_EQ(actual_analog.sample_intervals(i),
+                expected_analog.sample_intervals(i));
+    }
+    ++count;
+  }
+  EXPECT_EQ(count, 40);
+  EXPECT_FALSE(columnar.read_record());
+
+  RecordReader batched(columnar_path);
+  count = 0;
+  uint64_t last_time = 0;
+  for (auto batch = batched.read_batch(16); !batch.empty();
+       batch = batched.read_batch(16)) {
+    for (auto record : batch) {
+      EXPECT_EQ(record->analog().spans_size(), 2);
+      EXPECT_GE(record->time(), last_time);
+      last_time = record->time();
+      ++count;
+    }
+  }
+  EXPECT_EQ(count, 40);
+
+  std::filesystem::remove(normal_path);
+  std::filesystem::remove(columnar_path);
+}
+
+/**
+ * Writes count 64x48 gray frames of node camera, as Storage2Node records them
+ * with FFV1 or uncompressed.  Frame i is at 1s + i*33.3ms.
+ */
+static void write_video_capture(const std::filesystem::path &path,
+                                size_t count, bool ffv1) {
+  std::ofstream output(path, std::ios::binary);
+  AVCodecContext *context = nullptr;
+  AVFrame *frame = av_frame_alloc();
+  AVPacket *packet = av_packet_alloc();
+  frame->format = AV_PIX_FMT_GRAY8;
+  frame->width = 64;
+  frame->height = 48;
+  ASSERT_GE(av_frame_get_buffer(frame, 0), 0);
+  if (ffv1) {
+    auto codec = avcodec_find_encoder(AV_CODEC_ID_FFV1);
+    ASSERT_TRUE(codec);
+    context = avcodec_alloc_context3(codec);
+    context->width = 64;
+    context->height = 48;
+    context->pix_fmt = AV_PIX_FMT_GRAY8;
+    context->time_base = {1, 30};
+    context->level = 3;
+    ASSERT_GE(avcodec_open2(context, codec, nullptr), 0);
+  }
+
+  for (size_t i = 0; i < count; ++i) {
+    ASSERT_GE(av_frame_make_writable(frame), 0);
+    for (auto y = 0; y < 48; ++y) {
+      for (auto x = 0; x < 64; ++x) {
+        frame->data[0][y * frame->linesize[0] + x] = uint8_t(x + y + int(i));
+      }
+    }
+    thalamus_grpc::StorageRecord record;
+    record.set_node("camera");
+    record.set_time(1'000'000'000 + i * 33'333'333);
+    auto image = record.mutable_image();
+    image->set_width(64);
+    image->set_height(48);
+    image->set_frame_interval(33'333'333);
+    auto data = image->add_data();
+    if (!ffv1) {
+      image->set_format(thalamus_grpc::Image::Format::Image_Format_Gray);
+      for (auto y = 0; y < 48; ++y) {
+        data->append(reinterpret_cast<char *>(frame->data[0]) +
+                         y * frame->linesize[0],
+                     64);
+      }
+      write_record(output, record);
+      continue;
+    }
+    image->set_format(thalamus_grpc::Image::Format::Image_Format_FFV1);
+    if (i == 0) {
+      image->set_codec_extradata(reinterpret_cast<char *>(context->extradata),
+                                 size_t(context->extradata_size));
+    }
+    frame->pts = int64_t(i);
+    ASSERT_GE(avcodec_send_frame(context, frame), 0);
+    while (avcodec_receive_packet(context, packet) >= 0) {
+      data->append(reinterpret_cast<char *>(packet->data),
+                   size_t(packet->size));
+      av_packet_unref(packet);
+    }
+    write_record(output, record);
+  }
+  avcodec_free_context(&context);
+  av_frame_free(&frame);
+  av_packet_free(&packet);
+}
+
+/**
+ * The codec and number of packets of a video file's first stream.
+ */
+static std::pair<AVCodecID, size_t> probe_video(const std::string &path) {
+  AVFormatContext *context = nullptr;
+  if (avformat_open_input(&context, path.c_str(), nullptr, nullptr) < 0) {
+    return {AV_CODEC_ID_NONE, 0};
+  }
+  avformat_find_stream_info(context, nullptr);
+  auto codec = context->streams[0]->codecpar->codec_id;
+  AVPacket *packet = av_packet_alloc();
+  size_t count = 0;
+  while (av_read_frame(context, packet) >= 0) {
+    ++count;
+    av_packet_unref(packet);
+  }
+  av_packet_free(&packet);
+  avformat_close_input(&context);
+  return {codec, count};
+}
+
+TEST(VideoExportTest, CopiesStoredVideo) {
+  auto directory = std::filesystem::temp_directory_path();
+  auto input = directory / "thalamus_video_ffv1.tha";
+  auto output = (directory / "thalamus_video_ffv1.mkv").string();
+  write_video_capture(input, 10, true);
+
+  hydrate::VideoExport options;
+  options.input = input.string();
+  options.outputs["camera"] = output;
+  ASSERT_EQ(hydrate::export_videos(options), 0);
+  EXPECT_EQ(probe_video(output),
+            std::make_pair(AV_CODEC_ID_FFV1, size_t(10)));
+
+  // Trimming re-encodes, FFV1 stays FFV1
+  options.filter.start = 1'000'000'000ns + 5 * 33'333'333ns;
+  ASSERT_EQ(hydrate::export_videos(options), 0);
+  EXPECT_EQ(probe_video(output), std::make_pair(AV_CODEC_ID_FFV1, size_t(5)));
+  std::filesystem::remove(input);
+  std::filesystem::remove(output);
+}
+
+TEST(VideoExportTest, EncodesImages) {
+  auto directory = std::filesystem::temp_directory_path();
+  auto input = directory / "thalamus_video_gray.tha";
+  auto output = (directory / "thalamus_video_gray.mkv").string();
+  write_video_capture(input, 10, false);
+
+  hydrate::VideoExport options;
+  options.input = input.string();
+  options.outputs["camera"] = output;
+  ASSERT_EQ(hydrate::export_videos(options), 0);
+  EXPECT_EQ(probe_video(output),
+            std::make_pair(AV_CODEC_ID_MPEG4, size_t(10)));
+  std::filesystem::remove(input);
+  std::filesystem::remove(output);
+}
+
+TEST(VideoExportTest, SkipsFailedNode) {
+  auto directory = std::filesystem::temp_directory_path();
+  auto input = directory / "thalamus_video_failure.tha";
+  write_video_capture(input, 10, true);
+
+  // The output can't be opened, the export reports it instead of aborting
+  hydrate::VideoExport options;
+  options.input = input.string();
+  options.outputs["camera"] =
+      (directory / "thalamus_missing_directory" / "camera.mkv").string();
+  EXPECT_EQ(hydrate::export_videos(options), 1);
+  options.filter.start = 1'000'000'000ns;
+  EXPECT_EQ(hydrate::export_videos(options), 1);
+  std::filesystem::remove(input);
+}
+
+TEST(CsvExportTest, Channels) {
+  auto directory = std::filesystem::temp_directory_path();
+  auto input = directory / "thalamus_csv_test.tha";
+  auto output = directory / "thalamus_csv_test.csv";
+  {
+    std::ofstream stream(input, std::ios::binary);
+    for (size_t i = 0; i < 3; ++i) {
+      thalamus_grpc::StorageRecord record;
+      record.set_node("analog");
+      record.set_time(i + 1);
+      auto analog = record.mutable_analog();
+      auto a = analog->add_spans();
+      a->set_name("a");
+      a->set_begin(0);
+      a->set_end(2);
+      auto b = analog->add_spans();
+      b->set_name("b");
+      b->set_begin(2);
+      b->set_end(3);
+      analog->add_data(double(2 * i));
+      analog->add_data(double(2 * i + 1));
+      analog->add_data(-double(i) / 2 - 0.25);
+      write_record(stream, record);
+
+      record.set_node("other");
+      write_record(stream, record);
+    }
+  }
+
+  hydrate::CsvExport options;
+  options.input = input.string();
+  options.output = output.string();
+  options.node = "analog";
+  options.threads = 3;
+  options.batch_rows = 2;
+  ASSERT_EQ(hydrate::export_csv(options), 0);
+
+  std::ifstream stream(output);
+  std::string text((std::istreambuf_iterator<char>(stream)),
+                   std::istreambuf_iterator<char>());
+  EXPECT_EQ(text, "Time (ns),a,Time (ns),b,\n"
+                  "1,0.000000,1,-0.250000,\n"
+                  "1,1.000000,2,-0.750000,\n"
+                  "2,2.000000,3,-1.250000,\n"
+                  "2,3.000000,,,\n"
+                  "3,4.000000,,,\n"
+                  "3,5.000000,,,\n");
+
+  std::filesystem::remove(input);
+  std::filesystem::remove(output);
+}
+
+TEST(CsvExportTest, SpillsFastChannels) {
+  auto directory = std::filesystem::temp_directory_path();
+  auto input = directory / "thalamus_csv_spill_test.tha";
+  auto output = directory / "thalamus_csv_spill_test.csv";
+  const size_t records = 2000;
+  const size_t ratio = 10;
+  {
+    std::ofstream stream(input, std::ios::binary);
+    for (size_t i = 0; i < records; ++i) {
+      thalamus_grpc::StorageRecord record;
+      record.set_node("analog");
+      record.set_time(i);
+      auto analog = record.mutable_analog();
+      auto fast = analog->add_spans();
+      fast->set_name("fast");
+      fast->set_begin(0);
+      fast->set_end(uint32_t(ratio));
+      auto slow = analog->add_spans();
+      slow->set_name("slow");
+      slow->set_begin(uint32_t(ratio));
+      slow->set_end(uint32_t(ratio + 1));
+      analog->set_is_int_data(true);
+      for (size_t j = 0; j < ratio; ++j) {
+        analog->add_int_data(int(i * ratio + j));
+      }
+      analog->add_int_data(-int(i));
+      write_record(stream, record);
+    }
+  }
+
+  hydrate::CsvExport options;
+  options.input = input.string();
+  options.output = output.string();
+  options.node = "analog";
+  options.threads = 2;
+  options.batch_rows = 16;
+  options.buffered_samples = 0;
+  ASSERT_EQ(hydrate::export_csv(options), 0);
+
+  std::string expected = "Time (ns),fast,Time (ns),slow,\n";
+  for (size_t row = 0; row < records * ratio; ++row) {
+    expected += std::to_string(row / ratio) + "," + std::to_string(row) + ",";
+    if (row < records) {
+      expected += std::to_string(row) + "," + std::to_string(-int(row)) + ",";
+    } else {
+      expected += ",,";
+    }
+    expected += "\n";
+  }
+  std::ifstream stream(output);
+  std::string text((std::istreambuf_iterator<char>(stream)),
+                   std::istreambuf_iterator<char>());
+  EXPECT_EQ(text, expected);
+
+  std::filesystem::remove(input);
+  std::filesystem::remove(output);
+}
+
+TEST(CsvExportBenchmark, Analog) {
+  auto directory = std::filesystem::temp_directory_path();
+  auto input = directory / "thalamus_csv_benchmark.tha";
+  auto output = directory / "thalamus_csv_benchmark.csv";
+  write_capture(input, CaptureType::UNCOMPRESSED);
+
+  auto measure = [&](const std::string &name, auto &&run) {
+    auto start = std::chrono::steady_clock::now();
+    run();
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    auto bytes = double(std::filesystem::file_size(output));
+    std::cout << "csv " << name << ": " << bytes / elapsed.count() / 1e6
+              << " MB/s" << std::endl;
+  };
+
+  // The tmpfile per channel and merge export hydrate used before export_csv.
+  measure("tmpfile merge", [&] {
+    std::map<std::string, FILE *> column_files;
+    RecordReader reader(input);
+    while (auto record = reader.read_record()) {
+      auto &analog = record->analog();
+      for (auto &span : analog.spans()) {
+        auto &file = column_files[span.name()];
+        if (!file) {
+          file = std::tmpfile();
+          fprintf(file, "Time (ns),%s,\n", span.name().c_str());
+        }
+        for (auto i = span.begin(); i < span.end(); ++i) {
+          fprintf(file, "%" PRIu64 ",%f,\n", record->time(),
+                  analog.data(int(i)));
+        }
+      }
+    }
+    for (auto &pair : column_files) {
+      fseek(pair.second, 0, SEEK_SET);
+    }
+    std::ofstream merged(output);
+    char buffer[1024];
+    auto working = true;
+    while (working) {
+      working = false;
+      for (auto &pair : column_files) {
+        if (fgets(buffer, sizeof(buffer), pair.second)) {
+          auto line = std::string_view(buffer);
+          merged << line.substr(0, line.size() - 1);
+          working = true;
+        } else {
+          merged << ",,";
+        }
+      }
+      merged << "\n";
+    }
+    for (auto &pair : column_files) {
+      fclose(pair.second);
+    }
+  });
+
+  measure("export_csv", [&] {
+    hydrate::CsvExport options;
+    options.input = input.string();
+    options.output = output.string();
+    options.node = "analog";
+    hydrate::export_csv(options);
+  });
+
+  std::filesystem::remove(input);
+  std::filesystem::remove(output);
+}
+
+/**
+ * Forwards to an AnalogNodeImpl through the per channel API only, so frame()
+ * takes AnalogNode's default path.
+ */
+class PerChannelAnalogNode : public AnalogNode {
+  AnalogNodeImpl &underlying;
+
+public:
+  explicit PerChannelAnalogNode(AnalogNodeImpl &_underlying)
+      : underlying(_underlying) {}
+  std::span<const double> data(int channel) const override {
+    return underlying.data(channel);
+  }
+  int num_channels() const override { return underlying.num_channels(); }
+  std::chrono::nanoseconds sample_interval(int channel) const override {
+    return underlying.sample_interval(channel);
+  }
+  std::chrono::nanoseconds time() const override { return underlying.time(); }
+  std::string_view name(int channel) const override {
+    return underlying.name(channel);
+  }
+  void inject(const thalamus::vector<std::span<double const>> &data,
+              const thalamus::vector<std::chrono::nanoseconds> &intervals,
+              const thalamus::vector<std::string_view> &names) override {
+    underlying.inject(data, intervals, names);
+  }
+};
+
+TEST(AnalogFrameTest, MatchesChannels) {
+  AnalogNodeImpl node;
+  PerChannelAnalogNode fallback(node);
+  std::vector<std::vector<double>> buffers = {{1, 2, 3}, {4}, {}};
+  std::vector<std::string> names = {"a", "b", "c"};
+  thalamus::vector<std::chrono::nanoseconds> intervals = {1ms, 2ms, 3ms};
+  auto inject = [&](std::chrono::nanoseconds time) {
+    thalamus::vector<std::span<const double>> spans(buffers.begin(),
+                                                    buffers.end());
+    thalamus::vector<std::string_view> name_views(names.begin(), names.end());
+    node.inject(spans, intervals, name_views, time);
+  };
+
+  inject(5s);
+  for (auto frame : {&node.frame(), &fallback.frame()}) {
+    ASSERT_EQ(frame->num_channels(), 3);
+    EXPECT_EQ(frame->type, AnalogFrame::Type::DOUBLE);
+    EXPECT_EQ(frame->time, 5s);
+    EXPECT_FALSE(frame->is_transformed);
+    for (auto i = 0; i < 3; ++i) {
+      auto data = frame->data<double>(i);
+      auto &expected = buffers[size_t(i)];
+      EXPECT_TRUE(std::equal(data.begin(), data.end(), expected.begin(),
+                             expected.end()));
+      EXPECT_EQ(frame->names[size_t(i)], names[size_t(i)]);
+      EXPECT_EQ(frame->sample_intervals[size_t(i)], intervals[size_t(i)]);
+    }
+  }
+
+  auto version = node.frame().version;
+  auto fallback_version = fallback.frame().version;
+  EXPECT_NE(version, fallback_version);
+  buffers[1].push_back(5);
+  inject(6s);
+  EXPECT_EQ(node.frame().version, version);
+  EXPECT_EQ(fallback.frame().version, fallback_version);
+  EXPECT_EQ(node.frame().data<double>(1).size(), 2);
+  EXPECT_EQ(node.frame().time, 6s);
+
+  names[1] = "d";
+  inject(7s);
+  EXPECT_NE(node.frame().version, version);
+  EXPECT_NE(fallback.frame().version, fallback_version);
+  EXPECT_EQ(node.frame().names[1], "d");
+  EXPECT_EQ(fallback.frame().names[1], "d");
+}
+
+TEST(AnalogFrameBenchmark, Ready) {
+  const size_t channels = 1024;
+  const size_t readies = 5000;
+  std::vector<std::vector<double>> buffers(channels, std::vector<double>(4, 1));
+  std::vector<std::string> names;
+  for (size_t i = 0; i < channels; ++i) {
+    names.push_back("Channel " + std::to_string(i));
+  }
+  thalamus::vector<std::span<const double>> spans(buffers.begin(),
+                                                  buffers.end());
+  thalamus::vector<std::string_view> name_views(names.begin(), names.end());
+  thalamus::vector<std::chrono::nanoseconds> intervals(channels, 1ms);
+
+  AnalogNodeImpl node;
+  PerChannelAnalogNode per_channel(node);
+  // Keeps the compiler from devirtualizing the calls below.
+  AnalogNode *volatile native_pointer = &node;
+  AnalogNode *volatile fallback_pointer = &per_channel;
+  AnalogNode *native = native_pointer;
+  AnalogNode *fallback = fallback_pointer;
+
+  auto measure = [&](const std::string &label, size_t consumers,
+                     auto &&consume) {
+    double total = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < readies; ++r) {
+      node.inject(spans, intervals, name_views, std::chrono::nanoseconds(r));
+      for (size_t c = 0; c < consumers; ++c) {
+        total += consume();
+      }
+    }
+    std::chrono::duration<double, std::nano> elapsed =
+        std::chrono::steady_clock::now() - start;
+    std::cout << "AnalogFrame " << label << " x" << consumers << ": "
+              << elapsed.count() / double(readies) << " ns per ready"
+              << std::endl;
+    return total;
+  };
+  auto consume_channels = [&] {
+    double sum = 0;
+    for (auto i = 0; i < native->num_channels(); ++i) {
+      for (auto sample : native->data(i)) {
+        sum += sample;
+      }
+      sum += double(native->sample_interval(i).count());
+      sum += double(native->name(i).size());
+    }
+    return sum;
+  };
+  auto consume_frame = [](const AnalogFrame &frame) {
+    double sum = 0;
+    for (auto i = 0; i < frame.num_channels(); ++i) {
+      for (auto sample : frame.data<double>(i)) {
+        sum += sample;
+      }
+      sum += double(frame.sample_intervals[size_t(i)].count());
+      sum += double(frame.names[size_t(i)].size());
+    }
+    return sum;
+  };
+
+  measure("inject only", 1, [] { return 0.0; });
+  for (size_t consumers : {1, 4}) {
+    auto per_channel_total =
+        measure("per channel API", consumers, consume_channels);
+    auto frame_total = measure("frame", consumers, [&] {
+      return consume_frame(native->frame());
+    });
+    auto fallback_total = measure("default frame", consumers, [&] {
+      return consume_frame(fallback->frame());
+    });
+    EXPECT_EQ(per_channel_total, frame_total);
+    EXPECT_EQ(per_channel_total, fallback_total);
+  }
+}
+
+TEST(SignalTest, ConnectDisconnect) {
+  Signal<void(int)> signal;
+  std::vector<int> calls;
+  EXPECT_TRUE(signal.empty());
+  auto second = signal.connect([&](int v) { calls.push_back(2 * v); });
+  auto first =
+      signal.connect(boost::signals2::at_front, [&](int v) { calls.push_back(v); });
+  EXPECT_EQ(signal.num_slots(), 2u);
+  signal(1);
+  EXPECT_EQ(calls, std::vector<int>({1, 2}));
+
+  second.disconnect();
+  EXPECT_FALSE(second.connected());
+  EXPECT_TRUE(first.connected());
+  signal(2);
+  EXPECT_EQ(calls, std::vector<int>({1, 2, 2}));
+
+  {
+    ScopedConnection scoped = signal.connect([&](int v) { calls.push_back(-v); });
+    signal(3);
+  }
+  signal(4);
+  EXPECT_EQ(calls, std::vector<int>({1, 2, 2, 3, -3, 4}));
+
+  auto node = std::make_shared<int>(0);
+  auto tracked = signal.connect(
+      Signal<void(int)>::slot_type([&](int v) { calls.push_back(10 * v); })
+          .track_foreign(node));
+  signal(5);
+  node.reset();
+  signal(6);
+  EXPECT_FALSE(tracked.connected());
+  EXPECT_EQ(calls, std::vector<int>({1, 2, 2, 3, -3, 4, 5, 50, 6}));
+
+  Connection outlived;
+  {
+    Signal<void(int)> temporary;
+    outlived = temporary.connect([](int) {});
+    EXPECT_TRUE(outlived.connected());
+  }
+  EXPECT_FALSE(outlived.connected());
+}
+
+TEST(SignalTest, ChangesDuringDispatch) {
+  Signal<void(int)> signal;
+  std::vector<std::string> calls;
+  ScopedConnection later, removed, added;
+  ScopedConnection self = signal.connect([&](int v) {
+    calls.push_back("self " + std::to_string(v));
+    if (v == 0) {
+      removed.disconnect();
+      added = signal.connect(
+          [&](int w) { calls.push_back("added " + std::to_string(w)); });
+      self.disconnect();
+      signal(1);
+    }
+  });
+  removed = signal.connect(
+      [&](int v) { calls.push_back("removed " + std::to_string(v)); });
+  later = signal.connect(
+      [&](int v) { calls.push_back("later " + std::to_string(v)); });
+
+  signal(0);
+  // The nested emission walks the same list, slots connected during the
+  // emission only see the next one.
+  EXPECT_EQ(calls, std::vector<std::string>(
+                       {"self 0", "later 1", "later 0"}));
+  calls.clear();
+  signal(2);
+  EXPECT_EQ(calls, std::vector<std::string>({"later 2", "added 2"}));
+}
+
+TEST(SignalBenchmark, Emit) {
+  const size_t emissions = 200000;
+  for (size_t subscribers : {1, 5, 10, 25, 50}) {
+    size_t fast_total = 0;
+    size_t boost_total = 0;
+    Signal<void(Node *)> fast;
+    boost::signals2::signal<void(Node *)> slow;
+    std::vector<ScopedConnection> fast_connections;
+    std::vector<boost::signals2::scoped_connection> boost_connections;
+    for (size_t i = 0; i < subscribers; ++i) {
+      fast_connections.emplace_back(
+          fast.connect([&fast_total](Node *) { ++fast_total; }));
+      boost_connections.emplace_back(
+          slow.connect([&boost_total](Node *) { ++boost_total; }));
+    }
+
+    auto measure = [&](auto &signal) {
+      auto start = std::chrono::steady_clock::now();
+      for (size_t e = 0; e < emissions; ++e) {
+        signal(nullptr);
+      }
+      std::chrono::duration<double, std::nano> elapsed =
+          std::chrono::steady_clock::now() - start;
+      return elapsed.count() / double(emissions);
+    };
+    auto boost_ns = measure(slow);
+    auto fast_ns = measure(fast);
+    std::cout << "Signal x" << subscribers << ": boost::signals2 " << boost_ns
+              << " ns, thalamus::Signal " << fast_ns << " ns per emission"
+              << std::endl;
+    EXPECT_EQ(fast_total, boost_total);
+  }
+}
+
+TEST(AnalogHistoryTest, Limits) {
+  AnalogNodeImpl node;
+  AnalogHistory history(&node, &node, 10ms, 1024 * sizeof(double));
+  std::vector<double> a(4);
+  std::vector<double> b(2);
+  thalamus::vector<std::string_view> names = {"a", "b"};
+  thalamus::vector<std::chrono::nanoseconds> intervals = {250us, 500us};
+  double next = 0;
+  auto inject = [&](std::chrono::nanoseconds time) {
+    for (auto &sample : a) {
+      sample = next++;
+    }
+    thalamus::vector<std::span<const double>> spans = {a, b};
+    node.inject(spans, intervals, names, time);
+  };
+
+  for (auto i = 0; i < 100; ++i) {
+    inject(i * 1ms);
+  }
+  EXPECT_EQ(history.num_chunks(), 11);
+
+  std::vector<std::chrono::nanoseconds> times;
+  std::vector<double> samples;
+  history.backfill(5ms, [&](const AnalogFrame &frame) {
+    ASSERT_EQ(frame.num_channels(), 2);
+    EXPECT_EQ(frame.names[0], "a");
+    EXPECT_EQ(frame.sample_intervals[1], 500us);
+    EXPECT_EQ(frame.data<double>(1).size(), 2);
+    times.push_back(frame.time);
+    auto data = frame.data<double>(0);
+    samples.insert(samples.end(), data.begin(), data.end());
+  });
+  ASSERT_EQ(times.size(), 6);
+  EXPECT_EQ(times.front(), 94ms);
+  EXPECT_EQ(times.back(), 99ms);
+  ASSERT_EQ(samples.size(), 24);
+  for (size_t i = 0; i < samples.size(); ++i) {
+    EXPECT_EQ(samples[i], double(94 * 4 + i));
+  }
+
+  // 8 samples per channel holds 2 chunks of channel a
+  history.set_limits(1s, 8 * sizeof(double));
+  for (auto i = 100; i < 110; ++i) {
+    inject(i * 1ms);
+  }
+  EXPECT_EQ(history.num_chunks(), 2);
+  EXPECT_EQ(history.num_samples(), 12);
+
+  names[1] = "c";
+  inject(110ms);
+  EXPECT_EQ(history.num_chunks(), 1);
+}
+
+TEST(AnalogHistoryTest, BackfillJoinsLiveStream) {
+  boost::asio::io_context io_context;
+  auto work = boost::asio::make_work_guard(io_context);
+  ObservableDictPtr node_config = std::make_shared<ObservableDict>();
+  (*node_config)["name"].assign("analog");
+  (*node_config)["type"].assign("ANALOG");
+  (*node_config)["History (s)"].assign(1.0);
+  ObservableListPtr nodes = std::make_shared<ObservableList>();
+  nodes->push_back(node_config);
+  std::vector<SharedLibrary> extensions;
+  NodeGraphImpl node_graph(nodes, io_context, std::chrono::system_clock::now(),
+                           std::chrono::steady_clock::now(), nullptr,
+                           extensions, Vulkan{});
+  auto node = std::static_pointer_cast<AnalogNodeImpl>(
+      node_graph.get_node("analog").lock());
+  ASSERT_TRUE(node_graph.get_analog_history(node.get()));
+
+  std::vector<double> samples(16);
+  thalamus::vector<std::string_view> names = {"a"};
+  thalamus::vector<std::chrono::nanoseconds> intervals = {1ms / 16};
+  double next = 0;
+  std::chrono::nanoseconds time = 0ns;
+  auto publish = [&] {
+    for (auto &sample : samples) {
+      sample = next++;
+    }
+    thalamus::vector<std::span<const double>> spans = {samples};
+    node->inject(spans, intervals, names, time);
+    time += 1ms;
+  };
+
+  // Subscribes the way the analog RPC does, from another thread while the
+  // node keeps publishing.
+  struct Subscriber {
+    std::vector<double> received;
+    size_t backfilled = 0;
+    ScopedConnection connection;
+  };
+  std::vector<Subscriber> subscribers(5);
+  std::thread io_thread([&] { io_context.run(); });
+  for (size_t r = 0; r < 500; ++r) {
+    boost::asio::post(io_context, publish);
+    if (r % 100 == 50) {
+      auto &subscriber = subscribers[r / 100];
+      boost::asio::post(io_context, [&] {
+        auto history = node_graph.get_analog_history(node.get());
+        history->backfill(20ms, [&](const AnalogFrame &frame) {
+          auto data = frame.data<double>(0);
+          subscriber.received.insert(subscriber.received.end(), data.begin(),
+                                     data.end());
+        });
+        subscriber.backfilled = subscriber.received.size();
+        subscriber.connection =
+            node::connect_ready_singlethreaded(node.get(), [&](Node *) {
+              auto data = node->frame().data<double>(0);
+              subscriber.received.insert(subscriber.received.end(),
+                                         data.begin(), data.end());
+            });
+      });
+    }
+    std::this_thread::sleep_for(50us);
+  }
+  std::promise<void> done;
+  boost::asio::post(io_context, [&] {
+    for (auto &subscriber : subscribers) {
+      subscriber.connection.disconnect();
+    }
+    done.set_value();
+  });
+  done.get_future().wait();
+  io_context.stop();
+  io_thread.join();
+
+  for (auto &subscriber : subscribers) {
+    auto &received = subscriber.received;
+    EXPECT_EQ(subscriber.backfilled, 21 * 16);
+    ASSERT_GT(received.size(), subscriber.backfilled);
+    EXPECT_EQ(received.back(), next - 1);
+    for (size_t i = 0; i < received.size(); ++i) {
+      ASSERT_EQ(received[i], received[0] + double(i)) << i;
+    }
+  }
+}
+
+/**
+ * A graph with the sample plugin loaded and a node for every entry of
+ * configs, each given as name, type and settings.
+ */
+struct PluginGraph {
+  boost::asio::io_context io_context;
+  ObservableListPtr nodes = std::make_shared<ObservableList>();
+  std::vector<SharedLibrary> extensions;
+  std::unique_ptr<NodeGraphImpl> node_graph;
+
+  explicit PluginGraph(
+      const std::vector<std::map<std::string, ObservableCollection::Value>>
+          &configs) {
+    for (auto &config : configs) {
+      ObservableDictPtr node_config = std::make_shared<ObservableDict>();
+      for (auto &[key, value] : config) {
+        (*node_config)[key].assign(value);
+      }
+      nodes->push_back(node_config);
+    }
+    extensions.emplace_back(SAMPLE_PLUGIN_PATH);
+    node_graph = std::make_unique<NodeGraphImpl>(
+        nodes, io_context, std::chrono::system_clock::now(),
+        std::chrono::steady_clock::now(), nullptr, extensions, Vulkan{});
+    io_context.poll();
+  }
+
+  std::shared_ptr<Node> get(const std::string &name) {
+    return node_graph->get_node(name).lock();
+  }
+};
+
+static double sum_frame(const AnalogFrame &frame) {
+  double sum = 0;
+  visit_frame(frame, [&](auto wrapper) {
+    for (auto i = 0; i < wrapper->num_channels(); ++i) {
+      for (auto sample : wrapper->data(i)) {
+        sum += double(sample);
+      }
+    }
+  });
+  return sum;
+}
+
+TEST(PluginTest, Frames) {
+  std::vector<std::map<std::string, ObservableCollection::Value>> configs;
+  for (auto frames : {false, true}) {
+    for (auto interleaved : {false, true}) {
+      configs.push_back({{"name", "source" + std::to_string(configs.size())},
+                         {"type", "SAMPLE_SOURCE"},
+                         {"Channels", int64_t(5)},
+                         {"Samples", int64_t(3)},
+                         {"Frame API", frames},
+                         {"Interleaved", interleaved}});
+    }
+  }
+  PluginGraph graph(configs);
+
+  std::vector<std::vector<double>> published;
+  for (size_t i = 0; i < configs.size(); ++i) {
+    auto node = graph.get("source" + std::to_string(i));
+    auto analog = node_cast<AnalogNode *>(node.get());
+    ASSERT_NE(analog, nullptr);
+    std::vector<double> received;
+    ScopedConnection connection = node->ready.connect([&](Node *) {
+      auto &frame = analog->frame();
+      ASSERT_EQ(frame.num_channels(), 5);
+      for (auto c = 0; c < frame.num_channels(); ++c) {
+        auto data = frame.data<double>(c);
+        EXPECT_TRUE(std::ranges::equal(data, analog->data(c)));
+        EXPECT_EQ(frame.names[size_t(c)], analog->name(c));
+        EXPECT_EQ(frame.sample_intervals[size_t(c)], 1ms);
+        received.insert(received.end(), data.begin(), data.end());
+      }
+    });
+    uint64_t version = 0;
+    for (auto r = 0; r < 3; ++r) {
+      node->process(boost::json::value(), [](const boost::json::value &) {});
+      if (r > 0) {
+        EXPECT_EQ(analog->frame().version, version);
+      }
+      version = analog->frame().version;
+    }
+    published.push_back(received);
+  }
+  ASSERT_EQ(published.front().size(), 3 * 5 * 3);
+  for (auto &received : published) {
+    EXPECT_EQ(received, published.front());
+  }
+}
+
+TEST(PluginBenchmark, Ready) {
+  const size_t channels = 384;
+  const size_t samples = 16;
+  const size_t readies = 2000;
+  std::vector<std::map<std::string, ObservableCollection::Value>> configs;
+  for (auto frames : {false, true}) {
+    std::string version = frames ? "v2" : "v1";
+    configs.push_back({{"name", "source " + version},
+                       {"type", "SAMPLE_SOURCE"},
+                       {"Channels", int64_t(channels)},
+                       {"Samples", int64_t(samples)},
+                       {"Frame API", frames}});
+    configs.push_back({{"name", "analog " + version}, {"type", "ANALOG"}});
+    configs.push_back({{"name", "sum " + version},
+                       {"type", "SAMPLE_SUM"},
+                       {"Source", "analog " + version},
+                       {"Frame API", frames}});
+  }
+  PluginGraph graph(configs);
+
+  std::vector<std::vector<double>> buffers(channels,
+                                           std::vector<double>(samples));
+  std::vector<std::string> names;
+  for (size_t c = 0; c < buffers.size(); ++c) {
+    std::iota(buffers[c].begin(), buffers[c].end(), double(c));
+    names.push_back("Channel " + std::to_string(c));
+  }
+  thalamus::vector<std::span<const double>> spans(buffers.begin(),
+                                                  buffers.end());
+  thalamus::vector<std::string_view> name_views(names.begin(), names.end());
+  thalamus::vector<std::chrono::nanoseconds> intervals(channels, 1ms);
+  double expected = 0;
+  for (auto &buffer : buffers) {
+    expected = std::accumulate(buffer.begin(), buffer.end(), expected);
+  }
+
+  auto measure = [&](const std::string &label, auto &&publish) {
+    auto start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < readies; ++r) {
+      publish();
+    }
+    std::chrono::duration<double, std::nano> elapsed =
+        std::chrono::steady_clock::now() - start;
+    std::cout << "Plugin " << label << ": "
+              << elapsed.count() / double(readies) << " ns per ready"
+              << std::endl;
+  };
+
+  std::map<std::string, double> totals;
+  for (std::string version : {"v1", "v2"}) {
+    // A plugin publishing to a C++ consumer.
+    auto source = graph.get("source " + version);
+    auto source_analog = node_cast<AnalogNode *>(source.get());
+    auto &total = totals[version];
+    ScopedConnection connection = source->ready.connect(
+        [&](Node *) { total += sum_frame(source_analog->frame()); });
+    measure("publish " + version, [&] {
+      source->process(boost::json::value(), [](const boost::json::value &) {});
+    });
+
+    // A plugin consuming a C++ node.
+    auto analog = std::static_pointer_cast<AnalogNodeImpl>(
+        graph.get("analog " + version));
+    auto sum = graph.get("sum " + version);
+    auto sum_analog = node_cast<AnalogNode *>(sum.get());
+    size_t sums = 0;
+    ScopedConnection sum_connection = sum->ready.connect([&](Node *) {
+      EXPECT_EQ(sum_analog->data(0)[0], expected);
+      ++sums;
+    });
+    measure("consume " + version, [&] {
+      analog->inject(spans, intervals, name_views);
+    });
+    EXPECT_EQ(sums, readies);
+  }
+  EXPECT_EQ(totals["v1"], totals["v2"]);
+}
+
+static double magnitude(const std::vector<Biquad> &sections, double frequency,
+                        double sample_rate) {
+  auto z = std::polar(1.0, 2 * std::numbers::pi * frequency / sample_rate);
+  std::complex<double> response = 1;
+  for (auto &s : sections) {
+    response *= (s.b0 + s.b1 / z + s.b2 / (z * z)) /
+                (1.0 + s.a1 / z + s.a2 / (z * z));
+  }
+  return std::abs(response);
+}
+
+TEST(FilterTest, Butterworth) {
+  // scipy.signal.butter(2, 0.2)
+  auto reference = design_butterworth(FilterBand::LOW_PASS, 2, 100, 0, 1000);
+  ASSERT_TRUE(reference);
+  ASSERT_EQ(reference->size(), 1);
+  auto &section = reference->front();
+  EXPECT_NEAR(section.b0, 0.06745527, 1e-8);
+  EXPECT_NEAR(section.b1, 0.13491055, 1e-8);
+  EXPECT_NEAR(section.b2, 0.06745527, 1e-8);
+  EXPECT_NEAR(section.a1, -1.14298050, 1e-8);
+  EXPECT_NEAR(section.a2, 0.41280160, 1e-8);
+
+  // The bilinear transform maps the analog Butterworth response onto
+  // tan(pi*f/fs).
+  const double fs = 30000;
+  auto warp = [&](double f) { return std::tan(std::numbers::pi * f / fs); };
+  for (auto order : {1, 2, 3, 5, 8}) {
+    auto low = design_butterworth(FilterBand::LOW_PASS, order, 300, 0, fs);
+    auto high = design_butterworth(FilterBand::HIGH_PASS, order, 300, 0, fs);
+    ASSERT_TRUE(low && high);
+    EXPECT_EQ(low->size(), size_t(order + 1) / 2);
+    for (auto f : {10.0, 100.0, 300.0, 1000.0, 10000.0}) {
+      auto ratio = std::pow(warp(f) / warp(300), 2 * order);
+      EXPECT_NEAR(magnitude(*low, f, fs), 1 / std::sqrt(1 + ratio), 1e-9);
+      EXPECT_NEAR(magnitude(*high, f, fs), 1 / std::sqrt(1 + 1 / ratio), 1e-9);
+    }
+
+    auto pass = design_butterworth(FilterBand::BAND_PASS, order, 300, 3000, fs);
+    auto stop = design_butterworth(FilterBand::BAND_STOP, order, 300, 3000, fs);
+    ASSERT_TRUE(pass && stop);
+    EXPECT_EQ(pass->size(), size_t(order));
+    for (auto f : {300.0, 3000.0}) {
+      EXPECT_NEAR(magnitude(*pass, f, fs), 1 / std::numbers::sqrt2, 1e-9);
+      EXPECT_NEAR(magnitude(*stop, f, fs), 1 / std::numbers::sqrt2, 1e-9);
+    }
+    auto center =
+        std::atan(std::sqrt(warp(300) * warp(3000))) * fs / std::numbers::pi;
+    EXPECT_NEAR(magnitude(*pass, center, fs), 1, 1e-9);
+    EXPECT_NEAR(magnitude(*stop, center, fs), 0, 1e-9);
+    EXPECT_NEAR(magnitude(*stop, 0, fs), 1, 1e-9);
+  }
+
+  EXPECT_FALSE(design_butterworth(FilterBand::LOW_PASS, 2, 600, 0, 1000));
+  EXPECT_FALSE(design_butterworth(FilterBand::BAND_PASS, 2, 300, 200, 1000));
+  EXPECT_FALSE(design_butterworth(FilterBand::HIGH_PASS, 0, 100, 0, 1000));
+}
+
+TEST(FilterTest, Notch) {
+  // scipy.signal.iirnotch(60, 30, 1000)
+  auto notch = design_notch(60, 30, 1000);
+  ASSERT_TRUE(notch);
+  EXPECT_NEAR(notch->b0, 0.99375596, 1e-8);
+  EXPECT_NEAR(notch->b1, -1.84794186, 1e-8);
+  EXPECT_NEAR(notch->b2, 0.99375596, 1e-8);
+  EXPECT_NEAR(notch->a1, -1.84794186, 1e-8);
+  EXPECT_NEAR(notch->a2, 0.98751193, 1e-8);
+  EXPECT_NEAR(magnitude({*notch}, 60, 1000), 0, 1e-12);
+  EXPECT_NEAR(magnitude({*notch}, 59, 1000), 1 / std::numbers::sqrt2, 1e-2);
+  EXPECT_NEAR(magnitude({*notch}, 0, 1000), 1, 1e-12);
+  EXPECT_FALSE(design_notch(500, 30, 1000));
+}
+
+TEST(FilterTest, Fir) {
+  const double fs = 30000;
+  auto response = [&](const std::vector<double> &taps, double f) {
+    std::complex<double> result = 0;
+    for (size_t n = 0; n < taps.size(); ++n) {
+      auto phase = -2 * std::numbers::pi * f / fs * double(n);
+      result += taps[n] * std::polar(1.0, phase);
+    }
+    return std::abs(result);
+  };
+  for (auto band : {FilterBand::LOW_PASS, FilterBand::HIGH_PASS,
+                    FilterBand::BAND_PASS, FilterBand::BAND_STOP}) {
+    auto low = band == FilterBand::LOW_PASS ? 3000.0 : 1000.0;
+    auto taps = design_fir(band, 201, low, 6000, fs);
+    ASSERT_TRUE(taps);
+    for (size_t n = 0; n < taps->size(); ++n) {
+      EXPECT_DOUBLE_EQ((*taps)[n], (*taps)[taps->size() - 1 - n]);
+    }
+    auto passes = [&](double f) {
+      switch (band) {
+      case FilterBand::LOW_PASS:
+        return f < low;
+      case FilterBand::HIGH_PASS:
+        return f > low;
+      case FilterBand::BAND_PASS:
+        return low < f && f < 6000;
+      case FilterBand::BAND_STOP:
+        return f < low || 6000 < f;
+      }
+      return false;
+    };
+    for (auto f : {0.0, 100.0, 2000.0, 4500.0, 10000.0, 15000.0}) {
+      EXPECT_NEAR(response(*taps, f), passes(f) ? 1 : 0, 5e-3) << f;
+    }
+  }
+  EXPECT_FALSE(design_fir(FilterBand::HIGH_PASS, 100, 1000, 0, fs));
+}
+
+TEST(FilterTest, BankMatchesDirectForm) {
+  auto sections =
+      *design_butterworth(FilterBand::BAND_PASS, 3, 300, 3000, 30000);
+  sections.push_back(*design_notch(60, 30, 30000));
+  auto taps = *design_fir(FilterBand::LOW_PASS, 31, 5000, 0, 30000);
+  const size_t channels = 21;
+  const size_t samples = 1000;
+  std::mt19937 generator(1);
+  std::normal_distribution<double> distribution;
+  std::vector<std::vector<double>> input(channels,
+                                         std::vector<double>(samples));
+  for (auto &channel : input) {
+    std::generate(channel.begin(), channel.end(),
+                  [&] { return distribution(generator); });
+  }
+
+  std::vector<std::vector<double>> expected;
+  for (auto &channel : input) {
+    std::vector<double> y(samples);
+    for (size_t i = 0; i < samples; ++i) {
+      for (size_t k = 0; k < taps.size() && k <= i; ++k) {
+        y[i] += taps[k] * channel[i - k];
+      }
+    }
+    for (auto &s : sections) {
+      double x1 = 0, x2 = 0, y1 = 0, y2 = 0;
+      for (auto &value : y) {
+        auto out = s.b0 * value + s.b1 * x1 + s.b2 * x2 - s.a1 * y1 - s.a2 * y2;
+        x2 = std::exchange(x1, value);
+        y2 = std::exchange(y1, out);
+        value = out;
+      }
+    }
+    expected.push_back(y);
+  }
+
+  // Feeds the samples in uneven blocks, channel 3 lagging behind the others
+  // in some of them.
+  auto filter = [&](const std::vector<size_t> &ends, size_t lag) {
+    FilterBank bank(sections, taps);
+    std::vector<std::vector<double>> output(channels,
+                                            std::vector<double>(samples));
+    std::vector<size_t> positions(channels);
+    for (auto end : ends) {
+      std::vector<std::span<const double>> in;
+      std::vector<std::span<double>> out;
+      for (size_t c = 0; c < channels; ++c) {
+        auto last = c == 3 && end != samples ? end - lag : end;
+        in.emplace_back(input[c].data() + positions[c], last - positions[c]);
+        out.emplace_back(output[c].data() + positions[c], last - positions[c]);
+        positions[c] = last;
+      }
+      bank.process(in, out);
+    }
+    return output;
+  };
+  for (auto lag : {0, 5}) {
+    auto output = filter({samples}, 0);
+    auto blocks = filter({7, 8, 400, 401, 999, samples}, size_t(lag));
+    for (size_t c = 0; c < channels; ++c) {
+      for (size_t i = 0; i < samples; ++i) {
+        EXPECT_NEAR(output[c][i], expected[c][i], 1e-9);
+        EXPECT_EQ(blocks[c][i], output[c][i]);
+      }
+    }
+  }
+}
+
+TEST(FilterTest, NodeKeepsStateAcrossChannelChanges) {
+  PluginGraph graph({{{"name", "analog"}, {"type", "ANALOG"}},
+                     {{"name", "filter"},
+                      {"type", "FILTER"},
+                      {"Source", "analog"},
+                      {"Filter", "Low Pass"},
+                      {"High Cutoff (Hz)", 50.0},
+                      {"Notch (Hz)", int64_t(60)}}});
+  auto analog =
+      std::static_pointer_cast<AnalogNodeImpl>(graph.get("analog"));
+  auto filter = graph.get("filter");
+  auto filter_analog = node_cast<AnalogNode *>(filter.get());
+  ASSERT_NE(filter_analog, nullptr);
+
+  std::map<std::string, std::vector<double>> received;
+  ScopedConnection connection = filter->ready.connect([&](Node *) {
+    auto &frame = filter_analog->frame();
+    for (auto c = 0; c < frame.num_channels(); ++c) {
+      auto data = frame.data<double>(c);
+      auto &channel = received[std::string(frame.names[size_t(c)])];
+      channel.insert(channel.end(), data.begin(), data.end());
+      EXPECT_EQ(frame.sample_intervals[size_t(c)], 1ms);
+    }
+  });
+
+  std::map<std::string, std::vector<double>> sent;
+  auto publish = [&](std::vector<std::string> names, size_t count) {
+    std::vector<std::vector<double>> buffers;
+    for (auto &name : names) {
+      auto &channel = sent[name];
+      auto &buffer = buffers.emplace_back();
+      for (size_t i = 0; i < count; ++i) {
+        auto frequency = double(name[0] - 'a' + 1);
+        buffer.push_back(std::sin(double(channel.size()) * frequency));
+        channel.push_back(buffer.back());
+      }
+    }
+    thalamus::vector<std::span<const double>> spans(buffers.begin(),
+                                                    buffers.end());
+    thalamus::vector<std::string_view> name_views(names.begin(), names.end());
+    thalamus::vector<std::chrono::nanoseconds> intervals(names.size(), 1ms);
+    analog->inject(spans, intervals, name_views);
+  };
+  publish({"a", "b"}, 10);
+  publish({"a", "b"}, 7);
+  publish({"b", "a", "c"}, 10);
+  publish({"c"}, 3);
+  publish({"a", "c"}, 10);
+
+  auto sections = *design_butterworth(FilterBand::LOW_PASS, 4, 50, 0, 1000);
+  sections.push_back(*design_notch(60, 30, 1000));
+  // a restarts after it disappears, b and c are filtered without a break
+  std::map<std::string, std::vector<size_t>> restarts = {
+      {"a", {0, 27, 37}}, {"b", {0, 27}}, {"c", {0, 23}}};
+  for (auto &[name, bounds] : restarts) {
+    auto &samples = sent[name];
+    ASSERT_EQ(samples.size(), bounds.back());
+    ASSERT_EQ(received[name].size(), samples.size());
+    for (size_t i = 0; i + 1 < bounds.size(); ++i) {
+      std::span<const double> segment(samples.begin() + int64_t(bounds[i]),
+                                      samples.begin() +
+                                          int64_t(bounds[i + 1]));
+      std::vector<double> expected(segment.size());
+      FilterBank bank(sections, {});
+      bank.process(std::vector<std::span<const double>>{segment},
+                   std::vector<std::span<double>>{expected});
+      for (size_t j = 0; j < segment.size(); ++j) {
+        EXPECT_NEAR(received[name][bounds[i] + j], expected[j], 1e-12)
+            << name << " " << bounds[i] + j;
+      }
+    }
+  }
+}
+
+TEST(FilterBenchmark, Throughput) {
+  const size_t channels = 384;
+  const size_t samples = 30;
+  const size_t readies = 1000;
+  std::mt19937 generator(1);
+  std::normal_distribution<double> distribution;
+  std::vector<std::vector<double>> buffers(channels,
+                                           std::vector<double>(samples));
+  std::vector<std::string> names;
+  for (size_t c = 0; c < channels; ++c) {
+    std::generate(buffers[c].begin(), buffers[c].end(),
+                  [&] { return distribution(generator); });
+    names.push_back("Channel " + std::to_string(c));
+  }
+  thalamus::vector<std::span<const double>> spans(buffers.begin(),
+                                                  buffers.end());
+  thalamus::vector<std::string_view> name_views(names.begin(), names.end());
+  thalamus::vector<std::chrono::nanoseconds> intervals(
+      channels, std::chrono::nanoseconds(1s) / 30000);
+
+  std::map<std::string, std::map<std::string, ObservableCollection::Value>>
+      filters = {{"inject only", {{"Filter", "None"}}},
+                 {"band pass and 3 notches",
+                  {{"Filter", "Band Pass"},
+                   {"Notch (Hz)", int64_t(60)},
+                   {"Notch Harmonics", int64_t(3)}}},
+                 {"63 tap FIR",
+                  {{"Filter", "Band Pass"},
+                   {"Design", "FIR"},
+                   {"Taps", int64_t(63)}}}};
+  for (auto &[label, settings] : filters) {
+    auto config = settings;
+    config["name"] = "filter";
+    config["type"] = "FILTER";
+    config["Source"] = "analog";
+    PluginGraph graph({{{"name", "analog"}, {"type", "ANALOG"}}, config});
+    auto analog =
+        std::static_pointer_cast<AnalogNodeImpl>(graph.get("analog"));
+    auto filter = graph.get("filter");
+    auto filter_analog = node_cast<AnalogNode *>(filter.get());
+    size_t outputs = 0;
+    ScopedConnection connection = filter->ready.connect([&](Node *) {
+      EXPECT_EQ(filter_analog->frame().num_channels(), int(channels));
+      EXPECT_TRUE(std::isfinite(filter_analog->data(0).back()));
+      ++outputs;
+    });
+
+    // 30 kHz published every millisecond
+    auto start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < readies; ++r) {
+      analog->inject(spans, intervals, name_views);
+    }
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    std::cout << "Filter " << label << ": " << elapsed.count()
+              << "s per second of " << channels << " channels at 30kHz"
+              << std::endl;
+    EXPECT_EQ(outputs, readies);
+  }
+}
+
+/**
+ * Uniform noise on [-sqrt(3), sqrt(3)], so unit variance and never near a
+ * spike threshold, with a -10 spike at each of spikes.  Uses the generator's
+ * raw output so the train is the same everywhere.
+ */
+static std::vector<double> spike_train(size_t samples,
+                                       const std::vector<size_t> &spikes,
+                                       std::mt19937 &generator) {
+  std::vector<double> train(samples);
+  for (auto &sample : train) {
+    auto unit = double(generator()) / double(std::mt19937::max());
+    sample = (2 * unit - 1) * std::sqrt(3.0);
+  }
+  for (auto spike : spikes) {
+    train[spike] = -10;
+  }
+  return train;
+}
+
+TEST(SpikeDetectorTest, SyntheticSpikeTrains) {
+  // 13 channels so the last block is partial
+  const size_t channels = 13;
+  const size_t samples = 30000;
+  std::mt19937 generator(1);
+  std::vector<std::vector<double>> trains;
+  std::vector<std::vector<size_t>> expected;
+  for (size_t c = 0; c < channels; ++c) {
+    // The spike 10 samples after 5000 + 7c is inside the 30 sample
+    // refractory period and the two samples at 20000 + c are one spike
+    trains.push_back(spike_train(
+        samples, {100 + c, 5000 + 7 * c, 5010 + 7 * c, 5100 + 7 * c, 20000 + c,
+                  20001 + c},
+        generator));
+    expected.push_back({100 + c, 5000 + 7 * c, 5100 + 7 * c, 20000 + c});
+  }
+
+  // Runs a detector with channel c given chunk(c, k) samples on call k
+  auto detect = [&](auto chunk) {
+    SpikeDetector detector(4.5, SpikeDetector::Polarity::NEGATIVE, 30,
+                           1.0 / 30000);
+    std::vector<std::vector<size_t>> found(channels);
+    std::vector<size_t> positions(channels, 0);
+    for (size_t k = 0; positions != std::vector<size_t>(channels, samples);
+         ++k) {
+      std::vector<std::span<const double>> input;
+      for (size_t c = 0; c < channels; ++c) {
+        auto count = std::min(chunk(c, k), samples - positions[c]);
+        input.emplace_back(trains[c].data() + positions[c], count);
+      }
+      std::vector<SpikeDetector::Event> events;
+      detector.process(input, events);
+      for (size_t i = 0; i < events.size(); ++i) {
+        auto &event = events[i];
+        if (i > 0) {
+          auto &previous = events[i - 1];
+          EXPECT_TRUE(previous.sample < event.sample ||
+                      (previous.sample == event.sample &&
+                       previous.channel < event.channel));
+        }
+        found[event.channel].push_back(positions[event.channel] +
+                                       event.sample);
+      }
+      for (size_t c = 0; c < channels; ++c) {
+        positions[c] += input[c].size();
+      }
+    }
+    // The estimate starts from each channel's first chunk and has had about
+    // one time constant to settle
+    for (size_t c = 0; c < channels; ++c) {
+      EXPECT_NEAR(detector.noise(c), std::sqrt(3.0) / 2 / 0.6745, 0.1);
+    }
+    return found;
+  };
+
+  EXPECT_EQ(detect([&](size_t, size_t) { return samples; }), expected);
+  EXPECT_EQ(detect([](size_t, size_t) { return size_t(30); }), expected);
+  EXPECT_EQ(detect([](size_t c, size_t k) { return 17 + (5 * c + k) % 23; }),
+            expected);
+}
+
+TEST(SpikeDetectorTest, Polarity) {
+  std::mt19937 generator(2);
+  auto train = spike_train(3000, {2000}, generator);
+  train[1000] = 10;
+  std::vector<std::span<const double>> input = {train};
+  std::map<SpikeDetector::Polarity, std::vector<size_t>> expected = {
+      {SpikeDetector::Polarity::NEGATIVE, {2000}},
+      {SpikeDetector::Polarity::POSITIVE, {1000}},
+      {SpikeDetector::Polarity::BOTH, {1000, 2000}}};
+  for (auto &[polarity, samples] : expected) {
+    SpikeDetector detector(4.5, polarity, 30, 1.0 / 30000);
+    std::vector<SpikeDetector::Event> events;
+    detector.process(input, events);
+    std::vector<size_t> found;
+    for (auto &event : events) {
+      found.push_back(event.sample);
+    }
+    EXPECT_EQ(found, samples);
+  }
+}
+
+TEST(SpikeDetectorTest, Node) {
+  PluginGraph graph({{{"name", "analog"}, {"type", "ANALOG"}},
+                     {{"name", "spikes"},
+                      {"type", "SPIKE_DETECT"},
+                      {"Source", "analog"},
+                      {"Rate Bin (ms)", 10.0},
+                      {"Rate Window (s)", 0.005}}});
+  auto analog =
+      std::static_pointer_cast<AnalogNodeImpl>(graph.get("analog"));
+  auto node = graph.get("spikes");
+  auto spikes = std::dynamic_pointer_cast<SpikeDetectNode>(node);
+  ASSERT_NE(spikes, nullptr);
+
+  auto interval = std::chrono::nanoseconds(1s) / 30000;
+  std::mt19937 generator(3);
+  std::vector<std::vector<double>> trains = {
+      spike_train(3000, {100, 1000, 1010, 1100}, generator),
+      spike_train(3000, {2000}, generator)};
+  std::vector<std::string> names = {"a", "b"};
+
+  std::vector<std::pair<int, std::chrono::nanoseconds>> found;
+  std::string text;
+  std::map<std::string, std::vector<double>> rates;
+  ScopedConnection connection = node->ready.connect([&](Node *) {
+    for (auto &spike : spikes->spikes()) {
+      found.emplace_back(spike.channel, spike.time);
+    }
+    text += spikes->text();
+    if (!spikes->has_analog_data()) {
+      return;
+    }
+    auto &frame = spikes->frame();
+    for (auto c = 0; c < frame.num_channels(); ++c) {
+      EXPECT_EQ(frame.sample_intervals[size_t(c)], 300 * interval);
+      auto data = frame.data<double>(c);
+      auto &channel = rates[std::string(frame.names[size_t(c)])];
+      channel.insert(channel.end(), data.begin(), data.end());
+    }
+  });
+
+  // 30 samples per ready with the last sample at sample index times interval
+  thalamus::vector<std::string_view> name_views(names.begin(), names.end());
+  thalamus::vector<std::chrono::nanoseconds> intervals(2, interval);
+  for (size_t i = 0; i < 3000; i += 30) {
+    thalamus::vector<std::span<const double>> spans = {
+        std::span<const double>(trains[0].data() + i, 30),
+        std::span<const double>(trains[1].data() + i, 30)};
+    analog->inject(spans, intervals, name_views,
+                   int64_t(i + 29) * interval);
+  }
+
+  std::vector<std::pair<int, std::chrono::nanoseconds>> expected = {
+      {0, 100 * interval},
+      {0, 1000 * interval},
+      {0, 1100 * interval},
+      {1, 2000 * interval}};
+  EXPECT_EQ(found, expected);
+  EXPECT_EQ(text, absl::StrCat((100 * interval).count(), " a\n",
+                               (1000 * interval).count(), " a\n",
+                               (1100 * interval).count(), " a\n",
+                               (2000 * interval).count(), " b\n"));
+
+  // 300 sample bins with the whole rate window in one bin
+  auto bin_rate = 1e9 / double((300 * interval).count());
+  std::vector<double> a_rates(10, 0), b_rates(10, 0);
+  a_rates[0] = bin_rate;
+  a_rates[3] = 2 * bin_rate;
+  b_rates[6] = bin_rate;
+  ASSERT_EQ(rates["a"].size(), 10);
+  ASSERT_EQ(rates["b"].size(), 10);
+  for (size_t i = 0; i < 10; ++i) {
+    EXPECT_NEAR(rates["a"][i], a_rates[i], 1e-9) << i;
+    EXPECT_NEAR(rates["b"][i], b_rates[i], 1e-9) << i;
+  }
+}
+
+TEST(SpikeDetectBenchmark, Latency) {
+  const size_t channels = 384;
+  const size_t samples = 30;
+  const size_t readies = 1000;
+  std::mt19937 generator(1);
+  std::normal_distribution<double> distribution;
+  std::vector<std::vector<double>> buffers(channels,
+                                           std::vector<double>(samples));
+  std::vector<std::string> names;
+  for (size_t c = 0; c < channels; ++c) {
+    std::generate(buffers[c].begin(), buffers[c].end(),
+                  [&] { return distribution(generator); });
+    buffers[c][c % samples] = -20;
+    names.push_back("Channel " + std::to_string(c));
+  }
+  thalamus::vector<std::span<const double>> spans(buffers.begin(),
+                                                  buffers.end());
+  thalamus::vector<std::string_view> name_views(names.begin(), names.end());
+  thalamus::vector<std::chrono::nanoseconds> intervals(
+      channels, std::chrono::nanoseconds(1s) / 30000);
+
+  PluginGraph graph({{{"name", "analog"}, {"type", "ANALOG"}},
+                     {{"name", "spikes"},
+                      {"type", "SPIKE_DETECT"},
+                      {"Source", "analog"}}});
+  auto analog =
+      std::static_pointer_cast<AnalogNodeImpl>(graph.get("analog"));
+  auto node = graph.get("spikes");
+  auto spikes = std::dynamic_pointer_cast<SpikeDetectNode>(node);
+  size_t outputs = 0;
+  size_t found = 0;
+  ScopedConnection connection = node->ready.connect([&](Node *) {
+    found += spikes->spikes().size();
+    ++outputs;
+  });
+
+  // 30 kHz published every millisecond
+  std::chrono::nanoseconds total = 0ns;
+  std::chrono::nanoseconds longest = 0ns;
+  for (size_t r = 0; r < readies; ++r) {
+    auto start = std::chrono::steady_clock::now();
+    analog->inject(spans, intervals, name_views);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    total += elapsed;
+    longest = std::max(longest, std::chrono::nanoseconds(elapsed));
+  }
+  std::cout << "Spike detection of " << channels << " channels at 30kHz: "
+            << double(total.count()) / double(readies) / 1e3
+            << "us mean and " << double(longest.count()) / 1e3
+            << "us max per " << samples << " sample ready" << std::endl;
+  EXPECT_EQ(outputs, readies);
+  // The spike repeats every ready, so the refractory period never hides it
+  EXPECT_EQ(found, channels * readies);
+}
+
+TEST(DecimatorTest, MatchesDirectForm) {
+  // 11 channels so the last block is partial
+  const size_t channels = 11;
+  const size_t samples = 2000;
+  const size_t ratio = 4;
+  std::mt19937 generator(1);
+  std::uniform_real_distribution<double> distribution(-1, 1);
+  std::vector<double> taps(25);
+  std::generate(taps.begin(), taps.end(),
+                [&] { return distribution(generator); });
+  std::vector<std::vector<double>> inputs(channels,
+                                          std::vector<double>(samples));
+  std::vector<std::vector<double>> expected(channels);
+  for (size_t c = 0; c < channels; ++c) {
+    std::generate(inputs[c].begin(), inputs[c].end(),
+                  [&] { return distribution(generator); });
+    for (size_t i = 0; i < samples; i += ratio) {
+      double sum = 0;
+      for (size_t k = 0; k < taps.size() && k <= i; ++k) {
+        sum += taps[k] * inputs[c][i - k];
+      }
+      expected[c].push_back(sum);
+    }
+  }
+
+  // Runs a decimator with channel c given chunk(c, k) samples on call k
+  auto decimate = [&](auto chunk) {
+    Decimator decimator(taps, ratio);
+    decimator.resize(channels);
+    std::vector<std::vector<double>> outputs(channels);
+    std::vector<size_t> positions(channels, 0);
+    for (size_t k = 0; positions != std::vector<size_t>(channels, samples);
+         ++k) {
+      std::vector<std::span<const double>> input;
+      std::vector<std::vector<double>> results;
+      for (size_t c = 0; c < channels; ++c) {
+        auto count = std::min(chunk(c, k), samples - positions[c]);
+        input.emplace_back(inputs[c].data() + positions[c], count);
+        results.emplace_back(decimator.outputs(c, count));
+        positions[c] += count;
+      }
+      decimator.process(input, std::vector<std::span<double>>(
+                                   results.begin(), results.end()));
+      for (size_t c = 0; c < channels; ++c) {
+        outputs[c].insert(outputs[c].end(), results[c].begin(),
+                          results[c].end());
+      }
+    }
+    return outputs;
+  };
+
+  for (auto outputs :
+       {decimate([&](size_t, size_t) { return samples; }),
+        decimate([](size_t, size_t) { return size_t(30); }),
+        decimate([](size_t c, size_t k) { return 1 + (5 * c + k) % 23; })}) {
+    for (size_t c = 0; c < channels; ++c) {
+      ASSERT_EQ(outputs[c].size(), expected[c].size());
+      for (size_t i = 0; i < expected[c].size(); ++i) {
+        EXPECT_NEAR(outputs[c][i], expected[c][i], 1e-12);
+      }
+    }
+  }
+}
+
+TEST(DecimateTest, RejectsAliasesAndReportsDelay) {
+  PluginGraph graph({{{"name", "analog"}, {"type", "ANALOG"}},
+                     {{"name", "decimate"},
+                      {"type", "DECIMATE"},
+                      {"Source", "analog"},
+                      {"Ratio", int64_t(30)},
+                      {"Passband (Hz)", 300.0}}});
+  auto analog =
+      std::static_pointer_cast<AnalogNodeImpl>(graph.get("analog"));
+  auto node = graph.get("decimate");
+  auto decimate = std::dynamic_pointer_cast<DecimateNode>(node);
+  ASSERT_NE(decimate, nullptr);
+
+  // 100Hz passes, 1100Hz would alias onto it at 1kHz and 10Hz shows the delay
+  const double sample_rate = 30000;
+  auto interval = std::chrono::nanoseconds(1s) / 30000;
+  std::vector<std::string> names = {"pass", "alias", "slow"};
+  std::vector<double> frequencies = {100, 1100, 10};
+  std::map<std::string, std::vector<double>> received;
+  std::vector<std::chrono::nanoseconds> times;
+  ScopedConnection connection = node->ready.connect([&](Node *) {
+    auto &frame = decimate->frame();
+    size_t outputs = 0;
+    for (auto c = 0; c < frame.num_channels(); ++c) {
+      EXPECT_EQ(frame.sample_intervals[size_t(c)], 30 * interval);
+      auto data = frame.data<double>(c);
+      auto &channel = received[std::string(frame.names[size_t(c)])];
+      channel.insert(channel.end(), data.begin(), data.end());
+      outputs = data.size();
+    }
+    times.push_back(frame.time);
+    // The newest output is from the newest input that is a multiple of 30
+    EXPECT_EQ(frame.time,
+              int64_t(received["pass"].size() - 1) * 30 * interval);
+    EXPECT_GT(outputs, 0);
+  });
+
+  // Uneven ready sizes, with the last sample at sample index times interval
+  const size_t samples = 30000;
+  std::vector<size_t> sizes = {7, 30, 45, 1, 67, 29};
+  thalamus::vector<std::string_view> name_views(names.begin(), names.end());
+  thalamus::vector<std::chrono::nanoseconds> intervals(3, interval);
+  for (size_t i = 0, k = 0; i < samples; ++k) {
+    auto count = std::min(sizes[k % sizes.size()], samples - i);
+    std::vector<std::vector<double>> buffers;
+    for (auto frequency : frequencies) {
+      auto &buffer = buffers.emplace_back();
+      for (size_t j = i; j < i + count; ++j) {
+        buffer.push_back(std::sin(2 * std::numbers::pi * frequency *
+                                  double(j) / sample_rate));
+      }
+    }
+    thalamus::vector<std::span<const double>> spans(buffers.begin(),
+                                                    buffers.end());
+    i += count;
+    analog->inject(spans, intervals, name_views,
+                   int64_t(i - 1) * interval);
+  }
+
+  // 495 taps, the most a 200Hz transition needs at 30kHz
+  auto delay = 247.0;
+  ObservableDictPtr config = graph.nodes->at(1);
+  EXPECT_DOUBLE_EQ(double((*config)["Delay (ms)"]),
+                   double((int64_t(delay) * interval).count()) / 1e6);
+  for (auto c = 0; c < 3; ++c) {
+    EXPECT_EQ(decimate->delay(c), int64_t(delay) * interval);
+  }
+
+  // Amplitudes from the power over whole periods after the filter settles
+  ASSERT_EQ(received["pass"].size(), 1000);
+  double pass = 0, alias = 0;
+  for (size_t m = 20; m < 1000; ++m) {
+    pass += 2 * received["pass"][m] * received["pass"][m] / 980;
+    alias += 2 * received["alias"][m] * received["alias"][m] / 980;
+    auto expected = std::sin(2 * std::numbers::pi * 10 *
+                             (double(m * 30) - delay) / sample_rate);
+    EXPECT_NEAR(received["slow"][m], expected, 1e-3) << m;
+  }
+  EXPECT_NEAR(std::sqrt(pass), 1, 1e-2);
+  EXPECT_LT(std::sqrt(alias), 1e-3);
+}
+
+TEST(DecimateBenchmark, Throughput) {
+  const size_t channels = 384;
+  const size_t samples = 30;
+  const size_t readies = 1000;
+  std::mt19937 generator(1);
+  std::normal_distribution<double> distribution;
+  std::vector<std::vector<double>> buffers(channels,
+                                           std::vector<double>(samples));
+  std::vector<std::string> names;
+  for (size_t c = 0; c < channels; ++c) {
+    std::generate(buffers[c].begin(), buffers[c].end(),
+                  [&] { return distribution(generator); });
+    names.push_back("Channel " + std::to_string(c));
+  }
+  thalamus::vector<std::span<const double>> spans(buffers.begin(),
+                                                  buffers.end());
+  thalamus::vector<std::string_view> name_views(names.begin(), names.end());
+  thalamus::vector<std::chrono::nanoseconds> intervals(
+      channels, std::chrono::nanoseconds(1s) / 30000);
+
+  PluginGraph graph({{{"name", "analog"}, {"type", "ANALOG"}},
+                     {{"name", "decimate"},
+                      {"type", "DECIMATE"},
+                      {"Source", "analog"}}});
+  auto analog =
+      std::static_pointer_cast<AnalogNodeImpl>(graph.get("analog"));
+  auto node = graph.get("decimate");
+  auto decimate = node_cast<AnalogNode *>(node.get());
+  size_t outputs = 0;
+  ScopedConnection connection = node->ready.connect([&](Node *) {
+    EXPECT_EQ(decimate->frame().num_channels(), int(channels));
+    outputs += decimate->data(0).size();
+  });
+
+  // 30 kHz published every millisecond, decimated to 1 kHz
+  auto start = std::chrono::steady_clock::now();
+  for (size_t r = 0; r < readies; ++r) {
+    analog->inject(spans, intervals, name_views);
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  std::cout << "Decimate by 30: " << elapsed.count() << "s per second of "
+            << channels << " channels at 30kHz" << std::endl;
+  EXPECT_EQ(outputs, readies);
+}
+
+/**
+ * The brute force cross correlation SyncNode used before the FFT, result[lag
+ * + data2.size() - 1] is the sum over n of data1[n + lag]*data2[n].
+ */
+static std::vector<double> direct_correlation(std::span<const double> data1,
+                                              std::span<const double> data2) {
+  std::vector<double> result;
+  for (auto lag = -(int(data2.size()) - 1); lag < int(data1.size()); ++lag) {
+    auto i = size_t(std::max(0, -lag));
+    auto j = size_t(std::max(0, lag));
+    auto count = std::min(data2.size() - i, data1.size() - j);
+    auto sum = 0.0;
+    for (size_t k = 0; k < count; ++k) {
+      sum += data2[i + k] * data1[j + k];
+    }
+    result.push_back(sum);
+  }
+  return result;
+}
+
+/**
+ * The lag SyncNode's brute force search picked, the first lag whose sum
+ * beats every earlier one and 0.
+ */
+static int direct_peak(std::span<const double> data1,
+                       std::span<const double> data2) {
+  auto correlation = direct_correlation(data1, data2);
+  auto max = 0.0;
+  auto max_index = 0;
+  for (size_t i = 0; i < correlation.size(); ++i) {
+    if (correlation[i] > max) {
+      max = correlation[i];
+      max_index = int(i) - (int(data2.size()) - 1);
+    }
+  }
+  return max_index;
+}
+
+TEST(CorrelationTest, MatchesBruteForce) {
+  // Lengths on both sides of a power of 2 and unequal windows
+  std::vector<std::pair<size_t, size_t>> sizes = {
+      {1, 1}, {5, 3}, {3, 5}, {100, 100}, {257, 130}, {1000, 1500}};
+  std::mt19937 generator(1);
+  std::uniform_real_distribution<double> distribution(-1, 1);
+  for (auto [size1, size2] : sizes) {
+    std::vector<double> data1(size1);
+    std::vector<double> data2(size2);
+    std::generate(data1.begin(), data1.end(),
+                  [&] { return distribution(generator); });
+    std::generate(data2.begin(), data2.end(),
+                  [&] { return distribution(generator); });
+    auto expected = direct_correlation(data1, data2);
+    auto actual = thalamus::cross_correlate(data1, data2);
+    ASSERT_EQ(actual.size(), expected.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+      EXPECT_NEAR(actual[i], expected[i], 1e-9) << size1 << " " << size2;
+    }
+    auto peak = thalamus::find_correlation_peak(data1, data2);
+    EXPECT_NEAR(peak.lag, direct_peak(data1, data2), .5);
+  }
+
+  // A shifted copy buried in noise
+  for (auto shift : {-37, 0, 12, 400}) {
+    const size_t samples = 3000;
+    std::vector<double> source(samples + 800);
+    std::generate(source.begin(), source.end(),
+                  [&] { return distribution(generator); });
+    std::vector<double> data1(samples);
+    std::vector<double> data2(samples);
+    for (size_t n = 0; n < samples; ++n) {
+      data1[n] = source[n + 400] + .5 * distribution(generator);
+      data2[n] = source[size_t(int(n) + 400 + shift)];
+    }
+    auto peak = thalamus::find_correlation_peak(data1, data2);
+    EXPECT_EQ(direct_peak(data1, data2), shift);
+    EXPECT_NEAR(peak.lag, shift, .5);
+  }
+}
+
+TEST(CorrelationTest, SubSamplePeak) {
+  const size_t samples = 1000;
+  const double width = 20;
+  auto pulse = [&](double center) {
+    std::vector<double> result(samples);
+    for (size_t n = 0; n < samples; ++n) {
+      auto x = (double(n) - center) / width;
+      result[n] = std::exp(-x * x / 2);
+    }
+    return result;
+  };
+  for (auto shift : {0.0, .25, 3.4, -7.3, 41.9}) {
+    auto data1 = pulse(500 + shift);
+    auto data2 = pulse(500);
+    auto peak = thalamus::find_correlation_peak(data1, data2);
+    EXPECT_NEAR(peak.lag, shift, .05);
+    EXPECT_EQ(direct_peak(data1, data2), int(std::round(shift)));
+  }
+}
+
+TEST(CorrelationTest, SyncNode) {
+  const size_t samples = 300;
+  const size_t readies = 12;
+  const size_t shift = 30;
+  auto sample_interval = std::chrono::nanoseconds(1s) / 30000;
+  std::mt19937 generator(1);
+  std::uniform_real_distribution<double> distribution(-1, 1);
+  std::vector<double> source(samples * readies + shift);
+  std::generate(source.begin(), source.end(),
+                [&] { return distribution(generator); });
+
+  ObservableListPtr pairs = std::make_shared<ObservableList>();
+  ObservableDictPtr pair = std::make_shared<ObservableDict>();
+  (*pair)["Node 1"].assign("analog1");
+  (*pair)["Channel 1"].assign("Signal");
+  (*pair)["Node 2"].assign("analog2");
+  (*pair)["Channel 2"].assign("Signal");
+  (*pair)["Window (s)"].assign(.1);
+  (*pair)["Threshold"].assign(.5);
+  (*pair)["Algorithm"].assign("Cross Correlation");
+  pairs->push_back(pair);
+  PluginGraph graph({{{"name", "analog1"}, {"type", "ANALOG"}},
+                     {{"name", "analog2"}, {"type", "ANALOG"}},
+                     {{"name", "sync"}, {"type", "SYNC"}, {"Pairs", pairs}}});
+  auto analog1 =
+      std::static_pointer_cast<AnalogNodeImpl>(graph.get("analog1"));
+  auto analog2 =
+      std::static_pointer_cast<AnalogNodeImpl>(graph.get("analog2"));
+  auto node = graph.get("sync");
+  auto sync = node_cast<AnalogNode *>(node.get());
+  std::optional<double> lag;
+  ScopedConnection connection = node->ready.connect([&](Node *) {
+    if (sync->data(0).front() != 0) {
+      lag = sync->data(0).front();
+    }
+  });
+
+  // Node 1 sees the source shift samples after node 2
+  thalamus::vector<std::chrono::nanoseconds> intervals(1, sample_interval);
+  thalamus::vector<std::string_view> names(1, "Signal");
+  auto time = 0ns;
+  for (size_t r = 0; r < readies; ++r) {
+    time += int64_t(samples) * sample_interval;
+    auto first = source.data() + r * samples;
+    thalamus::vector<std::span<const double>> span1(
+        1, std::span<const double>(first, samples));
+    thalamus::vector<std::span<const double>> span2(
+        1, std::span<const double>(first + shift, samples));
+    analog1->inject(span1, intervals, names, time);
+    analog2->inject(span2, intervals, names, time);
+  }
+
+  // The lag is computed on the thread pool and posted back
+  for (auto i = 0; i < 1000 && !lag; ++i) {
+    graph.io_context.restart();
+    graph.io_context.poll();
+    std::this_thread::sleep_for(1ms);
+  }
+  ASSERT_TRUE(lag);
+  auto expected = double((int64_t(shift) * sample_interval).count()) / 1e9;
+  EXPECT_NEAR(*lag, expected, double(sample_interval.count()) / 2e9);
+}
+
+TEST(CorrelationBenchmark, WindowSizes) {
+  const double sample_rate = 30000;
+  std::mt19937 generator(1);
+  std::uniform_real_distribution<double> distribution(-1, 1);
+  for (auto seconds : {.1, .5, 1.0, 2.0, 4.0, 8.0}) {
+    auto samples = size_t(seconds * sample_rate);
+    std::vector<double> data1(samples);
+    std::vector<double> data2(samples);
+    std::generate(data1.begin(), data1.end(),
+                  [&] { return distribution(generator); });
+    std::rotate_copy(data1.begin(), data1.begin() + 100, data1.end(),
+                     data2.begin());
+
+    const size_t repeats = 5;
+    thalamus::CorrelationPeak peak;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < repeats; ++r) {
+      peak = thalamus::find_correlation_peak(data1, data2);
+    }
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    std::cout << "FFT correlation of " << seconds << "s windows at 30kHz: "
+              << elapsed.count() / repeats << "s" << std::endl;
+    EXPECT_NEAR(peak.lag, 100, .5);
+
+    // The brute force search is only practical for short windows
+    if (seconds <= .5) {
+      start = std::chrono::steady_clock::now();
+      auto direct = direct_peak(data1, data2);
+      elapsed = std::chrono::steady_clock::now() - start;
+      std::cout << "Brute force correlation of " << seconds
+                << "s windows at 30kHz: " << elapsed.count() << "s"
+                << std::endl;
+      EXPECT_EQ(direct, 100);
+    }
+  }
+}
+
 int main(int argc, char** argv) {
   //auto steady_start = std::chrono::steady_clock::now();
   auto system_start = std::chrono::system_clock::now();
@@ -52,11 +52,12 @@ public:
     state->recap(std::bind(&Impl::on_change, this, _1, _2, _3));
   }
 
-  boost::signals2::scoped_connection source_connection;
+  ScopedConnection source_connection;
   AnalogNode *source = nullptr;
   std::optional<calculator::program> program; // Our program (AST)
   calculator::eval eval;
   std::vector<std::vector<double>> data;
+  AnalogFrameBuilder frame;
 
   void on_change(ObservableCollection::Action,
                  const ObservableCollection::Key &k,
@@ -78,11 +79,14 @@ public:
           if (!source->has_analog_data()) {
             return;
           }
-          if (data.size() < static_cast<size_t>(source->num_channels())) {
-            data.resize(size_t(source->num_channels()));
+          auto &input = source->frame();
+          if (data.size() < static_cast<size_t>(input.num_channels())) {
+            data.resize(size_t(input.num_channels()));
           }
-          for (auto i = 0; i < source->num_channels(); ++i) {
-            auto span = source->data(i);
+          for (auto i = 0; i < input.num_channels(); ++i) {
+            auto span = input.type == AnalogFrame::Type::DOUBLE
+                            ? input.data<double>(i)
+                            : source->data(i);
             auto &transformed = data.at(size_t(i));
             transformed.assign(span.begin(), span.end());
             if (!program) {
@@ -99,6 +103,12 @@ public:
               }
             }
           }
+          frame.resize(data.size());
+          for (size_t i = 0; i < data.size(); ++i) {
+            frame.set_data(i, std::span<const double>(data[i]));
+          }
+          frame.copy_layout(input);
+          frame.finish(input.time, input.remote_time);
           outer->ready(outer);
         });
       });
@@ -153,6 +163,8 @@ void AlgebraNode::inject(const thalamus::vector<std::span<double const>> &,
 
 bool AlgebraNode::has_analog_data() const { return true; }
 
+const AnalogFrame &AlgebraNode::frame() const { return impl->frame.get(); }
+
 size_t AlgebraNode::modalities() const {
   return infer_modalities<AlgebraNode>();
 }
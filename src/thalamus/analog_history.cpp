@@ -0,0 +1,143 @@
+#include <thalamus/analog_history.hpp>
+
+#include <algorithm>
+
+namespace thalamus {
+AnalogHistory::AnalogHistory(Node *node, AnalogNode *_analog,
+                             std::chrono::nanoseconds _duration,
+                             size_t _max_bytes)
+    : analog(_analog), duration(_duration), max_bytes(_max_bytes) {
+  ready_connection = node->ready.connect([this](Node *) {
+    if (analog->has_analog_data()) {
+      record(analog->frame());
+    }
+  });
+}
+
+void AnalogHistory::set_limits(std::chrono::nanoseconds _duration,
+                               size_t _max_bytes) {
+  if (duration == _duration && max_bytes == _max_bytes) {
+    return;
+  }
+  duration = _duration;
+  max_bytes = _max_bytes;
+  version = 0;
+  channels.clear();
+  chunks.clear();
+  ends.clear();
+}
+
+void AnalogHistory::reset(const AnalogFrame &frame) {
+  version = frame.version;
+  chunks.clear();
+  ends.clear();
+  auto count = size_t(frame.num_channels());
+  auto limit = max_bytes / sizeof(double);
+  channels.resize(count);
+  for (size_t c = 0; c < count; ++c) {
+    auto &channel = channels[c];
+    channel.name = frame.names[c];
+    channel.sample_interval = frame.sample_intervals[c];
+    // Room for duration plus the chunk that pushes the oldest one out
+    auto capacity = limit;
+    if (channel.sample_interval > 0ns) {
+      capacity = std::min(capacity, size_t(duration / channel.sample_interval) +
+                                        frame.sizes[c]);
+    }
+    channel.ring.assign(capacity, 0);
+    channel.written = 0;
+    channel.first = 0;
+  }
+}
+
+void AnalogHistory::pop_front() {
+  auto count = channels.size();
+  for (size_t c = 0; c < count; ++c) {
+    channels[c].first = ends[c];
+  }
+  ends.erase(ends.begin(), ends.begin() + int64_t(count));
+  chunks.pop_front();
+}
+
+void AnalogHistory::record(const AnalogFrame &frame) {
+  if (frame.version != version) {
+    reset(frame);
+  }
+
+  visit_frame(frame, [&](auto wrapper) {
+    for (size_t c = 0; c < channels.size(); ++c) {
+      auto &channel = channels[c];
+      auto data = wrapper->data(int(c));
+      auto scale = frame.is_transformed ? frame.scales[c] : 1.0;
+      auto offset = frame.is_transformed ? frame.offsets[c] : 0.0;
+      auto size = channel.ring.size();
+      if (size) {
+        for (auto sample : data) {
+          channel.ring[channel.written++ % size] =
+              double(sample) * scale + offset;
+        }
+      } else {
+        channel.written += data.size();
+      }
+      ends.push_back(channel.written);
+    }
+  });
+  chunks.push_back(Chunk{frame.time, frame.remote_time});
+
+  while (!chunks.empty()) {
+    auto expired = chunks.front().time < frame.time - duration;
+    auto overwritten = std::any_of(
+        channels.begin(), channels.end(), [](const Channel &channel) {
+          return channel.written - channel.first > channel.ring.size();
+        });
+    if (!expired && !overwritten) {
+      break;
+    }
+    pop_front();
+  }
+}
+
+void AnalogHistory::backfill(
+    std::chrono::nanoseconds backfill_duration,
+    const std::function<void(const AnalogFrame &)> &callback) const {
+  if (chunks.empty()) {
+    return;
+  }
+  auto since = chunks.back().time - backfill_duration;
+  auto begin = std::partition_point(
+      chunks.begin(), chunks.end(),
+      [&](const Chunk &chunk) { return chunk.time < since; });
+
+  auto count = channels.size();
+  AnalogFrameBuilder builder;
+  builder.resize(count);
+  for (size_t c = 0; c < count; ++c) {
+    builder.set_layout(c, channels[c].name, channels[c].sample_interval);
+  }
+  std::vector<std::vector<double>> buffers(count);
+  for (auto i = size_t(begin - chunks.begin()); i < chunks.size(); ++i) {
+    for (size_t c = 0; c < count; ++c) {
+      auto &channel = channels[c];
+      auto first = i ? ends[(i - 1) * count + c] : channel.first;
+      auto last = ends[i * count + c];
+      auto &buffer = buffers[c];
+      buffer.clear();
+      for (auto p = first; p < last; ++p) {
+        buffer.push_back(channel.ring[p % channel.ring.size()]);
+      }
+      builder.set_data(c, std::span<const double>(buffer));
+    }
+    callback(builder.finish(chunks[i].time, chunks[i].remote_time));
+  }
+}
+
+size_t AnalogHistory::num_chunks() const { return chunks.size(); }
+
+size_t AnalogHistory::num_samples() const {
+  size_t result = 0;
+  for (auto &channel : channels) {
+    result += channel.written - channel.first;
+  }
+  return result;
+}
+} // namespace thalamus
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <thalamus/analog_node.hpp>
+#include <thalamus/base_node.hpp>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace thalamus {
+/**
+ * The recent samples of an AnalogNode, so subscribers can be sent the last
+ * few seconds before live data.  Every ready is copied into a ring per
+ * channel, with scale and offset applied, and remembered as a chunk with its
+ * time.  The oldest chunks are dropped once the history spans more than
+ * duration or a channel's ring is full.  A ring holds duration at its
+ * channel's sample rate, so memory follows the channel count and rates, and
+ * is capped at max_bytes per channel.  The history restarts whenever the
+ * node's channels change.
+ *
+ * Records on the node's ready signal and must only be used from the thread
+ * ready is signaled on, so a backfill followed by a connection to ready in
+ * the same handler sees every chunk exactly once.
+ */
+class AnalogHistory {
+  struct Channel {
+    std::string name;
+    std::chrono::nanoseconds sample_interval = 0ns;
+    std::vector<double> ring;
+    uint64_t written = 0;
+    uint64_t first = 0;
+  };
+  struct Chunk {
+    std::chrono::nanoseconds time;
+    std::chrono::nanoseconds remote_time;
+  };
+
+  AnalogNode *analog;
+  std::chrono::nanoseconds duration;
+  size_t max_bytes;
+  uint64_t version = 0;
+  std::vector<Channel> channels;
+  std::deque<Chunk> chunks;
+  // Each chunk's end in every channel's ring, chunk i's ends start at
+  // i*channels.size().
+  std::deque<uint64_t> ends;
+  ScopedConnection ready_connection;
+
+  void record(const AnalogFrame &frame);
+  void reset(const AnalogFrame &frame);
+  void pop_front();
+
+public:
+  AnalogHistory(Node *node, AnalogNode *analog,
+                std::chrono::nanoseconds duration, size_t max_bytes);
+  AnalogHistory(const AnalogHistory &) = delete;
+  AnalogHistory &operator=(const AnalogHistory &) = delete;
+
+  /**
+   * Applies new limits, which discards the recorded chunks if they differ.
+   */
+  void set_limits(std::chrono::nanoseconds duration, size_t max_bytes);
+
+  /**
+   * Calls callback with every chunk recorded in the last duration, oldest
+   * first, as DOUBLE frames whose scale and offset are already applied.  The
+   * frames are only valid during the call.
+   */
+  void backfill(std::chrono::nanoseconds duration,
+                const std::function<void(const AnalogFrame &)> &callback) const;
+
+  size_t num_chunks() const;
+  size_t num_samples() const;
+};
+} // namespace thalamus
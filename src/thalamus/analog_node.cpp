@@ -2,12 +2,115 @@
 #include <thalamus/analog_node.hpp>
 #include <cstdint>
 #include <thalamus/modalities_util.hpp>
+#include <atomic>
 #include <random>
 
 using namespace thalamus;
 
 AnalogNode::~AnalogNode() {}
 
+static std::atomic<uint64_t> next_frame_version = 1;
+
+void AnalogFrameBuilder::resize(size_t count) {
+  if (count == channels.size()) {
+    return;
+  }
+  channels.resize(count);
+  sizes.resize(count);
+  name_storage.resize(count);
+  names.resize(count);
+  sample_intervals.resize(count);
+  scales.resize(count, 1);
+  offsets.resize(count, 0);
+  changed = true;
+}
+
+void AnalogFrameBuilder::set_layout(size_t channel, std::string_view name,
+                                    std::chrono::nanoseconds sample_interval,
+                                    double scale, double offset) {
+  if (name_storage[channel] != name) {
+    name_storage[channel] = name;
+    changed = true;
+  }
+  if (sample_intervals[channel] != sample_interval ||
+      scales[channel] != scale || offsets[channel] != offset) {
+    sample_intervals[channel] = sample_interval;
+    scales[channel] = scale;
+    offsets[channel] = offset;
+    changed = true;
+  }
+}
+
+void AnalogFrameBuilder::copy_layout(const AnalogFrame &source) {
+  if (!changed && source.version == copied_version) {
+    return;
+  }
+  auto count = std::min(channels.size(), size_t(source.num_channels()));
+  for (size_t i = 0; i < count; ++i) {
+    set_layout(i, source.names[i], source.sample_intervals[i],
+               source.scales[i], source.offsets[i]);
+  }
+  for (auto i = count; i < channels.size(); ++i) {
+    set_layout(i, "", 0ns);
+  }
+  copied_version = source.version;
+}
+
+const AnalogFrame &
+AnalogFrameBuilder::finish(std::chrono::nanoseconds time,
+                           std::chrono::nanoseconds remote_time,
+                           bool is_transformed) {
+  if (changed || frame.is_transformed != is_transformed) {
+    for (size_t i = 0; i < names.size(); ++i) {
+      names[i] = name_storage[i];
+    }
+    frame.version = next_frame_version++;
+    frame.is_transformed = is_transformed;
+    frame.channels = channels;
+    frame.sizes = sizes;
+    frame.names = names;
+    frame.sample_intervals = sample_intervals;
+    frame.scales = scales;
+    frame.offsets = offsets;
+    changed = false;
+  }
+  frame.time = time;
+  frame.remote_time = remote_time;
+  return frame;
+}
+
+template <typename T>
+static void fill_frame(const AnalogNode &node, AnalogFrameBuilder &builder,
+                       std::span<const T> (AnalogNode::*data)(int) const) {
+  auto count = size_t(std::max(node.num_channels(), 0));
+  builder.resize(count);
+  auto transformed = node.is_transformed();
+  for (size_t i = 0; i < count; ++i) {
+    auto channel = int(i);
+    builder.set_data(i, (node.*data)(channel));
+    builder.set_layout(i, node.name(channel), node.sample_interval(channel),
+                       transformed ? node.scale(channel) : 1.0,
+                       transformed ? node.offset(channel) : 0.0);
+  }
+}
+
+const AnalogFrame &AnalogNode::frame() const {
+  if (!fallback_frame) {
+    fallback_frame = std::make_unique<AnalogFrameBuilder>();
+  }
+  auto &builder = *fallback_frame;
+  if (is_short_data()) {
+    fill_frame(*this, builder, &AnalogNode::short_data);
+  } else if (is_int_data()) {
+    fill_frame(*this, builder, &AnalogNode::int_data);
+  } else if (is_ulong_data()) {
+    fill_frame(*this, builder, &AnalogNode::ulong_data);
+  } else {
+    fill_frame(*this, builder, &AnalogNode::data);
+  }
+  return builder.finish(time(), remote_time(), is_transformed());
+}
+
 struct WaveGeneratorNode::Impl {
   ObservableDictPtr state;
   ObservableList *nodes;
@@ -330,12 +433,17 @@ std::chrono::nanoseconds WaveGeneratorNode::sample_interval(int channel) const {
 std::chrono::nanoseconds WaveGeneratorNode::time() const {
   return impl->analog_impl.time();
 }
+const AnalogFrame &WaveGeneratorNode::frame() const {
+  return impl->analog_impl.frame();
+}
 
 struct AnalogNodeImpl::Impl {
   thalamus::vector<std::string_view> names;
   thalamus::vector<std::span<double const>> spans;
   thalamus::vector<std::chrono::nanoseconds> sample_intervals;
   std::chrono::nanoseconds time;
+  AnalogFrameBuilder frame;
+  bool frame_stale = true;
 };
 
 AnalogNodeImpl::AnalogNodeImpl(ObservableDictPtr, boost::asio::io_context &,
@@ -376,8 +484,23 @@ void AnalogNodeImpl::inject(
                                 sample_intervals.end());
   impl->names = names;
   impl->time = now;
+  impl->frame_stale = true;
   ready(this);
 }
+const AnalogFrame &AnalogNodeImpl::frame() const {
+  if (impl->frame_stale) {
+    impl->frame.resize(impl->spans.size());
+    for (size_t i = 0; i < impl->spans.size(); ++i) {
+      impl->frame.set_data(i, impl->spans[i]);
+      impl->frame.set_layout(
+          i, i < impl->names.size() ? impl->names[i] : "",
+          i < impl->sample_intervals.size() ? impl->sample_intervals[i] : 0ns);
+    }
+    impl->frame.finish(impl->time);
+    impl->frame_stale = false;
+  }
+  return impl->frame.get();
+}
 std::string AnalogNodeImpl::type_name() { return "ANALOG"; }
 
 struct ToggleNode::Impl {
@@ -386,7 +509,7 @@ struct ToggleNode::Impl {
   std::weak_ptr<Node> source;
   NodeGraph *graph;
   boost::signals2::scoped_connection state_connection;
-  boost::signals2::scoped_connection source_connection;
+  ScopedConnection source_connection;
   std::map<size_t, std::function<void(Node *)>> observers;
   boost::asio::io_context &io_context;
   thalamus::vector<double> buffer;
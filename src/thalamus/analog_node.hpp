@@ -1,6 +1,7 @@
 #pragma once
 
 #include <thalamus/base_node.hpp>
+#include <memory>
 #include <span>
 #include <string>
 #include <thalamus/util.hpp>
@@ -13,10 +14,95 @@ template <typename T> double interval_to_frequency(T interval) {
   return result;
 }
 
+/**
+ * Every channel of an AnalogNode's current data, returned by one call to
+ * AnalogNode::frame.  Channel i's samples are sizes[i] values of type starting
+ * at channels[i].  version changes whenever the sample type, channel count,
+ * names, sample intervals or transforms change and is unique across nodes, so consumers can
+ * keep anything derived from the layout until it does.
+ */
+struct AnalogFrame {
+  enum class Type { DOUBLE, SHORT, INT, ULONG };
+  Type type = Type::DOUBLE;
+  uint64_t version = 0;
+  std::chrono::nanoseconds time = 0ns;
+  std::chrono::nanoseconds remote_time = 0ns;
+  bool is_transformed = false;
+  std::span<const void *const> channels;
+  std::span<const size_t> sizes;
+  std::span<const std::string_view> names;
+  std::span<const std::chrono::nanoseconds> sample_intervals;
+  std::span<const double> scales;
+  std::span<const double> offsets;
+
+  int num_channels() const { return int(channels.size()); }
+  template <typename T> std::span<const T> data(int channel) const {
+    return std::span<const T>(
+        static_cast<const T *>(channels[size_t(channel)]),
+        sizes[size_t(channel)]);
+  }
+};
+
+template <typename T> constexpr AnalogFrame::Type analog_frame_type() {
+  if constexpr (std::is_same<T, short>::value) {
+    return AnalogFrame::Type::SHORT;
+  } else if constexpr (std::is_same<T, int>::value) {
+    return AnalogFrame::Type::INT;
+  } else if constexpr (std::is_same<T, uint64_t>::value) {
+    return AnalogFrame::Type::ULONG;
+  } else {
+    return AnalogFrame::Type::DOUBLE;
+  }
+}
+
+/**
+ * Owns the storage an AnalogFrame points into.  Producers describe every
+ * channel each time they have new data, the version is only bumped when the
+ * layout differs from the previous frame.
+ */
+class AnalogFrameBuilder {
+  AnalogFrame frame;
+  std::vector<const void *> channels;
+  std::vector<size_t> sizes;
+  std::vector<std::string> name_storage;
+  std::vector<std::string_view> names;
+  std::vector<std::chrono::nanoseconds> sample_intervals;
+  std::vector<double> scales;
+  std::vector<double> offsets;
+  uint64_t copied_version = 0;
+  bool changed = true;
+
+public:
+  void resize(size_t count);
+  template <typename T> void set_data(size_t channel, std::span<const T> data) {
+    if (frame.type != analog_frame_type<T>()) {
+      frame.type = analog_frame_type<T>();
+      changed = true;
+    }
+    channels[channel] = data.data();
+    sizes[channel] = data.size();
+  }
+  void set_layout(size_t channel, std::string_view name,
+                  std::chrono::nanoseconds sample_interval, double scale = 1,
+                  double offset = 0);
+  /**
+   * Takes the layout of another frame with the same channels, for nodes that
+   * transform their source's samples.  Nothing is compared while the source's
+   * version doesn't change.
+   */
+  void copy_layout(const AnalogFrame &source);
+  const AnalogFrame &finish(std::chrono::nanoseconds time,
+                            std::chrono::nanoseconds remote_time = 0ns,
+                            bool is_transformed = false);
+  const AnalogFrame &get() const { return frame; }
+};
+
 class AnalogNode {
+  mutable std::unique_ptr<AnalogFrameBuilder> fallback_frame;
+
 public:
   virtual ~AnalogNode();
-  boost::signals2::signal<void(AnalogNode *)> channels_changed;
+  Signal<void(AnalogNode *)> channels_changed;
   virtual std::span<const double> data(int channel) const = 0;
   virtual std::span<const short> short_data(int) const {
     THALAMUS_ASSERT(false, "AnalogNode::short_data unimplemented");
@@ -49,6 +135,13 @@ public:
   virtual bool is_transformed() const { return false; }
   virtual double scale(int) const { return 1.0; }
   virtual double offset(int) const { return 0.0; }
+
+  /**
+   * All channels in one call, only valid on the thread ready is signaled on.
+   * Nodes that override it build the frame at most once per ready, the
+   * default assembles it from the per channel API on every call.
+   */
+  virtual const AnalogFrame &frame() const;
 };
 
 template <typename T> class AnalogNodeWrapper {
@@ -97,6 +190,55 @@ template <typename T> void visit_node(AnalogNode *node, T callable) {
   }
 }
 
+template <typename T> class AnalogFrameWrapper {
+private:
+  const AnalogFrame &frame;
+
+public:
+  using value_type = T;
+  AnalogFrameWrapper(const AnalogFrame &_frame) : frame(_frame) {}
+  std::span<const T> data(int channel) const {
+    return frame.data<T>(channel);
+  }
+  int num_channels() const { return frame.num_channels(); }
+  std::chrono::nanoseconds sample_interval(int channel) const {
+    return frame.sample_intervals[size_t(channel)];
+  }
+  std::chrono::nanoseconds time() const { return frame.time; }
+  std::string_view name(int channel) const {
+    return frame.names[size_t(channel)];
+  }
+
+  bool is_transformed() const { return frame.is_transformed; }
+  double scale(int i) const { return frame.scales[size_t(i)]; }
+  double offset(int i) const { return frame.offsets[size_t(i)]; }
+};
+
+template <typename T> void visit_frame(const AnalogFrame &frame, T callable) {
+  switch (frame.type) {
+  case AnalogFrame::Type::SHORT: {
+    AnalogFrameWrapper<short> wrapper(frame);
+    callable(&wrapper);
+    break;
+  }
+  case AnalogFrame::Type::INT: {
+    AnalogFrameWrapper<int> wrapper(frame);
+    callable(&wrapper);
+    break;
+  }
+  case AnalogFrame::Type::ULONG: {
+    AnalogFrameWrapper<uint64_t> wrapper(frame);
+    callable(&wrapper);
+    break;
+  }
+  case AnalogFrame::Type::DOUBLE: {
+    AnalogFrameWrapper<double> wrapper(frame);
+    callable(&wrapper);
+    break;
+  }
+  }
+}
+
 class AnalogNodeImpl : public Node, public AnalogNode {
   struct Impl;
   std::unique_ptr<Impl> impl;
@@ -119,6 +261,7 @@ public:
                       const thalamus::vector<std::chrono::nanoseconds> &,
                       const thalamus::vector<std::string_view> &,
                       std::chrono::nanoseconds);
+  const AnalogFrame &frame() const override;
   static std::string type_name();
   size_t modalities() const override;
 };
@@ -153,6 +296,7 @@ public:
   std::string_view text() const override;
   bool has_text_data() const override;
   bool has_analog_data() const override;
+  const AnalogFrame &frame() const override;
 };
 
 class ToggleNode : public AnalogNode, public Node {
@@ -55,7 +55,17 @@ struct ArucoNode::Impl {
     ImageNode *image = nullptr;
     DistortionNode *distortion = nullptr;
     NodeGraph::NodeConnection get_connection;
-    boost::signals2::scoped_connection ready_connection;
+    ScopedConnection ready_connection;
+
+    // Tracking mode state, touched only on the io_context thread.  rois are
+    // predicted from the last detection and tracked_ids are the markers it
+    // found; hits records whether recent tracked frames were satisfied by the
+    // ROI search alone.
+    bool busy = false;
+    std::vector<cv::Rect> rois;
+    std::vector<int> tracked_ids;
+    unsigned int frames_since_full_search = 0;
+    std::deque<bool> hits;
   };
   std::map<std::string, std::unique_ptr<SourceBinding>> source_bindings;
   std::vector<std::string> source_order; // stable camera index for outputs
@@ -68,6 +78,12 @@ struct ArucoNode::Impl {
   cv::aruco::DetectorParameters detector_parameters;
   std::shared_ptr<cv::aruco::ArucoDetector> detector;
   bool running = false;
+  bool tracking = false;
+  unsigned int full_search_interval = 10;
+  std::chrono::nanoseconds last_emitted_time{0};
+  static constexpr size_t HIT_RATE_WINDOW = 30;
+  static constexpr double ROI_MARGIN = 0.5;
+  static constexpr int ROI_MIN_MARGIN = 16;
   ThreadPool &pool;
   struct Frame {
     cv::Mat mat;
@@ -395,6 +411,15 @@ struct ArucoNode::Impl {
     } else if (key_str == "Running") {
       frame = 0;
       running = std::get<bool>(value);
+    } else if (key_str == "Tracking") {
+      tracking = std::get<bool>(value);
+      for (auto &pair : source_bindings) {
+        pair.second->rois.clear();
+        pair.second->hits.clear();
+      }
+    } else if (key_str == "Full Search Interval") {
+      full_search_interval =
+          std::max(1u, static_cast<unsigned int>(std::get<int64_t>(value)));
     }
   }
 
@@ -576,6 +601,44 @@ struct ArucoNode::Impl {
     }
   }
 
+  /**
+   * Predict where markers will be in the next frame: the bounding box of each
+   * detected marker, grown by a margin proportional to its size, with
+   * overlapping boxes merged so no marker is searched twice.
+   */
+  static std::vector<cv::Rect>
+  predict_rois(const std::vector<std::vector<cv::Point2f>> &corners,
+               int width, int height) {
+    std::vector<cv::Rect> rois;
+    cv::Rect frame_rect(0, 0, width, height);
+    for (auto &marker : corners) {
+      auto box = cv::boundingRect(marker);
+      auto margin =
+          std::max(int(std::max(box.width, box.height) * ROI_MARGIN),
+                   ROI_MIN_MARGIN);
+      box = cv::Rect(box.x - margin, box.y - margin, box.width + 2 * margin,
+                     box.height + 2 * margin) &
+            frame_rect;
+      if (box.empty()) {
+        continue;
+      }
+      auto merged = true;
+      while (merged) {
+        merged = false;
+        for (auto i = rois.begin(); i != rois.end(); ++i) {
+          if ((*i & box).area() > 0) {
+            box |= *i;
+            rois.erase(i);
+            merged = true;
+            break;
+          }
+        }
+      }
+      rois.push_back(box);
+    }
+    return rois;
+  }
+
   void on_data(const std::string &source_name) {
     auto binding_it = source_bindings.find(source_name);
     if (binding_it == source_bindings.end()) {
@@ -593,11 +656,32 @@ struct ArucoNode::Impl {
       return;
     }
     ++frame;
+    auto &binding = *binding_it->second;
     if (pool.full()) {
+      pool.count_drop(outer);
+      TRACE_EVENT_END("thalamus");
+      return;
+    }
+    if (tracking && binding.busy) {
       TRACE_EVENT_END("thalamus");
       return;
     }
 
+    auto full_search = true;
+    std::vector<cv::Rect> rois;
+    std::vector<int> tracked_ids;
+    if (tracking) {
+      binding.busy = true;
+      full_search = binding.rois.empty() ||
+                    binding.frames_since_full_search + 1 >= full_search_interval;
+      binding.frames_since_full_search =
+          full_search ? 0 : binding.frames_since_full_search + 1;
+      if (!full_search) {
+        rois = binding.rois;
+        tracked_ids = binding.tracked_ids;
+      }
+    }
+
     unsigned char *data = const_cast<unsigned char *>(source->plane(0).data());
     auto width = int(source->width());
     auto height = int(source->height());
@@ -618,6 +702,8 @@ struct ArucoNode::Impl {
                time = source->time(),
                _distortion_parameters = std::vector<double>(
                    distortion_parameters.begin(), distortion_parameters.end()),
+               _tracking = this->tracking, full_search, _rois = std::move(rois),
+               _tracked_ids = std::move(tracked_ids),
                _outer = outer->shared_from_this()] {
       TRACE_EVENT_BEGIN("thalamus", "ArucoNode::compute",
                         perfetto::Flow::ProcessScoped(id));
@@ -628,16 +714,59 @@ struct ArucoNode::Impl {
       // Board origin (camera frame, meters) per board label, for jitter.
       std::map<std::string, cv::Vec3d> _origins;
 
+      std::vector<std::vector<cv::Point2f>> detected_corners;
+      std::vector<int> detected_ids;
+      auto roi_hit = false;
+
       if (_running) {
         std::vector<int> ids;
         std::vector<std::vector<cv::Point2f>> corners, rejected;
-        {
+        auto detect_start = std::chrono::steady_clock::now();
+        if (!full_search) {
+          TRACE_EVENT("thalamus", "ArucoNode::detect_rois");
+          for (auto &roi : _rois) {
+            std::vector<int> roi_ids;
+            std::vector<std::vector<cv::Point2f>> roi_corners, roi_rejected;
+            _detector->detectMarkers(in(roi), roi_corners, roi_ids,
+                                     roi_rejected);
+            for (size_t k = 0; k < roi_ids.size(); ++k) {
+              if (std::find(ids.begin(), ids.end(), roi_ids[k]) != ids.end()) {
+                continue;
+              }
+              for (auto &point : roi_corners[k]) {
+                point.x += float(roi.x);
+                point.y += float(roi.y);
+              }
+              ids.push_back(roi_ids[k]);
+              corners.push_back(std::move(roi_corners[k]));
+            }
+          }
+          // A marker lost from its ROI may have moved anywhere in the frame
+          roi_hit = !ids.empty() &&
+                    std::all_of(_tracked_ids.begin(), _tracked_ids.end(),
+                                [&](int marker) {
+                                  return std::find(ids.begin(), ids.end(),
+                                                   marker) != ids.end();
+                                });
+        }
+        if (!roi_hit) {
           TRACE_EVENT("thalamus", "cv::aruco::ArucoDetector::detectMarkers");
+          ids.clear();
+          corners.clear();
           _detector->detectMarkers(in, corners, ids, rejected);
         }
+        _metrics["detect_ms"] = std::chrono::duration<double, std::milli>(
+                                    std::chrono::steady_clock::now() -
+                                    detect_start)
+                                    .count();
+        if (_tracking) {
+          detected_corners = corners;
+          detected_ids = ids;
+        }
 
         // Only annotate markers that belong to a configured board (or the
-        // calibration wand).  Detection still runs over the whole frame, but
+        // calibration wand).  Detection still covers the whole frame (directly
+        // or via the tracked ROIs with a full-frame fallback), but
         // unselected scene markers (e.g. static markers with other IDs) are not
         // drawn or pose-solved.
         std::set<int> configured_ids;
@@ -1129,13 +1258,38 @@ struct ArucoNode::Impl {
       }
       TRACE_EVENT_END("thalamus");
       boost::asio::post(_io_context, [this, id, source_name, color, _outer,
-                                      frame_interval, _frame,
+                                      frame_interval, _frame, _tracking,
+                                      full_search, roi_hit,
+                                      width = in.cols, height = in.rows,
+                                      returned_corners = std::move(detected_corners),
+                                      returned_ids = std::move(detected_ids),
                                       returned_segments = std::move(_segments),
                                       returned_metrics = std::move(_metrics),
                                       returned_origins = std::move(_origins),
                                       time]() mutable {
         TRACE_EVENT("thalamus", "ArucoNode Post Main",
                     perfetto::TerminatingFlow::ProcessScoped(id));
+        auto binding_i = source_bindings.find(source_name);
+        if (binding_i != source_bindings.end()) {
+          binding_i->second->busy = false;
+        }
+        if (_tracking && binding_i != source_bindings.end()) {
+          auto &tracked = *binding_i->second;
+          tracked.rois = predict_rois(returned_corners, width, height);
+          tracked.tracked_ids = std::move(returned_ids);
+          if (!full_search) {
+            tracked.hits.push_back(roi_hit);
+            while (tracked.hits.size() > HIT_RATE_WINDOW) {
+              tracked.hits.pop_front();
+            }
+          }
+          if (!tracked.hits.empty()) {
+            returned_metrics["hit_rate"] =
+                double(std::count(tracked.hits.begin(), tracked.hits.end(),
+                                  true)) /
+                double(tracked.hits.size());
+          }
+        }
         // _outer keeps the ArucoNode (and therefore this Impl) alive; this post
         // runs on the io_context thread so touching members (pose_history) is
         // safe.  Temporal pose jitter = std of each grid board's origin over a
@@ -1180,9 +1334,19 @@ struct ArucoNode::Impl {
           }
           THALAMUS_LOG(info) << oss.str();
         }
+        auto previous = camera_results.find(source_name);
+        if (previous != camera_results.end() && previous->second.time > time) {
+          return;
+        }
         camera_results[source_name] =
             CameraResult{color, std::move(returned_segments),
                          std::move(returned_metrics), time, frame_interval};
+        // Cameras finish out of order when they run in parallel; only emit
+        // when this result does not move the merged timeline backwards.
+        if (time < last_emitted_time) {
+          return;
+        }
+        last_emitted_time = time;
         combine_and_emit();
       });
     });
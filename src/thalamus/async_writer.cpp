@@ -0,0 +1,605 @@
+#include <thalamus/async_writer.hpp>
+#include <thalamus/assert.hpp>
+#include <thalamus/log.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+using namespace std::chrono_literals;
+
+namespace thalamus {
+
+/** O_DIRECT needs buffers, sizes and offsets aligned to the logical block. */
+static const size_t SLAB_ALIGNMENT = 4096;
+
+#ifndef _WIN32
+static bool write_all(int fd, const char *data, size_t size, uint64_t offset) {
+  while (size > 0) {
+    auto written = pwrite(fd, data, size, off_t(offset));
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    } else if (written == 0) {
+      errno = EIO;
+      return false;
+    }
+    data += written;
+    size -= size_t(written);
+    offset += uint64_t(written);
+  }
+  return true;
+}
+
+static void sync_file(int fd) {
+#ifdef __APPLE__
+  fsync(fd);
+#else
+  fdatasync(fd);
+#endif
+}
+#endif
+
+#ifdef __linux__
+#ifdef __clang__
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wold-style-cast"
+#endif
+/**
+ * Minimal io_uring wrapper on top of the raw syscalls so there's no liburing
+ * dependency.  Only used from the writing thread.
+ */
+struct Ring {
+  int fd = -1;
+  unsigned *sq_tail = nullptr;
+  unsigned *sq_mask = nullptr;
+  unsigned *sq_array = nullptr;
+  io_uring_sqe *sqes = nullptr;
+  unsigned *cq_head = nullptr;
+  unsigned *cq_tail = nullptr;
+  unsigned *cq_mask = nullptr;
+  io_uring_cqe *cqes = nullptr;
+  void *sq_ring = MAP_FAILED;
+  void *cq_ring = MAP_FAILED;
+  size_t sq_ring_size = 0;
+  size_t cq_ring_size = 0;
+  size_t sqes_size = 0;
+
+  ~Ring() {
+    if (sqes) {
+      munmap(sqes, sqes_size);
+    }
+    if (cq_ring != MAP_FAILED && cq_ring != sq_ring) {
+      munmap(cq_ring, cq_ring_size);
+    }
+    if (sq_ring != MAP_FAILED) {
+      munmap(sq_ring, sq_ring_size);
+    }
+    if (fd >= 0) {
+      ::close(fd);
+    }
+  }
+
+  bool setup(unsigned entries) {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    fd = int(syscall(__NR_io_uring_setup, entries, &params));
+    if (fd < 0) {
+      THALAMUS_LOG(warning) << "io_uring_setup failed: " << strerror(errno);
+      return false;
+    }
+    // IORING_OP_WRITE arrived in the same release as IORING_FEAT_RW_CUR_POS
+    if (!(params.features & IORING_FEAT_RW_CUR_POS)) {
+      THALAMUS_LOG(warning) << "Kernel io_uring doesn't support IORING_OP_WRITE";
+      return false;
+    }
+
+    sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size =
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    auto single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+      sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+    }
+    sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sq_ring == MAP_FAILED) {
+      return false;
+    }
+    cq_ring = single_mmap ? sq_ring
+                          : mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE,
+                                 MAP_SHARED | MAP_POPULATE, fd,
+                                 IORING_OFF_CQ_RING);
+    if (cq_ring == MAP_FAILED) {
+      return false;
+    }
+    sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    auto sqes_map = mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sqes_map == MAP_FAILED) {
+      return false;
+    }
+    sqes = static_cast<io_uring_sqe *>(sqes_map);
+
+    auto sq_bytes = static_cast<char *>(sq_ring);
+    auto cq_bytes = static_cast<char *>(cq_ring);
+    sq_tail = reinterpret_cast<unsigned *>(sq_bytes + params.sq_off.tail);
+    sq_mask = reinterpret_cast<unsigned *>(sq_bytes + params.sq_off.ring_mask);
+    sq_array = reinterpret_cast<unsigned *>(sq_bytes + params.sq_off.array);
+    cq_head = reinterpret_cast<unsigned *>(cq_bytes + params.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned *>(cq_bytes + params.cq_off.tail);
+    cq_mask = reinterpret_cast<unsigned *>(cq_bytes + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe *>(cq_bytes + params.cq_off.cqes);
+    return true;
+  }
+
+  /**
+   * Queues one SQE and submits it right away, so the kernel has consumed it
+   * before the next call and the submission queue never fills up.
+   */
+  template <typename F> bool submit(F &&prepare) {
+    auto tail = *sq_tail;
+    auto index = tail & *sq_mask;
+    auto sqe = sqes + index;
+    std::memset(sqe, 0, sizeof(*sqe));
+    prepare(sqe);
+    sq_array[index] = index;
+    __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+    while (true) {
+      auto submitted = syscall(__NR_io_uring_enter, fd, 1, 0, 0, nullptr, 0);
+      if (submitted >= 0) {
+        return true;
+      }
+      if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+        THALAMUS_LOG(error) << "io_uring_enter failed: " << strerror(errno);
+        return false;
+      }
+    }
+  }
+
+  template <typename F> void reap(bool wait, F &&on_completion) {
+    if (wait) {
+      while (syscall(__NR_io_uring_enter, fd, 0, 1, IORING_ENTER_GETEVENTS,
+                     nullptr, 0) < 0 &&
+             errno == EINTR) {
+      }
+    }
+    auto head = *cq_head;
+    while (head != __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE)) {
+      auto &cqe = cqes[head & *cq_mask];
+      on_completion(cqe.user_data, cqe.res);
+      ++head;
+    }
+    __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+  }
+};
+#ifdef __clang__
+#pragma clang diagnostic pop
+#endif
+#endif
+
+struct AsyncWriter::Impl {
+  Options options;
+  Backend backend;
+  std::ofstream stream;
+  bool open = false;
+  std::atomic_bool failed = false;
+#ifndef _WIN32
+  int fd = -1;
+  bool direct = false;
+#endif
+
+  struct Slab {
+    char *data = nullptr;
+    size_t size = 0;
+    size_t written = 0;
+    uint64_t offset = 0;
+    std::chrono::steady_clock::time_point submitted;
+  };
+  std::vector<Slab> slabs;
+  std::vector<size_t> free_slabs;
+  std::optional<size_t> current;
+  uint64_t file_offset = 0;
+  size_t in_flight = 0;
+  std::chrono::steady_clock::time_point last_sync;
+
+  std::mutex mutex;
+  std::condition_variable condition;
+  std::deque<size_t> pending;
+  bool closing = false;
+  std::thread thread;
+
+#ifdef __linux__
+  Ring ring;
+  bool sync_in_flight = false;
+  static constexpr uint64_t SYNC_TAG = std::numeric_limits<uint64_t>::max();
+#endif
+
+  std::atomic_uint64_t total_latency_ns = 0;
+  std::atomic_uint64_t max_latency_ns = 0;
+  std::atomic_uint64_t completed = 0;
+  std::atomic_size_t max_queue_depth = 0;
+  std::atomic_size_t stalls = 0;
+
+  Impl(const std::filesystem::path &path, const Options &_options)
+      : options(_options), backend(_options.backend) {
+    options.slab_count = std::max(options.slab_count, size_t(2));
+    options.slab_size =
+        std::max((options.slab_size + SLAB_ALIGNMENT - 1) / SLAB_ALIGNMENT *
+                     SLAB_ALIGNMENT,
+                 SLAB_ALIGNMENT);
+#ifdef _WIN32
+    backend = Backend::STREAM;
+#endif
+    if (backend == Backend::STREAM) {
+      stream = std::ofstream(path, std::ios::trunc | std::ios::binary);
+      open = stream.is_open();
+      return;
+    }
+
+#ifndef _WIN32
+    auto flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef __linux__
+    if (options.direct) {
+      fd = ::open(path.string().c_str(), flags | O_DIRECT, 0644);
+      direct = fd >= 0;
+      if (!direct) {
+        THALAMUS_LOG(warning) << "O_DIRECT not supported for " << path.string()
+                              << ", using buffered writes: " << strerror(errno);
+      }
+    }
+#endif
+    if (fd < 0) {
+      fd = ::open(path.string().c_str(), flags, 0644);
+    }
+    if (fd < 0) {
+      THALAMUS_LOG(error) << "Failed to open " << path.string() << ": "
+                          << strerror(errno);
+      return;
+    }
+#ifdef __APPLE__
+    if (options.direct) {
+      fcntl(fd, F_NOCACHE, 1);
+    }
+#endif
+    open = true;
+
+    for (size_t i = 0; i < options.slab_count; ++i) {
+      void *data = nullptr;
+      auto error = posix_memalign(&data, SLAB_ALIGNMENT, options.slab_size);
+      THALAMUS_ASSERT(error == 0, "posix_memalign failed: %d", error);
+      slabs.emplace_back().data = static_cast<char *>(data);
+      free_slabs.push_back(i);
+    }
+    last_sync = std::chrono::steady_clock::now();
+
+#ifdef __linux__
+    if (backend == Backend::IO_URING &&
+        !ring.setup(unsigned(options.slab_count + 1))) {
+      THALAMUS_LOG(warning) << "io_uring unavailable, writing from a thread";
+      backend = Backend::THREAD;
+    }
+#else
+    backend = Backend::THREAD;
+#endif
+    if (backend == Backend::THREAD) {
+      thread = std::thread([this] { thread_target(); });
+    }
+#endif
+  }
+
+  ~Impl() {
+    close();
+    for (auto &slab : slabs) {
+      free(slab.data);
+    }
+  }
+
+  void record_completion(Slab &slab) {
+    auto latency = std::chrono::steady_clock::now() - slab.submitted;
+    auto latency_ns = uint64_t(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count());
+    total_latency_ns += latency_ns;
+    ++completed;
+    auto previous = max_latency_ns.load();
+    while (previous < latency_ns &&
+           !max_latency_ns.compare_exchange_weak(previous, latency_ns)) {
+    }
+  }
+
+  void log_failure() {
+    if (!failed.exchange(true)) {
+#ifndef _WIN32
+      THALAMUS_LOG(error) << "Write failed: " << strerror(errno);
+#else
+      THALAMUS_LOG(error) << "Write failed";
+#endif
+    }
+  }
+
+#ifndef _WIN32
+  bool sync_due() {
+    if (options.sync_interval == 0ns) {
+      return false;
+    }
+    auto now = std::chrono::steady_clock::now();
+    if (now - last_sync < options.sync_interval) {
+      return false;
+    }
+    last_sync = now;
+    return true;
+  }
+
+  void thread_target() {
+    while (true) {
+      size_t index;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait(lock, [&] { return !pending.empty() || closing; });
+        if (pending.empty()) {
+          return;
+        }
+        index = pending.front();
+        pending.pop_front();
+      }
+      auto &slab = slabs[index];
+      if (!write_all(fd, slab.data, slab.size, slab.offset)) {
+        log_failure();
+      }
+      record_completion(slab);
+      if (sync_due()) {
+        sync_file(fd);
+      }
+      std::lock_guard<std::mutex> lock(mutex);
+      --in_flight;
+      free_slabs.push_back(index);
+      condition.notify_all();
+    }
+  }
+#endif
+
+#ifdef __linux__
+  bool submit_write(size_t index) {
+    auto &slab = slabs[index];
+    return ring.submit([&](io_uring_sqe *sqe) {
+      sqe->opcode = IORING_OP_WRITE;
+      sqe->fd = fd;
+      sqe->addr = reinterpret_cast<uint64_t>(slab.data + slab.written);
+      sqe->len = uint32_t(slab.size - slab.written);
+      sqe->off = slab.offset + slab.written;
+      sqe->user_data = index;
+    });
+  }
+
+  void reap(bool wait) {
+    ring.reap(wait, [&](uint64_t user_data, int result) {
+      if (user_data == SYNC_TAG) {
+        sync_in_flight = false;
+        return;
+      }
+      auto &slab = slabs[user_data];
+      if (result < 0) {
+        errno = -result;
+        log_failure();
+      } else {
+        slab.written += size_t(result);
+        if (slab.written < slab.size) {
+          if (result > 0 && submit_write(size_t(user_data))) {
+            return;
+          }
+          // A write that makes no progress would otherwise leave the file
+          // silently truncated.
+          if (result == 0) {
+            errno = EIO;
+          }
+          log_failure();
+        }
+      }
+      record_completion(slab);
+      --in_flight;
+      free_slabs.push_back(size_t(user_data));
+    });
+  }
+#endif
+
+  size_t acquire() {
+#ifdef __linux__
+    if (backend == Backend::IO_URING) {
+      reap(false);
+      if (free_slabs.empty()) {
+        ++stalls;
+        while (free_slabs.empty()) {
+          reap(true);
+        }
+      }
+      auto index = free_slabs.back();
+      free_slabs.pop_back();
+      return index;
+    }
+#endif
+    std::unique_lock<std::mutex> lock(mutex);
+    if (free_slabs.empty()) {
+      ++stalls;
+      condition.wait(lock, [&] { return !free_slabs.empty(); });
+    }
+    auto index = free_slabs.back();
+    free_slabs.pop_back();
+    return index;
+  }
+
+  void submit(size_t index) {
+    auto &slab = slabs[index];
+    slab.offset = file_offset;
+    slab.written = 0;
+    slab.submitted = std::chrono::steady_clock::now();
+    file_offset += slab.size;
+
+    size_t depth;
+#ifdef __linux__
+    if (backend == Backend::IO_URING) {
+      depth = ++in_flight;
+      if (!submit_write(index)) {
+        log_failure();
+        --in_flight;
+        free_slabs.push_back(index);
+      }
+      // IO_DRAIN holds the sync back until every write before it completes.
+      if (!sync_in_flight && sync_due()) {
+        sync_in_flight = ring.submit([&](io_uring_sqe *sqe) {
+          sqe->opcode = IORING_OP_FSYNC;
+          sqe->fd = fd;
+          sqe->flags = IOSQE_IO_DRAIN;
+          sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+          sqe->user_data = SYNC_TAG;
+        });
+      }
+    } else
+#endif
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      depth = ++in_flight;
+      pending.push_back(index);
+      condition.notify_all();
+    }
+    auto previous = max_queue_depth.load();
+    while (previous < depth &&
+           !max_queue_depth.compare_exchange_weak(previous, depth)) {
+    }
+  }
+
+  void write(const char *data, size_t size) {
+    if (!open) {
+      return;
+    }
+    if (backend == Backend::STREAM) {
+      auto start = std::chrono::steady_clock::now();
+      stream.write(data, int64_t(size));
+      if (!stream) {
+        log_failure();
+      }
+      Slab slab;
+      slab.submitted = start;
+      record_completion(slab);
+      return;
+    }
+
+    while (size > 0) {
+      if (!current) {
+        current = acquire();
+        slabs[*current].size = 0;
+      }
+      auto &slab = slabs[*current];
+      auto count = std::min(size, options.slab_size - slab.size);
+      std::memcpy(slab.data + slab.size, data, count);
+      slab.size += count;
+      data += count;
+      size -= count;
+      if (slab.size == options.slab_size) {
+        submit(*current);
+        current.reset();
+      }
+    }
+  }
+
+  void close() {
+    if (!open) {
+      return;
+    }
+    open = false;
+    if (backend == Backend::STREAM) {
+      // Buffered writes only fail once they are flushed
+      stream.close();
+      if (!stream) {
+        log_failure();
+      }
+      return;
+    }
+
+#ifndef _WIN32
+#ifdef __linux__
+    if (backend == Backend::IO_URING) {
+      while (in_flight > 0 || sync_in_flight) {
+        reap(true);
+      }
+    } else
+#endif
+    {
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait(lock, [&] { return in_flight == 0; });
+        closing = true;
+        condition.notify_all();
+      }
+      thread.join();
+    }
+
+    // The partial slab isn't block aligned so it can't go through O_DIRECT.
+    if (current) {
+      auto &slab = slabs[*current];
+#ifdef __linux__
+      if (direct) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+      }
+#endif
+      if (!write_all(fd, slab.data, slab.size, file_offset)) {
+        log_failure();
+      }
+      current.reset();
+    }
+    if (options.sync_interval > 0ns) {
+      sync_file(fd);
+    }
+    ::close(fd);
+    fd = -1;
+#endif
+  }
+
+  Stats stats() {
+    Stats result;
+    auto count = completed.exchange(0);
+    auto total = total_latency_ns.exchange(0);
+    result.average_latency =
+        std::chrono::nanoseconds(count ? total / count : 0);
+    result.max_latency = std::chrono::nanoseconds(max_latency_ns.exchange(0));
+    result.max_queue_depth = max_queue_depth.exchange(0);
+    result.stalls = stalls.exchange(0);
+    return result;
+  }
+};
+
+AsyncWriter::AsyncWriter(const std::filesystem::path &path,
+                         const Options &options)
+    : impl(new Impl(path, options)) {}
+AsyncWriter::~AsyncWriter() {}
+void AsyncWriter::write(const char *data, size_t size) {
+  impl->write(data, size);
+}
+void AsyncWriter::close() { impl->close(); }
+bool AsyncWriter::is_open() const { return impl->open; }
+bool AsyncWriter::failed() const { return impl->failed; }
+AsyncWriter::Backend AsyncWriter::backend() const { return impl->backend; }
+AsyncWriter::Stats AsyncWriter::stats() { return impl->stats(); }
+} // namespace thalamus
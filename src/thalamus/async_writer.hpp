@@ -0,0 +1,55 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <memory>
+
+namespace thalamus {
+/**
+ * Writes a file through a fixed set of aligned slabs that are handed to the
+ * kernel in the background.  A slow write, e.g. while the page cache flushes,
+ * holds on to slabs rather than blocking the caller, and the caller only waits
+ * once every slab is in flight.
+ *
+ * The STREAM backend is a plain std::ofstream written in the caller's thread.
+ * THREAD writes slabs with pwrite from a dedicated thread and IO_URING submits
+ * them to an io_uring.  IO_URING falls back to THREAD when the kernel doesn't
+ * support it, THREAD and IO_URING fall back to STREAM on Windows.
+ */
+struct AsyncWriter {
+  enum class Backend { STREAM, THREAD, IO_URING };
+  struct Options {
+    Backend backend = Backend::STREAM;
+    /** Bypass the page cache (O_DIRECT on Linux, F_NOCACHE on macOS). */
+    bool direct = false;
+    size_t slab_size = 4 << 20;
+    size_t slab_count = 4;
+    /** How often to fdatasync the file, zero disables syncing. */
+    std::chrono::nanoseconds sync_interval = std::chrono::nanoseconds(0);
+  };
+  /**
+   * Statistics since the previous call to stats().  Latency is measured from
+   * when a slab is submitted until the write completes.
+   */
+  struct Stats {
+    std::chrono::nanoseconds average_latency;
+    std::chrono::nanoseconds max_latency;
+    size_t max_queue_depth;
+    size_t stalls;
+  };
+
+  struct Impl;
+  std::unique_ptr<Impl> impl;
+
+  AsyncWriter(const std::filesystem::path &path, const Options &options);
+  ~AsyncWriter();
+  void write(const char *data, size_t size);
+  /** Writes out the partially filled slab and waits for all writes. */
+  void close();
+  bool is_open() const;
+  /** Whether any write has failed, failures are also logged once. */
+  bool failed() const;
+  Backend backend() const;
+  Stats stats();
+};
+} // namespace thalamus
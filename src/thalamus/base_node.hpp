@@ -2,6 +2,7 @@
 
 #include <chrono>
 #include <functional>
+#include <thalamus/signal.hpp>
 #include <thalamus/state.hpp>
 #include <string>
 #include <thalamus/util.hpp>
@@ -38,11 +39,12 @@ namespace thalamus {
 using namespace std::chrono_literals;
 class Service;
 class ThreadPool;
+class AnalogHistory;
 
 class Node : public std::enable_shared_from_this<Node> {
 public:
   virtual ~Node();
-  boost::signals2::signal<void(Node *)> ready;
+  Signal<void(Node *)> ready;
   std::optional<boost::signals2::signal<void(Node *)>> ready_multithreaded;
   virtual size_t modalities() const = 0;
   virtual boost::json::value process(const boost::json::value &) {
@@ -76,7 +78,18 @@ public:
   get_node_scoped(const thalamus_grpc::NodeSelector &,
                   std::function<void(std::weak_ptr<Node>)>) = 0;
   virtual Service &get_service() = 0;
+  /**
+   * The display name of a node type, null if the type doesn't exist or its
+   * prepare step fails.  Waits for the type to be prepared, so it must not be
+   * called from the io_context thread.
+   */
   virtual std::optional<std::string> get_type_name(const std::string &) = 0;
+  virtual thalamus_grpc::StartupReport get_startup_report() = 0;
+  /**
+   * The recent samples of an AnalogNode whose History (s) is set, otherwise
+   * null.  Must be called from the io_context thread.
+   */
+  virtual std::shared_ptr<AnalogHistory> get_analog_history(Node *) = 0;
   virtual std::shared_ptr<grpc::Channel> get_channel(const std::string &) = 0;
   virtual thalamus_grpc::Thalamus::Stub* get_thalamus_stub(const std::string &) = 0;
   virtual std::chrono::system_clock::time_point get_system_clock_at_start() = 0;
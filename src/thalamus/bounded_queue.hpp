@@ -0,0 +1,59 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+namespace thalamus {
+/**
+ * FIFO between pipeline stages running on different threads.  push blocks
+ * while the queue is full so a fast producer can't run arbitrarily far ahead
+ * of its consumer.  Once closed, pop drains the remaining items and then
+ * returns nullopt.
+ */
+template <typename T> class BoundedQueue {
+  std::deque<T> items;
+  const size_t capacity;
+  bool closed = false;
+  std::mutex mutex;
+  std::condition_variable not_empty;
+  std::condition_variable not_full;
+
+public:
+  explicit BoundedQueue(size_t _capacity) : capacity(_capacity) {}
+
+  /**
+   * Returns false if the queue was closed, the item is dropped.
+   */
+  bool push(T &&item) {
+    std::unique_lock<std::mutex> lock(mutex);
+    not_full.wait(lock, [&] { return closed || items.size() < capacity; });
+    if (closed) {
+      return false;
+    }
+    items.push_back(std::move(item));
+    not_empty.notify_one();
+    return true;
+  }
+
+  std::optional<T> pop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    not_empty.wait(lock, [&] { return closed || !items.empty(); });
+    if (items.empty()) {
+      return std::nullopt;
+    }
+    auto result = std::move(items.front());
+    items.pop_front();
+    not_full.notify_one();
+    return result;
+  }
+
+  void close() {
+    std::lock_guard<std::mutex> lock(mutex);
+    closed = true;
+    not_empty.notify_all();
+    not_full.notify_all();
+  }
+};
+} // namespace thalamus
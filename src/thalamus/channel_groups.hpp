@@ -0,0 +1,133 @@
+#pragma once
+
+#include <thalamus/analog_node.hpp>
+#include <chrono>
+#include <map>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace thalamus {
+/**
+ * An analog frame's channels grouped by sample interval, each group with a
+ * Processor, such as FilterBank, that handles all of its channels at once.
+ * Processor needs resize, get_state and set_state.
+ */
+template <typename Processor> struct ChannelGroups {
+  struct Group {
+    std::chrono::nanoseconds sample_interval;
+    Processor processor;
+    std::vector<size_t> channels;
+    std::vector<std::span<const double>> input;
+    std::vector<std::span<double>> output;
+  };
+
+  std::vector<Group> groups;
+  std::vector<std::string> names;
+  std::vector<std::chrono::nanoseconds> sample_intervals;
+  // The index each channel had before the last rebuild if it kept its state
+  std::vector<std::optional<size_t>> previous;
+  // Every channel's samples as doubles after convert
+  std::vector<std::span<const double>> input;
+  uint64_t version = 0;
+
+private:
+  std::vector<std::vector<double>> converted;
+
+public:
+  /**
+   * Regroups the channels if frame's layout changed or redesign is set, and
+   * returns whether it did.  Each group's Processor comes from
+   * make(sample_interval).  Channels that keep their name and sample
+   * interval keep their state unless redesign is set.
+   */
+  template <typename Make>
+  bool update(const AnalogFrame &frame, bool redesign, Make make) {
+    if (!redesign && frame.version == version) {
+      return false;
+    }
+    using Key = std::pair<std::string, std::chrono::nanoseconds>;
+    std::map<Key, std::pair<size_t, std::vector<double>>> kept;
+    if (!redesign) {
+      for (auto &group : groups) {
+        for (size_t i = 0; i < group.channels.size(); ++i) {
+          auto c = group.channels[i];
+          kept[{names[c], group.sample_interval}] = {
+              c, group.processor.get_state(i)};
+        }
+      }
+    }
+
+    auto count = size_t(frame.num_channels());
+    std::map<std::chrono::nanoseconds, size_t> group_indices;
+    groups.clear();
+    names.assign(frame.names.begin(), frame.names.end());
+    sample_intervals.assign(frame.sample_intervals.begin(),
+                            frame.sample_intervals.end());
+    previous.assign(count, std::nullopt);
+    for (size_t c = 0; c < count; ++c) {
+      auto sample_interval = sample_intervals[c];
+      auto i = group_indices.find(sample_interval);
+      if (i == group_indices.end()) {
+        i = group_indices.emplace(sample_interval, groups.size()).first;
+        groups.push_back(Group{sample_interval, make(sample_interval), {},
+                               {}, {}});
+      }
+      groups[i->second].channels.push_back(c);
+    }
+
+    for (auto &group : groups) {
+      group.processor.resize(group.channels.size());
+      group.input.resize(group.channels.size());
+      group.output.resize(group.channels.size());
+      for (size_t i = 0; i < group.channels.size(); ++i) {
+        auto c = group.channels[i];
+        auto channel_state = kept.find({names[c], group.sample_interval});
+        if (channel_state != kept.end()) {
+          group.processor.set_state(i, channel_state->second.second);
+          previous[c] = channel_state->second.first;
+        }
+      }
+    }
+
+    version = frame.version;
+    return true;
+  }
+
+  /**
+   * Points input and every group's input at frame's samples, scaled and
+   * offset into doubles unless they already are.
+   */
+  void convert(const AnalogFrame &frame) {
+    auto count = size_t(frame.num_channels());
+    input.resize(count);
+    converted.resize(count);
+    visit_frame(frame, [&](auto wrapper) {
+      using T = typename std::remove_pointer_t<decltype(wrapper)>::value_type;
+      for (size_t c = 0; c < count; ++c) {
+        auto span = wrapper->data(int(c));
+        if constexpr (std::is_same<T, double>::value) {
+          if (!frame.is_transformed) {
+            input[c] = span;
+            continue;
+          }
+        }
+        auto scale = frame.is_transformed ? frame.scales[c] : 1.0;
+        auto offset = frame.is_transformed ? frame.offsets[c] : 0.0;
+        auto &values = converted[c];
+        values.resize(span.size());
+        for (size_t i = 0; i < span.size(); ++i) {
+          values[i] = double(span[i]) * scale + offset;
+        }
+        input[c] = values;
+      }
+    });
+    for (auto &group : groups) {
+      for (size_t i = 0; i < group.channels.size(); ++i) {
+        group.input[i] = input[group.channels[i]];
+      }
+    }
+  }
+};
+} // namespace thalamus
@@ -6,8 +6,8 @@ namespace thalamus {
 struct ChannelPickerNode::Impl {
   ObservableDictPtr state;
   boost::signals2::scoped_connection state_connection;
-  std::map<std::string, std::pair<boost::signals2::scoped_connection,
-                                  boost::signals2::scoped_connection>>
+  std::map<std::string, std::pair<ScopedConnection,
+                                  ScopedConnection>>
       sources_connections;
   boost::signals2::scoped_connection channels_connection;
   size_t buffer_size;
@@ -50,6 +50,30 @@ public:
   std::vector<std::string> recommended_channels;
   std::set<AnalogNode *> names_collected;
   AnalogNode *current_node;
+  AnalogFrameBuilder frame;
+
+  /**
+   * Resolves every output channel against the source that just became ready
+   * once, rather than on every data call of every consumer.
+   */
+  void build_frame(const std::weak_ptr<AnalogNode> &source) {
+    auto &input = current_node->frame();
+    auto count = size_t(outer->num_channels());
+    frame.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+      auto &[node, in_channel, name, sample_interval] = mappings[i];
+      std::span<const double> data;
+      auto is_source = !node.owner_before(source) && !source.owner_before(node);
+      if (is_source && in_channel < input.num_channels()) {
+        data = input.type == AnalogFrame::Type::DOUBLE
+                   ? input.data<double>(in_channel)
+                   : current_node->data(in_channel);
+      }
+      frame.set_data(i, data);
+      frame.set_layout(i, name, sample_interval);
+    }
+    frame.finish(input.time, input.remote_time);
+  }
 
   void on_source_mapping_change(std::weak_ptr<AnalogNode> node,
                                 int64_t in_channel,
@@ -163,6 +187,7 @@ public:
                   names_collected.insert(current_node);
                 }
               }
+              build_frame(weak_analog);
               outer->ready(outer);
             });
       });
@@ -250,6 +275,10 @@ void ChannelPickerNode::inject(
 
 bool ChannelPickerNode::has_analog_data() const { return true; }
 
+const AnalogFrame &ChannelPickerNode::frame() const {
+  return impl->frame.get();
+}
+
 size_t ChannelPickerNode::modalities() const {
   return infer_modalities<ChannelPickerNode>();
 }
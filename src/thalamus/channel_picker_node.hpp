@@ -25,6 +25,7 @@ public:
          const thalamus::vector<std::chrono::nanoseconds> &sample_intervals,
          const thalamus::vector<std::string_view> &) override;
   bool has_analog_data() const override;
+  const AnalogFrame &frame() const override;
   size_t modalities() const override;
 };
 } // namespace thalamus
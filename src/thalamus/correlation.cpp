@@ -0,0 +1,115 @@
+#include <thalamus/correlation.hpp>
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <numbers>
+#include <thalamus/assert.hpp>
+
+namespace thalamus {
+void fft(std::span<std::complex<double>> data, bool inverse) {
+  auto size = data.size();
+  THALAMUS_ASSERT(std::has_single_bit(size) || size == 0,
+                  "FFT size must be a power of 2");
+  if (size < 2) {
+    return;
+  }
+
+  for (size_t i = 1, j = 0; i < size; ++i) {
+    auto bit = size >> 1;
+    for (; j & bit; bit >>= 1) {
+      j ^= bit;
+    }
+    j ^= bit;
+    if (i < j) {
+      std::swap(data[i], data[j]);
+    }
+  }
+
+  // Twiddles for the largest stage, smaller stages stride through them
+  auto sign = inverse ? 1.0 : -1.0;
+  std::vector<std::complex<double>> twiddles(size / 2);
+  for (size_t k = 0; k < size / 2; ++k) {
+    twiddles[k] = std::polar(1.0, sign * 2 * std::numbers::pi * double(k) /
+                                      double(size));
+  }
+  for (size_t length = 2; length <= size; length <<= 1) {
+    auto half = length / 2;
+    auto stride = size / length;
+    for (size_t start = 0; start < size; start += length) {
+      for (size_t k = 0; k < half; ++k) {
+        auto even = data[start + k];
+        auto odd = data[start + k + half] * twiddles[k * stride];
+        data[start + k] = even + odd;
+        data[start + k + half] = even - odd;
+      }
+    }
+  }
+}
+
+std::vector<double> cross_correlate(std::span<const double> data1,
+                                    std::span<const double> data2) {
+  if (data1.empty() || data2.empty()) {
+    return {};
+  }
+  auto lags = data1.size() + data2.size() - 1;
+  auto size = std::bit_ceil(lags);
+
+  // Both real signals go through one complex transform, data1 as the real
+  // part and data2 as the imaginary part, and are separated by symmetry.
+  std::vector<std::complex<double>> z(size);
+  for (size_t n = 0; n < data1.size(); ++n) {
+    z[n].real(data1[n]);
+  }
+  for (size_t n = 0; n < data2.size(); ++n) {
+    z[n].imag(data2[n]);
+  }
+  fft(z, false);
+
+  std::vector<std::complex<double>> product(size);
+  for (size_t k = 0; k < size; ++k) {
+    auto forward = z[k];
+    auto mirrored = std::conj(z[(size - k) % size]);
+    auto transform1 = (forward + mirrored) / 2.0;
+    auto transform2 = (forward - mirrored) / std::complex<double>(0, 2);
+    product[k] = transform1 * std::conj(transform2);
+  }
+  fft(product, true);
+
+  // Negative lags wrap around to the end
+  std::vector<double> result(lags);
+  auto scale = 1 / double(size);
+  for (size_t i = 0; i < lags; ++i) {
+    auto lag = int64_t(i) - int64_t(data2.size() - 1);
+    auto index = lag < 0 ? size_t(int64_t(size) + lag) : size_t(lag);
+    result[i] = product[index].real() * scale;
+  }
+  return result;
+}
+
+CorrelationPeak find_correlation_peak(std::span<const double> data1,
+                                      std::span<const double> data2) {
+  auto correlation = cross_correlate(data1, data2);
+  auto zero = int64_t(data2.size()) - 1;
+  auto max = 0.0;
+  auto max_index = zero;
+  for (size_t i = 0; i < correlation.size(); ++i) {
+    if (correlation[i] > max) {
+      max = correlation[i];
+      max_index = int64_t(i);
+    }
+  }
+
+  CorrelationPeak result{double(max_index - zero), max};
+  if (max_index > 0 && size_t(max_index) + 1 < correlation.size()) {
+    auto before = correlation[size_t(max_index) - 1];
+    auto after = correlation[size_t(max_index) + 1];
+    auto curvature = before - 2 * max + after;
+    if (curvature < 0) {
+      auto offset = (before - after) / (2 * curvature);
+      result.lag += std::clamp(offset, -0.5, 0.5);
+    }
+  }
+  return result;
+}
+} // namespace thalamus
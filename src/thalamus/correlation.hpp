@@ -0,0 +1,38 @@
+#pragma once
+
+#include <complex>
+#include <span>
+#include <vector>
+
+namespace thalamus {
+/**
+ * Transforms data in place with an iterative radix 2 FFT, data's size must be
+ * a power of 2.  The inverse transform isn't scaled by 1/size.
+ */
+void fft(std::span<std::complex<double>> data, bool inverse);
+
+/**
+ * The cross correlation sum over n of data1[n + lag]*data2[n] for every lag
+ * from -(data2.size() - 1) to data1.size() - 1, at index lag + data2.size() -
+ * 1.  Computed with one forward and one inverse FFT of the next power of 2
+ * that holds every lag, so it is O(N log N) rather than O(N^2).
+ */
+std::vector<double> cross_correlate(std::span<const double> data1,
+                                    std::span<const double> data2);
+
+struct CorrelationPeak {
+  // The lag in samples, refined to a fraction of a sample
+  double lag;
+  // The correlation at the whole sample lag
+  double value;
+};
+
+/**
+ * Finds the lag of data1 relative to data2 where their cross correlation
+ * peaks.  The first, most negative, of equal peaks wins and a correlation
+ * that is never positive peaks at lag 0.  The whole sample peak is refined by
+ * fitting a parabola through it and its neighbours.
+ */
+CorrelationPeak find_correlation_peak(std::span<const double> data1,
+                                      std::span<const double> data2);
+} // namespace thalamus
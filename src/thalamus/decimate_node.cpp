@@ -0,0 +1,225 @@
+#include <thalamus/decimate_node.hpp>
+#include <vector>
+#include <thalamus/channel_groups.hpp>
+#include <thalamus/decimator.hpp>
+#include <thalamus/filter.hpp>
+#include <thalamus/modalities_util.hpp>
+
+namespace thalamus {
+struct DecimateNode::Impl {
+  ObservableDictPtr state;
+  boost::signals2::scoped_connection state_connection;
+  DecimateNode *outer;
+  NodeGraph *graph;
+
+  size_t ratio = 30;
+  double passband = 300;
+  size_t taps = 0;
+
+  bool redesign = true;
+  ChannelGroups<Decimator> channels;
+  std::vector<std::chrono::nanoseconds> delays;
+  std::vector<std::vector<double>> data;
+  bool has_data = false;
+
+public:
+  Impl(ObservableDictPtr _state, boost::asio::io_context &, NodeGraph *_graph,
+       DecimateNode *_outer)
+      : state(_state), outer(_outer), graph(_graph) {
+    state_connection =
+        state->changed.connect(std::bind(&Impl::on_change, this, _1, _2, _3));
+    state->recap(std::bind(&Impl::on_change, this, _1, _2, _3));
+  }
+
+  ScopedConnection source_connection;
+  AnalogNode *source = nullptr;
+  AnalogFrameBuilder frame;
+
+  /**
+   * Designs a low pass filter that is flat up to the passband and reaches its
+   * stopband at the output's Nyquist frequency.  Without a tap count the
+   * length is chosen from the Hamming window's transition width, about
+   * 3.3/taps of the sample rate.
+   */
+  Decimator design(std::chrono::nanoseconds sample_interval) {
+    if (sample_interval <= 0ns || ratio == 1) {
+      return Decimator({1}, ratio);
+    }
+    auto sample_rate = 1e9 / double(sample_interval.count());
+    auto nyquist = sample_rate / double(ratio) / 2;
+    auto transition = nyquist - passband;
+    auto length = taps;
+    if (length == 0 && transition > 0) {
+      length = size_t(std::ceil(3.3 * sample_rate / transition)) | 1;
+    }
+    auto designed = transition > 0 && passband > 0
+                        ? design_fir(FilterBand::LOW_PASS, length,
+                                     (passband + nyquist) / 2, 0, sample_rate)
+                        : std::nullopt;
+    if (!designed) {
+      THALAMUS_LOG(warning)
+          << "Can't design a " << passband << "Hz passband for decimating "
+          << sample_rate << "Hz by " << ratio << ", decimating unfiltered";
+      return Decimator({1}, ratio);
+    }
+    return Decimator(*designed, ratio);
+  }
+
+  /**
+   * Lays out the decimated channels after the channels are regrouped.
+   */
+  void rebuild() {
+    auto count = channels.names.size();
+    delays.resize(count);
+    frame.resize(count);
+    for (auto &group : channels.groups) {
+      for (auto c : group.channels) {
+        frame.set_layout(c, channels.names[c],
+                         int64_t(ratio) * group.sample_interval);
+        delays[c] = std::chrono::nanoseconds(int64_t(
+            group.processor.delay() * double(group.sample_interval.count())));
+      }
+    }
+
+    // Reports the longest delay, channels at one sample rate share theirs
+    auto longest = std::max_element(delays.begin(), delays.end());
+    auto delay = longest == delays.end() ? 0ns : *longest;
+    (*state)["Delay (ms)"].assign(double(delay.count()) / 1e6);
+  }
+
+  void on_ready(Node *) {
+    if (!source->has_analog_data()) {
+      return;
+    }
+    auto &source_frame = source->frame();
+    if (channels.update(source_frame, redesign,
+                        std::bind(&Impl::design, this, _1))) {
+      redesign = false;
+      rebuild();
+    }
+
+    auto count = size_t(source_frame.num_channels());
+    channels.convert(source_frame);
+    data.resize(count);
+
+    // The output is as old as the newest kept sample of any channel
+    has_data = false;
+    auto time = std::chrono::nanoseconds::min();
+    for (auto &group : channels.groups) {
+      for (size_t i = 0; i < group.channels.size(); ++i) {
+        auto c = group.channels[i];
+        auto samples = channels.input[c].size();
+        auto outputs = group.processor.outputs(i, samples);
+        data[c].resize(outputs);
+        group.output[i] = data[c];
+        if (outputs) {
+          auto last = group.processor.skip(i) + (outputs - 1) * ratio;
+          time = std::max(time, source_frame.time -
+                                    int64_t(samples - 1 - last) *
+                                        group.sample_interval);
+          has_data = true;
+        }
+      }
+      group.processor.process(group.input, group.output);
+    }
+    if (!has_data) {
+      return;
+    }
+
+    for (size_t c = 0; c < count; ++c) {
+      frame.set_data(c, std::span<const double>(data[c]));
+    }
+    frame.finish(time, source_frame.remote_time);
+    outer->ready(outer);
+  }
+
+  void on_change(ObservableCollection::Action,
+                 const ObservableCollection::Key &k,
+                 const ObservableCollection::Value &v) {
+    auto key_str = std::get<std::string>(k);
+    auto number = [&] {
+      return std::holds_alternative<int64_t>(v) ? double(std::get<int64_t>(v))
+                                                : std::get<double>(v);
+    };
+    if (key_str == "Ratio") {
+      ratio = size_t(std::max(number(), 1.0));
+      redesign = true;
+    } else if (key_str == "Passband (Hz)") {
+      passband = number();
+      redesign = true;
+    } else if (key_str == "Taps") {
+      taps = size_t(std::max(number(), 0.0));
+      redesign = true;
+    } else if (key_str == "Source") {
+      auto value_str = std::get<std::string>(v);
+      absl::StripAsciiWhitespace(&value_str);
+      graph->get_node(value_str, [&](auto node) {
+        auto locked = node.lock();
+        if (!locked) {
+          return;
+        }
+        source = std::dynamic_pointer_cast<AnalogNode>(locked).get();
+        if (!source) {
+          return;
+        }
+        redesign = true;
+        source_connection =
+            locked->ready.connect(std::bind(&Impl::on_ready, this, _1));
+      });
+    }
+  }
+};
+
+DecimateNode::DecimateNode(ObservableDictPtr state,
+                           boost::asio::io_context &io_context,
+                           NodeGraph *graph)
+    : impl(new Impl(state, io_context, graph, this)) {}
+
+DecimateNode::~DecimateNode() {}
+
+std::string DecimateNode::type_name() { return "DECIMATE"; }
+
+std::chrono::nanoseconds DecimateNode::time() const {
+  return impl->frame.get().time;
+}
+
+std::span<const double> DecimateNode::data(int channel) const {
+  auto &data = impl->data.at(size_t(channel));
+  return std::span<const double>(data.begin(), data.end());
+}
+
+int DecimateNode::num_channels() const {
+  return impl->frame.get().num_channels();
+}
+
+std::string_view DecimateNode::name(int channel) const {
+  return impl->frame.get().names[size_t(channel)];
+}
+
+std::span<const std::string> DecimateNode::get_recommended_channels() const {
+  return impl->source ? impl->source->get_recommended_channels()
+                      : std::span<const std::string>();
+}
+
+std::chrono::nanoseconds DecimateNode::sample_interval(int channel) const {
+  return impl->frame.get().sample_intervals[size_t(channel)];
+}
+
+void DecimateNode::inject(const thalamus::vector<std::span<double const>> &,
+                          const thalamus::vector<std::chrono::nanoseconds> &,
+                          const thalamus::vector<std::string_view> &) {
+  THALAMUS_ASSERT(false, "Unimplemented");
+}
+
+bool DecimateNode::has_analog_data() const { return impl->has_data; }
+
+const AnalogFrame &DecimateNode::frame() const { return impl->frame.get(); }
+
+size_t DecimateNode::modalities() const {
+  return infer_modalities<DecimateNode>();
+}
+
+std::chrono::nanoseconds DecimateNode::delay(int channel) const {
+  return impl->delays.at(size_t(channel));
+}
+} // namespace thalamus
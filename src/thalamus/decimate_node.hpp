@@ -0,0 +1,44 @@
+#pragma once
+
+#include <thalamus/analog_node.hpp>
+#include <thalamus/base_node.hpp>
+#include <thalamus/state.hpp>
+#include <string>
+
+namespace thalamus {
+/**
+ * Low pass filters and downsamples every channel of an AnalogNode, see
+ * Decimator.  Its channels have the source's names and a sample interval
+ * ratio times longer.
+ */
+class DecimateNode : public Node, public AnalogNode {
+  struct Impl;
+  std::unique_ptr<Impl> impl;
+
+public:
+  DecimateNode(ObservableDictPtr state, boost::asio::io_context &io_context,
+               NodeGraph *);
+  ~DecimateNode() override;
+  static std::string type_name();
+  std::chrono::nanoseconds time() const override;
+  std::span<const double> data(int channel) const override;
+  int num_channels() const override;
+  std::string_view name(int channel) const override;
+  std::span<const std::string> get_recommended_channels() const override;
+  std::chrono::nanoseconds sample_interval(int i) const override;
+  void
+  inject(const thalamus::vector<std::span<double const>> &spans,
+         const thalamus::vector<std::chrono::nanoseconds> &sample_intervals,
+         const thalamus::vector<std::string_view> &) override;
+  bool has_analog_data() const override;
+  const AnalogFrame &frame() const override;
+  size_t modalities() const override;
+
+  /**
+   * How far the channel's output lags the source because of the anti-aliasing
+   * filter.  Output times are when a sample was computed, the signal it holds
+   * is from this much earlier.
+   */
+  std::chrono::nanoseconds delay(int channel) const;
+};
+} // namespace thalamus
@@ -0,0 +1,203 @@
+#include <thalamus/decimator.hpp>
+
+#include <algorithm>
+#include <thalamus/assert.hpp>
+
+namespace thalamus {
+Decimator::Decimator(std::vector<double> _taps, size_t _ratio)
+    : taps(std::move(_taps)), ratio(std::max(_ratio, size_t(1))) {
+  THALAMUS_ASSERT(!taps.empty(), "Decimator needs at least one tap");
+}
+
+size_t Decimator::history_size() const { return taps.size() - 1; }
+
+void Decimator::resize(size_t count) {
+  auto blocks = (count + LANES - 1) / LANES;
+  history.resize(blocks * history_size() * LANES);
+  skips.resize(blocks * LANES);
+  for (auto c = std::min(channels, count); c < blocks * LANES; ++c) {
+    set_state(c, std::vector<double>(history_size() + 1));
+  }
+  channels = count;
+}
+
+size_t Decimator::num_channels() const { return channels; }
+
+size_t Decimator::skip(size_t channel) const { return skips[channel]; }
+
+size_t Decimator::outputs(size_t channel, size_t count) const {
+  auto next = skips[channel];
+  return count > next ? (count - next - 1) / ratio + 1 : 0;
+}
+
+double Decimator::delay() const { return double(history_size()) / 2; }
+
+std::vector<double> Decimator::get_state(size_t channel) const {
+  auto block = channel / LANES;
+  auto lane = channel % LANES;
+  std::vector<double> result;
+  auto saved = history.data() + block * history_size() * LANES;
+  for (size_t i = 0; i < history_size(); ++i) {
+    result.push_back(saved[i * LANES + lane]);
+  }
+  result.push_back(double(skips[channel]));
+  return result;
+}
+
+void Decimator::set_state(size_t channel, std::span<const double> state) {
+  THALAMUS_ASSERT(state.size() == history_size() + 1,
+                  "Decimator state doesn't match the design");
+  auto block = channel / LANES;
+  auto lane = channel % LANES;
+  auto saved = history.data() + block * history_size() * LANES;
+  for (size_t i = 0; i < history_size(); ++i) {
+    saved[i * LANES + lane] = state[i];
+  }
+  skips[channel] = size_t(state.back()) % ratio;
+}
+
+void Decimator::process(std::span<const std::span<const double>> input,
+                        std::span<const std::span<double>> result) {
+  THALAMUS_ASSERT(input.size() == result.size(),
+                  "Decimator input and result channels differ");
+  if (input.size() != channels) {
+    resize(input.size());
+  }
+  for (size_t first = 0, block = 0; first < channels;
+       first += LANES, ++block) {
+    auto count = std::min(LANES, channels - first);
+    auto block_input = input.subspan(first, count);
+    auto block_result = result.subspan(first, count);
+    auto size = block_input.front().size();
+    auto uniform = true;
+    for (size_t lane = 0; lane < count; ++lane) {
+      THALAMUS_ASSERT(block_result[lane].size() ==
+                          outputs(first + lane, block_input[lane].size()),
+                      "Decimator result has the wrong size");
+      uniform = uniform && block_input[lane].size() == size &&
+                skips[first + lane] == skips[first];
+    }
+    if (uniform) {
+      process_block(block, count, block_input, block_result);
+    } else {
+      for (size_t lane = 0; lane < count; ++lane) {
+        process_lane(block, lane, block_input[lane], block_result[lane]);
+      }
+    }
+  }
+}
+
+void Decimator::process_block(size_t block, size_t count,
+                              std::span<const std::span<const double>> input,
+                              std::span<const std::span<double>> result) {
+  auto samples = input.front().size();
+  if (samples == 0) {
+    return;
+  }
+
+  // The history followed by the new samples, interleaved
+  auto hist = history_size();
+  buffer.resize((hist + samples) * LANES);
+  auto saved = history.data() + block * hist * LANES;
+  std::copy(saved, saved + hist * LANES, buffer.begin());
+  auto x = buffer.data() + hist * LANES;
+  for (size_t lane = 0; lane < LANES; ++lane) {
+    if (lane < count) {
+      auto channel = input[lane];
+      for (size_t i = 0; i < samples; ++i) {
+        x[i * LANES + lane] = channel[i];
+      }
+    } else {
+      for (size_t i = 0; i < samples; ++i) {
+        x[i * LANES + lane] = 0;
+      }
+    }
+  }
+
+  // Two kept samples at a time, so each tap is loaded once for both
+  auto first_channel = block * LANES;
+  auto next = skips[first_channel];
+  auto kept = outputs(first_channel, samples);
+  auto num_taps = taps.size();
+  auto coefficients = taps.data();
+  size_t j = 0;
+  for (; j + 1 < kept; j += 2) {
+    double first[LANES] = {};
+    double second[LANES] = {};
+    auto newest = x + (next + j * ratio) * LANES;
+    auto after = newest + ratio * LANES;
+    for (size_t k = 0; k < num_taps; ++k) {
+      auto row = newest - k * LANES;
+      auto later = after - k * LANES;
+      auto tap = coefficients[k];
+      for (size_t lane = 0; lane < LANES; ++lane) {
+        first[lane] += tap * row[lane];
+        second[lane] += tap * later[lane];
+      }
+    }
+    for (size_t lane = 0; lane < count; ++lane) {
+      result[lane][j] = first[lane];
+      result[lane][j + 1] = second[lane];
+    }
+  }
+  if (j < kept) {
+    double last[LANES] = {};
+    auto newest = x + (next + j * ratio) * LANES;
+    for (size_t k = 0; k < num_taps; ++k) {
+      auto row = newest - k * LANES;
+      auto tap = coefficients[k];
+      for (size_t lane = 0; lane < LANES; ++lane) {
+        last[lane] += tap * row[lane];
+      }
+    }
+    for (size_t lane = 0; lane < count; ++lane) {
+      result[lane][j] = last[lane];
+    }
+  }
+
+  auto remaining = buffer.begin() + int64_t(samples * LANES);
+  std::copy(remaining, remaining + int64_t(hist * LANES), saved);
+  auto after = kept ? (next + (kept - 1) * ratio + ratio) - samples
+                    : next - samples;
+  for (size_t lane = 0; lane < count; ++lane) {
+    skips[first_channel + lane] = after;
+  }
+}
+
+void Decimator::process_lane(size_t block, size_t lane,
+                             std::span<const double> input,
+                             std::span<double> result) {
+  auto samples = input.size();
+  if (samples == 0) {
+    return;
+  }
+
+  // The lane's history followed by the new samples
+  auto hist = history_size();
+  auto channel = block * LANES + lane;
+  auto saved = history.data() + block * hist * LANES + lane;
+  buffer.resize(hist + samples);
+  for (size_t i = 0; i < hist; ++i) {
+    buffer[i] = saved[i * LANES];
+  }
+  std::copy(input.begin(), input.end(), buffer.begin() + int64_t(hist));
+
+  auto x = buffer.data() + hist;
+  auto next = skips[channel];
+  auto kept = outputs(channel, samples);
+  for (size_t j = 0; j < kept; ++j) {
+    auto newest = x + next + j * ratio;
+    double sum = 0;
+    for (size_t k = 0; k < taps.size(); ++k) {
+      sum += taps[k] * *(newest - k);
+    }
+    result[j] = sum;
+  }
+
+  for (size_t i = 0; i < hist; ++i) {
+    saved[i * LANES] = buffer[samples + i];
+  }
+  skips[channel] = kept ? (next + (kept - 1) * ratio + ratio) - samples
+                        : next - samples;
+}
+} // namespace thalamus
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <span>
+#include <vector>
+
+namespace thalamus {
+/**
+ * Low pass filters and downsamples many channels that share a sample rate,
+ * keeping every channel's state between calls.
+ *
+ * The FIR filter is only evaluated at the samples that are kept, which is
+ * the polyphase form of the decimator: each output sums every phase of the
+ * filter against its own subsequence of the input, and nothing is computed
+ * for the ratio - 1 samples in between.  The kept samples are every ratio'th
+ * sample starting from the first a channel receives, wherever the calls
+ * split the input.
+ *
+ * Channels are processed in blocks of LANES with interleaved samples like
+ * FilterBank.  Blocks whose channels received different numbers of samples,
+ * or are at different phases, are decimated one channel at a time with the
+ * same state.
+ */
+class Decimator {
+public:
+  static constexpr size_t LANES = 8;
+
+private:
+  std::vector<double> taps;
+  size_t ratio;
+  size_t channels = 0;
+  // The last taps.size() - 1 inputs of every block, oldest first,
+  // interleaved.
+  std::vector<double> history;
+  // How many inputs each channel skips before its next kept sample
+  std::vector<size_t> skips;
+  std::vector<double> buffer;
+
+  size_t history_size() const;
+  void process_block(size_t block, size_t count,
+                     std::span<const std::span<const double>> input,
+                     std::span<const std::span<double>> result);
+  void process_lane(size_t block, size_t lane, std::span<const double> input,
+                    std::span<double> result);
+
+public:
+  /**
+   * Decimates by ratio after filtering with taps, which must not be empty.
+   */
+  Decimator(std::vector<double> taps, size_t ratio);
+
+  /**
+   * Changes the number of channels, new channels start at rest.
+   */
+  void resize(size_t channels);
+  size_t num_channels() const;
+
+  /**
+   * How many inputs the channel skips before its next kept sample.
+   */
+  size_t skip(size_t channel) const;
+
+  /**
+   * How many samples the channel produces from count more inputs.
+   */
+  size_t outputs(size_t channel, size_t count) const;
+
+  /**
+   * The filter's delay in input samples, half its length less one.
+   */
+  double delay() const;
+
+  /**
+   * Decimates input[c] into result[c] for every channel, result[c] must have
+   * outputs(c, input[c].size()) samples.
+   */
+  void process(std::span<const std::span<const double>> input,
+               std::span<const std::span<double>> result);
+
+  /**
+   * A channel's state, so it can be carried over to a decimator with the
+   * same design when the channels are rearranged.
+   */
+  std::vector<double> get_state(size_t channel) const;
+  void set_state(size_t channel, std::span<const double> state);
+};
+} // namespace thalamus
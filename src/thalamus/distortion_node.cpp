@@ -28,7 +28,7 @@ struct DistortionNode::Impl {
   ObservableDictPtr state;
   boost::signals2::scoped_connection state_connection;
   boost::signals2::scoped_connection options_connection;
-  boost::signals2::scoped_connection source_connection;
+  ScopedConnection source_connection;
   boost::signals2::scoped_connection distortion_connection;
   boost::signals2::scoped_connection mat_connection;
   boost::signals2::scoped_connection mat0_connection;
@@ -64,7 +64,8 @@ struct DistortionNode::Impl {
   size_t source_height = std::numeric_limits<size_t>::max();
   size_t next_input_frame = 0;
   size_t next_output_frame = 0;
-  std::set<cv::Mat *> mat_pool;
+  std::vector<cv::Mat> mat_pool;
+  size_t frames_in_flight = 0;
   cv::Mat map1, map2;
   double square_size = 1;
 
@@ -98,8 +99,125 @@ struct DistortionNode::Impl {
 
   ~Impl() {
     (*state)["Running"].assign(false, [&] {});
-    for (auto mat : mat_pool) {
-      delete mat;
+  }
+
+  static constexpr size_t MAT_POOL_SIZE = 8;
+  static constexpr size_t MAX_FRAMES_IN_FLIGHT = 2;
+  static constexpr size_t TILE_BYTES = 256 * 1024;
+
+  cv::Mat acquire_mat(int mat_rows, int mat_cols, int type) {
+    while (!mat_pool.empty()) {
+      auto mat = std::move(mat_pool.back());
+      mat_pool.pop_back();
+      if (mat.rows == mat_rows && mat.cols == mat_cols && mat.type() == type) {
+        return mat;
+      }
+    }
+    return cv::Mat(mat_rows, mat_cols, type);
+  }
+
+  /**
+   * Returns a buffer to the pool, provided nothing else still references it.
+   */
+  void release_mat(cv::Mat &&mat) {
+    if (mat.empty() || mat.u == nullptr || mat.u->refcount != 1 ||
+        mat_pool.size() >= MAT_POOL_SIZE) {
+      return;
+    }
+    mat_pool.push_back(std::move(mat));
+  }
+
+  void set_current_result(const Result &result) {
+    auto previous = std::move(current_result.image);
+    current_result = result;
+    release_mat(std::move(previous));
+  }
+
+  struct TiledFrame {
+    cv::Mat in;
+    cv::Mat out;
+    cv::Mat map1;
+    cv::Mat map2;
+    std::atomic_size_t pending_tiles;
+    std::chrono::steady_clock::time_point start;
+  };
+
+  /**
+   * Undistorts the frame by splitting map1/map2 (int16 source coordinates
+   * plus fixed-point interpolation weights) into row bands sized to stay in
+   * cache and remapping each band on its own pool worker.  The last band to
+   * finish hands the frame back to the io_context.
+   */
+  void undistort_tiled(const cv::Mat &source, uint64_t id,
+                       std::chrono::nanoseconds frame_interval,
+                       std::chrono::nanoseconds sample_time) {
+    TRACE_EVENT("thalamus", "DistortionNode::undistort_tiled");
+    if (frames_in_flight >= MAX_FRAMES_IN_FLIGHT) {
+      return;
+    }
+    ++frames_in_flight;
+
+    auto frame = std::make_shared<TiledFrame>();
+    frame->in = acquire_mat(source.rows, source.cols, CV_8UC1);
+    {
+      TRACE_EVENT("thalamus", "cv::Mat::copyTo");
+      source.copyTo(frame->in);
+    }
+    frame->out = acquire_mat(source.rows, source.cols, CV_8UC1);
+    frame->map1 = map1;
+    frame->map2 = map2;
+    frame->start = std::chrono::steady_clock::now();
+
+    // Per output row a band touches the destination row, its map1 (4 bytes)
+    // and map2 (2 bytes) entries and roughly one row of source pixels.
+    auto row_bytes = size_t(source.cols) * 8;
+    auto tile_rows = std::min(std::max(TILE_BYTES / row_bytes, size_t(8)),
+                              size_t(source.rows));
+    auto num_tiles = (size_t(source.rows) + tile_rows - 1) / tile_rows;
+    frame->pending_tiles = num_tiles;
+    auto frame_id = next_input_frame++;
+
+    for (size_t tile = 0; tile < num_tiles; ++tile) {
+      auto begin = int(tile * tile_rows);
+      auto end = std::min(int((tile + 1) * tile_rows), source.rows);
+      pool.push([frame, begin, end, frame_id, id, frame_interval, sample_time,
+                 this, c_outer = outer->shared_from_this()] {
+        TRACE_EVENT("thalamus", "DistortionNode::remap_tile",
+                    perfetto::Flow::ProcessScoped(id));
+        auto out_tile = frame->out.rowRange(begin, end);
+        cv::remap(frame->in, out_tile, frame->map1.rowRange(begin, end),
+                  frame->map2.rowRange(begin, end), cv::INTER_LINEAR,
+                  cv::BORDER_CONSTANT);
+        if (--frame->pending_tiles != 0) {
+          return;
+        }
+        auto elapsed = std::chrono::steady_clock::now() - frame->start;
+        boost::asio::post(io_context, [frame, frame_id, id, elapsed,
+                                       frame_interval, sample_time, this,
+                                       c_outer] {
+          TRACE_EVENT("thalamus", "DistortionNode Post to Main",
+                      perfetto::TerminatingFlow::ProcessScoped(id));
+          --frames_in_flight;
+          auto latency = double(
+              std::chrono::duration_cast<std::chrono::milliseconds>(elapsed)
+                  .count());
+          release_mat(std::move(frame->in));
+          output_frames[frame_id] = Result{std::move(frame->out),
+                                           frame_interval, true, true,
+                                           latency, sample_time};
+          for (auto i = output_frames.begin(); i != output_frames.end();) {
+            if (i->first == next_output_frame) {
+              ++next_output_frame;
+              set_current_result(i->second);
+              i = output_frames.erase(i);
+              TRACE_EVENT("thalamus", "DistortionNode::ready");
+              outer->ready(outer);
+            } else {
+              ++i;
+            }
+          }
+        });
+      });
     }
   }
 
@@ -110,7 +228,13 @@ struct DistortionNode::Impl {
     auto id = get_unique_id();
     TRACE_EVENT_BEGIN("thalamus", "DistortionNode::on_data",
                       perfetto::Flow::ProcessScoped(id));
-    if (image_source->format() != ImageNode::Format::Gray || pool.full()) {
+    auto tiled = computing && !collecting && !apply_threshold;
+    if (image_source->format() != ImageNode::Format::Gray) {
+      TRACE_EVENT_END("thalamus");
+      return;
+    }
+    if (!tiled && pool.full()) {
+      pool.count_drop(outer);
       TRACE_EVENT_END("thalamus");
       return;
     }
@@ -139,6 +263,11 @@ struct DistortionNode::Impl {
     auto frame_interval = image_source->frame_interval();
     cv::Mat in =
         cv::Mat(int(source_height), int(source_width), CV_8UC1, luma_data);
+    if (tiled) {
+      undistort_tiled(in, id, frame_interval, image_source->time());
+      TRACE_EVENT_END("thalamus");
+      return;
+    }
     auto run_in_pool = collecting || computing;
     if (apply_threshold || run_in_pool) {
       TRACE_EVENT("thalamus", "cv::Mat::clone");
@@ -146,11 +275,6 @@ struct DistortionNode::Impl {
     }
     busy = true;
 
-    // if(mat_pool.empty()) {
-    //   mat_pool.insert(new cv::Mat());
-    // }
-    // auto out = *mat_pool.begin();
-    // mat_pool.erase(out);
     auto frame_id = 0;
     if (!collecting) {
       frame_id = int(next_input_frame++);
@@ -158,7 +282,6 @@ struct DistortionNode::Impl {
 
     auto execution = [frame_id, run_in_pool, id, &c_busy = this->busy,
                       c_time = image_source->time(),
-                      // out,
                       c_state = this->state, frame_interval,
                       c_invert = this->invert, c_rows = this->rows,
                       c_camera_matrix = this->camera_matrix,
@@ -169,8 +292,7 @@ struct DistortionNode::Impl {
                       &c_computations = this->computations,
                       &c_mutex = this->mutex, c_computing = this->computing,
                       &c_current_result = current_result,
-                          //&mat_pool=this->mat_pool,
-                          &c_output_frames = this->output_frames,
+                      &c_output_frames = this->output_frames,
                       &c_next_output_frame = this->next_output_frame,
                       &c_io_context = io_context, c_threshold = this->threshold,
                       c_map1 = this->map1, c_map2 = this->map2,
@@ -249,9 +371,7 @@ struct DistortionNode::Impl {
         }
       }
       auto elapsed = std::chrono::steady_clock::now() - start;
-      auto finish = [undistorted, elapsed,
-                     //&mat_pool,
-                     c_time, c_collecting, &c_busy, frame_id, id,
+      auto finish = [undistorted, elapsed, c_time, c_collecting, &c_busy, frame_id, id,
                      &c_output_frames, &c_next_output_frame, &c_current_result,
                      frame_interval, c_outer] {
         TRACE_EVENT("thalamus", "DistortionNode Post to Main",
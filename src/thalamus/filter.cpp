@@ -0,0 +1,492 @@
+#include <thalamus/filter.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <thalamus/assert.hpp>
+
+namespace thalamus {
+namespace {
+using Complex = std::complex<double>;
+
+bool is_real(Complex value) {
+  return std::abs(value.imag()) <= 1e-10 * std::max(1.0, std::abs(value));
+}
+
+/**
+ * Splits roots into conjugate pairs and leftover real roots, one root per
+ * group.  The second root of each pair is implied.
+ */
+std::vector<Complex> group_roots(const std::vector<Complex> &roots) {
+  std::vector<Complex> result;
+  std::vector<Complex> reals;
+  for (auto root : roots) {
+    if (is_real(root)) {
+      reals.push_back(root.real());
+    } else if (root.imag() > 0) {
+      result.push_back(root);
+    }
+  }
+  std::sort(reals.begin(), reals.end(),
+            [](Complex l, Complex r) { return l.real() < r.real(); });
+  result.insert(result.end(), reals.begin(), reals.end());
+  return result;
+}
+
+/**
+ * Turns digital zeros, poles and gain into second order sections, pairing
+ * each pole pair with the zeros nearest to it and leaving the gain in the
+ * first section.
+ */
+std::vector<Biquad> zpk_to_sections(std::vector<Complex> zeros,
+                                    std::vector<Complex> poles, double gain) {
+  auto pole_groups = group_roots(poles);
+  std::sort(pole_groups.begin(), pole_groups.end(), [](Complex l, Complex r) {
+    return std::abs(l) > std::abs(r);
+  });
+  std::vector<Complex> real_poles;
+  std::vector<Biquad> result;
+
+  auto take_zero = [&](Complex near, bool real) {
+    auto nearest = zeros.end();
+    for (auto i = zeros.begin(); i != zeros.end(); ++i) {
+      if ((!real || is_real(*i)) &&
+          (nearest == zeros.end() ||
+           std::abs(*i - near) < std::abs(*nearest - near))) {
+        nearest = i;
+      }
+    }
+    THALAMUS_ASSERT(nearest != zeros.end(), "Filter zeros don't match poles");
+    auto zero = *nearest;
+    zeros.erase(nearest);
+    return zero;
+  };
+  // Numerator of a section with count poles near pole
+  auto take_zeros = [&](Complex near, size_t count) {
+    auto zero = take_zero(near, count == 1);
+    if (!is_real(zero)) {
+      auto conjugate = take_zero(std::conj(zero), false);
+      return Biquad{1, -(zero + conjugate).real(), (zero * conjugate).real(),
+                    0, 0};
+    } else if (count == 1) {
+      return Biquad{1, -zero.real(), 0, 0, 0};
+    }
+    auto other = take_zero(near, true);
+    return Biquad{1, -(zero.real() + other.real()), zero.real() * other.real(),
+                  0, 0};
+  };
+
+  for (auto pole : pole_groups) {
+    if (is_real(pole)) {
+      real_poles.push_back(pole);
+      continue;
+    }
+    auto section = take_zeros(pole, 2);
+    section.a1 = -2 * pole.real();
+    section.a2 = std::norm(pole);
+    result.push_back(section);
+  }
+
+  for (size_t i = 0; i < real_poles.size(); i += 2) {
+    auto first = real_poles[i].real();
+    if (i + 1 < real_poles.size()) {
+      auto second = real_poles[i + 1].real();
+      auto section = take_zeros(first, 2);
+      section.a1 = -(first + second);
+      section.a2 = first * second;
+      result.push_back(section);
+    } else {
+      auto section = take_zeros(first, 1);
+      section.a1 = -first;
+      result.push_back(section);
+    }
+  }
+
+  if (!result.empty()) {
+    result.front().b0 *= gain;
+    result.front().b1 *= gain;
+    result.front().b2 *= gain;
+  }
+  return result;
+}
+
+bool is_band(FilterBand band) {
+  return band == FilterBand::BAND_PASS || band == FilterBand::BAND_STOP;
+}
+
+bool valid_cutoffs(FilterBand band, double low, double high,
+                   double sample_rate) {
+  auto nyquist = sample_rate / 2;
+  auto valid = [&](double f) { return 0 < f && f < nyquist; };
+  return valid(low) && (!is_band(band) || (valid(high) && low < high));
+}
+
+double sinc(double x) {
+  return x == 0 ? 1 : std::sin(M_PI * x) / (M_PI * x);
+}
+} // namespace
+
+std::optional<std::vector<Biquad>> design_butterworth(FilterBand band,
+                                                      int order, double low,
+                                                      double high,
+                                                      double sample_rate) {
+  if (order < 1 || !valid_cutoffs(band, low, high, sample_rate)) {
+    return std::nullopt;
+  }
+
+  // Analog prototype with a cutoff of 1 rad/s
+  std::vector<Complex> zeros;
+  std::vector<Complex> poles;
+  for (auto k = -order + 1; k < order; k += 2) {
+    poles.push_back(-std::exp(Complex(0, M_PI * k / (2 * order))));
+  }
+  double gain = 1;
+
+  // Prewarped analog band edges
+  auto warp = [&](double f) {
+    return 2 * sample_rate * std::tan(M_PI * f / sample_rate);
+  };
+  auto w1 = warp(low);
+  auto w2 = is_band(band) ? warp(high) : 0;
+  auto bandwidth = w2 - w1;
+  auto center = std::sqrt(w1 * w2);
+  auto inverse_gain = [&] {
+    Complex product = 1;
+    for (auto pole : poles) {
+      product *= -pole;
+    }
+    return (1.0 / product).real();
+  };
+
+  switch (band) {
+  case FilterBand::LOW_PASS:
+    for (auto &pole : poles) {
+      pole *= w1;
+    }
+    gain = std::pow(w1, order);
+    break;
+  case FilterBand::HIGH_PASS:
+    gain = inverse_gain();
+    for (auto &pole : poles) {
+      pole = w1 / pole;
+    }
+    zeros.assign(size_t(order), 0);
+    break;
+  case FilterBand::BAND_PASS: {
+    std::vector<Complex> band_poles;
+    for (auto pole : poles) {
+      auto scaled = pole * bandwidth / 2.0;
+      auto root = std::sqrt(scaled * scaled - center * center);
+      band_poles.push_back(scaled + root);
+      band_poles.push_back(scaled - root);
+    }
+    poles = band_poles;
+    zeros.assign(size_t(order), 0);
+    gain = std::pow(bandwidth, order);
+    break;
+  }
+  case FilterBand::BAND_STOP: {
+    gain = inverse_gain();
+    std::vector<Complex> band_poles;
+    for (auto pole : poles) {
+      auto scaled = bandwidth / 2.0 / pole;
+      auto root = std::sqrt(scaled * scaled - center * center);
+      band_poles.push_back(scaled + root);
+      band_poles.push_back(scaled - root);
+    }
+    poles = band_poles;
+    for (auto i = 0; i < order; ++i) {
+      zeros.emplace_back(0, center);
+      zeros.emplace_back(0, -center);
+    }
+    break;
+  }
+  }
+
+  // Bilinear transform, zeros at infinity move to Nyquist
+  auto fs2 = 2 * sample_rate;
+  Complex numerator = 1;
+  Complex denominator = 1;
+  for (auto &zero : zeros) {
+    numerator *= fs2 - zero;
+    zero = (fs2 + zero) / (fs2 - zero);
+  }
+  for (auto &pole : poles) {
+    denominator *= fs2 - pole;
+    pole = (fs2 + pole) / (fs2 - pole);
+  }
+  zeros.resize(poles.size(), -1);
+  gain *= (numerator / denominator).real();
+
+  return zpk_to_sections(zeros, poles, gain);
+}
+
+std::optional<Biquad> design_notch(double frequency, double q,
+                                   double sample_rate) {
+  if (q <= 0 || !valid_cutoffs(FilterBand::LOW_PASS, frequency, 0,
+                               sample_rate)) {
+    return std::nullopt;
+  }
+  auto w0 = 2 * M_PI * frequency / sample_rate;
+  auto gain = 1 / (1 + std::tan(w0 / q / 2));
+  auto cosine = std::cos(w0);
+  return Biquad{gain, -2 * gain * cosine, gain, -2 * gain * cosine,
+                2 * gain - 1};
+}
+
+std::optional<std::vector<double>> design_fir(FilterBand band, size_t taps,
+                                              double low, double high,
+                                              double sample_rate) {
+  auto passes_nyquist =
+      band == FilterBand::HIGH_PASS || band == FilterBand::BAND_STOP;
+  if (taps == 0 || (passes_nyquist && taps % 2 == 0) ||
+      !valid_cutoffs(band, low, high, sample_rate)) {
+    return std::nullopt;
+  }
+
+  // Pass bands as fractions of the Nyquist frequency
+  auto nyquist = sample_rate / 2;
+  low /= nyquist;
+  high /= nyquist;
+  std::vector<std::pair<double, double>> bands;
+  switch (band) {
+  case FilterBand::LOW_PASS:
+    bands = {{0, low}};
+    break;
+  case FilterBand::HIGH_PASS:
+    bands = {{low, 1}};
+    break;
+  case FilterBand::BAND_PASS:
+    bands = {{low, high}};
+    break;
+  case FilterBand::BAND_STOP:
+    bands = {{0, low}, {high, 1}};
+    break;
+  }
+
+  // Only the first half is computed so the taps are exactly symmetric
+  std::vector<double> result(taps);
+  auto middle = double(taps - 1) / 2;
+  for (size_t n = 0; n < (taps + 1) / 2; ++n) {
+    auto m = double(n) - middle;
+    double value = 0;
+    for (auto [left, right] : bands) {
+      value += right * sinc(right * m) - left * sinc(left * m);
+    }
+    auto window =
+        taps == 1 ? 1 : 0.54 - 0.46 * std::cos(2 * M_PI * double(n) /
+                                                double(taps - 1));
+    result[n] = result[taps - 1 - n] = value * window;
+  }
+
+  auto [left, right] = bands.front();
+  auto frequency = left == 0 ? 0 : right == 1 ? 1 : (left + right) / 2;
+  double response = 0;
+  for (size_t n = 0; n < taps; ++n) {
+    response += result[n] * std::cos(M_PI * (double(n) - middle) * frequency);
+  }
+  for (auto &tap : result) {
+    tap /= response;
+  }
+  return result;
+}
+
+FilterBank::FilterBank(std::vector<Biquad> _sections, std::vector<double> _taps)
+    : sections(std::move(_sections)), taps(std::move(_taps)) {}
+
+size_t FilterBank::history() const {
+  return taps.empty() ? 0 : taps.size() - 1;
+}
+
+void FilterBank::resize(size_t count) {
+  auto blocks = (count + LANES - 1) / LANES;
+  biquad_state.resize(blocks * sections.size() * 2 * LANES);
+  fir_state.resize(blocks * history() * LANES);
+  for (auto c = std::min(channels, count); c < blocks * LANES; ++c) {
+    set_state(c, std::vector<double>(sections.size() * 2 + history()));
+  }
+  channels = count;
+}
+
+size_t FilterBank::num_channels() const { return channels; }
+
+void FilterBank::reset() {
+  std::fill(biquad_state.begin(), biquad_state.end(), 0);
+  std::fill(fir_state.begin(), fir_state.end(), 0);
+}
+
+std::vector<double> FilterBank::get_state(size_t channel) const {
+  auto block = channel / LANES;
+  auto lane = channel % LANES;
+  std::vector<double> result;
+  auto biquads = biquad_state.data() + block * sections.size() * 2 * LANES;
+  for (size_t i = 0; i < sections.size() * 2; ++i) {
+    result.push_back(biquads[i * LANES + lane]);
+  }
+  auto fir = fir_state.data() + block * history() * LANES;
+  for (size_t i = 0; i < history(); ++i) {
+    result.push_back(fir[i * LANES + lane]);
+  }
+  return result;
+}
+
+void FilterBank::set_state(size_t channel, std::span<const double> state) {
+  THALAMUS_ASSERT(state.size() == sections.size() * 2 + history(),
+                  "Filter state doesn't match the design");
+  auto block = channel / LANES;
+  auto lane = channel % LANES;
+  auto biquads = biquad_state.data() + block * sections.size() * 2 * LANES;
+  for (size_t i = 0; i < sections.size() * 2; ++i) {
+    biquads[i * LANES + lane] = state[i];
+  }
+  auto fir = fir_state.data() + block * history() * LANES;
+  for (size_t i = 0; i < history(); ++i) {
+    fir[i * LANES + lane] = state[sections.size() * 2 + i];
+  }
+}
+
+void FilterBank::process(std::span<const std::span<const double>> input,
+                         std::span<const std::span<double>> result) {
+  THALAMUS_ASSERT(input.size() == result.size(),
+                  "Filter input and result channels differ");
+  if (input.size() != channels) {
+    resize(input.size());
+  }
+  for (size_t first = 0, block = 0; first < channels;
+       first += LANES, ++block) {
+    auto count = std::min(LANES, channels - first);
+    auto block_input = input.subspan(first, count);
+    auto block_result = result.subspan(first, count);
+    auto size = block_input.front().size();
+    auto uniform = std::all_of(block_input.begin(), block_input.end(),
+                               [&](std::span<const double> channel) {
+                                 return channel.size() == size;
+                               });
+    if (uniform) {
+      process_block(block, count, block_input, block_result);
+    } else {
+      for (size_t lane = 0; lane < count; ++lane) {
+        process_lane(block, lane, block_input[lane], block_result[lane]);
+      }
+    }
+  }
+}
+
+void FilterBank::process_block(size_t block, size_t count,
+                               std::span<const std::span<const double>> input,
+                               std::span<const std::span<double>> result) {
+  auto samples = input.front().size();
+  if (samples == 0) {
+    return;
+  }
+
+  // The FIR history followed by the new samples, interleaved, and a spare
+  // row so the FIR can produce two samples at a time.
+  auto hist = history();
+  auto rows = samples + samples % 2;
+  buffer.resize((hist + rows) * LANES);
+  auto fir = fir_state.data() + block * hist * LANES;
+  std::copy(fir, fir + hist * LANES, buffer.begin());
+  auto x = buffer.data() + hist * LANES;
+  for (size_t lane = 0; lane < LANES; ++lane) {
+    if (lane < count) {
+      auto channel = input[lane];
+      for (size_t i = 0; i < samples; ++i) {
+        x[i * LANES + lane] = channel[i];
+      }
+    } else {
+      for (size_t i = 0; i < samples; ++i) {
+        x[i * LANES + lane] = 0;
+      }
+    }
+  }
+
+  auto y = x;
+  if (!taps.empty()) {
+    output.resize(rows * LANES);
+    y = output.data();
+    auto num_taps = taps.size();
+    auto coefficients = taps.data();
+    for (size_t i = 0; i < samples; i += 2) {
+      double first[LANES] = {};
+      double second[LANES] = {};
+      auto newest = x + i * LANES;
+      for (size_t k = 0; k < num_taps; ++k) {
+        auto row = newest - k * LANES;
+        auto tap = coefficients[k];
+        for (size_t lane = 0; lane < LANES; ++lane) {
+          first[lane] += tap * row[lane];
+          second[lane] += tap * row[LANES + lane];
+        }
+      }
+      std::copy(first, first + LANES, y + i * LANES);
+      std::copy(second, second + LANES, y + (i + 1) * LANES);
+    }
+    auto kept = buffer.begin() + int64_t(samples * LANES);
+    std::copy(kept, kept + int64_t(hist * LANES), fir);
+  }
+
+  auto state = biquad_state.data() + block * sections.size() * 2 * LANES;
+  for (auto &section : sections) {
+    const auto b0 = section.b0, b1 = section.b1, b2 = section.b2;
+    const auto a1 = section.a1, a2 = section.a2;
+    double s1[LANES], s2[LANES];
+    std::copy(state, state + LANES, s1);
+    std::copy(state + LANES, state + 2 * LANES, s2);
+    for (size_t i = 0; i < samples; ++i) {
+      auto row = y + i * LANES;
+      for (size_t lane = 0; lane < LANES; ++lane) {
+        auto in = row[lane];
+        auto out = b0 * in + s1[lane];
+        s1[lane] = b1 * in - a1 * out + s2[lane];
+        s2[lane] = b2 * in - a2 * out;
+        row[lane] = out;
+      }
+    }
+    std::copy(s1, s1 + LANES, state);
+    std::copy(s2, s2 + LANES, state + LANES);
+    state += 2 * LANES;
+  }
+
+  for (size_t lane = 0; lane < count; ++lane) {
+    auto channel = result[lane];
+    for (size_t i = 0; i < samples; ++i) {
+      channel[i] = y[i * LANES + lane];
+    }
+  }
+}
+
+void FilterBank::process_lane(size_t block, size_t lane,
+                              std::span<const double> input,
+                              std::span<double> result) {
+  auto hist = history();
+  auto fir = fir_state.data() + block * hist * LANES + lane;
+  auto state =
+      biquad_state.data() + block * sections.size() * 2 * LANES + lane;
+  for (size_t i = 0; i < input.size(); ++i) {
+    auto x = input[i];
+    if (!taps.empty()) {
+      auto sum = taps[0] * x;
+      for (size_t k = 1; k < taps.size(); ++k) {
+        sum += taps[k] * fir[(hist - k) * LANES];
+      }
+      for (size_t j = 0; j + 1 < hist; ++j) {
+        fir[j * LANES] = fir[(j + 1) * LANES];
+      }
+      if (hist) {
+        fir[(hist - 1) * LANES] = x;
+      }
+      x = sum;
+    }
+    auto s = state;
+    for (auto &section : sections) {
+      auto out = section.b0 * x + s[0];
+      s[0] = section.b1 * x - section.a1 * out + s[LANES];
+      s[LANES] = section.b2 * x - section.a2 * out;
+      x = out;
+      s += 2 * LANES;
+    }
+    result[i] = x;
+  }
+}
+} // namespace thalamus
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace thalamus {
+/**
+ * A second order section, y = (b0 + b1/z + b2/z^2)/(1 + a1/z + a2/z^2).
+ * First order sections have b2 = a2 = 0.
+ */
+struct Biquad {
+  double b0, b1, b2, a1, a2;
+};
+
+enum class FilterBand { LOW_PASS, HIGH_PASS, BAND_PASS, BAND_STOP };
+
+/**
+ * Designs a digital Butterworth filter of the given order with the bilinear
+ * transform, as cascaded second order sections.  Low and high pass filters
+ * use low as their cutoff, band filters are between low and high and have
+ * twice the order.  Returns nothing if a cutoff isn't between 0 and the
+ * Nyquist frequency.
+ */
+std::optional<std::vector<Biquad>> design_butterworth(FilterBand band,
+                                                      int order, double low,
+                                                      double high,
+                                                      double sample_rate);
+
+/**
+ * Designs a second order notch at frequency whose -3dB bandwidth is
+ * frequency/q.
+ */
+std::optional<Biquad> design_notch(double frequency, double q,
+                                   double sample_rate);
+
+/**
+ * Designs a linear phase FIR filter with a Hamming window, scaled to unit
+ * gain in the middle of its first pass band.  High pass and band stop filters
+ * need an odd number of taps.
+ */
+std::optional<std::vector<double>> design_fir(FilterBand band, size_t taps,
+                                              double low, double high,
+                                              double sample_rate);
+
+/**
+ * Runs an FIR filter followed by cascaded biquads over many channels that
+ * share a sample rate, keeping every channel's state between calls.
+ *
+ * Channels are processed in blocks of LANES.  A block's samples are
+ * interleaved so the inner loops step through the lanes of one sample, which
+ * the compiler turns into vector instructions without any intrinsics.  Blocks
+ * whose channels received different numbers of samples are filtered one
+ * channel at a time with the same state.
+ */
+class FilterBank {
+public:
+  static constexpr size_t LANES = 8;
+
+private:
+  std::vector<Biquad> sections;
+  std::vector<double> taps;
+  size_t channels = 0;
+  // Section s of block b keeps its two states for every lane at
+  // biquad_state[((b*sections.size() + s)*2 + {0, 1})*LANES].
+  std::vector<double> biquad_state;
+  // The last taps.size() - 1 inputs of every block, oldest first,
+  // interleaved.
+  std::vector<double> fir_state;
+  std::vector<double> buffer;
+  std::vector<double> output;
+
+  size_t history() const;
+  void process_block(size_t block, size_t count,
+                     std::span<const std::span<const double>> input,
+                     std::span<const std::span<double>> result);
+  void process_lane(size_t block, size_t lane, std::span<const double> input,
+                    std::span<double> result);
+
+public:
+  FilterBank() = default;
+  FilterBank(std::vector<Biquad> sections, std::vector<double> taps);
+
+  /**
+   * Changes the number of channels, new channels start at rest.
+   */
+  void resize(size_t channels);
+  size_t num_channels() const;
+  void reset();
+
+  /**
+   * Filters input[c] into result[c] for every channel, result[c] must have
+   * the size of input[c].
+   */
+  void process(std::span<const std::span<const double>> input,
+               std::span<const std::span<double>> result);
+
+  /**
+   * A channel's state, so it can be carried over to a bank with the same
+   * design when the channels are rearranged.
+   */
+  std::vector<double> get_state(size_t channel) const;
+  void set_state(size_t channel, std::span<const double> state);
+};
+} // namespace thalamus
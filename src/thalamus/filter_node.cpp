@@ -0,0 +1,229 @@
+#include <thalamus/filter_node.hpp>
+#include <vector>
+#include <thalamus/channel_groups.hpp>
+#include <thalamus/filter.hpp>
+#include <thalamus/modalities_util.hpp>
+
+namespace thalamus {
+struct FilterNode::Impl {
+  ObservableDictPtr state;
+  boost::signals2::scoped_connection state_connection;
+  FilterNode *outer;
+  NodeGraph *graph;
+
+  std::string filter = "None";
+  bool fir = false;
+  int order = 4;
+  size_t taps = 101;
+  double low_cutoff = 300;
+  double high_cutoff = 3000;
+  double notch = 0;
+  double notch_q = 30;
+  int notch_harmonics = 1;
+
+  bool redesign = true;
+  ChannelGroups<FilterBank> channels;
+  std::vector<std::vector<double>> data;
+
+public:
+  Impl(ObservableDictPtr _state, boost::asio::io_context &, NodeGraph *_graph,
+       FilterNode *_outer)
+      : state(_state), outer(_outer), graph(_graph) {
+    state_connection =
+        state->changed.connect(std::bind(&Impl::on_change, this, _1, _2, _3));
+    state->recap(std::bind(&Impl::on_change, this, _1, _2, _3));
+  }
+
+  ScopedConnection source_connection;
+  AnalogNode *source = nullptr;
+  AnalogFrameBuilder frame;
+
+  FilterBank design(std::chrono::nanoseconds sample_interval) {
+    if (sample_interval <= 0ns) {
+      return FilterBank();
+    }
+    auto sample_rate = 1e9 / double(sample_interval.count());
+    std::vector<Biquad> sections;
+    std::vector<double> coefficients;
+
+    if (filter != "None") {
+      auto band = filter == "Low Pass"    ? FilterBand::LOW_PASS
+                  : filter == "High Pass" ? FilterBand::HIGH_PASS
+                  : filter == "Band Pass" ? FilterBand::BAND_PASS
+                                          : FilterBand::BAND_STOP;
+      // Low pass filters keep what is below the high cutoff
+      auto low = band == FilterBand::LOW_PASS ? high_cutoff : low_cutoff;
+      if (fir) {
+        auto designed = design_fir(band, taps, low, high_cutoff, sample_rate);
+        if (designed) {
+          coefficients = *designed;
+        } else {
+          THALAMUS_LOG(warning)
+              << "Can't design a " << taps << " tap " << filter
+              << " FIR filter at " << sample_rate << "Hz";
+        }
+      } else {
+        auto designed =
+            design_butterworth(band, order, low, high_cutoff, sample_rate);
+        if (designed) {
+          sections = *designed;
+        } else {
+          THALAMUS_LOG(warning)
+              << "Can't design an order " << order << " " << filter
+              << " Butterworth filter at " << sample_rate << "Hz";
+        }
+      }
+    }
+
+    if (notch > 0) {
+      for (auto harmonic = 1; harmonic <= notch_harmonics; ++harmonic) {
+        auto designed = design_notch(harmonic * notch, notch_q, sample_rate);
+        if (!designed) {
+          if (harmonic == 1) {
+            THALAMUS_LOG(warning) << "Can't design a " << notch
+                                  << "Hz notch at " << sample_rate << "Hz";
+          }
+          break;
+        }
+        sections.push_back(*designed);
+      }
+    }
+    return FilterBank(sections, coefficients);
+  }
+
+  void on_ready(Node *) {
+    if (!source->has_analog_data()) {
+      return;
+    }
+    auto &source_frame = source->frame();
+    if (channels.update(source_frame, redesign,
+                        std::bind(&Impl::design, this, _1))) {
+      redesign = false;
+      frame.resize(channels.names.size());
+      for (size_t c = 0; c < channels.names.size(); ++c) {
+        frame.set_layout(c, channels.names[c], channels.sample_intervals[c]);
+      }
+    }
+
+    auto count = size_t(source_frame.num_channels());
+    channels.convert(source_frame);
+    data.resize(count);
+    for (auto &group : channels.groups) {
+      for (size_t i = 0; i < group.channels.size(); ++i) {
+        auto c = group.channels[i];
+        data[c].resize(channels.input[c].size());
+        group.output[i] = data[c];
+      }
+      group.processor.process(group.input, group.output);
+    }
+
+    for (size_t c = 0; c < count; ++c) {
+      frame.set_data(c, std::span<const double>(data[c]));
+    }
+    frame.finish(source_frame.time, source_frame.remote_time);
+    outer->ready(outer);
+  }
+
+  void on_change(ObservableCollection::Action,
+                 const ObservableCollection::Key &k,
+                 const ObservableCollection::Value &v) {
+    auto key_str = std::get<std::string>(k);
+    auto number = [&] {
+      return std::holds_alternative<int64_t>(v) ? double(std::get<int64_t>(v))
+                                                : std::get<double>(v);
+    };
+    if (key_str == "Filter") {
+      filter = std::get<std::string>(v);
+      redesign = true;
+    } else if (key_str == "Design") {
+      fir = std::get<std::string>(v) == "FIR";
+      redesign = true;
+    } else if (key_str == "Order") {
+      order = int(number());
+      redesign = true;
+    } else if (key_str == "Taps") {
+      taps = size_t(std::max(number(), 1.0));
+      redesign = true;
+    } else if (key_str == "Low Cutoff (Hz)") {
+      low_cutoff = number();
+      redesign = true;
+    } else if (key_str == "High Cutoff (Hz)") {
+      high_cutoff = number();
+      redesign = true;
+    } else if (key_str == "Notch (Hz)") {
+      notch = number();
+      redesign = true;
+    } else if (key_str == "Notch Q") {
+      notch_q = number();
+      redesign = true;
+    } else if (key_str == "Notch Harmonics") {
+      notch_harmonics = int(number());
+      redesign = true;
+    } else if (key_str == "Source") {
+      auto value_str = std::get<std::string>(v);
+      absl::StripAsciiWhitespace(&value_str);
+      graph->get_node(value_str, [&](auto node) {
+        auto locked = node.lock();
+        if (!locked) {
+          return;
+        }
+        source = std::dynamic_pointer_cast<AnalogNode>(locked).get();
+        if (!source) {
+          return;
+        }
+        redesign = true;
+        source_connection =
+            locked->ready.connect(std::bind(&Impl::on_ready, this, _1));
+      });
+    }
+  }
+};
+
+FilterNode::FilterNode(ObservableDictPtr state,
+                       boost::asio::io_context &io_context, NodeGraph *graph)
+    : impl(new Impl(state, io_context, graph, this)) {}
+
+FilterNode::~FilterNode() {}
+
+std::string FilterNode::type_name() { return "FILTER"; }
+
+std::chrono::nanoseconds FilterNode::time() const {
+  return impl->frame.get().time;
+}
+
+std::span<const double> FilterNode::data(int channel) const {
+  auto &data = impl->data.at(size_t(channel));
+  return std::span<const double>(data.begin(), data.end());
+}
+
+int FilterNode::num_channels() const {
+  return impl->frame.get().num_channels();
+}
+
+std::string_view FilterNode::name(int channel) const {
+  return impl->frame.get().names[size_t(channel)];
+}
+
+std::span<const std::string> FilterNode::get_recommended_channels() const {
+  return impl->source ? impl->source->get_recommended_channels()
+                      : std::span<const std::string>();
+}
+
+std::chrono::nanoseconds FilterNode::sample_interval(int channel) const {
+  return impl->frame.get().sample_intervals[size_t(channel)];
+}
+
+void FilterNode::inject(const thalamus::vector<std::span<double const>> &,
+                        const thalamus::vector<std::chrono::nanoseconds> &,
+                        const thalamus::vector<std::string_view> &) {
+  THALAMUS_ASSERT(false, "Unimplemented");
+}
+
+bool FilterNode::has_analog_data() const { return true; }
+
+const AnalogFrame &FilterNode::frame() const { return impl->frame.get(); }
+
+size_t FilterNode::modalities() const {
+  return infer_modalities<FilterNode>();
+}
+} // namespace thalamus
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <thalamus/analog_node.hpp>
+#include <thalamus/base_node.hpp>
+#include <thalamus/state.hpp>
+#include <string>
+
+namespace thalamus {
+/**
+ * Filters every channel of an AnalogNode with a Butterworth or FIR design
+ * and optional notches, see FilterBank.
+ */
+class FilterNode : public Node, public AnalogNode {
+  struct Impl;
+  std::unique_ptr<Impl> impl;
+
+public:
+  FilterNode(ObservableDictPtr state, boost::asio::io_context &io_context,
+             NodeGraph *);
+  ~FilterNode() override;
+  static std::string type_name();
+  std::chrono::nanoseconds time() const override;
+  std::span<const double> data(int channel) const override;
+  int num_channels() const override;
+  std::string_view name(int channel) const override;
+  std::span<const std::string> get_recommended_channels() const override;
+  std::chrono::nanoseconds sample_interval(int i) const override;
+  void
+  inject(const thalamus::vector<std::span<double const>> &spans,
+         const thalamus::vector<std::chrono::nanoseconds> &sample_intervals,
+         const thalamus::vector<std::string_view> &) override;
+  bool has_analog_data() const override;
+  const AnalogFrame &frame() const override;
+  size_t modalities() const override;
+};
+} // namespace thalamus
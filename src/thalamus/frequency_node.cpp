@@ -58,7 +58,7 @@ struct FrequencyNode::Impl {
   bool alert = false;
   std::chrono::nanoseconds last_alert = 0ns;
   boost::signals2::scoped_connection get_source_connection;
-  boost::signals2::scoped_connection source_connection;
+  ScopedConnection source_connection;
   AnalogNode *source = nullptr;
 
 public:
@@ -6,12 +6,14 @@
 #endif
 #include <boost/qvm/quat_access.hpp>
 #include <boost/qvm/vec_access.hpp>
+#include <absl/strings/str_join.h>
 #include <grpcpp/support/status.h>
 #include "boost/asio/io_context.hpp"
 #include "thalamus.pb.h"
 #ifdef __clang__
 #pragma clang diagnostic pop
 #endif
+#include <thalamus/analog_history.hpp>
 #include <thalamus/grpc_impl.hpp>
 #include <thalamus/h5handle.hpp>
 #include <thalamus/image_node.hpp>
@@ -228,8 +230,8 @@ struct Service::Impl {
 
   struct AnalogSession : public NodeSession<AnalogNode, thalamus_grpc::AnalogResponse> {
 
-    boost::signals2::scoped_connection channels_changed_connection;
-    boost::signals2::scoped_connection ready_connection;
+    ScopedConnection channels_changed_connection;
+    ScopedConnection ready_connection;
     const ::thalamus_grpc::AnalogRequest request;
     std::vector<size_t> channels;
     std::set<size_t> specified_channel_ids;
@@ -249,6 +251,49 @@ struct Service::Impl {
 
     ~AnalogSession() override;
 
+    /**
+     * Sends the node's history from the last backfill_ns as one message with
+     * one span per selected channel.
+     */
+    void send_backfill(const AnalogHistory &history) {
+      std::vector<int> selected;
+      std::vector<std::vector<double>> samples;
+      ::thalamus_grpc::AnalogResponse response;
+      history.backfill(std::chrono::nanoseconds(request.backfill_ns()), [&](const AnalogFrame &frame) {
+        if (!response.is_backfill()) {
+          response.set_is_backfill(true);
+          for (auto i = 0; i < frame.num_channels(); ++i) {
+            std::string name(frame.names[size_t(i)]);
+            if(!channels_specified || specified_channel_ids.contains(size_t(i)) || specified_channel_names.contains(name)) {
+              selected.push_back(i);
+              auto span = response.add_spans();
+              span->set_name(name);
+              response.add_sample_intervals(uint64_t(frame.sample_intervals[size_t(i)].count()));
+            }
+          }
+          samples.resize(selected.size());
+        }
+        for (size_t c = 0; c < selected.size(); ++c) {
+          auto data = frame.data<double>(selected[c]);
+          samples[c].insert(samples[c].end(), data.begin(), data.end());
+        }
+        response.set_time(size_t(frame.time.count()));
+        response.set_remote_time(size_t(frame.remote_time.count()));
+      });
+      if (!response.is_backfill()) {
+        return;
+      }
+
+      response.set_channels_changed(true);
+      for (size_t c = 0; c < selected.size(); ++c) {
+        auto span = response.mutable_spans(int(c));
+        span->set_begin(uint32_t(response.data_size()));
+        response.mutable_data()->Add(samples[c].begin(), samples[c].end());
+        span->set_end(uint32_t(response.data_size()));
+      }
+      ServerWriteReactor<::thalamus_grpc::AnalogResponse>::send(std::move(response));
+    }
+
     void subscribe() override {
       THALAMUS_LOG(trace) << "got node";
       using channels_changed_signal_type = decltype(typed_node->channels_changed);
@@ -262,7 +307,7 @@ struct Service::Impl {
         channels_changed = true;
       }));
 
-      ready_connection = node::connect_ready_multithreaded(this->raw_node.get(), [&,c_state=state](const Node *) {
+      auto on_ready = [&,c_state=state](const Node *) {
         std::lock_guard<std::mutex> lock(c_state->mutex);
         if(c_state->joining) {
           THALAMUS_LOG(trace) << "ready_connection joined";
@@ -327,7 +372,20 @@ struct Service::Impl {
         }
 
         ServerWriteReactor<::thalamus_grpc::AnalogResponse>::send(std::move(response));
-      });
+      };
+
+      std::shared_ptr<AnalogHistory> history;
+      if (request.backfill_ns()) {
+        history = node_graph.get_analog_history(this->raw_node.get());
+      }
+      if (history) {
+        // The history records on the io_context thread.  Following it there
+        // puts every chunk either in the backfill or in the live stream.
+        send_backfill(*history);
+        ready_connection = node::connect_ready_singlethreaded(this->raw_node.get(), on_ready);
+      } else {
+        ready_connection = node::connect_ready_multithreaded(this->raw_node.get(), on_ready);
+      }
       raw_node.reset();
 
       timer.expires_after(1s);
@@ -490,6 +548,14 @@ Service::about(::grpc::ServerContext *,
   return ::grpc::Status::OK;
 }
 
+::grpc::Status
+Service::startup_report(::grpc::ServerContext *,
+                        const ::thalamus_grpc::Empty *,
+                        ::thalamus_grpc::StartupReport *response) {
+  *response = impl->node_graph.get_startup_report();
+  return ::grpc::Status::OK;
+}
+
 ::grpc::Status
 Service::get_type_name(::grpc::ServerContext *,
                        const ::thalamus_grpc::StringMessage *request,
@@ -1024,7 +1090,7 @@ static const size_t IMAGE_CHUNK_SIZE = 524288;
 struct ImageSession : public NodeSession<ImageNode, thalamus_grpc::Image> {
   Throttle throttle;
   const thalamus_grpc::ImageRequest request;
-  boost::signals2::scoped_connection ready_connection;
+  ScopedConnection ready_connection;
 
   std::vector<std::chrono::steady_clock::time_point> frame_times;
 
@@ -1116,8 +1182,8 @@ ImageSession::~ImageSession() {
 
 struct GraphSession : public NodeSession<AnalogNode, thalamus_grpc::GraphResponse> {
   const thalamus_grpc::GraphRequest request;
-  boost::signals2::scoped_connection channels_changed_connection;
-  boost::signals2::scoped_connection ready_connection;
+  ScopedConnection channels_changed_connection;
+  ScopedConnection ready_connection;
   
   std::vector<size_t> channels;
 
@@ -1141,6 +1207,137 @@ struct GraphSession : public NodeSession<AnalogNode, thalamus_grpc::GraphRespons
 
   ~GraphSession() override;
 
+  /**
+   * Bins the frame's samples into response, returns false while the
+   * requested channel names aren't all available.
+   */
+  bool add_frame(const AnalogFrame &frame, ::thalamus_grpc::GraphResponse &response) {
+    auto num_channels = size_t(frame.num_channels());
+    if (!has_channels && channels.size() != num_channels) {
+      for (auto i = channels.size(); i < num_channels; ++i) {
+        channels.push_back(i);
+      }
+      channels.resize(num_channels);
+      mins.resize(num_channels, std::numeric_limits<double>::max());
+      maxs.resize(num_channels, -std::numeric_limits<double>::max());
+      previous_mins.resize(num_channels);
+      previous_maxes.resize(num_channels);
+      current_times.resize(num_channels);
+      bin_ends.resize(num_channels, bin_ns);
+    }
+
+    if (!channel_names.empty()) {
+      std::vector<int> named_channels;
+      for (auto &name : channel_names) {
+        for (auto i = 0; i < int(num_channels); ++i) {
+          if (frame.names[size_t(i)] == name) {
+            named_channels.push_back(i);
+            break;
+          }
+        }
+      }
+      if (named_channels.size() == channel_names.size()) {
+        channels.insert(channels.end(), named_channels.begin(),
+                        named_channels.end());
+        channel_names.clear();
+
+        channels.resize(channels.size());
+        mins.resize(channels.size(), std::numeric_limits<double>::max());
+        maxs.resize(channels.size(), -std::numeric_limits<double>::max());
+        previous_mins.resize(channels.size());
+        previous_maxes.resize(channels.size());
+        current_times.resize(channels.size());
+        bin_ends.resize(channels.size(), bin_ns);
+      } else {
+        return false;
+      }
+    }
+
+    response.set_channels_changed(channels_changed);
+    channels_changed = false;
+    if (!first_time) {
+      first_time = frame.time;
+    }
+    auto is_transformed = frame.is_transformed;
+    for (auto c = 0u; c < channels.size(); ++c) {
+      auto channel = channels[c];
+      auto &min = mins[c];
+      auto &max = maxs[c];
+      auto &current_time = current_times[c];
+      auto &bin_end = bin_ends[c];
+      if (channel >= num_channels) {
+        continue;
+      }
+      auto span = response.add_spans();
+      span->set_begin(uint32_t(response.bins_size()));
+
+      auto interval = frame.sample_intervals[channel];
+      if (interval == 0ns) {
+        current_time = frame.time - *first_time;
+      }
+      auto scale = is_transformed ? frame.scales[channel] : 1.0;
+      auto offset = is_transformed ? frame.offsets[channel] : 0.0;
+      visit_frame(frame, [&](auto wrapper) {
+        auto data = wrapper->data(int(channel));
+        for (auto sample_raw : data) {
+          double sample = double(sample_raw) * scale + offset;
+          auto wrote = current_time >= bin_end;
+          while (current_time >= bin_end) {
+            response.add_bins(min);
+            response.add_bins(max);
+            bin_end += bin_ns;
+          }
+          if (wrote) {
+            min = std::numeric_limits<double>::max();
+            max = -std::numeric_limits<double>::max();
+          }
+          min = std::min(min, sample);
+          max = std::max(max, sample);
+          current_time += interval;
+        }
+      });
+      span->set_end(uint32_t(response.bins_size()));
+      auto name = frame.names[channel];
+      span->set_name(name.data(), name.size());
+    }
+    return true;
+  }
+
+  /**
+   * Bins the node's history from the last backfill_ns into one message with
+   * one span per channel.
+   */
+  void send_backfill(const AnalogHistory &history) {
+    ::thalamus_grpc::GraphResponse response;
+    std::vector<std::vector<double>> bins;
+    history.backfill(std::chrono::nanoseconds(request.backfill_ns()), [&](const AnalogFrame &frame) {
+      ::thalamus_grpc::GraphResponse chunk;
+      if (!add_frame(frame, chunk)) {
+        return;
+      }
+      response.set_channels_changed(response.channels_changed() || chunk.channels_changed());
+      bins.resize(size_t(chunk.spans_size()));
+      for (auto i = 0; i < chunk.spans_size(); ++i) {
+        auto &span = chunk.spans(i);
+        if (response.spans_size() <= i) {
+          response.add_spans()->set_name(span.name());
+        }
+        bins[size_t(i)].insert(bins[size_t(i)].end(), chunk.bins().begin() + span.begin(),
+                               chunk.bins().begin() + span.end());
+      }
+    });
+    if (response.spans_size() == 0) {
+      return;
+    }
+    for (auto i = 0; i < response.spans_size(); ++i) {
+      auto span = response.mutable_spans(i);
+      span->set_begin(uint32_t(response.bins_size()));
+      response.mutable_bins()->Add(bins[size_t(i)].begin(), bins[size_t(i)].end());
+      span->set_end(uint32_t(response.bins_size()));
+    }
+    ServerWriteReactor<::thalamus_grpc::GraphResponse>::send(std::move(response));
+  }
+
   void subscribe() override {
     channels.assign(request.channels().begin(),
                                   request.channels().end());
@@ -1171,6 +1368,14 @@ struct GraphSession : public NodeSession<AnalogNode, thalamus_grpc::GraphRespons
           channels_changed = true;
         }));
 
+    // The history is recorded on the ready signal too, so every chunk is
+    // either in the backfill or in the live stream.
+    if (request.backfill_ns()) {
+      if (auto history = node_graph.get_analog_history(raw_node.get())) {
+        send_backfill(*history);
+      }
+    }
+
     using signal_type = decltype(raw_node->ready);
     ready_connection =
       raw_node->ready.connect(signal_type::slot_type([this,c_state=this->state](const Node *) {
@@ -1181,98 +1386,10 @@ struct GraphSession : public NodeSession<AnalogNode, thalamus_grpc::GraphRespons
         if (!typed_node->has_analog_data()) {
           return;
         }
-        
         ::thalamus_grpc::GraphResponse response;
-
-        auto num_channels = size_t(typed_node->num_channels());
-        if (!has_channels && channels.size() != num_channels) {
-          for (auto i = channels.size(); i < num_channels; ++i) {
-            channels.push_back(i);
-          }
-          channels.resize(num_channels);
-          mins.resize(num_channels, std::numeric_limits<double>::max());
-          maxs.resize(num_channels, -std::numeric_limits<double>::max());
-          previous_mins.resize(num_channels);
-          previous_maxes.resize(num_channels);
-          current_times.resize(num_channels);
-          bin_ends.resize(num_channels, bin_ns);
-        }
-
-        if (!channel_names.empty()) {
-          std::vector<int> named_channels;
-          for (auto &name : channel_names) {
-            for (auto i = 0; i < int(num_channels); ++i) {
-              if (typed_node->name(i) == name) {
-                named_channels.push_back(i);
-                break;
-              }
-            }
-          }
-          if (named_channels.size() == channel_names.size()) {
-            channels.insert(channels.end(), named_channels.begin(),
-                            named_channels.end());
-            channel_names.clear();
-
-            channels.resize(channels.size());
-            mins.resize(channels.size(), std::numeric_limits<double>::max());
-            maxs.resize(channels.size(), -std::numeric_limits<double>::max());
-            previous_mins.resize(channels.size());
-            previous_maxes.resize(channels.size());
-            current_times.resize(channels.size());
-            bin_ends.resize(channels.size(), bin_ns);
-          } else {
-            return;
-          }
-        }
-
-        response.set_channels_changed(channels_changed);
-        channels_changed = false;
-        if (!first_time) {
-          first_time = typed_node->time();
-        }
-        auto is_transformed = typed_node->is_transformed();
-        for (auto c = 0u; c < channels.size(); ++c) {
-          auto channel = channels[c];
-          auto &min = mins[c];
-          auto &max = maxs[c];
-          auto &current_time = current_times[c];
-          auto &bin_end = bin_ends[c];
-          if (channel >= num_channels) {
-            continue;
-          }
-          auto span = response.add_spans();
-          span->set_begin(uint32_t(response.bins_size()));
-
-          auto interval = typed_node->sample_interval(int(channel));
-          if (interval == 0ns) {
-            current_time = typed_node->time() - *first_time;
-          }
-          auto scale = is_transformed ? typed_node->scale(int(channel)) : 1.0;
-          auto offset = is_transformed ? typed_node->offset(int(channel)) : 0.0;
-          visit_node(typed_node, [&](auto wrapper) {
-            auto data = wrapper->data(int(channel));
-            for (auto sample_raw : data) {
-              double sample = double(sample_raw) * scale + offset;
-              auto wrote = current_time >= bin_end;
-              while (current_time >= bin_end) {
-                response.add_bins(min);
-                response.add_bins(max);
-                bin_end += bin_ns;
-              }
-              if (wrote) {
-                min = std::numeric_limits<double>::max();
-                max = -std::numeric_limits<double>::max();
-              }
-              min = std::min(min, sample);
-              max = std::max(max, sample);
-              current_time += interval;
-            }
-          });
-          span->set_end(uint32_t(response.bins_size()));
-          auto name = typed_node->name(int(channel));
-          span->set_name(name.data(), name.size());
+        if (add_frame(typed_node->frame(), response)) {
+          ServerWriteReactor<::thalamus_grpc::GraphResponse>::send(std::move(response));
         }
-        ServerWriteReactor<::thalamus_grpc::GraphResponse>::send(std::move(response));
       }));
   }
 };
@@ -1348,7 +1465,7 @@ Service::graph(::grpc::CallbackServerContext *context,
       return ::grpc::Status::OK;
     }
 
-    boost::signals2::scoped_connection channels_connection =
+    ScopedConnection channels_connection =
         node->channels_changed.connect(
             channels_changed_signal_type::slot_type([&](const AnalogNode *) {
               if (!connection_mutex.try_lock()) {
@@ -1383,7 +1500,7 @@ Service::graph(::grpc::CallbackServerContext *context,
         break;
       }
 
-      boost::signals2::scoped_connection connection =
+      ScopedConnection connection =
           raw_node->ready.connect(signal_type::slot_type([&](const Node * base_node) {
             if (!connection_mutex.try_lock()) {
               return;
@@ -1787,9 +1904,95 @@ Service::image(::grpc::CallbackServerContext *context,
   return ::grpc::Status::OK;
 }
 
-::grpc::Status Service::replay(::grpc::ServerContext *,
-                               const ::thalamus_grpc::ReplayRequest *,
+/**
+ * Plays a capture through the graph's REPLAY node, adding one if the graph
+ * doesn't have any, and returns once playback finishes.  Cancelling the call
+ * stops playback.
+ */
+::grpc::Status Service::replay(::grpc::ServerContext *context,
+                               const ::thalamus_grpc::ReplayRequest *request,
                                ::thalamus_grpc::Empty *) {
+  set_current_thread_name("replay");
+  ContextGuard guard(this, context);
+
+  struct Playback {
+    std::promise<void> promise;
+    bool started = false;
+    bool finished = false;
+    ObservableDictPtr replay_state;
+    boost::signals2::scoped_connection connection;
+  };
+  auto playback = std::make_shared<Playback>();
+  auto future = playback->promise.get_future();
+  auto filename = request->filename();
+  auto nodes = absl::StrJoin(request->nodes(), ",");
+
+  auto finish = [playback] {
+    if (!playback->finished) {
+      playback->finished = true;
+      playback->connection.disconnect();
+      playback->promise.set_value();
+    }
+  };
+
+  auto configure = [playback, filename, nodes, finish](ObservableDictPtr replay_state) {
+    playback->replay_state = replay_state;
+    playback->connection = replay_state->changed.connect(
+        [playback, finish](auto, const auto &k, const auto &v) {
+          if (std::get<std::string>(k) != "Running") {
+            return;
+          }
+          if (std::get<bool>(v)) {
+            playback->started = true;
+          } else if (playback->started) {
+            finish();
+          }
+        });
+    (*replay_state)["File"].assign(filename, [playback, replay_state, nodes] {
+      (*replay_state)["Nodes"].assign(nodes, [replay_state] {
+        (*replay_state)["Running"].assign(true, [] {});
+      });
+    });
+  };
+
+  boost::asio::post(impl->io_context, [state = impl->state, configure, finish] {
+    auto root = std::get<ObservableDictPtr>(state);
+    if (!root->contains("nodes")) {
+      THALAMUS_LOG(error) << "No node graph to replay into";
+      finish();
+      return;
+    }
+    ObservableListPtr nodes_list = root->at("nodes");
+    for (auto i = 0ull; i < nodes_list->size(); ++i) {
+      ObservableDictPtr node = nodes_list->at(i);
+      std::string type = node->at("type");
+      if (type == "REPLAY") {
+        configure(node);
+        return;
+      }
+    }
+    boost::json::object node_json;
+    node_json["name"] = "Replay";
+    node_json["type"] = "REPLAY";
+    nodes_list->push_back(ObservableCollection::from_json(node_json),
+                          [nodes_list, configure] {
+                            ObservableDictPtr node =
+                                nodes_list->at(nodes_list->size() - 1);
+                            configure(node);
+                          });
+  });
+
+  while (future.wait_for(1s) == std::future_status::timeout) {
+    if (context->IsCancelled() || impl->io_context.stopped()) {
+      boost::asio::post(impl->io_context, [playback, finish] {
+        if (playback->replay_state) {
+          (*playback->replay_state)["Running"].assign(false, [] {});
+        }
+        finish();
+      });
+      break;
+    }
+  }
   return ::grpc::Status::OK;
 }
 
@@ -156,6 +156,9 @@ public:
   ::grpc::Status about(::grpc::ServerContext *context,
                        const ::thalamus_grpc::Empty *request,
                        ::thalamus_grpc::Text *response) override;
+  ::grpc::Status startup_report(::grpc::ServerContext *context,
+                                const ::thalamus_grpc::Empty *request,
+                                ::thalamus_grpc::StartupReport *response) override;
 
   std::future<ObservableCollection::Value> evaluate(const std::string &code);
   bool send_change(ObservableCollection::Action action,
@@ -15,7 +15,7 @@ struct HexascopeNode::Impl {
   ObservableDictPtr state;
   ObservableListPtr hexa_to_camera_state;
   boost::signals2::scoped_connection state_connection;
-  boost::signals2::scoped_connection source_connection;
+  ScopedConnection source_connection;
   boost::signals2::scoped_connection get_node_connection;
   HexascopeNode *outer;
   MotionCaptureNode *source_node;
@@ -29,7 +29,7 @@ struct FfmpegNode::Impl {
   boost::signals2::scoped_connection state_connection;
   boost::signals2::scoped_connection options_connection;
   NodeGraph::NodeConnection node_connection;
-  boost::signals2::scoped_connection data_connection;
+  ScopedConnection data_connection;
   bool is_running = false;
   FfmpegNode *outer;
   std::chrono::nanoseconds time;
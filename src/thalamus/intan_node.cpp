@@ -113,6 +113,9 @@ struct IntanNode::Impl {
   std::map<size_t, std::function<void(Node *)>> observers;
   std::vector<std::vector<double>> data;
   std::vector<std::string> names;
+  AnalogFrameBuilder frame;
+  bool frame_stale = true;
+  bool layout_stale = true;
   // double sample_rate;
   size_t counter = 0;
   std::string address = "localhost";
@@ -283,6 +286,7 @@ public:
         TRACE_EVENT("intan", "ready");
         num_samples = 128;
         time = std::chrono::steady_clock::now().time_since_epoch();
+        frame_stale = true;
         outer->ready(outer);
         for (auto &d : data) {
           d.clear();
@@ -434,6 +438,7 @@ public:
         co_return;
       }
       sample_interval = std::chrono::nanoseconds(std::nano::den / samplerate);
+      layout_stale = true;
       outer->channels_changed(outer);
 
       THALAMUS_LOG(info) << "Starting " << sample_interval.count();
@@ -588,6 +593,29 @@ std::string_view IntanNode::name(int channel) const {
 
 int IntanNode::num_channels() const { return int(impl->data.size()); }
 
+const AnalogFrame &IntanNode::frame() const {
+  auto &frame = impl->frame;
+  if (!impl->frame_stale) {
+    return frame.get();
+  }
+  auto count = impl->data.size();
+  if (impl->layout_stale || size_t(frame.get().num_channels()) != count) {
+    frame.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+      frame.set_layout(i, i < impl->names.size() ? impl->names[i] : "",
+                       impl->sample_interval);
+    }
+    impl->layout_stale = false;
+  }
+  for (size_t i = 0; i < count; ++i) {
+    frame.set_data(i, std::span<const double>(impl->data[i].data(),
+                                              impl->num_samples));
+  }
+  frame.finish(impl->time);
+  impl->frame_stale = false;
+  return frame.get();
+}
+
 std::chrono::nanoseconds IntanNode::sample_interval(int) const {
   return impl->sample_interval;
 }
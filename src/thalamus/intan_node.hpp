@@ -32,6 +32,7 @@ public:
   std::chrono::nanoseconds sample_interval(int) const override;
   std::chrono::nanoseconds time() const override;
   std::string_view name(int channel) const override;
+  const AnalogFrame &frame() const override;
   size_t modalities() const override;
 };
 } // namespace thalamus
@@ -11,7 +11,7 @@ struct LoopTestNode::Impl {
   ObservableDictPtr state;
   boost::signals2::scoped_connection state_connection;
   boost::signals2::scoped_connection data_connection;
-  boost::signals2::scoped_connection channels_changed_connection;
+  ScopedConnection channels_changed_connection;
   boost::signals2::scoped_connection get_node_connection;
   LoopTestNode *outer;
   std::chrono::nanoseconds time = 0ns;
@@ -39,7 +39,7 @@ struct LuaNode::Impl {
   ObservableDictPtr state;
   boost::signals2::scoped_connection state_connection;
   std::map<std::string, boost::signals2::scoped_connection> sources_connections;
-  boost::signals2::scoped_connection channels_connection;
+  ScopedConnection channels_connection;
   size_t buffer_size;
   // double sample_rate;
   size_t counter = 0;
@@ -145,7 +145,7 @@ public:
     return 1;
   }
 
-  boost::signals2::scoped_connection source_connection;
+  ScopedConnection source_connection;
   AnalogNode *source = nullptr;
   std::vector<std::vector<double>> data;
   std::vector<double> last_data;
@@ -4,6 +4,7 @@
 #include <thalamus/grpc_impl.hpp>
 #include <thalamus/modalities_util.hpp>
 #include <thalamus/nidaq_node.hpp>
+#include <mutex>
 #include <numeric>
 #include <regex>
 #include <thalamus/thread.hpp>
@@ -32,12 +33,9 @@ namespace thalamus {
 static DAQmxAPI *daqmxapi = nullptr;
 
 static bool prepare_nidaq() {
-  static bool has_run = false;
-  if(!has_run) {
-    daqmxapi = DAQmxAPI::get_singleton();
-    has_run = true;
-  }
-
+  // NIDAQ and NIDAQ_OUT may be prepared concurrently.
+  static std::once_flag once;
+  std::call_once(once, [] { daqmxapi = DAQmxAPI::get_singleton(); });
   return daqmxapi != nullptr;
 }
 
@@ -94,6 +92,9 @@ struct NidaqNode::Impl {
   NidaqNode *outer;
   bool is_running;
   thalamus::vector<std::string> recommended_names;
+  AnalogFrameBuilder frame;
+  bool frame_stale = true;
+  bool layout_stale = true;
   Impl(ObservableDictPtr _state, boost::asio::io_context &_io_context,
        NodeGraph *_graph, NidaqNode *_outer)
       : state(_state), task_handle(nullptr), io_context(_io_context),
@@ -176,6 +177,7 @@ struct NidaqNode::Impl {
       }
 
       node_impl->_time = now.time_since_epoch();
+      node_impl->frame_stale = true;
       node->ready(node);
       node_impl->busy = false;
     });
@@ -310,6 +312,7 @@ struct NidaqNode::Impl {
           return;
         }
         _time = 0ns;
+        layout_stale = true;
         outer->channels_changed(outer);
 
         // if (reader) {
@@ -355,6 +358,29 @@ std::string_view NidaqNode::name(int channel) const {
   return impl->recommended_names.at(size_t(channel));
 }
 
+const AnalogFrame &NidaqNode::frame() const {
+  auto &frame = impl->frame;
+  if (!impl->frame_stale) {
+    return frame.get();
+  }
+  auto count = impl->spans.size();
+  if (impl->layout_stale || size_t(frame.get().num_channels()) != count) {
+    frame.resize(count);
+    auto &names = impl->recommended_names;
+    for (size_t i = 0; i < count; ++i) {
+      frame.set_layout(i, i < names.size() ? names[i] : "",
+                       impl->_sample_interval);
+    }
+    impl->layout_stale = false;
+  }
+  for (size_t i = 0; i < count; ++i) {
+    frame.set_data(i, impl->spans[i]);
+  }
+  frame.finish(impl->_time);
+  impl->frame_stale = false;
+  return frame.get();
+}
+
 void NidaqNode::inject(
     const thalamus::vector<std::span<double const>> &spans,
     const thalamus::vector<std::chrono::nanoseconds> &sample_intervals,
@@ -364,9 +390,12 @@ void NidaqNode::inject(
   impl->_num_channels = spans.size();
   impl->spans = spans;
   impl->_sample_interval = sample_intervals.at(0);
+  impl->frame_stale = true;
+  impl->layout_stale = true;
   ready(this);
   impl->_sample_interval = previous_sample_interval;
   impl->_num_channels = temp;
+  impl->layout_stale = true;
 }
 
 static bool is_digital(const std::string &channel) {
@@ -388,7 +417,7 @@ struct NidaqOutputNode::Impl {
   std::vector<std::span<const double>> _data;
   size_t _num_channels;
   size_t buffer_size;
-  boost::signals2::scoped_connection source_connection;
+  ScopedConnection source_connection;
   std::map<size_t, std::function<void(Node *)>> observers;
   double _sample_rate;
   thalamus::vector<std::chrono::nanoseconds> _sample_intervals;
@@ -37,6 +37,7 @@ public:
          const thalamus::vector<std::string_view> &names) override;
   static int get_num_channels(const std::string &channel);
   std::string_view name(int channel) const override;
+  const AnalogFrame &frame() const override;
 
   static bool prepare();
   size_t modalities() const override;
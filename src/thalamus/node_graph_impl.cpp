@@ -1,17 +1,23 @@
 #include <cstddef>
+#include <cstring>
+#include <future>
 #include <limits>
+#include <thread>
 #include <thalamus/tracing.hpp>
 #include <chrono>
 #include <thalamus/algebra_node.hpp>
 #include <thalamus/nidaq_node.hpp>
 #include <thalamus/storage_node.hpp>
 #include <thalamus/xsens_node.hpp>
+#include <thalamus/analog_history.hpp>
 #include <thalamus/analog_node.hpp>
 #include <thalamus/aruco_node.hpp>
 #include <thalamus/alpha_omega_node.hpp>
 #include <thalamus/channel_picker_node.hpp>
 #include <thalamus/chessboard_node.hpp>
+#include <thalamus/decimate_node.hpp>
 #include <thalamus/distortion_node.hpp>
+#include <thalamus/filter_node.hpp>
 #include <thalamus/genicam_node.hpp>
 #include <thalamus/hexascope_node.hpp>
 #include <thalamus/image_node.hpp>
@@ -25,7 +31,9 @@
 #include <thalamus/pupil_node.hpp>
 #include <thalamus/remote_node.hpp>
 #include <thalamus/remotelog_node.hpp>
+#include <thalamus/replay_node.hpp>
 #include <thalamus/serialtouchscreen_node.hpp>
+#include <thalamus/spike_detect_node.hpp>
 #include <thalamus/joystick_node.hpp>
 #include <variant>
 #ifndef _WIN32
@@ -46,6 +54,7 @@
 #include <thalamus/touchscreen_node.hpp>
 #include <thalamus/video_node.hpp>
 #include <thalamus/test_pulse_node.hpp>
+#include <thalamus/thread.hpp>
 #include <thalamus/wallclock_node.hpp>
 #include <thalamus/delsys_node.hpp>
 #include <thalamus/ceci_node.hpp>
@@ -135,7 +144,7 @@ struct ThalamusNodeGetConnection {
 };
 
 struct ThalamusNodeReadyConnection {
-  boost::signals2::scoped_connection connection;
+  thalamus::ScopedConnection connection;
   ThalamusNode* node;
 };
 
@@ -160,6 +169,7 @@ struct INodeFactory {
                        boost::asio::io_context &io_context,
                        NodeGraph *graph) = 0;
   virtual bool prepare() = 0;
+  virtual bool has_prepare() = 0;
   virtual void cleanup() = 0;
   virtual std::string type_name() = 0;
 };
@@ -178,6 +188,7 @@ template <typename T> struct NodeFactory : public INodeFactory {
       return true;
     }
   }
+  bool has_prepare() override { return requires { T::prepare(); }; }
   void cleanup() override {
     constexpr bool has_cleanup = requires { T::cleanup(); };
     if constexpr (has_cleanup) {
@@ -200,11 +211,89 @@ struct ExtNode : public Node, public AnalogNode, public ImageNode, public Motion
   ThalamusNodeFactory *factory;
   ThalamusAPI *api;
   std::function<void()> drop_ready;
-
-  ExtNode(ThalamusNode *_node, ThalamusNodeFactory *_factory, ThalamusAPI *_api)
-      : node(_node), factory(_factory), api(_api) {}
+  // The plugin publishes whole ThalamusAnalogFrames, which are converted once
+  // per ready and also serve the per channel API.
+  bool frames;
+  mutable std::mutex frame_mutex;
+  mutable std::atomic_bool frame_stale = true;
+  mutable AnalogFrameBuilder frame_builder;
+  mutable std::optional<uint64_t> plugin_frame_version;
+  mutable std::vector<std::vector<std::byte>> gathered;
+
+  ExtNode(ThalamusNode *_node, ThalamusNodeFactory *_factory, ThalamusAPI *_api, uint64_t capabilities)
+      : node(_node), factory(_factory), api(_api),
+        frames((capabilities & THALAMUS_CAPABILITY_ANALOG_FRAME) && node->analog && node->analog->frame) {}
   ~ExtNode() override;
 
+  void mark_frame_stale() {
+    if(frames) {
+      frame_stale = true;
+    }
+  }
+
+  template <typename T>
+  void read_channels(const ThalamusAnalogFrame &source) const {
+    for(size_t i = 0;i < source.num_channels;++i) {
+      auto& channel = source.channels[i];
+      if(channel.stride == sizeof(T)) {
+        frame_builder.set_data(i, std::span<const T>(static_cast<const T*>(channel.data), channel.size));
+        continue;
+      }
+      auto& buffer = gathered[i];
+      buffer.resize(channel.size*sizeof(T));
+      auto input = static_cast<const std::byte*>(channel.data);
+      for(size_t j = 0;j < channel.size;++j) {
+        std::memcpy(buffer.data() + j*sizeof(T), input + int64_t(j)*channel.stride, sizeof(T));
+      }
+      frame_builder.set_data(i, std::span<const T>(reinterpret_cast<const T*>(buffer.data()), channel.size));
+    }
+  }
+
+  void read_frame() const {
+    ThalamusAnalogFrame source;
+    memset(&source, 0, sizeof(source));
+    node->analog->frame(&source, node);
+    auto count = size_t(source.num_channels);
+    frame_builder.resize(count);
+    gathered.resize(count);
+    if(plugin_frame_version != source.version) {
+      for(size_t i = 0;i < count;++i) {
+        auto& channel = source.channels[i];
+        frame_builder.set_layout(i, to_string_view(channel.name), std::chrono::nanoseconds(channel.sample_interval_ns),
+                                 channel.scale, channel.offset);
+      }
+      plugin_frame_version = source.version;
+    }
+    switch(source.type) {
+    case ThalamusSampleType::SampleShort:
+      read_channels<short>(source);
+      break;
+    case ThalamusSampleType::SampleInt:
+      read_channels<int>(source);
+      break;
+    case ThalamusSampleType::SampleULong:
+      read_channels<uint64_t>(source);
+      break;
+    case ThalamusSampleType::SampleDouble:
+      read_channels<double>(source);
+      break;
+    }
+    frame_builder.finish(std::chrono::nanoseconds(source.time_ns), std::chrono::nanoseconds(source.remote_time_ns),
+                         source.is_transformed);
+  }
+
+  const AnalogFrame &frame() const override {
+    // Offmain nodes are read from the io_context and their own thread at once
+    std::lock_guard<std::mutex> lock(frame_mutex);
+    if(!frames) {
+      return AnalogNode::frame();
+    }
+    if(frame_stale.exchange(false)) {
+      read_frame();
+    }
+    return frame_builder.get();
+  }
+
   void predrop(std::function<void()> on_drop_ready) override {
     THALAMUS_LOG(info) << "*ext* ExtNode::predrop";
     drop_ready = on_drop_ready;
@@ -225,29 +314,47 @@ struct ExtNode : public Node, public AnalogNode, public ImageNode, public Motion
   }
 
   std::span<const double> data(int channel) const override {
+    if(frames) {
+      return frame().data<double>(channel);
+    }
     ThalamusDoubleSpan temp;
     node->analog->data(&temp, node, channel);
     return std::span<const double>(temp.data, temp.data+temp.size);
   }
   std::span<const short> short_data(int channel) const override {
+    if(frames) {
+      return frame().data<short>(channel);
+    }
     ThalamusShortSpan temp;
     node->analog->short_data(&temp, node, channel);
     return std::span<const short>(temp.data, temp.data+temp.size);
   }
   std::span<const int> int_data(int channel) const override {
+    if(frames) {
+      return frame().data<int>(channel);
+    }
     ThalamusIntSpan temp;
     node->analog->int_data(&temp, node, channel);
     return std::span<const int>(temp.data, temp.data+temp.size);
   }
   std::span<const uint64_t> ulong_data(int channel) const override {
+    if(frames) {
+      return frame().data<uint64_t>(channel);
+    }
     ThalamusULongSpan temp;
     node->analog->ulong_data(&temp, node, channel);
     return std::span<const uint64_t>(temp.data, temp.data+temp.size);
   }
   int num_channels() const override {
+    if(frames) {
+      return frame().num_channels();
+    }
     return node->analog->num_channels(node);
   }
   std::chrono::nanoseconds sample_interval(int channel) const override {
+    if(frames) {
+      return frame().sample_intervals[size_t(channel)];
+    }
     return std::chrono::nanoseconds(node->analog->sample_interval_ns(node, channel));
   }
   std::chrono::nanoseconds time() const override {
@@ -257,6 +364,9 @@ struct ExtNode : public Node, public AnalogNode, public ImageNode, public Motion
     return 0ns;
   }
   std::string_view name(int channel) const override {
+    if(frames) {
+      return frame().names[size_t(channel)];
+    }
     ThalamusCharSpan temp2;
     node->analog->name(&temp2, node, channel);
     return std::string_view(temp2.data, temp2.data + temp2.size);
@@ -270,22 +380,40 @@ struct ExtNode : public Node, public AnalogNode, public ImageNode, public Motion
     return node->analog->has_analog_data(node);
   }
   bool is_short_data() const override {
+    if(frames) {
+      return frame().type == AnalogFrame::Type::SHORT;
+    }
     return node->analog->is_short_data ? node->analog->is_short_data(node) : false;
   }
   bool is_int_data() const override {
+    if(frames) {
+      return frame().type == AnalogFrame::Type::INT;
+    }
     return node->analog->is_int_data ? node->analog->is_int_data(node) : false;
   }
   bool is_ulong_data() const override {
+    if(frames) {
+      return frame().type == AnalogFrame::Type::ULONG;
+    }
     return node->analog->is_ulong_data ? node->analog->is_ulong_data(node) : false;
   }
 
   bool is_transformed() const override {
+    if(frames) {
+      return frame().is_transformed;
+    }
     return node->analog->is_transformed ? node->analog->is_transformed(node) : false;
   }
   double scale(int channel) const override {
+    if(frames) {
+      return frame().scales[size_t(channel)];
+    }
     return node->analog->scale(node, channel);
   }
   double offset(int channel) const override {
+    if(frames) {
+      return frame().offsets[size_t(channel)];
+    }
     return node->analog->offset(node, channel);
   }
 
@@ -378,8 +506,22 @@ struct Interfaces {
   MotionCaptureNode* mocap = nullptr;
   std::atomic_int safe = 0;
   std::atomic_int count = 0;
+  // The channels of the frames handed out by plugin_analog_frame.  Callbacks
+  // of ready run on the io_context while those of ready_multithreaded run on
+  // the node's own thread, so each signal gets its own table and the node's
+  // frame is read under frame_mutex.
+  struct FrameTable {
+    uint64_t version = 0;
+    std::vector<ThalamusAnalogChannel> channels;
+  };
+  std::mutex frame_mutex;
+  FrameTable frame_table;
+  FrameTable multithreaded_frame_table;
 };
 
+// Set while a thread runs a plugin's ready_multithreaded callback
+static thread_local bool in_multithreaded_ready = false;
+
 #define ASSERT_SAFE() do { if(!interfaces->safe) [[unlikely]] { THALAMUS_ABORT("Node should only be accessed in get_node or ready callback"); } } while(0)
 
 static uint64_t plugin_analog_time_ns(struct ThalamusNode* node) {
@@ -507,6 +649,79 @@ static double plugin_analog_offset(struct ThalamusNode* node, int channel) {
   return interfaces->analog->offset(channel);
 }
 
+template <typename T>
+static void plugin_analog_frame_data(std::vector<ThalamusAnalogChannel>& channels, const AnalogFrame& frame) {
+  for(size_t i = 0;i < channels.size();++i) {
+    auto span = frame.data<T>(int(i));
+    channels[i].data = span.data();
+    channels[i].size = span.size();
+  }
+}
+
+static void plugin_analog_frame(struct ThalamusAnalogFrame* output, struct ThalamusNode* node) {
+  auto interfaces = reinterpret_cast<Interfaces*>(node->impl);
+  ASSERT_SAFE();
+  auto& table = in_multithreaded_ready ? interfaces->multithreaded_frame_table
+                                       : interfaces->frame_table;
+  std::lock_guard<std::mutex> lock(interfaces->frame_mutex);
+  const auto& frame = interfaces->analog->frame();
+
+  auto& channels = table.channels;
+  if(table.version != frame.version) {
+    int64_t stride = sizeof(double);
+    switch(frame.type) {
+    case AnalogFrame::Type::SHORT:
+      stride = sizeof(short);
+      break;
+    case AnalogFrame::Type::INT:
+      stride = sizeof(int);
+      break;
+    case AnalogFrame::Type::ULONG:
+      stride = sizeof(uint64_t);
+      break;
+    case AnalogFrame::Type::DOUBLE:
+      break;
+    }
+    channels.resize(size_t(frame.num_channels()));
+    for(size_t i = 0;i < channels.size();++i) {
+      auto& channel = channels[i];
+      channel.stride = stride;
+      channel.sample_interval_ns = uint64_t(frame.sample_intervals[i].count());
+      channel.scale = frame.scales[i];
+      channel.offset = frame.offsets[i];
+      channel.name.data = frame.names[i].data();
+      channel.name.size = frame.names[i].size();
+      channel.name.owns_data = 0;
+    }
+    table.version = frame.version;
+  }
+
+  switch(frame.type) {
+  case AnalogFrame::Type::SHORT:
+    output->type = ThalamusSampleType::SampleShort;
+    plugin_analog_frame_data<short>(channels, frame);
+    break;
+  case AnalogFrame::Type::INT:
+    output->type = ThalamusSampleType::SampleInt;
+    plugin_analog_frame_data<int>(channels, frame);
+    break;
+  case AnalogFrame::Type::ULONG:
+    output->type = ThalamusSampleType::SampleULong;
+    plugin_analog_frame_data<uint64_t>(channels, frame);
+    break;
+  case AnalogFrame::Type::DOUBLE:
+    output->type = ThalamusSampleType::SampleDouble;
+    plugin_analog_frame_data<double>(channels, frame);
+    break;
+  }
+  output->version = frame.version;
+  output->time_ns = uint64_t(frame.time.count());
+  output->remote_time_ns = uint64_t(frame.remote_time.count());
+  output->is_transformed = frame.is_transformed ? 1 : 0;
+  output->num_channels = channels.size();
+  output->channels = channels.data();
+}
+
 static void plugin_image_plane(struct ThalamusByteSpan* output, struct ThalamusNode* node, int channel) {
   auto interfaces = reinterpret_cast<Interfaces*>(node->impl);
   ASSERT_SAFE();
@@ -637,6 +852,7 @@ struct ThalamusAPIImpl {
       result->analog->is_transformed = plugin_analog_is_transformed;
       result->analog->scale = plugin_analog_scale;
       result->analog->offset = plugin_analog_offset;
+      result->analog->frame = plugin_analog_frame;
     }
     if (image) {
       interfaces->image = image;
@@ -872,11 +1088,13 @@ struct ThalamusAPIImpl {
 
   static void node_ready(ThalamusNode* node) {
     auto ext_node = reinterpret_cast<ExtNode*>(node->impl);
+    ext_node->mark_frame_stale();
     ext_node->ready(ext_node);
   }
 
   static void node_ready_offmain(ThalamusNode* node) {
     auto ext_node = reinterpret_cast<ExtNode*>(node->impl);
+    ext_node->mark_frame_stale();
     node::signal_ready_offmain(ext_node, *io_context);
   }
 
@@ -1301,7 +1519,10 @@ struct ThalamusAPIImpl {
     node_inc_ref(node);
     result->connection = node::connect_ready_multithreaded(interfaces->node, [node, callback, data] (auto) {
       NodeGuard lock(node);
+      auto was_multithreaded = in_multithreaded_ready;
+      in_multithreaded_ready = true;
       callback(node, data);
+      in_multithreaded_ready = was_multithreaded;
     });
     return result;
   }
@@ -1372,12 +1593,22 @@ struct ThalamusAPIImpl {
   static void unlock_vulkan_queue(ThalamusVkQueueLock* lock) {
     delete lock;
   }
+
+  // The capabilities of the extension whose thalamus_get_node_factories is
+  // running.
+  static uint64_t negotiated_capabilities;
+
+  static uint64_t negotiate_capabilities(uint64_t requested) {
+    negotiated_capabilities = requested & THALAMUS_CAPABILITY_ANALOG_FRAME;
+    return negotiated_capabilities;
+  }
 };
 
 std::map<ObservableCollection::Value, ThalamusState*>* ThalamusAPIImpl::cpp_to_c = nullptr;
 std::map<ThalamusState*, ObservableCollection::Value>* ThalamusAPIImpl::c_to_cpp = nullptr;
 boost::asio::io_context* ThalamusAPIImpl::io_context = nullptr;
 NodeGraphImpl* ThalamusAPIImpl::node_graph = nullptr;
+uint64_t ThalamusAPIImpl::negotiated_capabilities = 0;
 
 
 std::mutex* ThalamusAPIImpl::mutex = nullptr;
@@ -1389,9 +1620,15 @@ struct ExtNodeFactory : public INodeFactory {
   ThalamusIoContext io_context;
   ThalamusNodeGraph node_graph;
   ThalamusAPI* api;
+  // Factories of one extension share its globals, so their prepare steps
+  // don't run concurrently.
+  std::shared_ptr<std::mutex> extension_mutex;
+  uint64_t capabilities;
 
-  ExtNodeFactory(ThalamusNodeFactory* _underlying, boost::asio::io_context &_io_context, NodeGraph *graph, ThalamusAPI* _api)
-  : underlying(_underlying), io_context(_io_context), node_graph(graph), api(_api) {}
+  ExtNodeFactory(ThalamusNodeFactory* _underlying, boost::asio::io_context &_io_context, NodeGraph *graph, ThalamusAPI* _api,
+                 std::shared_ptr<std::mutex> _extension_mutex, uint64_t _capabilities)
+  : underlying(_underlying), io_context(_io_context), node_graph(graph), api(_api), extension_mutex(_extension_mutex),
+    capabilities(_capabilities) {}
 
   Node *create(ObservableDictPtr state, boost::asio::io_context &,
                NodeGraph *) override {
@@ -1400,18 +1637,20 @@ struct ExtNodeFactory : public INodeFactory {
     auto node = underlying->create(underlying, state_wrapper, &io_context, &node_graph);
 
     ThalamusAPIImpl::state_dec_ref(state_wrapper);
-    auto result = new ExtNode(node, underlying, api);
+    auto result = new ExtNode(node, underlying, api, capabilities);
     node->impl = result;
     return result;
   }
 
   bool prepare() override {
     if(underlying->prepare != nullptr) {
+      std::lock_guard<std::mutex> lock(*extension_mutex);
       return underlying->prepare(underlying);
     } else {
       return true;
     }
   }
+  bool has_prepare() override { return underlying->prepare != nullptr; }
   void cleanup() override {
     if(underlying->cleanup != nullptr) {
       return underlying->cleanup(underlying);
@@ -1427,6 +1666,7 @@ struct NodeGraphImpl::Impl {
   ObservableListPtr nodes;
   std::vector<std::string> node_next_type;
   std::vector<std::shared_ptr<Node>> node_impls;
+  std::vector<std::shared_ptr<AnalogHistory>> node_histories;
   std::vector<std::string> node_types;
   std::vector<ObservableDictPtr> node_configs;
   size_t num_nodes;
@@ -1451,6 +1691,31 @@ struct NodeGraphImpl::Impl {
 
   std::map<std::string, INodeFactory *> node_factories;
 
+  struct Preparation {
+    std::shared_future<bool> result;
+    std::optional<bool> prepared;
+    std::chrono::nanoseconds duration = 0ns;
+  };
+  struct NodeInit {
+    std::string name;
+    std::string type;
+    std::chrono::nanoseconds wait;
+    std::chrono::nanoseconds init;
+    std::chrono::steady_clock::time_point created;
+  };
+  std::mutex startup_mutex;
+  std::map<std::string, Preparation> preparations;
+  // Nodes whose type is still preparing and when they were added
+  std::map<ObservableDict *, std::chrono::steady_clock::time_point> waiting;
+  // While the graph is constructed the io_context isn't running yet, so nodes
+  // wait for their types instead of being created later.
+  bool constructing = true;
+  // Expires with the graph, work posted by prepare threads checks it.
+  std::shared_ptr<int> lifetime = std::make_shared<int>();
+  std::vector<NodeInit> node_inits;
+  size_t logged_node_inits = 0;
+  boost::asio::steady_timer startup_timer;
+
   ThalamusAPIImpl thalamus_api_impl;
   ThalamusAPI thalamus_api;
   int creating_index = -1;
@@ -1466,7 +1731,8 @@ public:
        std::vector<SharedLibrary>& _extension, Vulkan _vulkan)
       : nodes(_nodes), num_nodes(nodes->size()), io_context(_io_context),
         outer(_outer), system_time(_system_time), steady_time(_steady_time),
-        thread_pool("ThreadPool"), stub(_stub), extension(_extension), vulkan(_vulkan) {
+        thread_pool("ThreadPool"), stub(_stub), extension(_extension), vulkan(_vulkan),
+        startup_timer(_io_context) {
 
     ThalamusAPIImpl::cpp_to_c = new std::map<ObservableCollection::Value, ThalamusState*>();
     ThalamusAPIImpl::c_to_cpp = new std::map<ThalamusState*, ObservableCollection::Value>();
@@ -1590,7 +1856,8 @@ public:
     thalamus_api.create_vulkan_command_pool = ThalamusAPIImpl::create_vulkan_command_pool;
     thalamus_api.lock_vulkan_queue = ThalamusAPIImpl::lock_vulkan_queue;
     thalamus_api.unlock_vulkan_queue = ThalamusAPIImpl::unlock_vulkan_queue;
-    thalamus_api.version = 91;
+    thalamus_api.negotiate_capabilities = ThalamusAPIImpl::negotiate_capabilities;
+    thalamus_api.version = 92;
 
     node_factories = {
         {"NONE", new NodeFactory<NoneNode>()},
@@ -1617,6 +1884,9 @@ public:
         {"THREAD_POOL", new NodeFactory<ThreadPoolNode>()},
         {"CHANNEL_PICKER", new NodeFactory<ChannelPickerNode>()},
         {"NORMALIZE", new NodeFactory<NormalizeNode>()},
+        {"FILTER", new NodeFactory<FilterNode>()},
+        {"SPIKE_DETECT", new NodeFactory<SpikeDetectNode>()},
+        {"DECIMATE", new NodeFactory<DecimateNode>()},
         {"ALGEBRA", new NodeFactory<AlgebraNode>()},
         {"LUA", new NodeFactory<LuaNode>()},
 #if !defined(_WIN32) && !defined(__APPLE__)
@@ -1627,6 +1897,8 @@ public:
 #endif
         {"REMOTE", new NodeFactory<RemoteNode>()},
         {"REMOTE_LOG", new NodeFactory<RemoteLogNode>()},
+        {"REPLAY", new NodeFactory<ReplayNode>()},
+        {"REPLAY_SOURCE", new NodeFactory<ReplaySourceNode>()},
         {"CHESSBOARD", new NodeFactory<ChessBoardNode>()},
         {"PUPIL", new NodeFactory<PupilNode>()},
         {"LOG", new NodeFactory<LogNode>()},
@@ -1656,35 +1928,37 @@ public:
       auto get_node_factories = ext.load<thalamus_get_node_factories_t>("thalamus_get_node_factories");
       THALAMUS_ASSERT(get_node_factories, "thalamus_get_node_factories not found in extension");
 
+      ThalamusAPIImpl::negotiated_capabilities = 0;
       auto factory = get_node_factories(&thalamus_api);
+      auto capabilities = ThalamusAPIImpl::negotiated_capabilities;
+      THALAMUS_LOG(info) << ext.name() << " capabilities " << capabilities;
+      auto extension_mutex = std::make_shared<std::mutex>();
       while(*factory != nullptr) {
         THALAMUS_LOG(info) << "Found " << (*factory)->type;
         auto type_name = to_string((*factory)->type);
-        node_factories[type_name] = new ExtNodeFactory(*factory, io_context, outer, &thalamus_api);
+        node_factories[type_name] = new ExtNodeFactory(*factory, io_context, outer, &thalamus_api, extension_mutex,
+                                                       capabilities);
         ++factory;
       }
     }
 
     using namespace std::placeholders;
-    auto i = node_factories.begin();
-    while (i != node_factories.end()) {
-      if (!i->second->prepare()) {
-        i = node_factories.erase(i);
-      } else {
-        ++i;
-      }
-    }
-    
     nodes_connection = nodes->changed.connect(std::bind(&Impl::on_nodes, this, _1, _2, _3));
   }
 
   ~Impl() {
+    startup_timer.cancel();
     nodes_connection.disconnect();
     node_connections.clear();
+    node_histories.clear();
     node_impls.clear();
+    for (auto &[type, preparation] : preparations) {
+      if (preparation.result.get()) {
+        node_factories.at(type)->cleanup();
+      }
+    }
     auto i = node_factories.begin();
     while (i != node_factories.end()) {
-      i->second->cleanup();
       delete i->second;
       ++i;
     }
@@ -1710,6 +1984,236 @@ public:
     }
   }
 
+  /**
+   * Starts the prepare step of a node type on its own thread unless it was
+   * already started.  Types prepare concurrently with each other and with
+   * the construction of nodes whose types are ready.
+   */
+  void prepare_type(const std::string &type) {
+    std::lock_guard<std::mutex> lock(startup_mutex);
+    auto factory = node_factories.find(type);
+    if (factory == node_factories.end() || preparations.contains(type)) {
+      return;
+    }
+    if (!factory->second->has_prepare()) {
+      std::promise<bool> promise;
+      promise.set_value(true);
+      preparations[type].result = promise.get_future().share();
+      preparations[type].prepared = true;
+      return;
+    }
+    preparations[type].result =
+        std::async(std::launch::async, [this, type, factory = factory->second,
+                                        weak = std::weak_ptr<int>(lifetime)] {
+          set_current_thread_name("prepare " + type);
+          auto start = std::chrono::steady_clock::now();
+          auto prepared = factory->prepare();
+          auto duration = std::chrono::steady_clock::now() - start;
+          {
+            std::lock_guard<std::mutex> lock2(startup_mutex);
+            preparations[type].prepared = prepared;
+            preparations[type].duration = duration;
+          }
+          THALAMUS_LOG(info) << "Prepared " << type << " in "
+                             << std::chrono::duration<double, std::milli>(duration).count()
+                             << " ms" << (prepared ? "" : ", failed");
+          boost::asio::post(io_context, [this, type, weak] {
+            if (weak.lock()) {
+              create_waiting(type);
+            }
+          });
+          return prepared;
+        }).share();
+  }
+
+  /**
+   * Whether the prepare step of type has finished, types without a factory
+   * count as prepared so creating them fails right away.
+   */
+  bool is_prepared(const std::string &type) {
+    std::lock_guard<std::mutex> lock(startup_mutex);
+    auto preparation = preparations.find(type);
+    return preparation == preparations.end() ||
+           preparation->second.prepared.has_value();
+  }
+
+  /**
+   * Creates the node at index if its type is prepared.  Otherwise its slot
+   * stays empty, lookups of it wait as they would for a node that doesn't
+   * exist yet, and create_waiting creates it once the type is prepared, so the
+   * io_context never blocks on a prepare step.
+   */
+  void place_node(size_t index) {
+    auto config = node_configs.at(index);
+    auto type = node_types.at(index);
+    prepare_configured_types();
+    prepare_type(type);
+    auto requested = std::chrono::steady_clock::now();
+    if (!constructing && !is_prepared(type)) {
+      waiting.emplace(config.get(), requested);
+      return;
+    }
+    auto i = waiting.find(config.get());
+    if (i != waiting.end()) {
+      requested = i->second;
+      waiting.erase(i);
+    }
+    creating_index = int(index);
+    node_impls.at(index).reset(create_node(type, config, requested));
+    update_history(index);
+    creating_index = -1;
+  }
+
+  /**
+   * Creates the nodes that were waiting for type to be prepared and hands
+   * them to the lookups waiting for them.
+   */
+  void create_waiting(const std::string &type) {
+    for (size_t i = 0; i < node_impls.size(); ++i) {
+      auto config = node_configs[i];
+      if (node_impls[i] || node_types[i] != type ||
+          !waiting.contains(config.get())) {
+        continue;
+      }
+      place_node(i);
+      std::string name;
+      if (config->contains("name")) {
+        std::string value = config->at("name");
+        name = value;
+      }
+      notify(
+          [&](auto &selector) {
+            return selector.name().empty() ? selector.type() == type
+                                           : selector.name() == name;
+          },
+          node_impls[i]);
+    }
+  }
+
+  /**
+   * Prepares every type in the configuration, not just the one being
+   * created, so that a configuration replayed one node at a time overlaps
+   * the prepare steps of all its types.
+   */
+  void prepare_configured_types() {
+    for (auto i = 0u; i < nodes->size(); ++i) {
+      ObservableDictPtr node = nodes->at(i);
+      if (node->contains("type")) {
+        std::string type = node->at("type");
+        prepare_type(type);
+      }
+    }
+  }
+
+  Node *create_node(const std::string &type, ObservableDictPtr config,
+                    std::chrono::steady_clock::time_point start) {
+    auto factory = node_factories.at(type);
+    std::shared_future<bool> prepared;
+    {
+      std::lock_guard<std::mutex> lock(startup_mutex);
+      prepared = preparations.at(type).result;
+    }
+
+    if (!prepared.get()) {
+      THALAMUS_LOG(error) << type << " failed to prepare, creating a NONE node";
+      factory = node_factories.at("NONE");
+    }
+    auto construct_start = std::chrono::steady_clock::now();
+    auto result = factory->create(config, io_context, outer);
+    auto end = std::chrono::steady_clock::now();
+
+    NodeInit init;
+    if (config->contains("name")) {
+      std::string name = config->at("name");
+      init.name = name;
+    }
+    init.type = type;
+    init.wait = construct_start - start;
+    init.init = end - construct_start;
+    init.created = end;
+    THALAMUS_LOG(info) << "Created " << init.name << " (" << type << ") in "
+                       << std::chrono::duration<double, std::milli>(init.init).count()
+                       << " ms, waited "
+                       << std::chrono::duration<double, std::milli>(init.wait).count()
+                       << " ms for prepare";
+    {
+      std::lock_guard<std::mutex> lock(startup_mutex);
+      node_inits.push_back(std::move(init));
+    }
+
+    startup_timer.expires_after(1s);
+    startup_timer.async_wait([this](const boost::system::error_code &error) {
+      if (error) {
+        return;
+      }
+      log_startup_report();
+    });
+    return result;
+  }
+
+  /**
+   * Summarizes the nodes created since the last summary, which runs once
+   * node creation has been quiet for a second.
+   */
+  void log_startup_report() {
+    std::vector<NodeInit> batch;
+    {
+      std::lock_guard<std::mutex> lock(startup_mutex);
+      batch.assign(node_inits.begin() + int64_t(logged_node_inits),
+                   node_inits.end());
+      logged_node_inits = node_inits.size();
+    }
+    if (batch.empty()) {
+      return;
+    }
+    std::sort(batch.begin(), batch.end(), [](auto &lhs, auto &rhs) {
+      return lhs.wait + lhs.init > rhs.wait + rhs.init;
+    });
+    auto first = std::min_element(batch.begin(), batch.end(), [](auto &lhs, auto &rhs) {
+      return lhs.created - lhs.init - lhs.wait < rhs.created - rhs.init - rhs.wait;
+    });
+    auto last = std::max_element(batch.begin(), batch.end(), [](auto &lhs, auto &rhs) {
+      return lhs.created < rhs.created;
+    });
+    auto elapsed = last->created - (first->created - first->init - first->wait);
+    THALAMUS_LOG(info) << "Created " << batch.size() << " nodes in "
+                       << std::chrono::duration<double, std::milli>(elapsed).count()
+                       << " ms, slowest:";
+    for (size_t i = 0; i < std::min(batch.size(), size_t(10)); ++i) {
+      THALAMUS_LOG(info) << "  " << batch[i].name << " (" << batch[i].type << "): "
+                         << std::chrono::duration<double, std::milli>(batch[i].init).count()
+                         << " ms, waited "
+                         << std::chrono::duration<double, std::milli>(batch[i].wait).count()
+                         << " ms for prepare";
+    }
+  }
+
+  /**
+   * Creates, updates or drops the history of the node at index to match its
+   * History (s) and History Limit (MB), the latter per channel.
+   */
+  void update_history(size_t index) {
+    auto config = node_configs.at(index);
+    double seconds = config->contains("History (s)") ? config->at("History (s)") : 0.0;
+    double megabytes = config->contains("History Limit (MB)") ? config->at("History Limit (MB)") : 16.0;
+    auto node = node_impls.at(index).get();
+    auto analog = node_cast<AnalogNode *>(node);
+    auto &history = node_histories.at(index);
+    if (seconds <= 0 || !analog) {
+      history.reset();
+      return;
+    }
+
+    auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::duration<double>(seconds));
+    auto max_bytes = size_t(std::max(megabytes, 0.0) * (1 << 20));
+    if (history) {
+      history->set_limits(duration, max_bytes);
+    } else {
+      history = std::make_shared<AnalogHistory>(node, analog, duration, max_bytes);
+    }
+  }
+
   void on_nodes(ObservableCollection::Action a,
                 const ObservableCollection::Key &k,
                 const ObservableCollection::Value &v) {
@@ -1721,23 +2225,21 @@ public:
           std::bind(&Impl::on_node, this, node.get(), _1, _2, _3));
 
       std::string type_str = node->at("type");
-      auto factory = node_factories.at(type_str);
-      
-      creating_index = int32_t(index);
-      auto node_impl =
-          std::shared_ptr<Node>(factory->create(node, io_context, outer));
-      creating_index = -1;
 
       node_connections.insert(node_connections.begin() + index, std::move(conn));
       node_next_type.insert(node_next_type.begin() + index, "");
-      node_impls.insert(node_impls.begin() + index, node_impl);
+      node_impls.insert(node_impls.begin() + index, nullptr);
+      node_histories.insert(node_histories.begin() + index, nullptr);
       node_types.insert(node_types.begin() + index, type_str);
       node_configs.insert(node_configs.begin() + index, node);
+      place_node(size_t(index));
       node->recap(std::bind(&Impl::on_node, this, node.get(), _1, _2, _3));
     } else {
       auto index = std::get<int64_t>(k);
+      waiting.erase(node_configs.at(size_t(index)).get());
       node_connections.erase(node_connections.begin() + index);
       node_next_type.erase(node_next_type.begin() + index);
+      node_histories.erase(node_histories.begin() + index);
       node_impls.erase(node_impls.begin() + index);
       node_types.erase(node_types.begin() + index);
       node_configs.erase(node_configs.begin() + index);
@@ -1790,7 +2292,16 @@ public:
           auto current_node = node_impls.at(size_t(node_index));
           auto current_next_type = node_next_type[size_t(node_index)];
 
-          if(!current_next_type.empty()) {
+          if (!current_node && current_next_type.empty()) {
+            // Still waiting for its previous type, wait for this one instead
+            node_types.at(size_t(node_index)) = value_str;
+            place_node(size_t(node_index));
+            if (auto node_impl = node_impls.at(size_t(node_index))) {
+              notify([&value_str](
+                        auto &selector) { return selector.type() == value_str; },
+                    node_impl);
+            }
+          } else if(!current_next_type.empty()) {
             node_next_type[size_t(node_index)] = value_str;
           } else {
             node_next_type[size_t(node_index)] = value_str;
@@ -1807,17 +2318,17 @@ public:
                 auto node_config = node_configs[new_node_index];
 
                 auto type_str = node_next_type[new_node_index];
-                auto factory = node_factories.at(type_str);
-                
-                node_types.at(new_node_index) = type_str;
-                creating_index = int(new_node_index);
-                node_impls.at(new_node_index)
-                    .reset(factory->create(node_config, io_context, outer));
 
-                creating_index = -1;
+                node_types.at(new_node_index) = type_str;
+                node_histories.at(new_node_index).reset();
+                node_impls.at(new_node_index).reset();
+                place_node(new_node_index);
                 node_next_type[new_node_index] = "";
 
                 auto node_impl = node_impls.at(new_node_index);
+                if (!node_impl) {
+                  return;
+                }
                 notify([&type_str](
                           auto &selector) { return selector.type() == type_str; },
                       node_impl);
@@ -1830,6 +2341,8 @@ public:
                     auto &selector) { return selector.type() == value_str; },
                 node_impl);
         }
+      } else if (key_str == "History (s)" || key_str == "History Limit (MB)") {
+        update_history(size_t(node_index));
       } else if (key_str == "name") {
         auto node_impl = node_impls.at(size_t(node_index));
         auto value_str = std::get<std::string>(v);
@@ -1852,6 +2365,7 @@ NodeGraphImpl::NodeGraphImpl(ObservableListPtr nodes,
                              std::optional<int> thread_priority)
     : impl(new Impl(nodes, io_context, this, system_time, steady_time, stub, extension, vulkan)) {
   impl->nodes->recap();
+  impl->constructing = false;
   impl->thread_pool.start(thread_policy, thread_priority);
 }
 
@@ -1860,17 +2374,58 @@ NodeGraphImpl::~NodeGraphImpl() {}
 std::optional<std::string>
 NodeGraphImpl::get_type_name(const std::string &type) {
   auto i = impl->node_factories.find(type);
-  if (i != impl->node_factories.end()) {
-    return i->second->type_name();
-  } else {
+  if (i == impl->node_factories.end()) {
+    return std::nullopt;
+  }
+  impl->prepare_type(type);
+  std::shared_future<bool> prepared;
+  {
+    std::lock_guard<std::mutex> lock(impl->startup_mutex);
+    prepared = impl->preparations.at(type).result;
+  }
+  if (!prepared.get()) {
     return std::nullopt;
   }
+  return i->second->type_name();
+}
+
+thalamus_grpc::StartupReport NodeGraphImpl::get_startup_report() {
+  thalamus_grpc::StartupReport result;
+  std::lock_guard<std::mutex> lock(impl->startup_mutex);
+  for (auto &[type, preparation] : impl->preparations) {
+    if (!preparation.prepared) {
+      continue;
+    }
+    auto report = result.add_types();
+    report->set_type(type);
+    report->set_prepared(*preparation.prepared);
+    report->set_prepare_ns(uint64_t(preparation.duration.count()));
+  }
+  for (auto &init : impl->node_inits) {
+    auto report = result.add_nodes();
+    report->set_name(init.name);
+    report->set_type(init.type);
+    report->set_wait_ns(uint64_t(init.wait.count()));
+    report->set_init_ns(uint64_t(init.init.count()));
+    report->set_created_ns(uint64_t(
+        std::chrono::nanoseconds(init.created - impl->steady_time).count()));
+  }
+  return result;
 }
 
 void NodeGraphImpl::set_service(Service *service) { impl->service = service; }
 
 Service &NodeGraphImpl::get_service() { return **impl->service; }
 
+std::shared_ptr<AnalogHistory> NodeGraphImpl::get_analog_history(Node *node) {
+  for(size_t i = 0;i < impl->node_impls.size();++i) {
+    if(impl->node_impls[i].get() == node) {
+      return impl->node_histories[i];
+    }
+  }
+  return nullptr;
+}
+
 std::weak_ptr<Node> NodeGraphImpl::get_node(const std::string &query_name) {
   thalamus_grpc::NodeSelector selector;
   selector.set_name(query_name);
@@ -2046,6 +2601,12 @@ void NodeGraphImpl::predrop(std::function<void()> ready) {
     return;
   }
   for(auto& node : impl->node_impls) {
+    if (!node) {
+      if (--*drop_count == 0) {
+        ready();
+      }
+      continue;
+    }
     node->predrop([ready,drop_count,this] {
       boost::asio::post(impl->io_context, [ready,drop_count] {
         --*drop_count;
@@ -35,6 +35,8 @@ public:
                 std::optional<int> thread_priority = std::nullopt);
   ~NodeGraphImpl() override;
   std::optional<std::string> get_type_name(const std::string &type) override;
+  thalamus_grpc::StartupReport get_startup_report() override;
+  std::shared_ptr<AnalogHistory> get_analog_history(Node *) override;
   void set_service(Service *service);
   Service &get_service() override;
   std::weak_ptr<Node> get_node(const std::string &query_name) override;
@@ -12,14 +12,14 @@
 
 namespace thalamus {
   namespace node {
-    boost::signals2::connection connect_ready_multithreaded(Node* node, std::function<void(Node*)> callback) {
+    Connection connect_ready_multithreaded(Node* node, std::function<void(Node*)> callback) {
       if(node->ready_multithreaded) {
         return node->ready_multithreaded->connect(callback);
       }
       return node->ready.connect(callback);
     }
 
-    boost::signals2::connection connect_ready_singlethreaded(Node* node, std::function<void(Node*)> callback) {
+    Connection connect_ready_singlethreaded(Node* node, std::function<void(Node*)> callback) {
       return node->ready.connect(callback);
     }
 
@@ -61,9 +61,10 @@ public:
     state->recap(std::bind(&Impl::on_change, this, _1, _2, _3));
   }
 
-  boost::signals2::scoped_connection source_connection;
+  ScopedConnection source_connection;
   AnalogNode *source = nullptr;
   std::vector<std::vector<double>> data;
+  AnalogFrameBuilder frame;
   std::vector<Range> ranges;
   double out_min = 0;
   double out_max = 1;
@@ -99,14 +100,17 @@ public:
           if (!source->has_analog_data()) {
             return;
           }
-          if (int(data.size()) < source->num_channels()) {
-            data.resize(size_t(source->num_channels()));
-            ranges.resize(size_t(source->num_channels()),
+          auto &input = source->frame();
+          if (int(data.size()) < input.num_channels()) {
+            data.resize(size_t(input.num_channels()));
+            ranges.resize(size_t(input.num_channels()),
                           std::make_pair(std::numeric_limits<double>::max(),
                                          -std::numeric_limits<double>::max()));
           }
-          for (auto i = 0; i < source->num_channels(); ++i) {
-            auto span = source->data(i);
+          for (auto i = 0; i < input.num_channels(); ++i) {
+            auto span = input.type == AnalogFrame::Type::DOUBLE
+                            ? input.data<double>(i)
+                            : source->data(i);
             auto &transformed = data.at(size_t(i));
             auto &range = ranges.at(size_t(i));
             transformed.assign(span.begin(), span.end());
@@ -121,6 +125,12 @@ public:
                   out_min;
             }
           }
+          frame.resize(data.size());
+          for (size_t i = 0; i < data.size(); ++i) {
+            frame.set_data(i, std::span<const double>(data[i]));
+          }
+          frame.copy_layout(input);
+          frame.finish(input.time, input.remote_time);
           outer->ready(outer);
         });
       });
@@ -169,6 +179,8 @@ void NormalizeNode::inject(const thalamus::vector<std::span<double const>> &,
 
 bool NormalizeNode::has_analog_data() const { return true; }
 
+const AnalogFrame &NormalizeNode::frame() const { return impl->frame.get(); }
+
 boost::json::value NormalizeNode::process(const boost::json::value &value) {
   auto text = value.as_string();
   if (text == "Cache") {
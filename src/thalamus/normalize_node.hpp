@@ -26,6 +26,7 @@ public:
          const thalamus::vector<std::chrono::nanoseconds> &sample_intervals,
          const thalamus::vector<std::string_view> &) override;
   bool has_analog_data() const override;
+  const AnalogFrame &frame() const override;
 
   boost::json::value process(const boost::json::value &) override;
   size_t modalities() const override;
@@ -3,6 +3,7 @@
 #include <thalamus/thread_pool.hpp>
 
 #include <thalamus/modalities_util.hpp>
+#include <cstring>
 
 #ifdef __clang__
 #pragma clang diagnostic push
@@ -22,12 +23,232 @@ static const double AOUT_MIN = -10;
 static const double AOUT_MAX = 10;
 static const double AOUT_RANGE = AOUT_MAX - AOUT_MIN;
 
+/**
+ * Dark pupil tracker used by the "Fast Path" mode.  Thresholds the luma plane
+ * in place (no copy) and labels dark pixels with a single-pass run based
+ * connected component labeling, accumulating area, centroid and bounds per
+ * component as it goes.  The search is restricted to an ROI around the last
+ * detected pupil and falls back to the full frame when the pupil is lost.
+ */
+struct FastPupilTracker {
+  struct Blob {
+    double area = 0;
+    double sum_x = 0;
+    double sum_y = 0;
+    int min_x = std::numeric_limits<int>::max();
+    int max_x = std::numeric_limits<int>::min();
+    int min_y = std::numeric_limits<int>::max();
+    int max_y = std::numeric_limits<int>::min();
+
+    void merge(const Blob &other) {
+      area += other.area;
+      sum_x += other.sum_x;
+      sum_y += other.sum_y;
+      min_x = std::min(min_x, other.min_x);
+      max_x = std::max(max_x, other.max_x);
+      min_y = std::min(min_y, other.min_y);
+      max_y = std::max(max_y, other.max_y);
+    }
+  };
+
+  struct Run {
+    int begin;
+    int end;
+    size_t label;
+  };
+
+  struct Roi {
+    int x;
+    int y;
+    int width;
+    int height;
+  };
+
+  std::vector<unsigned char> mask;
+  std::vector<Run> previous_runs;
+  std::vector<Run> current_runs;
+  std::vector<size_t> parents;
+  std::vector<Blob> blobs;
+  std::optional<std::pair<double, double>> last_center;
+  double last_diameter = 0;
+
+  static constexpr double ROI_SCALE = 2.0;
+  static constexpr int ROI_MIN_SIZE = 32;
+
+  size_t find(size_t label) {
+    while (parents[label] != label) {
+      parents[label] = parents[parents[label]];
+      label = parents[label];
+    }
+    return label;
+  }
+
+  void unite(size_t a, size_t b) {
+    a = find(a);
+    b = find(b);
+    if (a != b) {
+      parents[std::max(a, b)] = std::min(a, b);
+    }
+  }
+
+  size_t new_label() {
+    parents.push_back(parents.size());
+    blobs.emplace_back();
+    return parents.size() - 1;
+  }
+
+  /**
+   * Threshold one row into mask (1 = dark).  Written as a branchless loop over
+   * bytes so the compiler emits packed compares (SSE2/AVX2/NEON).
+   */
+  static void threshold_row(const unsigned char *row, unsigned char *out,
+                            int width, unsigned char threshold) {
+    for (int x = 0; x < width; ++x) {
+      out[x] = static_cast<unsigned char>(row[x] <= threshold);
+    }
+  }
+
+  void label_row(const unsigned char *row_mask, int width, int x_offset,
+                 int y) {
+    current_runs.clear();
+    int x = 0;
+    while (x < width) {
+      // Skip background eight pixels at a time.
+      while (x + 8 <= width) {
+        uint64_t word;
+        std::memcpy(&word, row_mask + x, sizeof(word));
+        if (word != 0) {
+          break;
+        }
+        x += 8;
+      }
+      while (x < width && !row_mask[x]) {
+        ++x;
+      }
+      if (x == width) {
+        break;
+      }
+      auto begin = x;
+      while (x < width && row_mask[x]) {
+        ++x;
+      }
+      auto end = x - 1;
+
+      size_t label = std::numeric_limits<size_t>::max();
+      for (auto &previous : previous_runs) {
+        if (previous.end + 1 < begin) {
+          continue;
+        }
+        if (previous.begin - 1 > end) {
+          break;
+        }
+        if (label == std::numeric_limits<size_t>::max()) {
+          label = previous.label;
+        } else {
+          unite(label, previous.label);
+        }
+      }
+      if (label == std::numeric_limits<size_t>::max()) {
+        label = new_label();
+      }
+
+      auto &blob = blobs[label];
+      auto length = double(end - begin + 1);
+      auto abs_begin = begin + x_offset;
+      auto abs_end = end + x_offset;
+      blob.area += length;
+      blob.sum_x += (abs_begin + abs_end) * length / 2;
+      blob.sum_y += y * length;
+      blob.min_x = std::min(blob.min_x, abs_begin);
+      blob.max_x = std::max(blob.max_x, abs_end);
+      blob.min_y = std::min(blob.min_y, y);
+      blob.max_y = std::max(blob.max_y, y);
+      current_runs.push_back(Run{begin, end, label});
+    }
+    std::swap(previous_runs, current_runs);
+  }
+
+  std::optional<Blob> search(const unsigned char *data, size_t stride,
+                             const Roi &roi, unsigned char threshold,
+                             double min_area, double max_area) {
+    TRACE_EVENT("thalamus", "FastPupilTracker::search");
+    mask.resize(size_t(roi.width));
+    previous_runs.clear();
+    parents.clear();
+    blobs.clear();
+
+    for (auto y = roi.y; y < roi.y + roi.height; ++y) {
+      auto row = data + size_t(y) * stride + size_t(roi.x);
+      threshold_row(row, mask.data(), roi.width, threshold);
+      label_row(mask.data(), roi.width, roi.x, y);
+    }
+
+    for (size_t i = 0; i < blobs.size(); ++i) {
+      auto root = find(i);
+      if (root != i) {
+        blobs[root].merge(blobs[i]);
+        blobs[i] = Blob();
+      }
+    }
+
+    std::optional<Blob> selected;
+    for (size_t i = 0; i < blobs.size(); ++i) {
+      auto &blob = blobs[i];
+      if (parents[i] != i || blob.area < min_area || max_area < blob.area) {
+        continue;
+      }
+      if (!selected || blob.area > selected->area) {
+        selected = blob;
+      }
+    }
+    return selected;
+  }
+
+  std::optional<Blob> track(const unsigned char *data, int width, int height,
+                            size_t stride, unsigned char threshold,
+                            double min_area, double max_area) {
+    Roi full{0, 0, width, height};
+    if (last_center) {
+      auto size = std::max(int(last_diameter * ROI_SCALE), ROI_MIN_SIZE);
+      auto x = std::clamp(int(last_center->first) - size / 2, 0, width);
+      auto y = std::clamp(int(last_center->second) - size / 2, 0, height);
+      Roi roi{x, y, std::min(size, width - x), std::min(size, height - y)};
+      auto blob = search(data, stride, roi, threshold, min_area, max_area);
+      auto touches_edge =
+          blob && ((blob->min_x == roi.x && roi.x > 0) ||
+                   (blob->max_x == roi.x + roi.width - 1 &&
+                    roi.x + roi.width < width) ||
+                   (blob->min_y == roi.y && roi.y > 0) ||
+                   (blob->max_y == roi.y + roi.height - 1 &&
+                    roi.y + roi.height < height));
+      if (blob && !touches_edge) {
+        update(*blob);
+        return blob;
+      }
+    }
+
+    auto blob = search(data, stride, full, threshold, min_area, max_area);
+    if (blob) {
+      update(*blob);
+    } else {
+      last_center.reset();
+    }
+    return blob;
+  }
+
+  void update(const Blob &blob) {
+    last_center = std::make_pair(blob.sum_x / blob.area, blob.sum_y / blob.area);
+    last_diameter = double(std::max(blob.max_x - blob.min_x + 1,
+                                    blob.max_y - blob.min_y + 1));
+  }
+};
+
 struct OculomaticNode::Impl {
   boost::asio::io_context &io_context;
   ObservableDictPtr state;
   boost::signals2::scoped_connection state_connection;
   boost::signals2::scoped_connection options_connection;
-  boost::signals2::scoped_connection source_connection;
+  ScopedConnection source_connection;
   ImageNode *image_source;
   std::weak_ptr<Node> image_source_weak;
   bool is_running = false;
@@ -68,6 +289,13 @@ struct OculomaticNode::Impl {
   std::map<size_t, Result> output_frames;
   Result current_result;
   ThreadPool &pool;
+  bool fast_path = false;
+  FastPupilTracker tracker;
+  size_t processed_frames = 0;
+  size_t dropped_frames = 0;
+  std::chrono::steady_clock::time_point stats_start = std::chrono::steady_clock::now();
+  double processed_fps = 0;
+  double dropped_fps = 0;
 
   Impl(ObservableDictPtr _state, boost::asio::io_context &_io_context,
        OculomaticNode *_outer, NodeGraph *_graph)
@@ -147,14 +375,129 @@ struct OculomaticNode::Impl {
     return result;
   }
 
+  void update_stats() {
+    auto now = std::chrono::steady_clock::now();
+    auto elapsed = now - stats_start;
+    if (elapsed < 1s) {
+      return;
+    }
+    auto seconds = std::chrono::duration<double>(elapsed).count();
+    processed_fps = double(processed_frames) / seconds;
+    dropped_fps = double(dropped_frames) / seconds;
+    processed_frames = 0;
+    dropped_frames = 0;
+    stats_start = now;
+  }
+
+  void publish(size_t frame_id, Result &&result) {
+    output_frames[frame_id] = std::move(result);
+    for (auto i = output_frames.begin(); i != output_frames.end();) {
+      if (i->first == next_output_frame) {
+        ++next_output_frame;
+        current_result = i->second;
+        TRACE_EVENT("thalamus", "OculomaticNode::ready");
+        outer->ready(outer);
+        i = output_frames.erase(i);
+      } else {
+        ++i;
+      }
+    }
+  }
+
+  static bool is_luma_format(ImageNode::Format format) {
+    return format == ImageNode::Format::Gray ||
+           format == ImageNode::Format::YUV420P ||
+           format == ImageNode::Format::YUVJ420P;
+  }
+
+  /**
+   * Inline tracking on the io_context thread.  The source's luma plane is
+   * read in place and republished without a copy, so there is no pool hop and
+   * no frame is dropped for lack of a free worker.  The image is only
+   * available during the ready signal.
+   */
+  void on_data_fast() {
+    TRACE_EVENT("thalamus", "OculomaticNode::on_data_fast");
+    auto plane = image_source->plane(0);
+    auto data = const_cast<unsigned char *>(plane.data());
+    auto height = int(image_source->height());
+    auto width = int(image_source->width());
+    auto stride = plane.size() / size_t(height);
+
+    Result result{0,
+                  0,
+                  0,
+                  cv::Mat(height, width, CV_8UC1, data, stride),
+                  true,
+                  computing,
+                  image_source->frame_interval(),
+                  image_source->time()};
+
+    if (computing) {
+      auto frame_size = double(width * height);
+      auto blob = tracker.track(
+          data, width, height, stride,
+          static_cast<unsigned char>(std::min(threshold, size_t(255))),
+          double(min_area) * frame_size / 100,
+          double(max_area) * frame_size / 100);
+      if (blob) {
+        auto center =
+            std::make_pair(blob->sum_x / blob->area, blob->sum_y / blob->area);
+        if (need_recenter) {
+          need_recenter = false;
+          centering_pix = center;
+          centering_offset = normalize_center(
+              center.first, center.second, std::make_pair(width, height),
+              centering_pix, std::make_pair(0.0, 0.0), x_gain, y_gain,
+              invert_x, invert_y);
+          (*state)["Pix X"].assign(centering_pix.first);
+          (*state)["Pix Y"].assign(centering_pix.second);
+        }
+        std::tie(result.x, result.y) = normalize_center(
+            center.first, center.second, std::make_pair(width, height),
+            centering_pix, centering_offset, x_gain, y_gain, invert_x,
+            invert_y);
+        result.diameter = double(blob->max_x - blob->min_x + 1);
+      } else {
+        result.x = 1e6;
+        result.y = 1e6;
+      }
+    }
+
+    ++processed_frames;
+    auto frame_id = next_input_frame++;
+    if (frame_id != next_output_frame) {
+      // Waits behind frames still on the pool, after the source's buffer is
+      // released
+      result.image = result.image.clone();
+    }
+    publish(frame_id, std::move(result));
+
+    // The image aliases the source's plane, which is only valid during its
+    // ready signal
+    if (current_result.image.data == data) {
+      current_result.image = cv::Mat();
+      current_result.has_image = false;
+    }
+  }
+
   void on_data(Node *) {
+    update_stats();
+    if (fast_path && is_luma_format(image_source->format())) {
+      on_data_fast();
+      return;
+    }
+
     auto event_id = get_unique_id();
     TRACE_EVENT_BEGIN("thalamus", "OculomaticNode::on_data",
                       perfetto::Flow::ProcessScoped(event_id));
     if (pool.full()) {
+      ++dropped_frames;
+      pool.count_drop(outer);
       TRACE_EVENT_END("thalamus");
       return;
     }
+    ++processed_frames;
 
     unsigned char *data =
         const_cast<unsigned char *>(image_source->plane(0).data());
@@ -376,6 +719,8 @@ struct OculomaticNode::Impl {
     auto key_str = std::get<std::string>(k);
     if (key_str == "Computing") {
       computing = std::get<bool>(v);
+    } else if (key_str == "Fast Path") {
+      fast_path = std::get<bool>(v);
     } else if (key_str == "Render Thresholded") {
       render_thresholded = std::get<bool>(v);
     } else if (key_str == "Threshold") {
@@ -438,8 +783,7 @@ std::string OculomaticNode::type_name() { return "OCULOMATIC"; }
 
 ImageNode::Plane OculomaticNode::plane(int) const {
   auto image = impl->current_result.image;
-  return ImageNode::Plane(image.data, image.data + image.rows * image.cols *
-                                                       image.channels());
+  return ImageNode::Plane(image.data, image.data + image.step[0] * size_t(image.rows));
 }
 
 size_t OculomaticNode::num_planes() const { return 1; }
@@ -485,12 +829,17 @@ std::span<const double> OculomaticNode::data(int channel) const {
   case 2:
     return std::span<const double>(&impl->current_result.diameter,
                                    &impl->current_result.diameter + 1);
+  case 3:
+    return std::span<const double>(&impl->processed_fps,
+                                   &impl->processed_fps + 1);
+  case 4:
+    return std::span<const double>(&impl->dropped_fps, &impl->dropped_fps + 1);
   default:
     return std::span<const double>();
   }
 }
 
-int OculomaticNode::num_channels() const { return 3; }
+int OculomaticNode::num_channels() const { return 5; }
 
 std::chrono::nanoseconds OculomaticNode::sample_interval(int) const {
   return impl->current_result.interval;
@@ -508,6 +857,10 @@ std::string_view OculomaticNode::name(int channel) const {
     return "Y";
   case 2:
     return "Diameter";
+  case 3:
+    return "Processed FPS";
+  case 4:
+    return "Dropped FPS";
   default:
     return "";
   }
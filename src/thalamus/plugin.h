@@ -17,6 +17,9 @@ typedef struct VkCommandPool_T* VkCommandPool;
 
 #define THALAMUS_OPERATION_ABORTED 995
 
+/* Capabilities a plugin can request with ThalamusAPI::negotiate_capabilities */
+#define THALAMUS_CAPABILITY_ANALOG_FRAME 1
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -77,6 +80,50 @@ extern "C" {
     char owns_data;
   };
 
+  enum ThalamusSampleType {
+    SampleDouble,
+    SampleShort,
+    SampleInt,
+    SampleULong
+  };
+
+  /*
+   * One channel of a ThalamusAnalogFrame.  Sample i is at
+   * (const char*)data + i*stride and has the frame's sample type.  A stride
+   * equal to the size of the sample type is a contiguous channel, a larger
+   * stride lets a plugin publish interleaved buffers without copying.
+   */
+  struct ThalamusAnalogChannel {
+    const void* data;
+    uint64_t size;
+    int64_t stride;
+    uint64_t sample_interval_ns;
+    double scale;
+    double offset;
+    struct ThalamusCharSpan name;
+  };
+
+  /*
+   * Every channel of an analog node at once, requires
+   * THALAMUS_CAPABILITY_ANALOG_FRAME.  version changes whenever the sample
+   * type, channel count, names, sample intervals, scales or offsets change,
+   * so readers can keep anything derived from them until it does.
+   *
+   * All pointers are borrowed.  A frame read from a Thalamus node is valid
+   * until the get_node or ready callback it was read in returns.  A frame a
+   * plugin node publishes must stay valid until the plugin calls node_ready
+   * or node_ready_offmain for that node again, or the node is destroyed.
+   */
+  struct ThalamusAnalogFrame {
+    uint64_t version;
+    enum ThalamusSampleType type;
+    uint64_t time_ns;
+    uint64_t remote_time_ns;
+    char is_transformed;
+    uint64_t num_channels;
+    const struct ThalamusAnalogChannel* channels;
+  };
+
   struct ThalamusNodeSelector {
     ThalamusCharSpan name;
     ThalamusCharSpan type;
@@ -117,6 +164,12 @@ extern "C" {
     double (*scale)(struct ThalamusNode* node, int channel);
     double (*offset)(struct ThalamusNode* node, int channel);
     void (*name)(struct ThalamusCharSpan*, struct ThalamusNode* node, int channel);
+    /*
+     * Only present with THALAMUS_CAPABILITY_ANALOG_FRAME.  Thalamus doesn't
+     * read it from plugins that didn't negotiate the capability, a plugin node
+     * may leave it null to keep using the per channel functions.
+     */
+    void (*frame)(struct ThalamusAnalogFrame*, struct ThalamusNode* node);
   };
 
   enum ThalamusImageFormat {
@@ -316,6 +369,13 @@ extern "C" {
     VkCommandPool (*create_vulkan_command_pool)(); // 89
     struct ThalamusVkQueueLock* (*lock_vulkan_queue)(); // 90
     void (*unlock_vulkan_queue)(struct ThalamusVkQueueLock*); // 91
+
+    /*
+     * Returns the requested capabilities this Thalamus supports, which are
+     * then enabled for the calling plugin.  Must be called from
+     * thalamus_get_node_factories and only exists when version >= 92.
+     */
+    uint64_t (*negotiate_capabilities)(uint64_t requested); // 92
   };
 
   typedef struct ThalamusNodeFactory** (*thalamus_get_node_factories_t)(struct ThalamusAPI*);
@@ -2,8 +2,14 @@
 #include <thalamus/log.hpp>
 #include <thalamus/assert.hpp>
 
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <list>
 #include <map>
+#include <set>
 #include <vector>
 
 #ifdef _WIN32
@@ -23,6 +29,12 @@
 #define ZLIB_CONST
 #include <zlib.h>
 
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/json.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <google/protobuf/arena.h>
+#include <google/protobuf/io/coded_stream.h>
+
 extern "C" {
 #include <libavcodec/avcodec.h>
 #include <libavdevice/avdevice.h>
@@ -36,14 +48,50 @@ extern "C" {
 #endif
 
 using namespace thalamus;
+using namespace std::chrono_literals;
 
 static char hydrate_av_error[AV_ERROR_MAX_STRING_SIZE];
 
+/**
+ * Storage2Node writes records roughly, not strictly, in time order.  Reading
+ * stops once records are this far past the end of a filter's window.
+ */
+static const std::chrono::nanoseconds window_slack = 10s;
+
+static bool is_compressed_video(thalamus_grpc::Image::Format format) {
+  return format == thalamus_grpc::Image::Format::Image_Format_MPEG1 ||
+         format == thalamus_grpc::Image::Format::Image_Format_MPEG4 ||
+         format == thalamus_grpc::Image::Format::Image_Format_FFV1 ||
+         format == thalamus_grpc::Image::Format::Image_Format_H264;
+}
+
 struct RecordReader::Impl {
-  std::istream &stream;
+  std::istream *stream = nullptr;
+  boost::interprocess::file_mapping mapping;
+  boost::interprocess::mapped_region region;
+  const char *mapped = nullptr;
+  size_t mapped_size = 0;
+  size_t mapped_offset = 0;
+  // read_batch parses into the arena, the initial block survives Arena::Reset
+  // so steady state batches don't go back to the allocator.
+  std::vector<char> arena_block = std::vector<char>(4 << 20);
+  google::protobuf::Arena arena{arena_block.data(), arena_block.size()};
+  std::vector<const thalamus_grpc::StorageRecord *> batch;
   double progress = 0;
   std::map<int, z_stream> zstreams;
-  std::map<int, std::pair<size_t, std::vector<unsigned char>>> zstream_buffers;
+  /**
+   * Inflated bytes of a zlib stream that haven't been parsed yet, [begin, end)
+   * of data.  Parsed records advance begin instead of erasing the front of the
+   * buffer, the unread tail is moved down only once it is less than half the
+   * buffer.
+   */
+  struct ZBuffer {
+    size_t begin = 0;
+    size_t end = 0;
+    std::vector<unsigned char> data = std::vector<unsigned char>(1024);
+    size_t available() const { return end - begin; }
+  };
+  std::map<int, ZBuffer> zstream_buffers;
   std::list<thalamus_grpc::StorageRecord> record_buffer;
 
   std::vector<std::pair<double, AVRational>> framerates = {
@@ -63,17 +111,310 @@ struct RecordReader::Impl {
 
   bool do_decode_video;
 
-  Impl(std::istream &_stream, bool _do_decode_video = true)
-      : stream(_stream), do_decode_video(_do_decode_video) {
+  Impl(std::istream &_stream, bool _do_decode_video)
+      : stream(&_stream), do_decode_video(_do_decode_video) {
     std::sort(framerates.begin(), framerates.end(),
               [](auto &lhs, auto &rhs) { return lhs.first < rhs.first; });
   }
+
+  /**
+   * A sharded capture is read through its manifest, the shards are then
+   * merged by record time instead of reading path itself.
+   */
+  struct Shard {
+    std::unique_ptr<Impl> reader;
+    std::optional<thalamus_grpc::StorageRecord> head;
+    double size;
+  };
+  std::vector<Shard> shards;
+
+  Impl(const std::filesystem::path &path, bool _do_decode_video,
+       bool follow_manifest = true)
+      : do_decode_video(_do_decode_video) {
+    std::sort(framerates.begin(), framerates.end(),
+              [](auto &lhs, auto &rhs) { return lhs.first < rhs.first; });
+    if (follow_manifest) {
+      auto manifest = path;
+      if (!path.string().ends_with(".manifest.json")) {
+        manifest = path.string() + ".manifest.json";
+      }
+      if (std::filesystem::exists(manifest)) {
+        open_shards(manifest);
+        return;
+      }
+    }
+    // mapped_region refuses to map an empty file, an empty capture simply has
+    // no records.
+    if (std::filesystem::file_size(path) == 0) {
+      return;
+    }
+    mapping = boost::interprocess::file_mapping(
+        path.string().c_str(), boost::interprocess::read_only);
+    region = boost::interprocess::mapped_region(mapping,
+                                                boost::interprocess::read_only);
+    region.advise(boost::interprocess::mapped_region::advice_sequential);
+    mapped = static_cast<const char *>(region.get_address());
+    mapped_size = region.get_size();
+  }
   ~Impl() {
     for (auto &pair : zstreams) {
       deflateEnd(&pair.second);
     }
   }
 
+  void open_shards(const std::filesystem::path &manifest_path) {
+    std::ifstream input(manifest_path);
+    std::string text((std::istreambuf_iterator<char>(input)),
+                     std::istreambuf_iterator<char>());
+    auto manifest = boost::json::parse(text).as_object();
+    for (auto &file_value : manifest["shards"].as_array()) {
+      std::filesystem::path file = std::string(file_value.as_string());
+      if (file.is_relative()) {
+        file = manifest_path.parent_path() / file;
+      }
+      if (!std::filesystem::exists(file)) {
+        std::cout << "Missing shard " << file.string() << std::endl;
+        continue;
+      }
+      shards.push_back(
+          Shard{std::make_unique<Impl>(file, do_decode_video, false),
+                std::nullopt, double(std::filesystem::file_size(file))});
+      advance(shards.back());
+    }
+  }
+
+  /**
+   * Reads the next record of a shard.  Only the first shard's metadata is
+   * kept so the merged capture looks like a single file.
+   */
+  void advance(Shard &shard) {
+    auto is_first = &shard == &shards.front();
+    do {
+      shard.head = shard.reader->read_record();
+    } while (!is_first && shard.head &&
+             shard.head->body_case() ==
+                 thalamus_grpc::StorageRecord::kMetadata);
+  }
+
+  /**
+   * k-way merge of the shards, hands out the earliest head.
+   */
+  std::optional<thalamus_grpc::StorageRecord> read_merged() {
+    std::optional<thalamus_grpc::StorageRecord> result;
+    // Heads read before set_filter was called still have to be filtered here.
+    while (!result || !accept(*result)) {
+      Shard *next = nullptr;
+      for (auto &shard : shards) {
+        if (shard.head && (!next || shard.head->time() < next->head->time())) {
+          next = &shard;
+        }
+      }
+      if (!next) {
+        progress = 100;
+        return std::nullopt;
+      }
+      result = std::move(next->head);
+      advance(*next);
+    }
+
+    double total = 0;
+    double done = 0;
+    for (auto &shard : shards) {
+      total += shard.size;
+      done += shard.size * shard.reader->progress;
+    }
+    progress = total > 0 ? done / total : 100;
+    return result;
+  }
+
+  Filter filter;
+  bool filtering = false;
+  /**
+   * Set once records are past the end of the filter's window, the rest of the
+   * capture isn't read.
+   */
+  bool past_end = false;
+  /**
+   * zlib streams whose node or channel the filter rejects, their records are
+   * dropped without being inflated.
+   */
+  std::set<int> ignored_streams;
+
+  void set_filter(const Filter &_filter) {
+    filter = _filter;
+    filtering = filter.start || filter.end || filter.node || filter.channel;
+    for (auto &shard : shards) {
+      shard.reader->set_filter(filter);
+    }
+  }
+
+  /**
+   * The fields of a serialized record that decide whether it is needed, read
+   * without parsing the record.
+   */
+  struct Header {
+    uint64_t time = 0;
+    std::string_view node;
+    int body = 0;
+    std::optional<int> stream;
+  };
+
+  static std::optional<Header> peek(const char *data, size_t size) {
+    google::protobuf::io::CodedInputStream input(
+        reinterpret_cast<const uint8_t *>(data), int(size));
+    Header header;
+    while (auto tag = input.ReadTag()) {
+      auto field = int(tag >> 3);
+      switch (tag & 7) {
+      case 0: {
+        uint64_t value;
+        if (!input.ReadVarint64(&value)) {
+          return std::nullopt;
+        }
+        if (field == thalamus_grpc::StorageRecord::kTimeFieldNumber) {
+          header.time = value;
+        } else if (field == thalamus_grpc::Compressed::kStreamFieldNumber) {
+          // Only reached while peeking into the Compressed body below,
+          // StorageRecord's own field 3 is a message.
+          header.stream = int(value);
+        }
+      } break;
+      case 1:
+        if (!input.Skip(8)) {
+          return std::nullopt;
+        }
+        break;
+      case 2: {
+        uint32_t length;
+        if (!input.ReadVarint32(&length) ||
+            size - size_t(input.CurrentPosition()) < length) {
+          return std::nullopt;
+        }
+        auto field_data = data + input.CurrentPosition();
+        if (field == thalamus_grpc::StorageRecord::kNodeFieldNumber) {
+          header.node = std::string_view(field_data, length);
+        } else {
+          header.body = field;
+          if (field == thalamus_grpc::StorageRecord::kCompressedFieldNumber) {
+            auto compressed = peek(field_data, length);
+            header.stream = compressed ? compressed->stream : std::nullopt;
+          }
+        }
+        input.Skip(int(length));
+      } break;
+      case 5:
+        if (!input.Skip(4)) {
+          return std::nullopt;
+        }
+        break;
+      default:
+        return std::nullopt;
+      }
+    }
+    return header;
+  }
+
+  bool rejects(std::string_view node) const {
+    return !node.empty() && filter.node && !filter.node(node);
+  }
+
+  /**
+   * Whether a record can be dropped based on its header alone.  Metadata,
+   * analog schemas, blocks and, when decoding, video frames before the window
+   * are kept since later records depend on them.
+   */
+  bool skip(const Header &header) {
+    if (header.body == thalamus_grpc::StorageRecord::kMetadataFieldNumber) {
+      return false;
+    }
+    auto time = std::chrono::nanoseconds(int64_t(header.time));
+    if (filter.end && header.time && time > *filter.end + window_slack) {
+      past_end = true;
+      return true;
+    }
+    if (header.body == thalamus_grpc::StorageRecord::kCompressedFieldNumber) {
+      return header.stream && ignored_streams.contains(*header.stream);
+    }
+    if (rejects(header.node)) {
+      return true;
+    }
+    switch (header.body) {
+    case thalamus_grpc::StorageRecord::kAnalogSchemaFieldNumber:
+    case thalamus_grpc::StorageRecord::kAnalogBlockFieldNumber:
+      return false;
+    case thalamus_grpc::StorageRecord::kImageFieldNumber:
+      if (do_decode_video) {
+        return false;
+      }
+      break;
+    default:
+      break;
+    }
+    return filter.start && time < *filter.start;
+  }
+
+  bool skip(const char *data, size_t size) {
+    if (!filtering) {
+      return false;
+    }
+    auto header = peek(data, size);
+    return header && skip(*header);
+  }
+
+  /**
+   * Drops the spans of channels the filter rejects.  Returns false when no
+   * span is left.
+   */
+  bool keep_channels(thalamus_grpc::AnalogResponse &analog) {
+    if (!filter.channel) {
+      return true;
+    }
+    auto spans = analog.mutable_spans();
+    auto intervals = analog.mutable_sample_intervals();
+    auto kept = 0;
+    for (auto i = 0; i < spans->size(); ++i) {
+      if (!filter.channel(spans->Get(i).name())) {
+        continue;
+      }
+      if (kept != i) {
+        spans->SwapElements(kept, i);
+        if (i < intervals->size()) {
+          intervals->SwapElements(kept, i);
+        }
+      }
+      ++kept;
+    }
+    spans->DeleteSubrange(kept, spans->size() - kept);
+    intervals->Truncate(std::min(kept, intervals->size()));
+    return kept > 0;
+  }
+
+  /**
+   * Applies the filter to a record that is about to be handed out.
+   */
+  bool accept(thalamus_grpc::StorageRecord &record) {
+    if (!filtering) {
+      return true;
+    }
+    switch (record.body_case()) {
+    case thalamus_grpc::StorageRecord::BODY_NOT_SET:
+      return false;
+    case thalamus_grpc::StorageRecord::kMetadata:
+      return true;
+    default:
+      break;
+    }
+    if (rejects(record.node())) {
+      return false;
+    }
+    auto time = std::chrono::nanoseconds(int64_t(record.time()));
+    if ((filter.start && time < *filter.start) ||
+        (filter.end && time >= *filter.end)) {
+      return false;
+    }
+    return !record.has_analog() || keep_channels(*record.mutable_analog());
+  }
+
   int z = 0;
 
   struct VideoDecoder {
@@ -89,24 +430,46 @@ struct RecordReader::Impl {
       avcodec_free_context(&context);
       av_packet_free(&packet);
       av_frame_free(&frame);
-      av_parser_close(parser);
+      if (parser) {
+        av_parser_close(parser);
+      }
     }
 
     VideoDecoder(int width, int height, AVRational framerate,
                  AVPixelFormat pixel_format,
-                 thalamus_grpc::Image::Format image_format) {
-      if (image_format == thalamus_grpc::Image::Format::Image_Format_MPEG4) {
+                 thalamus_grpc::Image::Format image_format,
+                 const std::string &extradata) {
+      switch (image_format) {
+      case thalamus_grpc::Image::Format::Image_Format_MPEG4:
         codec = avcodec_find_decoder(AV_CODEC_ID_MPEG4);
-      } else {
+        break;
+      case thalamus_grpc::Image::Format::Image_Format_FFV1:
+        codec = avcodec_find_decoder(AV_CODEC_ID_FFV1);
+        break;
+      case thalamus_grpc::Image::Format::Image_Format_H264:
+        codec = avcodec_find_decoder(AV_CODEC_ID_H264);
+        break;
+      default:
         codec = avcodec_find_decoder(AV_CODEC_ID_MPEG1VIDEO);
+        break;
       }
 
       THALAMUS_ASSERT(codec, "avcodec_find_decoder failed");
+      // FFV1 has no parser; Storage2Node writes exactly one packet per record
+      // so the record boundaries are the packet boundaries.
       parser = av_parser_init(codec->id);
-      THALAMUS_ASSERT(parser, "av_parser_init failed");
+      THALAMUS_ASSERT(parser || image_format ==
+                                    thalamus_grpc::Image::Format::Image_Format_FFV1,
+                      "av_parser_init failed");
 
       context = avcodec_alloc_context3(codec);
       THALAMUS_ASSERT(context, "avcodec_alloc_context3 failed");
+      if (!extradata.empty()) {
+        context->extradata = static_cast<uint8_t *>(
+            av_mallocz(extradata.size() + AV_INPUT_BUFFER_PADDING_SIZE));
+        std::copy(extradata.begin(), extradata.end(), context->extradata);
+        context->extradata_size = int(extradata.size());
+      }
       packet = av_packet_alloc();
       frame = av_frame_alloc();
 
@@ -154,8 +517,25 @@ struct RecordReader::Impl {
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wold-style-cast"
 #endif
+        if (!parser && !data.empty()) {
+          packet->data =
+              reinterpret_cast<uint8_t *>(const_cast<char *>(data.data()));
+          packet->size = int(data.size());
+          ret = avcodec_send_packet(context, packet);
+          if (ret < 0) {
+            // A corrupt record shouldn't end the read, its frame is dropped
+            av_strerror(ret, hydrate_av_error, sizeof(hydrate_av_error));
+            THALAMUS_LOG(error) << "Dropping a " << record->node()
+                                << " packet, avcodec_send_packet failed: "
+                                << hydrate_av_error;
+            if (record->image().width() > 0) {
+              pending.pop_back();
+            }
+            return;
+          }
+        }
         auto offset = 0;
-        while (size_t(offset) < data.size()) {
+        while (parser && size_t(offset) < data.size()) {
           ret = av_parser_parse2(
               parser, context, &packet->data, &packet->size,
               reinterpret_cast<const unsigned char *>(data.data()) + offset,
@@ -187,8 +567,31 @@ struct RecordReader::Impl {
         buffer.push_back(std::move(pending.front()));
         pending.pop_front();
         auto &buffer_record = buffer.back();
+        auto buffer_image = buffer_record.mutable_image();
+        if (frame->format == AV_PIX_FMT_GRAY16LE) {
+          buffer_image->set_format(
+              thalamus_grpc::Image::Format::Image_Format_Gray16);
+          buffer_image->set_bigendian(false);
+        } else if (frame->format == AV_PIX_FMT_GBRP) {
+          buffer_image->set_format(
+              thalamus_grpc::Image::Format::Image_Format_RGB);
+          auto rgb = buffer_image->add_data();
+          rgb->resize(3 * size_t(frame->width) * size_t(frame->height));
+          auto out = rgb->data();
+          for (auto y = 0; y < frame->height; ++y) {
+            auto g = frame->data[0] + y * frame->linesize[0];
+            auto b = frame->data[1] + y * frame->linesize[1];
+            auto r = frame->data[2] + y * frame->linesize[2];
+            for (auto x = 0; x < frame->width; ++x) {
+              *out++ = char(r[x]);
+              *out++ = char(g[x]);
+              *out++ = char(b[x]);
+            }
+          }
+          continue;
+        }
         for (auto i = 0; i < 1; ++i) {
-          buffer_record.mutable_image()->add_data()->assign(
+          buffer_image->add_data()->assign(
               frame->data[0],
               frame->data[0] + frame->linesize[0] * frame->height);
         }
@@ -204,72 +607,171 @@ struct RecordReader::Impl {
     }
   };
 
-  std::optional<thalamus_grpc::StorageRecord> read_record_from_stream() {
+  /**
+   * Reads the next length prefixed record, either straight out of the mapping
+   * or through the stream.  Returns false at the end of the capture or when
+   * the final record is truncated.
+   */
+  bool parse_next(thalamus_grpc::StorageRecord &record) {
+    if (past_end) {
+      progress = 100;
+      return false;
+    }
+    if (!stream) {
+      while (true) {
+        progress = mapped_size
+                       ? 100.0 * double(mapped_offset) / double(mapped_size)
+                       : 100.0;
+        auto remaining = mapped_size - mapped_offset;
+        if (remaining == 0) {
+          return false;
+        }
+        if (remaining < 8) {
+          std::cout << "Not enough bytes to read message size, likely final "
+                       "message was corrupted."
+                    << std::endl;
+          return false;
+        }
+
+        uint64_t size;
+        std::memcpy(&size, mapped + mapped_offset, sizeof(size));
+        size = htonll(size);
+        mapped_offset += 8;
+        remaining -= 8;
+        if (remaining < size) {
+          std::cout << "Not enough bytes to read message, likely final message "
+                       "was corrupted."
+                    << std::endl;
+          mapped_offset = mapped_size;
+          return false;
+        }
+
+        auto data = mapped + mapped_offset;
+        mapped_offset += size;
+        if (skip(data, size)) {
+          if (past_end) {
+            progress = 100;
+            return false;
+          }
+          continue;
+        }
+        auto parsed = record.ParseFromArray(data, int(size));
+        if (!parsed) {
+          std::cout << "Failed to parse message" << std::endl;
+          mapped_offset = mapped_size;
+          return false;
+        }
+        return true;
+      }
+    }
+
     while (true) {
-      auto initial_position = stream.tellg();
+      auto initial_position = stream->tellg();
       auto current_position = initial_position;
 
-      stream.seekg(0, std::ios::end);
-      auto file_size = stream.tellg();
-      stream.seekg(initial_position);
+      stream->seekg(0, std::ios::end);
+      auto file_size = stream->tellg();
+      stream->seekg(initial_position);
 
       progress = 100.0 * double(current_position) / double(file_size);
 
       if (file_size == current_position) {
         // std::cout << "End of file" << std::endl;
-        flush_video_decoders();
-        return std::nullopt;
+        return false;
       }
 
       if (file_size - current_position < 8) {
         std::cout << "Not enough bytes to read message size, likely final "
                      "message was corrupted."
                   << std::endl;
-        flush_video_decoders();
-        return std::nullopt;
+        return false;
       }
 
-      std::string buffer;
-      buffer.resize(8);
-      stream.read(buffer.data(), 8);
-      size_t size = *reinterpret_cast<size_t *>(buffer.data());
+      stream_buffer.resize(8);
+      stream->read(stream_buffer.data(), 8);
+      size_t size = *reinterpret_cast<size_t *>(stream_buffer.data());
       size = htonll(size);
 
-      current_position = stream.tellg();
+      current_position = stream->tellg();
       if (size_t(file_size - current_position) < size) {
         std::cout << "Not enough bytes to read message, likely final message "
                      "was corrupted."
                   << std::endl;
-        flush_video_decoders();
-        return std::nullopt;
+        return false;
       }
 
-      buffer.resize(size);
-      stream.read(buffer.data(), int64_t(size));
+      stream_buffer.resize(size);
+      stream->read(stream_buffer.data(), int64_t(size));
+      if (skip(stream_buffer.data(), size)) {
+        if (past_end) {
+          progress = 100;
+          return false;
+        }
+        continue;
+      }
 
-      thalamus_grpc::StorageRecord record;
-      auto parsed = record.ParseFromString(buffer);
+      auto parsed = record.ParseFromArray(stream_buffer.data(), int(size));
       if (!parsed) {
         std::cout << "Failed to parse message" << std::endl;
+        return false;
+      }
+      return true;
+    }
+  }
+
+  std::string stream_buffer;
+
+  /**
+   * Feeds compressed and video records to their decoders.  Returns false for
+   * records that only carry decoder input and shouldn't be handed out.
+   */
+  bool admit(thalamus_grpc::StorageRecord &record) {
+    if (record.body_case() == thalamus_grpc::StorageRecord::kCompressed) {
+      if (ignored_streams.contains(record.compressed().stream())) {
+        return false;
+      }
+      inflate_record(record.compressed());
+      if (record.compressed().type() ==
+          thalamus_grpc::Compressed::Type::Compressed_Type_NONE) {
+        return false;
+      }
+    } else if (do_decode_video &&
+               record.body_case() == thalamus_grpc::StorageRecord::kImage &&
+               is_compressed_video(record.image().format())) {
+      decode_video(record);
+      if (record.image().width() == 0) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /**
+   * Whether the record is handed out exactly as it was stored, as opposed to
+   * being inflated, decoded or expanded first.
+   */
+  bool is_passthrough(const thalamus_grpc::StorageRecord &record) {
+    switch (record.body_case()) {
+    case thalamus_grpc::StorageRecord::kCompressed:
+    case thalamus_grpc::StorageRecord::kAnalogSchema:
+    case thalamus_grpc::StorageRecord::kAnalogBlock:
+      return false;
+    case thalamus_grpc::StorageRecord::kImage:
+      return !do_decode_video || !is_compressed_video(record.image().format());
+    default:
+      return true;
+    }
+  }
+
+  std::optional<thalamus_grpc::StorageRecord> read_record_from_stream() {
+    while (true) {
+      thalamus_grpc::StorageRecord record;
+      if (!parse_next(record)) {
         flush_video_decoders();
         return std::nullopt;
       }
-      if (record.body_case() == thalamus_grpc::StorageRecord::kCompressed) {
-        inflate_record(record.compressed());
-        if (record.compressed().type() ==
-            thalamus_grpc::Compressed::Type::Compressed_Type_NONE) {
-          continue;
-        }
-      } else if (do_decode_video &&
-                 record.body_case() == thalamus_grpc::StorageRecord::kImage &&
-                 (record.image().format() ==
-                      thalamus_grpc::Image::Format::Image_Format_MPEG1 ||
-                  record.image().format() ==
-                      thalamus_grpc::Image::Format::Image_Format_MPEG4)) {
-        decode_video(record);
-        if (record.image().width() == 0) {
-          continue;
-        }
+      if (!admit(record)) {
+        continue;
       }
       return std::move(record);
     }
@@ -321,6 +823,8 @@ struct RecordReader::Impl {
         break;
       case thalamus_grpc::Image::Format::Image_Format_MPEG1:
       case thalamus_grpc::Image::Format::Image_Format_MPEG4:
+      case thalamus_grpc::Image::Format::Image_Format_FFV1:
+      case thalamus_grpc::Image::Format::Image_Format_H264:
         format = AV_PIX_FMT_YUV420P;
         break;
       case thalamus_grpc::Image::Format::Image_Format_RGB:
@@ -336,7 +840,8 @@ struct RecordReader::Impl {
       }
 
       video_decoders[record.node()] = std::make_unique<VideoDecoder>(
-          image.width(), image.height(), framerate, format, image.format());
+          image.width(), image.height(), framerate, format, image.format(),
+          image.codec_extradata());
     }
     video_decoders[record.node()]->decode(&record);
     // if(image.width() == 0) {
@@ -365,68 +870,93 @@ struct RecordReader::Impl {
 #pragma clang diagnostic pop
 #endif
       THALAMUS_ASSERT(error == Z_OK, "ZLIB Error: %d", error);
-      zstream_buffers[compressed.stream()] =
-          std::make_pair(0ull, std::vector<unsigned char>(1024));
+      zstream_buffers[compressed.stream()] = ZBuffer();
     }
     auto &zstream = zstreams[compressed.stream()];
-    auto &[offset, zbuffer] = zstream_buffers[compressed.stream()];
+    auto &zbuffer = zstream_buffers[compressed.stream()];
+    if (zbuffer.begin > 0 && zbuffer.begin >= zbuffer.available()) {
+      std::memmove(zbuffer.data.data(), zbuffer.data.data() + zbuffer.begin,
+                   zbuffer.available());
+      zbuffer.end -= zbuffer.begin;
+      zbuffer.begin = 0;
+    }
     zstream.avail_in = uint32_t(compressed_data.size());
     zstream.next_in =
         reinterpret_cast<const unsigned char *>(compressed_data.data());
     auto compressing = true;
     while (compressing) {
-      zstream.avail_out = uint32_t(zbuffer.size() - offset);
-      zstream.next_out = zbuffer.data() + offset;
+      zstream.avail_out = uint32_t(zbuffer.data.size() - zbuffer.end);
+      zstream.next_out = zbuffer.data.data() + zbuffer.end;
       auto error = inflate(&zstream, Z_NO_FLUSH);
       THALAMUS_ASSERT(error == Z_OK || error == Z_BUF_ERROR ||
                           error == Z_STREAM_END,
                       "ZLIB Error: %d", error);
       compressing = zstream.avail_out == 0;
       if (compressing) {
-        offset = zbuffer.size();
-        zbuffer.resize(2 * zbuffer.size());
+        zbuffer.end = zbuffer.data.size();
+        zbuffer.data.resize(2 * zbuffer.data.size());
       }
     }
-    offset = zbuffer.size() - zstream.avail_out;
+    zbuffer.end = zbuffer.data.size() - zstream.avail_out;
   }
 
   std::optional<thalamus_grpc::StorageRecord>
   process_record(const thalamus_grpc::StorageRecord &record) {
     if (record.body_case() == thalamus_grpc::StorageRecord::kCompressed) {
-      auto compressed = record.compressed();
+      auto &compressed = record.compressed();
+      if (ignored_streams.contains(compressed.stream())) {
+        return thalamus_grpc::StorageRecord();
+      }
       auto i = zstream_buffers.find(compressed.stream());
-      auto offset = i->second.first;
+      auto available = i->second.available();
 
-      while (offset < size_t(compressed.size())) {
+      while (available < size_t(compressed.size())) {
         auto new_record = read_record_from_stream();
         i = zstream_buffers.find(compressed.stream());
-        offset = i->second.first;
+        available = i->second.available();
         if (!new_record) {
           break;
         }
-        record_buffer.push_back(*new_record);
+        record_buffer.push_back(std::move(*new_record));
       }
-      if (offset < size_t(compressed.size())) {
+      if (available < size_t(compressed.size())) {
         return std::nullopt;
       }
 
+      auto &zbuffer = i->second;
+      auto inflated = reinterpret_cast<const char *>(zbuffer.data.data()) +
+                      zbuffer.begin;
+      std::optional<Header> header;
+      if (filtering) {
+        header = peek(inflated, size_t(compressed.size()));
+      }
+      // Storage2Node gives every channel its own zlib stream, so a stream
+      // whose node or channel is rejected is never inflated again.
+      if (header && rejects(header->node)) {
+        ignore_stream(compressed.stream());
+        return thalamus_grpc::StorageRecord();
+      }
+      if (header && skip(*header)) {
+        zbuffer.begin += size_t(compressed.size());
+        return thalamus_grpc::StorageRecord();
+      }
       thalamus_grpc::StorageRecord inflated_record;
-      auto parsed = inflated_record.ParseFromArray(i->second.second.data(),
-                                                   compressed.size());
+      auto parsed =
+          inflated_record.ParseFromArray(inflated, compressed.size());
       if (!parsed) {
         return std::nullopt;
       }
-      i->second.second.erase(i->second.second.begin(),
-                             i->second.second.begin() + compressed.size());
-      i->second.first -= size_t(compressed.size());
+      zbuffer.begin += size_t(compressed.size());
+      if (filtering && inflated_record.has_analog() &&
+          !keep_channels(*inflated_record.mutable_analog())) {
+        ignore_stream(compressed.stream());
+        return thalamus_grpc::StorageRecord();
+      }
 
       return std::move(inflated_record);
     } else if (do_decode_video &&
                record.body_case() == thalamus_grpc::StorageRecord::kImage &&
-               (record.image().format() ==
-                    thalamus_grpc::Image::Format::Image_Format_MPEG1 ||
-                record.image().format() ==
-                    thalamus_grpc::Image::Format::Image_Format_MPEG4)) {
+               is_compressed_video(record.image().format())) {
       auto &decoder = video_decoders[record.node()];
       auto pulled = decoder->pull();
       while (!pulled) {
@@ -435,7 +965,7 @@ struct RecordReader::Impl {
         if (!new_record) {
           break;
         }
-        record_buffer.push_back(*new_record);
+        record_buffer.push_back(std::move(*new_record));
       }
       if (!pulled) {
         return std::nullopt;
@@ -446,27 +976,358 @@ struct RecordReader::Impl {
     }
   }
 
+  void ignore_stream(int stream) {
+    ignored_streams.insert(stream);
+    zstream_buffers.erase(stream);
+  }
+
+  std::map<uint32_t, thalamus_grpc::AnalogSchema> analog_schemas;
+  std::list<thalamus_grpc::StorageRecord> expanded_records;
+
+  template <typename T>
+  static void read_samples(const std::string &bytes, size_t begin, size_t end,
+                           auto *output) {
+    for (auto i = begin; i < end; ++i) {
+      T value;
+      std::memcpy(&value, bytes.data() + i * sizeof(T), sizeof(T));
+      if constexpr (std::endian::native == std::endian::big) {
+        auto value_bytes = reinterpret_cast<char *>(&value);
+        std::reverse(value_bytes, value_bytes + sizeof(T));
+      }
+      output->Add(value);
+    }
+  }
+
+  /**
+   * The blocks of one node's current flush, by channel.  Storage2Node writes
+   * every channel's block of a flush together, so the flush is complete when
+   * every channel has one, a channel repeats or the node's schema changes.
+   */
+  struct PendingBlocks {
+    uint32_t schema = 0;
+    std::vector<std::optional<thalamus_grpc::AnalogBlock>> blocks;
+    size_t count = 0;
+  };
+  std::map<std::string, PendingBlocks> pending_blocks;
+
+  void add_schema(const thalamus_grpc::StorageRecord &record) {
+    auto pending = pending_blocks.find(record.node());
+    if (pending != pending_blocks.end()) {
+      expand_blocks(record.node(), pending->second);
+    }
+    analog_schemas[record.analog_schema().id()] = record.analog_schema();
+  }
+
+  void add_block(thalamus_grpc::StorageRecord &record) {
+    auto &block = *record.mutable_analog_block();
+    auto schema_i = analog_schemas.find(block.schema());
+    if (schema_i == analog_schemas.end()) {
+      std::cout << "Analog block references unknown schema " << block.schema()
+                << std::endl;
+      return;
+    }
+    auto channels = size_t(schema_i->second.channels_size());
+    if (block.channel() >= channels) {
+      std::cout << "Analog block references unknown channel "
+                << block.channel() << std::endl;
+      return;
+    }
+
+    auto &pending = pending_blocks[record.node()];
+    if (pending.count &&
+        (pending.schema != block.schema() || pending.blocks[block.channel()])) {
+      expand_blocks(record.node(), pending);
+    }
+    pending.schema = block.schema();
+    pending.blocks.resize(channels);
+    pending.blocks[block.channel()].emplace().Swap(&block);
+    if (++pending.count == channels) {
+      expand_blocks(record.node(), pending);
+    }
+  }
+
+  /**
+   * Expands every node's buffered blocks at the end of the capture, returns
+   * whether that produced any records.
+   */
+  bool expand_pending() {
+    auto had_records = !expanded_records.empty();
+    for (auto &pair : pending_blocks) {
+      expand_blocks(pair.first, pair.second);
+    }
+    return !had_records && !expanded_records.empty();
+  }
+
+  /**
+   * Turns a flush of columnar AnalogBlocks back into one analog record per
+   * update with a span for every channel, in the order the updates happened,
+   * the same records Storage2Node writes for uncolumnar analog data, so
+   * consumers never see the columnar layout.
+   */
+  void expand_blocks(const std::string &node, PendingBlocks &pending) {
+    if (!pending.count) {
+      return;
+    }
+    auto &schema = analog_schemas[pending.schema];
+    struct Column {
+      const thalamus_grpc::AnalogSchema::Channel *channel = nullptr;
+      const thalamus_grpc::AnalogBlock *block = nullptr;
+      std::string inflated;
+      const std::string *bytes = nullptr;
+      int chunk = 0;
+      size_t begin = 0;
+
+      bool has_chunk() const {
+        return block && chunk < block->chunk_ends_size();
+      }
+    };
+    std::vector<Column> columns;
+    for (size_t c = 0; c < pending.blocks.size(); ++c) {
+      auto &channel = schema.channels(int(c));
+      if (filter.channel && !filter.channel(channel.name())) {
+        continue;
+      }
+      auto &column = columns.emplace_back();
+      column.channel = &channel;
+      auto &block = pending.blocks[c];
+      if (!block) {
+        continue;
+      }
+      column.block = &*block;
+      column.bytes = &block->data();
+      if (block->compressed()) {
+        column.inflated.resize(block->size());
+        auto size = uLongf(column.inflated.size());
+        auto error = uncompress(
+            reinterpret_cast<Bytef *>(column.inflated.data()), &size,
+            reinterpret_cast<const Bytef *>(block->data().data()),
+            uLong(block->data().size()));
+        THALAMUS_ASSERT(error == Z_OK, "ZLIB Error: %d", error);
+        column.bytes = &column.inflated;
+      }
+    }
+
+    while (true) {
+      std::optional<uint64_t> time;
+      for (auto &column : columns) {
+        if (column.has_chunk()) {
+          auto chunk_time = column.block->chunk_times(column.chunk);
+          time = time ? std::min(*time, chunk_time) : chunk_time;
+        }
+      }
+      if (!time) {
+        break;
+      }
+
+      auto &expanded = expanded_records.emplace_back();
+      expanded.set_node(node);
+      expanded.set_time(*time);
+      auto body = expanded.mutable_analog();
+      body->set_time(*time);
+      body->set_is_transformed(schema.is_transformed());
+      body->set_is_int_data(
+          schema.sample_type() == thalamus_grpc::AnalogSchema::INT16 ||
+          schema.sample_type() == thalamus_grpc::AnalogSchema::INT32);
+      body->set_is_ulong_data(schema.sample_type() ==
+                              thalamus_grpc::AnalogSchema::UINT64);
+      for (auto &column : columns) {
+        auto span = body->add_spans();
+        span->set_name(column.channel->name());
+        if (schema.is_transformed()) {
+          span->set_scale(column.channel->scale());
+          span->set_offset(column.channel->offset());
+        }
+        body->add_sample_intervals(column.channel->sample_interval());
+        if (!column.has_chunk() ||
+            column.block->chunk_times(column.chunk) != *time) {
+          auto size = body->is_int_data()     ? body->int_data_size()
+                      : body->is_ulong_data() ? body->ulong_data_size()
+                                              : body->data_size();
+          span->set_begin(uint32_t(size));
+          span->set_end(uint32_t(size));
+          continue;
+        }
+
+        auto &block = *column.block;
+        if (column.chunk < block.chunk_remote_times_size()) {
+          body->set_remote_time(block.chunk_remote_times(column.chunk));
+        }
+        size_t end = block.chunk_ends(column.chunk);
+        auto &bytes = *column.bytes;
+        switch (schema.sample_type()) {
+        case thalamus_grpc::AnalogSchema::INT16:
+          span->set_begin(uint32_t(body->int_data_size()));
+          read_samples<short>(bytes, column.begin, end,
+                              body->mutable_int_data());
+          span->set_end(uint32_t(body->int_data_size()));
+          break;
+        case thalamus_grpc::AnalogSchema::INT32:
+          span->set_begin(uint32_t(body->int_data_size()));
+          read_samples<int>(bytes, column.begin, end, body->mutable_int_data());
+          span->set_end(uint32_t(body->int_data_size()));
+          break;
+        case thalamus_grpc::AnalogSchema::UINT64:
+          span->set_begin(uint32_t(body->ulong_data_size()));
+          read_samples<uint64_t>(bytes, column.begin, end,
+                                 body->mutable_ulong_data());
+          span->set_end(uint32_t(body->ulong_data_size()));
+          break;
+        default:
+          span->set_begin(uint32_t(body->data_size()));
+          read_samples<double>(bytes, column.begin, end, body->mutable_data());
+          span->set_end(uint32_t(body->data_size()));
+          break;
+        }
+        column.begin = end;
+        ++column.chunk;
+      }
+    }
+
+    pending.blocks.clear();
+    pending.count = 0;
+  }
+
   std::optional<thalamus_grpc::StorageRecord> read_record() {
-    if (!record_buffer.empty()) {
-      thalamus_grpc::StorageRecord result = std::move(record_buffer.front());
-      record_buffer.pop_front();
-      return process_record(result);
+    if (!shards.empty()) {
+      return read_merged();
     }
+    while (true) {
+      if (!expanded_records.empty()) {
+        auto result = std::move(expanded_records.front());
+        expanded_records.pop_front();
+        if (!accept(result)) {
+          continue;
+        }
+        return std::move(result);
+      }
 
-    auto record = read_record_from_stream();
-    if (!record) {
-      return std::nullopt;
+      std::optional<thalamus_grpc::StorageRecord> record;
+      if (!record_buffer.empty()) {
+        thalamus_grpc::StorageRecord result = std::move(record_buffer.front());
+        record_buffer.pop_front();
+        record = process_record(result);
+      } else {
+        record = read_record_from_stream();
+        if (!record) {
+          if (expand_pending()) {
+            continue;
+          }
+          return std::nullopt;
+        }
+        record = process_record(*record);
+      }
+      if (!record) {
+        // Records read ahead while inflating may still be buffered.
+        if (record_buffer.empty() && !expand_pending()) {
+          return std::nullopt;
+        }
+        continue;
+      }
+
+      if (record->body_case() ==
+                        thalamus_grpc::StorageRecord::kAnalogSchema) {
+        add_schema(*record);
+        continue;
+      } else if (record->body_case() ==
+                 thalamus_grpc::StorageRecord::kAnalogBlock) {
+        add_block(*record);
+        continue;
+      }
+      if (!accept(*record)) {
+        continue;
+      }
+      return record;
+    }
+  }
+
+  std::span<const thalamus_grpc::StorageRecord *const>
+  read_batch(size_t max_records) {
+    batch.clear();
+    arena.Reset();
+    while (!shards.empty() && batch.size() < max_records) {
+      auto merged = read_merged();
+      if (!merged) {
+        return batch;
+      }
+      auto record =
+          google::protobuf::Arena::Create<thalamus_grpc::StorageRecord>(&arena);
+      *record = std::move(*merged);
+      batch.push_back(record);
+    }
+    while (batch.size() < max_records) {
+      auto record =
+          google::protobuf::Arena::Create<thalamus_grpc::StorageRecord>(&arena);
+      if (!expanded_records.empty() || !record_buffer.empty()) {
+        auto buffered = read_record();
+        if (!buffered) {
+          break;
+        }
+        *record = std::move(*buffered);
+        batch.push_back(record);
+        continue;
+      }
+
+      if (!parse_next(*record)) {
+        if (expand_pending()) {
+          continue;
+        }
+        flush_video_decoders();
+        break;
+      }
+      if (!admit(*record)) {
+        continue;
+      }
+      // Plain records are parsed straight from the mapping into the arena and
+      // handed out as is, everything else takes the same path as read_record.
+      if (is_passthrough(*record)) {
+        if (accept(*record)) {
+          batch.push_back(record);
+        }
+        continue;
+      }
+
+      auto processed = process_record(*record);
+      if (!processed) {
+        if (record_buffer.empty() && !expand_pending()) {
+          break;
+        }
+        continue;
+      }
+      if (processed->body_case() ==
+          thalamus_grpc::StorageRecord::kAnalogSchema) {
+        add_schema(*processed);
+        continue;
+      } else if (processed->body_case() ==
+                 thalamus_grpc::StorageRecord::kAnalogBlock) {
+        add_block(*processed);
+        continue;
+      }
+      if (!accept(*processed)) {
+        continue;
+      }
+      *record = std::move(*processed);
+      batch.push_back(record);
     }
-    return process_record(*record);
+    return batch;
   }
 };
 
 RecordReader::RecordReader(std::istream &_stream, bool _do_decode_video)
  : impl(new Impl(_stream, _do_decode_video)) {}
+RecordReader::RecordReader(const std::filesystem::path &path,
+                           bool _do_decode_video)
+    : impl(new Impl(path, _do_decode_video)) {}
 RecordReader::~RecordReader() {}
+void RecordReader::set_filter(const Filter &filter) {
+  impl->set_filter(filter);
+}
 std::optional<thalamus_grpc::StorageRecord> RecordReader::read_record() {
   return impl->read_record();
 }
+std::span<const thalamus_grpc::StorageRecord *const>
+RecordReader::read_batch(size_t max_records) {
+  return impl->read_batch(max_records);
+}
 double RecordReader::progress() {
   return impl->progress;
 }
@@ -1,5 +1,11 @@
 #pragma once
+#include <chrono>
+#include <filesystem>
+#include <functional>
 #include <memory>
+#include <optional>
+#include <span>
+#include <string_view>
 
 #ifdef __clang__
 #pragma clang diagnostic push
@@ -15,8 +21,34 @@ struct RecordReader {
   struct Impl;
   std::unique_ptr<Impl> impl;
   RecordReader(std::istream &_stream, bool _do_decode_video = true);
+  /**
+   * Memory maps the capture and parses records in place instead of copying
+   * them through an istream.
+   */
+  RecordReader(const std::filesystem::path &path, bool _do_decode_video = true);
   ~RecordReader();
+  /**
+   * Limits the records that are read.  Records of rejected nodes and records
+   * outside of [start, end) are dropped, usually before they are parsed, and
+   * the zlib streams of rejected channels stop being inflated.  Analog records
+   * keep only the spans of accepted channels.  Metadata is always read and
+   * records without a node, like the log, aren't subject to the node filter.
+   */
+  struct Filter {
+    std::optional<std::chrono::nanoseconds> start;
+    std::optional<std::chrono::nanoseconds> end;
+    std::function<bool(std::string_view)> node;
+    std::function<bool(std::string_view)> channel;
+  };
+  void set_filter(const Filter &filter);
   std::optional<thalamus_grpc::StorageRecord> read_record();
+  /**
+   * Reads up to max_records records into an arena owned by the reader.  The
+   * records stay valid until the next call to read_batch.  Returns an empty
+   * span at the end of the capture.
+   */
+  std::span<const thalamus_grpc::StorageRecord *const>
+  read_batch(size_t max_records);
   double progress();
 };
 }
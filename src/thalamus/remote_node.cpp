@@ -533,6 +533,8 @@ struct RemoteNode::Impl {
             case thalamus_grpc::Image_Format_RGB16:
             case thalamus_grpc::Image_Format_MPEG1:
             case thalamus_grpc::Image_Format_MPEG4:
+            case thalamus_grpc::Image_Format_FFV1:
+            case thalamus_grpc::Image_Format_H264:
             case thalamus_grpc::Image_Format_Image_Format_INT_MIN_SENTINEL_DO_NOT_USE_:
             case thalamus_grpc::Image_Format_Image_Format_INT_MAX_SENTINEL_DO_NOT_USE_:
               THALAMUS_ASSERT(false, "Unsupported image format");
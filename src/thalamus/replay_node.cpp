@@ -0,0 +1,862 @@
+#include <thalamus/tracing.hpp>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thalamus/async.hpp>
+#include <thalamus/modalities_util.hpp>
+#include <thalamus/record_reader.hpp>
+#include <thalamus/replay_node.hpp>
+#include <thalamus/thread.hpp>
+#include <thalamus/thread_pool.hpp>
+
+#ifdef __clang__
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Weverything"
+#endif
+#include <absl/strings/str_split.h>
+#include <absl/strings/strip.h>
+#ifdef __clang__
+#pragma clang diagnostic pop
+#endif
+
+namespace thalamus {
+using namespace std::chrono_literals;
+
+struct ReplayNode::Impl {
+  ObservableDictPtr state;
+  boost::signals2::scoped_connection state_connection;
+  boost::asio::io_context &io_context;
+  NodeGraph *graph;
+  ReplayNode *outer;
+  std::thread replay_thread;
+  std::atomic_bool running = false;
+
+  enum class Clock { REAL_TIME, SPEED, FAST };
+  std::atomic<Clock> clock = Clock::REAL_TIME;
+  std::atomic<double> speed = 1.0;
+  // Set when the clock or speed changes so that playback re-anchors to the
+  // wall clock at the next record instead of jumping.
+  std::atomic_bool reanchor = false;
+  // Publish records at their capture time and move MovableSteadyClock and
+  // MovableSystemClock along with them.
+  std::atomic_bool virtual_clock = false;
+  // In as fast as possible mode, hand over one image at a time and only once
+  // the ThreadPool is idle so nodes that drop frames when it is full, such as
+  // OCULOMATIC, see every frame.
+  std::atomic_bool wait_for_pool = false;
+
+  struct Entry {
+    thalamus_grpc::StorageRecord record;
+    // Offset of the record from the start of the capture.
+    std::chrono::nanoseconds position;
+    unsigned int epoch;
+  };
+
+  // Records waiting for their presentation time.  The read thread fills it up
+  // to prefetch_records ahead of the replay thread.
+  std::mutex ring_mutex;
+  std::condition_variable ring_condition;
+  std::deque<Entry> ring;
+  size_t prefetch_records = 4096;
+  bool read_finished = false;
+  bool dispatch_pending = false;
+  unsigned int epoch = 0;
+  std::chrono::nanoseconds capture_start = 0ns;
+  std::atomic<double> seek_target = -1;
+  std::atomic<double> read_progress = 0;
+
+  struct Source {
+    std::weak_ptr<ReplaySourceNode> node;
+    bool pending = false;
+    bool ignored = false;
+    std::vector<std::pair<thalamus_grpc::StorageRecord, std::chrono::nanoseconds>>
+        backlog;
+    NodeGraph::NodeConnection connection;
+  };
+  std::map<std::string, Source> sources;
+
+  std::array<double, 4> stats = {0, 0, 0, 0};
+  std::chrono::nanoseconds time = 0ns;
+  std::chrono::steady_clock::time_point last_stats_time;
+  size_t dispatched_records = 0;
+  bool has_analog = false;
+
+  Impl(ObservableDictPtr _state, boost::asio::io_context &_io_context,
+       NodeGraph *_graph, ReplayNode *_outer)
+      : state(_state), io_context(_io_context), graph(_graph), outer(_outer) {
+    state_connection =
+        state->changed.connect(std::bind(&Impl::on_change, this, _1, _2, _3));
+    state->recap(std::bind(&Impl::on_change, this, _1, _2, _3));
+  }
+
+  ~Impl() {
+    running = false;
+    stop();
+  }
+
+  /**
+   * Reads and decodes records into the prefetch ring.  Runs on its own thread
+   * so that decoding, video in particular, overlaps with waiting on the
+   * current record's presentation time.
+   */
+  void read_target(std::filesystem::path path, std::set<std::string> nodes) {
+    set_current_thread_name("REPLAY Read");
+    std::optional<RecordReader> reader;
+    reader.emplace(path);
+
+    auto first_time = std::chrono::nanoseconds(-1);
+    auto last_position = 0ns;
+    auto skip_until = 0ns;
+    while (running) {
+      double seek_seconds = seek_target.exchange(-1);
+      if (seek_seconds >= 0) {
+        TRACE_EVENT("thalamus", "ReplayNode::seek");
+        skip_until = std::chrono::nanoseconds(int64_t(seek_seconds * 1e9));
+        // Captures have no index, seeking backwards reads from the start again.
+        if (skip_until < last_position) {
+          reader.reset();
+          reader.emplace(path);
+          last_position = 0ns;
+        }
+        std::lock_guard<std::mutex> lock(ring_mutex);
+        ring.clear();
+        ++epoch;
+        ring_condition.notify_all();
+      }
+
+      std::optional<thalamus_grpc::StorageRecord> record;
+      {
+        TRACE_EVENT("thalamus", "RecordReader::read_record");
+        record = reader->read_record();
+      }
+      if (!record) {
+        break;
+      }
+      read_progress = reader->progress();
+
+      switch (record->body_case()) {
+      case thalamus_grpc::StorageRecord::kAnalog:
+      case thalamus_grpc::StorageRecord::kXsens:
+      case thalamus_grpc::StorageRecord::kImage:
+      case thalamus_grpc::StorageRecord::kText:
+        break;
+      default:
+        continue;
+      }
+
+      auto record_time = std::chrono::nanoseconds(record->time());
+      if (first_time.count() < 0) {
+        first_time = record_time;
+        std::lock_guard<std::mutex> lock(ring_mutex);
+        capture_start = first_time;
+      }
+      auto position = record_time - first_time;
+      last_position = position;
+      if (position < skip_until) {
+        continue;
+      }
+      if (!nodes.empty() && !nodes.contains(record->node())) {
+        continue;
+      }
+
+      std::unique_lock<std::mutex> lock(ring_mutex);
+      ring_condition.wait(lock, [&] {
+        return ring.size() < prefetch_records || !running || seek_target >= 0;
+      });
+      if (!running || seek_target >= 0) {
+        continue;
+      }
+      ring.push_back(Entry{std::move(*record), position, epoch});
+      ring_condition.notify_all();
+    }
+
+    std::lock_guard<std::mutex> lock(ring_mutex);
+    read_finished = true;
+    ring_condition.notify_all();
+  }
+
+  void replay_target(std::filesystem::path path, std::set<std::string> nodes) {
+    set_current_thread_name("REPLAY");
+    {
+      std::lock_guard<std::mutex> lock(ring_mutex);
+      ring.clear();
+      read_finished = false;
+      dispatch_pending = false;
+    }
+    std::thread read_thread(
+        std::bind(&Impl::read_target, this, path, std::move(nodes)));
+    Finally join_reader([&] {
+      {
+        std::lock_guard<std::mutex> lock(ring_mutex);
+        ring_condition.notify_all();
+      }
+      read_thread.join();
+    });
+
+    // Posted work can outlive the node, stop() only joins this thread
+    auto weak = outer->weak_from_this();
+    auto stop = [this, weak] {
+      auto locked = weak.lock();
+      if (!locked) {
+        return;
+      }
+      (*state)["Running"].assign(false, [&] {});
+    };
+    auto start_record = std::chrono::nanoseconds(-1);
+    auto start_time = std::chrono::steady_clock::now();
+    auto presented_epoch = 0u;
+    auto due = [&](const Entry &entry) {
+      auto scale = clock == Clock::SPEED ? speed.load() : 1.0;
+      auto elapsed = double((entry.position - start_record).count()) / scale;
+      return start_time + std::chrono::nanoseconds(int64_t(elapsed));
+    };
+
+    while (running) {
+      TRACE_EVENT("thalamus", "loop");
+      std::unique_lock<std::mutex> lock(ring_mutex);
+      ring_condition.wait(lock, [&] {
+        return ((!ring.empty() || read_finished) && !dispatch_pending) ||
+               !running;
+      });
+      if (!running) {
+        break;
+      }
+      if (ring.empty()) {
+        THALAMUS_LOG(info) << "End of capture, stopping replay";
+        boost::asio::post(io_context, stop);
+        break;
+      }
+
+      auto now = std::chrono::steady_clock::now();
+      if (start_record.count() < 0 || ring.front().epoch != presented_epoch ||
+          reanchor.exchange(false)) {
+        start_record = ring.front().position;
+        start_time = now;
+        presented_epoch = ring.front().epoch;
+      }
+
+      auto fast = clock == Clock::FAST;
+      if (!fast) {
+        auto next = due(ring.front());
+        if (now < next) {
+          TRACE_EVENT("thalamus", "wait_until");
+          ring_condition.wait_until(lock, next, [&] {
+            return !running || reanchor || ring.empty() ||
+                   ring.front().epoch != presented_epoch;
+          });
+          continue;
+        }
+      }
+
+      auto paced = fast && wait_for_pool;
+      if (paced) {
+        lock.unlock();
+        graph->get_thread_pool().wait_idle();
+        lock.lock();
+        if (!running) {
+          break;
+        }
+        // A seek may have replaced the ring while waiting
+        if (ring.empty() || ring.front().epoch != presented_epoch) {
+          continue;
+        }
+      }
+
+      // Everything that is due is handed to the main thread in one post, in
+      // as fast as possible mode that is everything that has been prefetched.
+      std::vector<Entry> batch;
+      while (!ring.empty() && ring.front().epoch == presented_epoch &&
+             (fast || due(ring.front()) <= now)) {
+        batch.push_back(std::move(ring.front()));
+        ring.pop_front();
+        if (paced && batch.back().record.has_image()) {
+          break;
+        }
+      }
+      dispatch_pending = true;
+      auto buffered = ring.size();
+      ring_condition.notify_all();
+
+      auto use_virtual_clock = virtual_clock.load();
+      auto offset = use_virtual_clock
+                        ? capture_start
+                        : start_time.time_since_epoch() - start_record;
+      lock.unlock();
+
+      boost::asio::post(io_context, [this, weak, moved_batch = std::move(batch),
+                                     offset, buffered,
+                                     use_virtual_clock]() mutable {
+        auto locked = weak.lock();
+        if (!locked) {
+          return;
+        }
+        TRACE_EVENT("thalamus", "ReplayNode::dispatch");
+        for (auto &entry : moved_batch) {
+          auto record_time = entry.position + offset;
+          if (use_virtual_clock) {
+            auto clock_offset =
+                record_time - std::chrono::steady_clock::now().time_since_epoch();
+            MovableSteadyClock::set_offset(clock_offset);
+            MovableSystemClock::set_offset(clock_offset);
+          }
+          dispatch(entry.record, record_time);
+        }
+        dispatched_records += moved_batch.size();
+        update_stats(moved_batch.back().position, buffered);
+
+        std::lock_guard<std::mutex> lock2(ring_mutex);
+        dispatch_pending = false;
+        ring_condition.notify_all();
+      });
+    }
+  }
+
+  void update_stats(std::chrono::nanoseconds position, size_t buffered) {
+    auto now = std::chrono::steady_clock::now();
+    auto elapsed = now - last_stats_time;
+    if (elapsed < 200ms) {
+      return;
+    }
+    stats[0] = 100 * read_progress;
+    stats[1] = double(position.count()) / 1e9;
+    stats[2] = double(dispatched_records) /
+               std::chrono::duration<double>(elapsed).count();
+    stats[3] = double(buffered);
+    dispatched_records = 0;
+    last_stats_time = now;
+    time = now.time_since_epoch();
+    has_analog = true;
+    outer->ready(outer);
+  }
+
+  ObservableListPtr get_nodes_list() {
+    ObservableCollection *root = state.get();
+    while (root->parent) {
+      root = root->parent;
+    }
+    auto root_dict = root->as_dict();
+    if (!root_dict || !root_dict->contains("nodes")) {
+      return nullptr;
+    }
+    ObservableListPtr nodes = root_dict->at("nodes");
+    return nodes;
+  }
+
+  Source &get_source(const std::string &name) {
+    auto i = sources.find(name);
+    if (i != sources.end()) {
+      return i->second;
+    }
+    auto &source = sources[name];
+
+    auto existing = graph->get_node(name).lock();
+    if (existing) {
+      auto node = std::dynamic_pointer_cast<ReplaySourceNode>(existing);
+      if (!node) {
+        THALAMUS_LOG(warning) << "Node " << name
+                              << " already exists and isn't a REPLAY_SOURCE, "
+                                 "its records won't be replayed";
+        source.ignored = true;
+      }
+      source.node = node;
+      return source;
+    }
+
+    auto nodes = get_nodes_list();
+    if (!nodes) {
+      source.ignored = true;
+      return source;
+    }
+    // Records are held back until the graph creates the node.
+    source.pending = true;
+    source.connection = graph->get_node_scoped(name, [this, name](auto weak) {
+      auto &arrived = sources[name];
+      auto node = std::dynamic_pointer_cast<ReplaySourceNode>(weak.lock());
+      arrived.pending = false;
+      if (!node) {
+        arrived.ignored = true;
+        arrived.backlog.clear();
+        return;
+      }
+      arrived.node = node;
+      for (auto &[record, record_time] : arrived.backlog) {
+        node->publish(record, record_time);
+      }
+      arrived.backlog.clear();
+    });
+    boost::json::object node_json;
+    node_json["name"] = name;
+    node_json["type"] = "REPLAY_SOURCE";
+    nodes->push_back(ObservableCollection::from_json(node_json), [] {});
+    return source;
+  }
+
+  void dispatch(thalamus_grpc::StorageRecord &record,
+                std::chrono::nanoseconds record_time) {
+    auto &source = get_source(record.node());
+    if (source.ignored) {
+      return;
+    }
+    if (source.pending) {
+      source.backlog.emplace_back(std::move(record), record_time);
+      return;
+    }
+    auto node = source.node.lock();
+    if (!node) {
+      // The source was deleted from the graph, it will be added again.
+      sources.erase(record.node());
+      dispatch(record, record_time);
+      return;
+    }
+    node->publish(record, record_time);
+  }
+
+  void start() {
+    std::string filename =
+        state->contains("File") ? state->at("File") : std::string();
+    std::string nodes_str =
+        state->contains("Nodes") ? state->at("Nodes") : std::string();
+    int64_t prefetch = state->contains("Prefetch Records")
+                           ? state->at("Prefetch Records")
+                           : int64_t(4096);
+    prefetch_records = size_t(std::max(prefetch, int64_t(1)));
+    double seek = state->contains("Seek") ? state->at("Seek") : 0.0;
+    seek_target = seek > 0 ? seek : -1;
+
+    std::set<std::string> nodes;
+    for (auto token : absl::StrSplit(nodes_str, ',', absl::SkipWhitespace())) {
+      nodes.emplace(absl::StripAsciiWhitespace(token));
+    }
+
+    std::filesystem::path path(filename);
+    std::error_code ec;
+    if (filename.empty() || !std::filesystem::is_regular_file(path, ec)) {
+      THALAMUS_LOG(error) << "Capture not found: " << filename;
+      running = false;
+      boost::asio::post(io_context, [this, weak = outer->weak_from_this()] {
+        auto locked = weak.lock();
+        if (!locked) {
+          return;
+        }
+        (*state)["Running"].assign(false, [&] {});
+      });
+      return;
+    }
+
+    sources.clear();
+    dispatched_records = 0;
+    last_stats_time = std::chrono::steady_clock::now();
+    replay_thread =
+        std::thread(std::bind(&Impl::replay_target, this, path, nodes));
+  }
+
+  void stop() {
+    {
+      std::lock_guard<std::mutex> lock(ring_mutex);
+      ring_condition.notify_all();
+    }
+    if (replay_thread.joinable()) {
+      replay_thread.join();
+    }
+  }
+
+  void on_change(ObservableCollection::Action,
+                 const ObservableCollection::Key &k,
+                 const ObservableCollection::Value &v) {
+    auto key_str = std::get<std::string>(k);
+    if (key_str == "Running") {
+      {
+        std::lock_guard<std::mutex> lock(ring_mutex);
+        running = false;
+      }
+      stop();
+      if (std::get<bool>(v)) {
+        running = true;
+        start();
+      }
+    } else if (key_str == "Clock") {
+      auto value_str = std::get<std::string>(v);
+      if (value_str == "Speed") {
+        clock = Clock::SPEED;
+      } else if (value_str == "As Fast As Possible") {
+        clock = Clock::FAST;
+      } else {
+        clock = Clock::REAL_TIME;
+      }
+      reanchor = true;
+      std::lock_guard<std::mutex> lock(ring_mutex);
+      ring_condition.notify_all();
+    } else if (key_str == "Virtual Clock") {
+      virtual_clock = std::get<bool>(v);
+    } else if (key_str == "Wait For Pool") {
+      wait_for_pool = std::get<bool>(v);
+    } else if (key_str == "Speed") {
+      auto value = std::holds_alternative<double>(v)
+                       ? std::get<double>(v)
+                       : double(std::get<int64_t>(v));
+      speed = std::max(value, .01);
+      reanchor = true;
+      std::lock_guard<std::mutex> lock(ring_mutex);
+      ring_condition.notify_all();
+    } else if (key_str == "Seek") {
+      if (!running) {
+        return;
+      }
+      auto seconds = std::holds_alternative<double>(v)
+                         ? std::get<double>(v)
+                         : double(std::get<int64_t>(v));
+      seek_target = std::max(seconds, 0.0);
+      std::lock_guard<std::mutex> lock(ring_mutex);
+      ring_condition.notify_all();
+    }
+  }
+};
+
+ReplayNode::ReplayNode(ObservableDictPtr state,
+                       boost::asio::io_context &io_context, NodeGraph *graph)
+    : impl(new Impl(state, io_context, graph, this)) {}
+
+ReplayNode::~ReplayNode() {}
+
+std::string ReplayNode::type_name() { return "REPLAY"; }
+
+std::span<const double> ReplayNode::data(int index) const {
+  if (index < 0 || size_t(index) >= impl->stats.size()) {
+    return {};
+  }
+  return std::span<const double>(impl->stats.data() + index, 1);
+}
+
+int ReplayNode::num_channels() const { return int(impl->stats.size()); }
+
+std::chrono::nanoseconds ReplayNode::sample_interval(int) const { return 0ns; }
+
+std::chrono::nanoseconds ReplayNode::time() const { return impl->time; }
+
+std::string_view ReplayNode::name(int channel) const {
+  switch (channel) {
+  case 0:
+    return "Progress";
+  case 1:
+    return "Position";
+  case 2:
+    return "Records Per Second";
+  case 3:
+    return "Buffered Records";
+  default:
+    return "";
+  }
+}
+
+void ReplayNode::inject(const thalamus::vector<std::span<double const>> &,
+                        const thalamus::vector<std::chrono::nanoseconds> &,
+                        const thalamus::vector<std::string_view> &) {
+  THALAMUS_ASSERT(false, "Unimplemented");
+}
+
+bool ReplayNode::has_analog_data() const { return impl->has_analog; }
+
+size_t ReplayNode::modalities() const { return infer_modalities<ReplayNode>(); }
+
+struct ReplaySourceNode::Impl {
+  ObservableDictPtr state;
+  ReplaySourceNode *outer;
+  std::chrono::nanoseconds time = 0ns;
+  std::chrono::nanoseconds remote_time = 0ns;
+
+  // Every channel the node has published, in the order they first appeared.
+  // A record may hold any subset of them, compressed captures hold one
+  // channel per record, and spans maps each channel to its span in the
+  // current record or -1.
+  thalamus_grpc::AnalogResponse analog;
+  std::vector<std::chrono::nanoseconds> sample_intervals;
+  std::vector<std::string> names;
+  std::map<std::string, size_t, std::less<>> channels;
+  std::vector<int> spans;
+  bool has_analog = false;
+
+  std::vector<Segment> segments;
+  std::string pose_name;
+  bool has_motion = false;
+
+  thalamus_grpc::Image image;
+  Format format = Format::Gray;
+  bool has_image = false;
+  bool warned_format = false;
+
+  thalamus_grpc::Text text;
+  bool has_text = false;
+
+  Impl(ObservableDictPtr _state, ReplaySourceNode *_outer)
+      : state(_state), outer(_outer) {}
+
+  /**
+   * Publishes the current record, signalling channels_changed only when it
+   * adds a channel or changes one's sample interval.
+   */
+  void publish_analog() {
+    auto channels_changed = false;
+    std::fill(spans.begin(), spans.end(), -1);
+    for (auto i = 0; i < analog.spans_size(); ++i) {
+      auto &name = analog.spans(i).name();
+      auto sample_interval =
+          i < analog.sample_intervals_size()
+              ? std::chrono::nanoseconds(analog.sample_intervals(i))
+              : 0ns;
+      auto channel = channels.find(name);
+      if (channel == channels.end()) {
+        channel = channels.emplace(name, names.size()).first;
+        names.push_back(name);
+        sample_intervals.push_back(sample_interval);
+        spans.push_back(-1);
+        channels_changed = true;
+      } else if (sample_intervals[channel->second] != sample_interval) {
+        sample_intervals[channel->second] = sample_interval;
+        channels_changed = true;
+      }
+      spans[channel->second] = i;
+    }
+    if (channels_changed) {
+      outer->channels_changed(outer);
+    }
+
+    has_analog = true;
+    outer->ready(outer);
+    has_analog = false;
+  }
+
+  bool publish_image() {
+    switch (image.format()) {
+    case thalamus_grpc::Image::Gray:
+      format = Format::Gray;
+      break;
+    case thalamus_grpc::Image::RGB:
+      format = Format::RGB;
+      break;
+    case thalamus_grpc::Image::YUYV422:
+      format = Format::YUYV422;
+      break;
+    case thalamus_grpc::Image::YUV420P:
+      format = Format::YUV420P;
+      break;
+    case thalamus_grpc::Image::YUVJ420P:
+      format = Format::YUVJ420P;
+      break;
+    default:
+      if (!warned_format) {
+        THALAMUS_LOG(warning) << "Can't replay image format " << image.format();
+        warned_format = true;
+      }
+      return false;
+    }
+    has_image = true;
+    outer->ready(outer);
+    has_image = false;
+    return true;
+  }
+};
+
+ReplaySourceNode::ReplaySourceNode(ObservableDictPtr state,
+                                   boost::asio::io_context &, NodeGraph *)
+    : impl(new Impl(state, this)) {}
+
+ReplaySourceNode::~ReplaySourceNode() {}
+
+std::string ReplaySourceNode::type_name() { return "REPLAY_SOURCE"; }
+
+void ReplaySourceNode::publish(thalamus_grpc::StorageRecord &record,
+                               std::chrono::nanoseconds time) {
+  TRACE_EVENT("thalamus", "ReplaySourceNode::publish");
+  impl->time = time;
+  switch (record.body_case()) {
+  case thalamus_grpc::StorageRecord::kAnalog:
+    impl->analog.Swap(record.mutable_analog());
+    impl->remote_time = std::chrono::nanoseconds(impl->analog.remote_time());
+    impl->publish_analog();
+    break;
+  case thalamus_grpc::StorageRecord::kXsens: {
+    auto &xsens = record.xsens();
+    impl->segments.clear();
+    for (auto &s : xsens.segments()) {
+      auto &segment = impl->segments.emplace_back();
+      segment.frame = s.frame();
+      segment.segment_id = s.id();
+      segment.time = s.time();
+      segment.position[0] = s.x();
+      segment.position[1] = s.y();
+      segment.position[2] = s.z();
+      segment.rotation[0] = s.q0();
+      segment.rotation[1] = s.q1();
+      segment.rotation[2] = s.q2();
+      segment.rotation[3] = s.q3();
+      segment.actor = static_cast<unsigned char>(s.actor());
+    }
+    impl->pose_name = xsens.pose_name();
+    impl->has_motion = true;
+    ready(this);
+    impl->has_motion = false;
+  } break;
+  case thalamus_grpc::StorageRecord::kImage:
+    impl->image.Swap(record.mutable_image());
+    impl->publish_image();
+    break;
+  case thalamus_grpc::StorageRecord::kText:
+    impl->text.Swap(record.mutable_text());
+    impl->has_text = true;
+    ready(this);
+    impl->has_text = false;
+    break;
+  default:
+    break;
+  }
+}
+
+std::span<const double> ReplaySourceNode::data(int channel) const {
+  THALAMUS_ASSERT(!impl->analog.is_int_data() && !impl->analog.is_ulong_data(),
+                  "Replayed record holds integer data");
+  auto index = impl->spans.at(size_t(channel));
+  if (index < 0) {
+    return std::span<const double>();
+  }
+  auto &span = impl->analog.spans(index);
+  auto begin = impl->analog.data().data();
+  return std::span<const double>(begin + span.begin(), begin + span.end());
+}
+
+std::span<const int> ReplaySourceNode::int_data(int channel) const {
+  auto index = impl->spans.at(size_t(channel));
+  if (index < 0) {
+    return std::span<const int>();
+  }
+  auto &span = impl->analog.spans(index);
+  auto begin = impl->analog.int_data().data();
+  return std::span<const int>(begin + span.begin(), begin + span.end());
+}
+
+std::span<const uint64_t> ReplaySourceNode::ulong_data(int channel) const {
+  auto index = impl->spans.at(size_t(channel));
+  if (index < 0) {
+    return std::span<const uint64_t>();
+  }
+  auto &span = impl->analog.spans(index);
+  auto begin = impl->analog.ulong_data().data();
+  return std::span<const uint64_t>(begin + span.begin(), begin + span.end());
+}
+
+int ReplaySourceNode::num_channels() const { return int(impl->names.size()); }
+
+std::chrono::nanoseconds ReplaySourceNode::sample_interval(int channel) const {
+  return impl->sample_intervals.at(size_t(channel));
+}
+
+std::chrono::nanoseconds ReplaySourceNode::time() const { return impl->time; }
+
+std::chrono::nanoseconds ReplaySourceNode::remote_time() const {
+  return impl->remote_time;
+}
+
+std::string_view ReplaySourceNode::name(int channel) const {
+  return impl->names.at(size_t(channel));
+}
+
+void ReplaySourceNode::inject(
+    const thalamus::vector<std::span<double const>> &spans,
+    const thalamus::vector<std::chrono::nanoseconds> &sample_intervals,
+    const thalamus::vector<std::string_view> &names) {
+  impl->analog.Clear();
+  for (auto i = 0ull; i < spans.size(); ++i) {
+    auto span = impl->analog.add_spans();
+    span->set_begin(uint32_t(impl->analog.data_size()));
+    impl->analog.mutable_data()->Add(spans[i].begin(), spans[i].end());
+    span->set_end(uint32_t(impl->analog.data_size()));
+    span->set_name(std::string(names.at(i)));
+    impl->analog.add_sample_intervals(uint64_t(sample_intervals.at(i).count()));
+  }
+  impl->time = std::chrono::steady_clock::now().time_since_epoch();
+  impl->publish_analog();
+}
+
+bool ReplaySourceNode::has_analog_data() const { return impl->has_analog; }
+
+bool ReplaySourceNode::is_int_data() const {
+  return impl->analog.is_int_data();
+}
+
+bool ReplaySourceNode::is_ulong_data() const {
+  return impl->analog.is_ulong_data();
+}
+
+bool ReplaySourceNode::is_transformed() const {
+  return impl->analog.is_transformed();
+}
+
+double ReplaySourceNode::scale(int channel) const {
+  auto index = impl->spans.at(size_t(channel));
+  return index < 0 ? 1.0 : impl->analog.spans(index).scale();
+}
+
+double ReplaySourceNode::offset(int channel) const {
+  auto index = impl->spans.at(size_t(channel));
+  return index < 0 ? 0.0 : impl->analog.spans(index).offset();
+}
+
+std::span<ReplaySourceNode::Segment const>
+ReplaySourceNode::segments() const {
+  return impl->segments;
+}
+
+const std::string_view ReplaySourceNode::pose_name() const {
+  return impl->pose_name;
+}
+
+void ReplaySourceNode::inject(const std::span<Segment const> &segments) {
+  impl->segments.assign(segments.begin(), segments.end());
+  impl->time = std::chrono::steady_clock::now().time_since_epoch();
+  impl->has_motion = true;
+  ready(this);
+  impl->has_motion = false;
+}
+
+bool ReplaySourceNode::has_motion_data() const { return impl->has_motion; }
+
+ImageNode::Plane ReplaySourceNode::plane(int i) const {
+  auto &data = impl->image.data(i);
+  auto begin = reinterpret_cast<const unsigned char *>(data.data());
+  return Plane(begin, begin + data.size());
+}
+
+size_t ReplaySourceNode::num_planes() const {
+  return size_t(impl->image.data_size());
+}
+
+ImageNode::Format ReplaySourceNode::format() const { return impl->format; }
+
+size_t ReplaySourceNode::width() const { return impl->image.width(); }
+
+size_t ReplaySourceNode::height() const { return impl->image.height(); }
+
+std::chrono::nanoseconds ReplaySourceNode::frame_interval() const {
+  return std::chrono::nanoseconds(impl->image.frame_interval());
+}
+
+void ReplaySourceNode::inject(const thalamus_grpc::Image &image) {
+  impl->image = image;
+  impl->time = std::chrono::steady_clock::now().time_since_epoch();
+  impl->publish_image();
+}
+
+bool ReplaySourceNode::has_image_data() const { return impl->has_image; }
+
+std::string_view ReplaySourceNode::text() const { return impl->text.text(); }
+
+bool ReplaySourceNode::has_text_data() const { return impl->has_text; }
+
+size_t ReplaySourceNode::modalities() const {
+  return infer_modalities<ReplaySourceNode>();
+}
+} // namespace thalamus
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <thalamus/analog_node.hpp>
+#include <thalamus/base_node.hpp>
+#include <thalamus/image_node.hpp>
+#include <thalamus/state.hpp>
+#include <thalamus/text_node.hpp>
+#include <thalamus/xsens_node.hpp>
+#include <string>
+
+namespace thalamus {
+/**
+ * Plays a capture back into the graph.  Every node in the capture is replayed
+ * through a REPLAY_SOURCE node of the same name, which is added to the graph
+ * if it doesn't exist.
+ */
+class ReplayNode : public Node, public AnalogNode {
+  struct Impl;
+  std::unique_ptr<Impl> impl;
+
+public:
+  ReplayNode(ObservableDictPtr state, boost::asio::io_context &io_context,
+             NodeGraph *);
+  ~ReplayNode() override;
+  static std::string type_name();
+
+  std::span<const double> data(int channel) const override;
+  int num_channels() const override;
+  std::chrono::nanoseconds sample_interval(int channel) const override;
+  std::chrono::nanoseconds time() const override;
+  std::string_view name(int channel) const override;
+  void inject(const thalamus::vector<std::span<double const>> &,
+              const thalamus::vector<std::chrono::nanoseconds> &,
+              const thalamus::vector<std::string_view> &) override;
+  bool has_analog_data() const override;
+  size_t modalities() const override;
+};
+
+/**
+ * Publishes the records a REPLAY node reads for one of the capture's nodes.
+ */
+class ReplaySourceNode : public Node,
+                         public AnalogNode,
+                         public MotionCaptureNode,
+                         public ImageNode,
+                         public TextNode {
+  struct Impl;
+  std::unique_ptr<Impl> impl;
+
+public:
+  ReplaySourceNode(ObservableDictPtr state, boost::asio::io_context &io_context,
+                   NodeGraph *);
+  ~ReplaySourceNode() override;
+  static std::string type_name();
+
+  /**
+   * Publishes record as if it had been received at time.  The record's body is
+   * swapped out rather than copied.
+   */
+  void publish(thalamus_grpc::StorageRecord &record,
+               std::chrono::nanoseconds time);
+
+  std::span<const double> data(int channel) const override;
+  std::span<const int> int_data(int channel) const override;
+  std::span<const uint64_t> ulong_data(int channel) const override;
+  int num_channels() const override;
+  std::chrono::nanoseconds sample_interval(int channel) const override;
+  std::chrono::nanoseconds time() const override;
+  std::chrono::nanoseconds remote_time() const override;
+  std::string_view name(int channel) const override;
+  void inject(const thalamus::vector<std::span<double const>> &,
+              const thalamus::vector<std::chrono::nanoseconds> &,
+              const thalamus::vector<std::string_view> &) override;
+  bool has_analog_data() const override;
+  bool is_int_data() const override;
+  bool is_ulong_data() const override;
+  bool is_transformed() const override;
+  double scale(int channel) const override;
+  double offset(int channel) const override;
+
+  std::span<Segment const> segments() const override;
+  const std::string_view pose_name() const override;
+  void inject(const std::span<Segment const> &segments) override;
+  bool has_motion_data() const override;
+
+  Plane plane(int) const override;
+  size_t num_planes() const override;
+  Format format() const override;
+  size_t width() const override;
+  size_t height() const override;
+  std::chrono::nanoseconds frame_interval() const override;
+  void inject(const thalamus_grpc::Image &) override;
+  bool has_image_data() const override;
+
+  std::string_view text() const override;
+  bool has_text_data() const override;
+
+  size_t modalities() const override;
+};
+} // namespace thalamus
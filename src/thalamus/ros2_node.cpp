@@ -71,7 +71,7 @@ namespace thalamus {
 struct Ros2Node::Impl {
   ObservableDictPtr state;
   boost::signals2::scoped_connection state_connection;
-  thalamus::map<std::string, boost::signals2::scoped_connection>
+  thalamus::map<std::string, ScopedConnection>
       source_connections;
   NodeGraph *graph;
   Ros2Node *outer;
@@ -22,8 +22,8 @@ struct SampleMonitorNode::Impl {
   struct Connection {
     NodeGraph *graph;
     boost::signals2::scoped_connection get_node_connection;
-    boost::signals2::scoped_connection data_connection;
-    boost::signals2::scoped_connection changed_connection;
+    ScopedConnection data_connection;
+    ScopedConnection changed_connection;
     bool changed = true;
 
     std::vector<std::string> names;
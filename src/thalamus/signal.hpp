@@ -0,0 +1,248 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#ifdef __clang__
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Weverything"
+#endif
+#include <boost/signals2/connection.hpp>
+#include <boost/signals2/detail/slot_groups.hpp>
+#ifdef __clang__
+#pragma clang diagnostic pop
+#endif
+
+namespace thalamus {
+namespace signal_detail {
+struct SlotBase {
+  std::atomic_bool connected = true;
+};
+
+struct State {
+  std::mutex mutex;
+  std::vector<std::shared_ptr<SlotBase>> slots;
+  std::atomic_bool dirty = false;
+  std::atomic_size_t size = 0;
+
+  void remove(SlotBase *slot) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto i = std::find_if(slots.begin(), slots.end(),
+                          [&](auto &s) { return s.get() == slot; });
+    if (i != slots.end()) {
+      slots.erase(i);
+      size = slots.size();
+      dirty = true;
+    }
+  }
+};
+} // namespace signal_detail
+
+/**
+ * Handle to a slot of a Signal.  Copies refer to the same slot.  It can
+ * also hold a boost::signals2 connection so functions that connect to either
+ * kind of signal can return one type.
+ */
+class Connection {
+  std::weak_ptr<signal_detail::SlotBase> slot;
+  std::weak_ptr<signal_detail::State> state;
+  boost::signals2::connection foreign;
+
+public:
+  Connection() = default;
+  Connection(std::weak_ptr<signal_detail::SlotBase> _slot,
+             std::weak_ptr<signal_detail::State> _state)
+      : slot(std::move(_slot)), state(std::move(_state)) {}
+  Connection(boost::signals2::connection _foreign)
+      : foreign(std::move(_foreign)) {}
+
+  void disconnect() {
+    if (auto locked = slot.lock()) {
+      if (locked->connected.exchange(false)) {
+        if (auto locked_state = state.lock()) {
+          locked_state->remove(locked.get());
+        }
+      }
+    }
+    foreign.disconnect();
+  }
+
+  bool connected() const {
+    auto locked = slot.lock();
+    return (locked && locked->connected) || foreign.connected();
+  }
+};
+
+/**
+ * Disconnects its slot when destroyed or assigned a new connection.
+ */
+class ScopedConnection : public Connection {
+public:
+  ScopedConnection() = default;
+  ScopedConnection(const Connection &other) : Connection(other) {}
+  ScopedConnection(const ScopedConnection &) = delete;
+  ScopedConnection(ScopedConnection &&other) noexcept
+      : Connection(other.release()) {}
+  ~ScopedConnection() { disconnect(); }
+
+  ScopedConnection &operator=(const ScopedConnection &) = delete;
+  ScopedConnection &operator=(const Connection &other) {
+    disconnect();
+    Connection::operator=(other);
+    return *this;
+  }
+  ScopedConnection &operator=(ScopedConnection &&other) noexcept {
+    if (this != &other) {
+      disconnect();
+      Connection::operator=(other.release());
+    }
+    return *this;
+  }
+
+  /**
+   * Returns the connection without disconnecting it.
+   */
+  Connection release() {
+    Connection result = *this;
+    Connection::operator=(Connection());
+    return result;
+  }
+};
+
+template <typename Signature> class Signal;
+
+/**
+ * Observer list for the signals that fire on every sample, such as
+ * Node::ready.  Slots are called in connection order with the same semantics
+ * as boost::signals2, but an emission only walks a cached list of slots
+ * instead of locking and copying the slot list.
+ *
+ * The signal must be emitted from one thread at a time, which is the
+ * io_context thread for Node::ready.  connect and disconnect may be called
+ * from any thread, including from inside a slot: a slot disconnected during
+ * an emission isn't called again, a slot connected during an emission is
+ * first called by the next one.
+ */
+template <typename... Args> class Signal<void(Args...)> {
+  struct Slot : public signal_detail::SlotBase {
+    std::function<void(Args...)> function;
+    std::vector<std::weak_ptr<void>> tracked;
+  };
+
+  std::shared_ptr<signal_detail::State> state =
+      std::make_shared<signal_detail::State>();
+  std::vector<std::shared_ptr<signal_detail::SlotBase>> dispatch;
+  size_t depth = 0;
+
+  struct DepthGuard {
+    size_t &depth;
+    explicit DepthGuard(size_t &_depth) : depth(_depth) { ++depth; }
+    ~DepthGuard() { --depth; }
+  };
+
+  void call(Slot &slot, Args... args) {
+    if (slot.tracked.empty()) {
+      slot.function(args...);
+      return;
+    }
+    std::vector<std::shared_ptr<void>> locked;
+    locked.reserve(slot.tracked.size());
+    for (auto &weak : slot.tracked) {
+      locked.push_back(weak.lock());
+      if (!locked.back()) {
+        if (slot.connected.exchange(false)) {
+          state->remove(&slot);
+        }
+        return;
+      }
+    }
+    slot.function(args...);
+  }
+
+public:
+  /**
+   * A callable plus the objects whose lifetime bounds the connection, the
+   * slot disconnects once any of them expires and holds them alive while it
+   * runs.
+   */
+  class slot_type {
+    friend class Signal;
+    std::function<void(Args...)> function;
+    std::vector<std::weak_ptr<void>> tracked;
+
+  public:
+    template <typename F,
+              typename = std::enable_if_t<
+                  !std::is_same_v<std::decay_t<F>, slot_type>>>
+    slot_type(F &&f) : function(std::forward<F>(f)) {}
+
+    template <typename T> slot_type &track_foreign(std::weak_ptr<T> object) {
+      tracked.push_back(std::move(object));
+      return *this;
+    }
+    template <typename T>
+    slot_type &track_foreign(const std::shared_ptr<T> &object) {
+      tracked.push_back(std::weak_ptr<T>(object));
+      return *this;
+    }
+  };
+
+  Signal() = default;
+  Signal(const Signal &) = delete;
+  Signal &operator=(const Signal &) = delete;
+  ~Signal() {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    for (auto &slot : state->slots) {
+      slot->connected = false;
+    }
+  }
+
+  Connection connect(slot_type slot) {
+    return connect(boost::signals2::at_back, std::move(slot));
+  }
+
+  Connection connect(boost::signals2::connect_position position,
+                     slot_type slot) {
+    auto result = std::make_shared<Slot>();
+    result->function = std::move(slot.function);
+    result->tracked = std::move(slot.tracked);
+    std::lock_guard<std::mutex> lock(state->mutex);
+    if (position == boost::signals2::at_front) {
+      state->slots.insert(state->slots.begin(), result);
+    } else {
+      state->slots.push_back(result);
+    }
+    state->size = state->slots.size();
+    state->dirty = true;
+    return Connection(result, state);
+  }
+
+  bool empty() const { return state->size == 0; }
+
+  size_t num_slots() const { return state->size; }
+
+  void operator()(Args... args) {
+    // The cached list is only replaced between emissions, a nested emission
+    // keeps walking the list of the outer one.
+    if (depth == 0 && state->dirty.load(std::memory_order_acquire)) {
+      std::lock_guard<std::mutex> lock(state->mutex);
+      dispatch = state->slots;
+      state->dirty = false;
+    }
+    DepthGuard guard(depth);
+    auto count = dispatch.size();
+    for (size_t i = 0; i < count; ++i) {
+      auto &slot = static_cast<Slot &>(*dispatch[i]);
+      if (slot.connected.load(std::memory_order_acquire)) {
+        call(slot, args...);
+      }
+    }
+  }
+};
+} // namespace thalamus
@@ -0,0 +1,279 @@
+#include <thalamus/spike_detect_node.hpp>
+#include <vector>
+#include <thalamus/channel_groups.hpp>
+#include <thalamus/modalities_util.hpp>
+#include <thalamus/spike_detector.hpp>
+
+namespace thalamus {
+struct SpikeDetectNode::Impl {
+  struct Rate {
+    size_t bin = 1;
+    size_t position = 0;
+    size_t count = 0;
+    double value = 0;
+  };
+
+  ObservableDictPtr state;
+  boost::signals2::scoped_connection state_connection;
+  SpikeDetectNode *outer;
+  NodeGraph *graph;
+
+  double threshold = 4.5;
+  SpikeDetector::Polarity polarity = SpikeDetector::Polarity::NEGATIVE;
+  double refractory_ms = 1;
+  double noise_window = 1;
+  double rate_bin_ms = 10;
+  double rate_window = 1;
+
+  bool redesign = true;
+  ChannelGroups<SpikeDetector> channels;
+  std::vector<Rate> rates;
+  std::vector<SpikeDetector::Event> events;
+  std::vector<std::vector<double>> data;
+  std::vector<std::vector<size_t>> channel_spikes;
+  std::vector<Spike> spikes;
+  std::string text;
+  bool has_rates = false;
+
+public:
+  Impl(ObservableDictPtr _state, boost::asio::io_context &, NodeGraph *_graph,
+       SpikeDetectNode *_outer)
+      : state(_state), outer(_outer), graph(_graph) {
+    state_connection =
+        state->changed.connect(std::bind(&Impl::on_change, this, _1, _2, _3));
+    state->recap(std::bind(&Impl::on_change, this, _1, _2, _3));
+  }
+
+  ScopedConnection source_connection;
+  AnalogNode *source = nullptr;
+  AnalogFrameBuilder frame;
+
+  SpikeDetector make_detector(std::chrono::nanoseconds sample_interval) {
+    if (sample_interval <= 0ns) {
+      return SpikeDetector(threshold, polarity, 0, 0);
+    }
+    auto sample_rate = 1e9 / double(sample_interval.count());
+    auto refractory = size_t(std::round(refractory_ms / 1e3 * sample_rate));
+    auto adaptation =
+        noise_window > 0 ? std::min(1 / (noise_window * sample_rate), 0.5)
+                         : 0.0;
+    return SpikeDetector(threshold, polarity, refractory, adaptation);
+  }
+
+  /**
+   * Lays out the rate channels after the channels are regrouped.  Channels
+   * that kept their noise estimate keep their rate.
+   */
+  void rebuild() {
+    std::chrono::nanoseconds rate_bin(int64_t(rate_bin_ms * 1e6));
+    auto count = channels.names.size();
+    std::vector<Rate> previous_rates;
+    previous_rates.swap(rates);
+    rates.assign(count, Rate{});
+    frame.resize(count);
+    for (size_t c = 0; c < count; ++c) {
+      auto sample_interval = channels.sample_intervals[c];
+      auto &rate = rates[c];
+      if (channels.previous[c]) {
+        rate = previous_rates[*channels.previous[c]];
+      } else if (sample_interval > 0ns) {
+        rate.bin = std::max(size_t(1), size_t(std::llround(
+                                           double(rate_bin.count()) /
+                                           double(sample_interval.count()))));
+      }
+      frame.set_layout(c, channels.names[c],
+                       int64_t(rate.bin) * sample_interval);
+    }
+  }
+
+  /**
+   * Counts the channel's spikes into rate bins and appends the smoothed rate
+   * of every bin that ends in these samples.
+   */
+  void update_rate(size_t c, size_t samples) {
+    auto &rate = rates[c];
+    auto &output = data[c];
+    auto &channel = channel_spikes[c];
+    output.clear();
+    auto bin_seconds = double(rate.bin) *
+                       double(channels.sample_intervals[c].count()) / 1e9;
+    auto smoothing =
+        rate_window > 0 ? std::min(bin_seconds / rate_window, 1.0) : 1.0;
+    size_t i = 0;
+    auto spike = channel.begin();
+    while (samples - i >= rate.bin - rate.position) {
+      auto end = i + rate.bin - rate.position;
+      for (; spike != channel.end() && *spike < end; ++spike) {
+        ++rate.count;
+      }
+      auto value = bin_seconds > 0 ? double(rate.count) / bin_seconds : 0;
+      rate.value += (value - rate.value) * smoothing;
+      output.push_back(rate.value);
+      rate.count = 0;
+      rate.position = 0;
+      i = end;
+    }
+    rate.count += size_t(channel.end() - spike);
+    rate.position += samples - i;
+  }
+
+  void on_ready(Node *) {
+    if (!source->has_analog_data()) {
+      return;
+    }
+    auto &source_frame = source->frame();
+    if (channels.update(source_frame, redesign,
+                        std::bind(&Impl::make_detector, this, _1))) {
+      redesign = false;
+      rebuild();
+    }
+
+    auto count = size_t(source_frame.num_channels());
+    channels.convert(source_frame);
+    data.resize(count);
+    channel_spikes.resize(count);
+    spikes.clear();
+    for (auto &channel : channel_spikes) {
+      channel.clear();
+    }
+    for (auto &group : channels.groups) {
+      events.clear();
+      group.processor.process(group.input, events);
+      for (auto &event : events) {
+        auto c = group.channels[event.channel];
+        auto samples = channels.input[c].size();
+        auto time = source_frame.time - int64_t(samples - 1 - event.sample) *
+                                            group.sample_interval;
+        spikes.push_back(Spike{int(c), time});
+        channel_spikes[c].push_back(event.sample);
+      }
+    }
+    std::stable_sort(spikes.begin(), spikes.end(),
+                     [](const Spike &l, const Spike &r) {
+                       return l.time < r.time;
+                     });
+
+    text.clear();
+    for (auto &spike : spikes) {
+      absl::StrAppend(&text, spike.time.count(), " ",
+                      channels.names[size_t(spike.channel)], "\n");
+    }
+
+    has_rates = false;
+    for (size_t c = 0; c < count; ++c) {
+      update_rate(c, channels.input[c].size());
+      has_rates = has_rates || !data[c].empty();
+      frame.set_data(c, std::span<const double>(data[c]));
+    }
+    frame.finish(source_frame.time, source_frame.remote_time);
+    outer->ready(outer);
+  }
+
+  void on_change(ObservableCollection::Action,
+                 const ObservableCollection::Key &k,
+                 const ObservableCollection::Value &v) {
+    auto key_str = std::get<std::string>(k);
+    auto number = [&] {
+      return std::holds_alternative<int64_t>(v) ? double(std::get<int64_t>(v))
+                                                : std::get<double>(v);
+    };
+    if (key_str == "Threshold (SD)") {
+      threshold = number();
+      redesign = true;
+    } else if (key_str == "Polarity") {
+      auto value = std::get<std::string>(v);
+      polarity = value == "Positive" ? SpikeDetector::Polarity::POSITIVE
+                 : value == "Both"   ? SpikeDetector::Polarity::BOTH
+                                     : SpikeDetector::Polarity::NEGATIVE;
+      redesign = true;
+    } else if (key_str == "Refractory (ms)") {
+      refractory_ms = number();
+      redesign = true;
+    } else if (key_str == "Noise Window (s)") {
+      noise_window = number();
+      redesign = true;
+    } else if (key_str == "Rate Bin (ms)") {
+      rate_bin_ms = number();
+      redesign = true;
+    } else if (key_str == "Rate Window (s)") {
+      rate_window = number();
+    } else if (key_str == "Source") {
+      auto value_str = std::get<std::string>(v);
+      absl::StripAsciiWhitespace(&value_str);
+      graph->get_node(value_str, [&](auto node) {
+        auto locked = node.lock();
+        if (!locked) {
+          return;
+        }
+        source = std::dynamic_pointer_cast<AnalogNode>(locked).get();
+        if (!source) {
+          return;
+        }
+        redesign = true;
+        source_connection =
+            locked->ready.connect(std::bind(&Impl::on_ready, this, _1));
+      });
+    }
+  }
+};
+
+SpikeDetectNode::SpikeDetectNode(ObservableDictPtr state,
+                                 boost::asio::io_context &io_context,
+                                 NodeGraph *graph)
+    : impl(new Impl(state, io_context, graph, this)) {}
+
+SpikeDetectNode::~SpikeDetectNode() {}
+
+std::string SpikeDetectNode::type_name() { return "SPIKE_DETECT"; }
+
+std::chrono::nanoseconds SpikeDetectNode::time() const {
+  return impl->frame.get().time;
+}
+
+std::span<const double> SpikeDetectNode::data(int channel) const {
+  auto &data = impl->data.at(size_t(channel));
+  return std::span<const double>(data.begin(), data.end());
+}
+
+int SpikeDetectNode::num_channels() const {
+  return impl->frame.get().num_channels();
+}
+
+std::string_view SpikeDetectNode::name(int channel) const {
+  return impl->frame.get().names[size_t(channel)];
+}
+
+std::span<const std::string>
+SpikeDetectNode::get_recommended_channels() const {
+  return impl->source ? impl->source->get_recommended_channels()
+                      : std::span<const std::string>();
+}
+
+std::chrono::nanoseconds SpikeDetectNode::sample_interval(int channel) const {
+  return impl->frame.get().sample_intervals[size_t(channel)];
+}
+
+void SpikeDetectNode::inject(const thalamus::vector<std::span<double const>> &,
+                             const thalamus::vector<std::chrono::nanoseconds> &,
+                             const thalamus::vector<std::string_view> &) {
+  THALAMUS_ASSERT(false, "Unimplemented");
+}
+
+bool SpikeDetectNode::has_analog_data() const { return impl->has_rates; }
+
+const AnalogFrame &SpikeDetectNode::frame() const {
+  return impl->frame.get();
+}
+
+std::string_view SpikeDetectNode::text() const { return impl->text; }
+
+bool SpikeDetectNode::has_text_data() const { return !impl->spikes.empty(); }
+
+size_t SpikeDetectNode::modalities() const {
+  return infer_modalities<SpikeDetectNode>();
+}
+
+std::span<const SpikeDetectNode::Spike> SpikeDetectNode::spikes() const {
+  return impl->spikes;
+}
+} // namespace thalamus
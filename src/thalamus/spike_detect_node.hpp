@@ -0,0 +1,51 @@
+#pragma once
+
+#include <thalamus/analog_node.hpp>
+#include <thalamus/base_node.hpp>
+#include <thalamus/state.hpp>
+#include <thalamus/text_node.hpp>
+#include <string>
+
+namespace thalamus {
+/**
+ * Detects spikes on every channel of an AnalogNode, see SpikeDetector.  Its
+ * analog channels are each source channel's firing rate, its text and
+ * spikes() are the spikes found in the source's latest samples.
+ */
+class SpikeDetectNode : public Node, public AnalogNode, public TextNode {
+  struct Impl;
+  std::unique_ptr<Impl> impl;
+
+public:
+  struct Spike {
+    int channel;
+    std::chrono::nanoseconds time;
+  };
+
+  SpikeDetectNode(ObservableDictPtr state, boost::asio::io_context &io_context,
+                  NodeGraph *);
+  ~SpikeDetectNode() override;
+  static std::string type_name();
+  std::chrono::nanoseconds time() const override;
+  std::span<const double> data(int channel) const override;
+  int num_channels() const override;
+  std::string_view name(int channel) const override;
+  std::span<const std::string> get_recommended_channels() const override;
+  std::chrono::nanoseconds sample_interval(int i) const override;
+  void
+  inject(const thalamus::vector<std::span<double const>> &spans,
+         const thalamus::vector<std::chrono::nanoseconds> &sample_intervals,
+         const thalamus::vector<std::string_view> &) override;
+  bool has_analog_data() const override;
+  const AnalogFrame &frame() const override;
+  std::string_view text() const override;
+  bool has_text_data() const override;
+  size_t modalities() const override;
+
+  /**
+   * The spikes found in the source's latest samples, ordered by time.
+   * Channels are the source's channel indices.
+   */
+  std::span<const Spike> spikes() const;
+};
+} // namespace thalamus
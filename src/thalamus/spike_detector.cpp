@@ -0,0 +1,201 @@
+#include <thalamus/spike_detector.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <thalamus/assert.hpp>
+
+namespace thalamus {
+namespace {
+// Median of |x| over the standard deviation of Gaussian noise
+const double MEDIAN_TO_SIGMA = 0.6745;
+
+/**
+ * Steps one channel by one sample, returns 1 for a spike.  The polarity is
+ * applied as magnitude*rectify + x*direction and every branch is a select
+ * of a constant, GCC doesn't vectorize the lane loops when they select
+ * between computed values.
+ */
+inline double detect(double x, double rectify, double direction, double scale,
+                     double refractory, double adaptation, double &median,
+                     double &seen, double &beyond, double &since) {
+  auto magnitude = std::abs(x);
+  auto value = magnitude * rectify + x * direction;
+  auto past = value > scale * median && median > 0 ? 1.0 : 0.0;
+  auto spike = past > beyond && since >= refractory ? 1.0 : 0.0;
+  since = (since + 1) * (1 - spike) + spike;
+  beyond = past;
+  auto fraction = 1 / (seen + 1);
+  auto step = fraction > adaptation ? fraction : adaptation;
+  median *= 1 + step * (magnitude > median ? 1.0 : -1.0);
+  seen += 1;
+  return spike;
+}
+} // namespace
+
+SpikeDetector::SpikeDetector(double _threshold, Polarity _polarity,
+                             size_t _refractory, double _adaptation)
+    : threshold(_threshold), polarity(_polarity),
+      refractory(double(_refractory)), adaptation(_adaptation) {}
+
+void SpikeDetector::resize(size_t count) {
+  auto lanes = (count + LANES - 1) / LANES * LANES;
+  medians.resize(lanes);
+  seen.resize(lanes);
+  beyond.resize(lanes);
+  since.resize(lanes);
+  for (auto c = std::min(channels, count); c < lanes; ++c) {
+    medians[c] = 0;
+    seen[c] = 0;
+    beyond[c] = 0;
+    since[c] = refractory;
+  }
+  channels = count;
+}
+
+size_t SpikeDetector::num_channels() const { return channels; }
+
+double SpikeDetector::noise(size_t channel) const {
+  return medians[channel] / MEDIAN_TO_SIGMA;
+}
+
+std::vector<double> SpikeDetector::get_state(size_t channel) const {
+  return {medians[channel], seen[channel], beyond[channel], since[channel]};
+}
+
+void SpikeDetector::set_state(size_t channel, std::span<const double> state) {
+  THALAMUS_ASSERT(state.size() == 4, "Spike detector state has 4 values");
+  medians[channel] = state[0];
+  seen[channel] = state[1];
+  beyond[channel] = state[2];
+  since[channel] = state[3];
+}
+
+void SpikeDetector::start(size_t channel, std::span<const double> input) {
+  if (input.empty()) {
+    return;
+  }
+  buffer.resize(input.size());
+  std::transform(input.begin(), input.end(), buffer.begin(),
+                 [](double x) { return std::abs(x); });
+  auto middle = buffer.begin() + int64_t(buffer.size() / 2);
+  std::nth_element(buffer.begin(), middle, buffer.end());
+  medians[channel] = *middle;
+  seen[channel] = double(input.size());
+}
+
+void SpikeDetector::process(std::span<const std::span<const double>> input,
+                            std::vector<Event> &events) {
+  if (input.size() != channels) {
+    resize(input.size());
+  }
+  for (size_t c = 0; c < channels; ++c) {
+    if (medians[c] == 0) {
+      start(c, input[c]);
+    }
+  }
+
+  auto first_event = events.size();
+  for (size_t first = 0, block = 0; first < channels;
+       first += LANES, ++block) {
+    auto count = std::min(LANES, channels - first);
+    auto block_input = input.subspan(first, count);
+    auto size = block_input.front().size();
+    auto uniform = std::all_of(block_input.begin(), block_input.end(),
+                               [&](std::span<const double> channel) {
+                                 return channel.size() == size;
+                               });
+    if (uniform) {
+      process_block(block, count, block_input, events);
+    } else {
+      for (size_t lane = 0; lane < count; ++lane) {
+        process_lane(block, lane, block_input[lane], events);
+      }
+    }
+  }
+  std::sort(events.begin() + int64_t(first_event), events.end(),
+            [](const Event &l, const Event &r) {
+              return l.sample < r.sample ||
+                     (l.sample == r.sample && l.channel < r.channel);
+            });
+}
+
+void SpikeDetector::process_block(
+    size_t block, size_t count, std::span<const std::span<const double>> input,
+    std::vector<Event> &events) {
+  auto samples = input.front().size();
+  buffer.resize(samples * LANES);
+  auto x = buffer.data();
+  for (size_t lane = 0; lane < LANES; ++lane) {
+    if (lane < count) {
+      auto channel = input[lane];
+      for (size_t i = 0; i < samples; ++i) {
+        x[i * LANES + lane] = channel[i];
+      }
+    } else {
+      for (size_t i = 0; i < samples; ++i) {
+        x[i * LANES + lane] = 0;
+      }
+    }
+  }
+
+  const auto rectify = polarity == Polarity::BOTH ? 1.0 : 0.0;
+  const auto direction = polarity == Polarity::POSITIVE   ? 1.0
+                         : polarity == Polarity::NEGATIVE ? -1.0
+                                                          : 0.0;
+  const auto scale = threshold / MEDIAN_TO_SIGMA;
+  const auto limit = refractory;
+  const auto rate = adaptation;
+  double median[LANES], observed[LANES], past[LANES], elapsed[LANES];
+  auto offset = block * LANES;
+  std::copy(medians.begin() + int64_t(offset),
+            medians.begin() + int64_t(offset + LANES), median);
+  std::copy(seen.begin() + int64_t(offset),
+            seen.begin() + int64_t(offset + LANES), observed);
+  std::copy(beyond.begin() + int64_t(offset),
+            beyond.begin() + int64_t(offset + LANES), past);
+  std::copy(since.begin() + int64_t(offset),
+            since.begin() + int64_t(offset + LANES), elapsed);
+
+  // Overwrites every sample with 1 for a spike and 0 otherwise
+  for (size_t i = 0; i < samples; ++i) {
+    auto row = x + i * LANES;
+    for (size_t lane = 0; lane < LANES; ++lane) {
+      row[lane] = detect(row[lane], rectify, direction, scale, limit, rate,
+                         median[lane], observed[lane], past[lane],
+                         elapsed[lane]);
+    }
+  }
+
+  std::copy(median, median + LANES, medians.begin() + int64_t(offset));
+  std::copy(observed, observed + LANES, seen.begin() + int64_t(offset));
+  std::copy(past, past + LANES, beyond.begin() + int64_t(offset));
+  std::copy(elapsed, elapsed + LANES, since.begin() + int64_t(offset));
+
+  for (size_t i = 0; i < samples; ++i) {
+    auto row = x + i * LANES;
+    for (size_t lane = 0; lane < count; ++lane) {
+      if (row[lane] > 0) {
+        events.push_back(Event{offset + lane, i});
+      }
+    }
+  }
+}
+
+void SpikeDetector::process_lane(size_t block, size_t lane,
+                                 std::span<const double> input,
+                                 std::vector<Event> &events) {
+  auto channel = block * LANES + lane;
+  auto rectify = polarity == Polarity::BOTH ? 1.0 : 0.0;
+  auto direction = polarity == Polarity::POSITIVE   ? 1.0
+                   : polarity == Polarity::NEGATIVE ? -1.0
+                                                    : 0.0;
+  auto scale = threshold / MEDIAN_TO_SIGMA;
+  for (size_t i = 0; i < input.size(); ++i) {
+    if (detect(input[i], rectify, direction, scale, refractory, adaptation,
+               medians[channel], seen[channel], beyond[channel],
+               since[channel]) > 0) {
+      events.push_back(Event{channel, i});
+    }
+  }
+}
+} // namespace thalamus
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace thalamus {
+/**
+ * Detects threshold crossings on many channels that share a sample rate.
+ *
+ * Each channel's noise is estimated as the running median of its absolute
+ * value divided by 0.6745, which spikes barely move.  The median is started
+ * from the first samples a channel receives and then follows the signal by
+ * growing or shrinking by a fraction of itself every sample.  That fraction
+ * is 1/n on the nth sample, so the estimate settles quickly, until it falls
+ * to adaptation, which then sets how quickly it follows changes.
+ *
+ * A spike is the first sample past threshold times the noise after a sample
+ * that wasn't, at least refractory samples after the channel's previous
+ * spike.
+ *
+ * Channels are processed in blocks of LANES with interleaved samples like
+ * FilterBank, so the detection loop is vectorized across channels.
+ */
+class SpikeDetector {
+public:
+  static constexpr size_t LANES = 8;
+  enum class Polarity { NEGATIVE, POSITIVE, BOTH };
+  struct Event {
+    size_t channel;
+    size_t sample;
+  };
+
+private:
+  double threshold;
+  Polarity polarity;
+  double refractory;
+  double adaptation;
+  size_t channels = 0;
+  // Lane l of block b is at [b*LANES + l], medians are 0 until a channel
+  // receives samples.
+  std::vector<double> medians;
+  std::vector<double> seen;
+  std::vector<double> beyond;
+  std::vector<double> since;
+  std::vector<double> buffer;
+
+  void start(size_t channel, std::span<const double> input);
+  void process_block(size_t block, size_t count,
+                     std::span<const std::span<const double>> input,
+                     std::vector<Event> &events);
+  void process_lane(size_t block, size_t lane, std::span<const double> input,
+                    std::vector<Event> &events);
+
+public:
+  SpikeDetector(double threshold, Polarity polarity, size_t refractory,
+                double adaptation);
+
+  /**
+   * Changes the number of channels, new channels start without a noise
+   * estimate.
+   */
+  void resize(size_t channels);
+  size_t num_channels() const;
+
+  /**
+   * Appends the spikes in input[c] of every channel c to events, ordered by
+   * sample and then channel.
+   */
+  void process(std::span<const std::span<const double>> input,
+               std::vector<Event> &events);
+
+  /**
+   * A channel's estimated noise standard deviation.
+   */
+  double noise(size_t channel) const;
+
+  /**
+   * A channel's state, so it can be carried over to a detector with the same
+   * settings when the channels are rearranged.
+   */
+  std::vector<double> get_state(size_t channel) const;
+  void set_state(size_t channel, std::span<const double> state);
+};
+} // namespace thalamus
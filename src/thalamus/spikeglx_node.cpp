@@ -97,6 +97,9 @@ struct SpikeGlxNode::Impl {
   Device current_js;
   int current_ip;
   bool constructed = false;
+  AnalogFrameBuilder frame;
+  bool frame_stale = true;
+  bool layout_stale = true;
   // static uint64_t io_track;
 
   Impl(ObservableDictPtr _state, boost::asio::io_context &_io_context,
@@ -679,6 +682,7 @@ struct SpikeGlxNode::Impl {
         success = absl::SimpleAtod(text, &rate);
         sample_intervals[std::make_pair(js, ip)] =
             std::chrono::nanoseconds(size_t(1000000000 / rate));
+        layout_stale = true;
         if (!success) {
           throw std::runtime_error(
               std::string("Failed to parse sample rate: ") + text);
@@ -903,6 +907,7 @@ struct SpikeGlxNode::Impl {
             if (num_channels != last_num_channels) {
               // std::cout << "channels_changed" << std::endl;
               TRACE_EVENT("thalamus", "SpikeGlxNode::channels_changed");
+              layout_stale = true;
               outer->channels_changed(outer);
             }
             if (complete_samples > 0) {
@@ -910,6 +915,7 @@ struct SpikeGlxNode::Impl {
               current_ip = ip;
               // std::cout << "ready" << std::endl;
               TRACE_EVENT("thalamus", "SpikeGlxNode::ready");
+              frame_stale = true;
               outer->ready(outer);
             }
             // std::cout << "fetch done" << std::endl;
@@ -1138,6 +1144,48 @@ std::string_view SpikeGlxNode::name(int channel) const {
 
 int SpikeGlxNode::num_channels() const { return int(impl->num_channels + 1); }
 
+const AnalogFrame &SpikeGlxNode::frame() const {
+  auto &frame = impl->frame;
+  if (!impl->frame_stale) {
+    return frame.get();
+  }
+  auto count = size_t(num_channels());
+  if (impl->layout_stale || size_t(frame.get().num_channels()) != count) {
+    frame.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+      frame.set_layout(i, name(int(i)), sample_interval(int(i)));
+    }
+    impl->layout_stale = false;
+  }
+
+  frame.set_data(0, std::span<const short>(&impl->latency, 1));
+  size_t channel = 1;
+  auto publish = [&](const std::vector<std::vector<short>> &data,
+                     bool current) {
+    for (const auto &samples : data) {
+      if (channel == count) {
+        return;
+      }
+      frame.set_data(channel++, current ? std::span<const short>(
+                                              samples.data(),
+                                              impl->complete_samples)
+                                        : std::span<const short>());
+    }
+  };
+  for (size_t j = 0; j < impl->imec_data.size(); ++j) {
+    publish(impl->imec_data[j], impl->current_js == Impl::Device::IMEC &&
+                                    size_t(impl->current_ip) == j);
+  }
+  publish(impl->ni_data, impl->current_js == Impl::Device::NI);
+  for (; channel < count; ++channel) {
+    frame.set_data(channel, std::span<const short>());
+  }
+
+  frame.finish(impl->time);
+  impl->frame_stale = false;
+  return frame.get();
+}
+
 std::chrono::nanoseconds SpikeGlxNode::sample_interval(int i) const {
   if (i == 0) {
     return 0ns;
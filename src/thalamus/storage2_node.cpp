@@ -1,10 +1,14 @@
 #include <thalamus/tracing.hpp>
+#include <bit>
+#include <cstring>
+#include <deque>
 #include <fstream>
 #include <thalamus/image_node.hpp>
 #include <thalamus/modalities_util.hpp>
 #include <thalamus/storage2_node.hpp>
 #include <thalamus/text_node.hpp>
 #include <thalamus/async.hpp>
+#include <thalamus/async_writer.hpp>
 #include <thalamus/thread.hpp>
 #include <thalamus/thread_pool.hpp>
 #include <thalamus/util.hpp>
@@ -26,6 +30,8 @@
 #endif
 
 #include <absl/strings/str_format.h>
+#include <absl/strings/str_split.h>
+#include <absl/strings/strip.h>
 #include <absl/time/time.h>
 #include <boost/pool/object_pool.hpp>
 #include <boost/qvm/quat_access.hpp>
@@ -40,6 +46,7 @@ extern "C" {
 #include <libavutil/imgutils.h>
 #include <libavutil/mem.h>
 #include <libavutil/opt.h>
+#include <libavutil/pixdesc.h>
 #include <libswscale/swscale.h>
 }
 
@@ -88,7 +95,7 @@ struct Storage2Node::Impl {
   ObservableDictPtr state;
   boost::signals2::scoped_connection state_connection;
   std::atomic_bool is_running = false;
-  thalamus::vector<boost::signals2::scoped_connection> source_connections;
+  thalamus::vector<ScopedConnection> source_connections;
   size_t changes_written;
   int recording_number = 0;
   NodeGraph *graph;
@@ -96,7 +103,29 @@ struct Storage2Node::Impl {
   boost::signals2::scoped_connection events_connection;
   boost::signals2::scoped_connection log_connection;
   boost::signals2::scoped_connection change_connection;
-  std::ofstream output_stream;
+  std::unique_ptr<AsyncWriter> output_writer;
+  AsyncWriter::Options writer_options;
+  /**
+   * Sharded recording splits a capture into the primary file, which gets every
+   * source without a shard plus events and logs, and one file per shard.  A
+   * shard can live in its own directory, e.g. on another disk, and a manifest
+   * next to the primary file lists the files that make up the capture.
+   */
+  struct ShardLayout {
+    std::map<std::string, size_t> nodes;
+    /** Directory of shard i at i-1, shards without one sit next to the primary file. */
+    std::vector<std::filesystem::path> directories;
+    size_t count() const {
+      size_t result = 0;
+      for (auto &[node, shard] : nodes) {
+        result = std::max(result, shard);
+      }
+      return result;
+    }
+  };
+  ShardLayout shard_layout;
+  /** Writer of shard i at i-1. */
+  std::vector<std::unique_ptr<AsyncWriter>> shard_writers;
   thalamus::vector<std::pair<double, bool>> metrics;
   thalamus::vector<std::string> names;
   std::chrono::nanoseconds metrics_time;
@@ -136,6 +165,10 @@ struct Storage2Node::Impl {
     }
 
     update_metrics(1, 0, 1, [&] { return "Events"; });
+    if (triggered && trigger_type == TriggerType::EVENT &&
+        e.payload().find(trigger_text) != std::string::npos) {
+      fire_trigger(e.time());
+    }
 
     thalamus_grpc::StorageRecord record;
     {
@@ -169,11 +202,157 @@ struct Storage2Node::Impl {
 
   std::map<std::pair<Node *, int>, int> stream_mappings;
 
+  struct ColumnarSource {
+    thalamus_grpc::AnalogSchema schema;
+    std::vector<thalamus_grpc::AnalogBlock> blocks;
+    std::chrono::nanoseconds block_start;
+    uint64_t frame_version = 0;
+  };
+  std::map<std::string, ColumnarSource> columnar_sources;
+  uint32_t next_schema_id = 1;
+
+  template <typename T>
+  static thalamus_grpc::AnalogSchema::SampleType sample_type() {
+    if constexpr (std::is_same<T, short>::value) {
+      return thalamus_grpc::AnalogSchema::INT16;
+    } else if constexpr (std::is_same<T, int>::value) {
+      return thalamus_grpc::AnalogSchema::INT32;
+    } else if constexpr (std::is_same<T, uint64_t>::value) {
+      return thalamus_grpc::AnalogSchema::UINT64;
+    } else {
+      return thalamus_grpc::AnalogSchema::FLOAT64;
+    }
+  }
+
+  template <typename T>
+  static void append_samples(std::string *out, std::span<const T> data) {
+    auto offset = out->size();
+    out->resize(offset + data.size_bytes());
+    auto bytes = out->data() + offset;
+    std::memcpy(bytes, data.data(), data.size_bytes());
+    if constexpr (std::endian::native == std::endian::big) {
+      for (auto i = 0ull; i < data.size(); ++i) {
+        std::reverse(bytes + i * sizeof(T), bytes + (i + 1) * sizeof(T));
+      }
+    }
+  }
+
+  void flush_columnar(const std::string &name, ColumnarSource &source) {
+    for (auto &block : source.blocks) {
+      if (block.chunk_ends().empty()) {
+        continue;
+      }
+      thalamus_grpc::StorageRecord record;
+      record.set_node(name);
+      record.set_time(block.chunk_times(block.chunk_times_size() - 1));
+      block.set_size(block.data().size());
+      auto body = record.mutable_analog_block();
+      body->Swap(&block);
+      block.set_schema(body->schema());
+      block.set_channel(body->channel());
+      queue_record(std::move(record));
+    }
+  }
+
+  void flush_columnar() {
+    for (auto &pair : columnar_sources) {
+      flush_columnar(pair.first, pair.second);
+    }
+  }
+
+  /**
+   * Columnar analog capture: channel names and intervals are written once per
+   * source as an AnalogSchema and samples are accumulated into per-channel
+   * blocks of raw little-endian values that are flushed every block_duration.
+   * The schema is only rebuilt when the source's AnalogFrame version changes,
+   * readies otherwise only copy samples.
+   */
+  void on_columnar_data(Node *node, const std::string &name,
+                        AnalogNode *locked_analog, int metrics_index) {
+    TRACE_EVENT("thalamus", "Storage2Node::on_columnar_data");
+    auto &frame = locked_analog->frame();
+    auto now = frame.time;
+    auto &source = columnar_sources[name];
+    visit_frame(frame, [&]<typename T>(T *wrapper) {
+      using Sample = typename decltype(wrapper->data(0))::value_type;
+      auto is_transformed = wrapper->is_transformed();
+
+      if (frame.version != source.frame_version ||
+          source.blocks.size() != size_t(wrapper->num_channels())) {
+        flush_columnar(name, source);
+        source.frame_version = frame.version;
+        auto &schema = source.schema;
+        schema.Clear();
+        schema.set_id(next_schema_id++);
+        schema.set_sample_type(sample_type<Sample>());
+        schema.set_is_transformed(is_transformed);
+        for (auto i = 0; i < wrapper->num_channels(); ++i) {
+          auto channel = schema.add_channels();
+          auto channel_name = wrapper->name(i);
+          channel->set_name(
+              std::string(channel_name.begin(), channel_name.end()));
+          channel->set_sample_interval(
+              uint64_t(wrapper->sample_interval(i).count()));
+          if (is_transformed) {
+            channel->set_scale(wrapper->scale(i));
+            channel->set_offset(wrapper->offset(i));
+          }
+        }
+        source.blocks.clear();
+        source.blocks.resize(size_t(schema.channels_size()));
+        for (auto i = 0u; i < source.blocks.size(); ++i) {
+          source.blocks[i].set_schema(schema.id());
+          source.blocks[i].set_channel(i);
+        }
+        source.block_start = now;
+
+        thalamus_grpc::StorageRecord record;
+        record.set_node(name);
+        record.set_time(uint64_t(now.count()));
+        *record.mutable_analog_schema() = schema;
+        queue_record(std::move(record));
+      }
+
+      if (node != outer) {
+        std::lock_guard<std::mutex> lock(stats_mutex);
+        for (auto i = 0; i < wrapper->num_channels(); ++i) {
+          auto count = frame.sizes[size_t(i)];
+          if (count) {
+            update_metrics_unsafe(metrics_index, i, count, [&] {
+              return name + "(" + source.schema.channels(i).name() + ")";
+            });
+          }
+        }
+      }
+
+      for (auto i = 0; i < wrapper->num_channels(); ++i) {
+        auto data = wrapper->data(i);
+        if (data.empty()) {
+          continue;
+        }
+        auto &block = source.blocks[size_t(i)];
+        append_samples(block.mutable_data(), data);
+        block.add_chunk_ends(uint32_t(block.data().size() / sizeof(Sample)));
+        block.add_chunk_times(uint64_t(now.count()));
+        block.add_chunk_remote_times(uint64_t(frame.remote_time.count()));
+      }
+    });
+
+    if (now - source.block_start >= block_duration) {
+      flush_columnar(name, source);
+      source.block_start = now;
+    }
+  }
+
   void on_data(Node *node, const std::string &name, AnalogNode *locked_analog,
                int metrics_index) {
     if (!is_running || !locked_analog->has_analog_data()) {
       return;
     }
+    if (columnar_analog) {
+      on_columnar_data(node, name, locked_analog, metrics_index);
+      return;
+    }
 
     TRACE_EVENT("thalamus", "Storage2Node::on_analog_data");
 
@@ -185,13 +364,14 @@ struct Storage2Node::Impl {
 
     {
       TRACE_EVENT("thalamus", "Storage2Node::on_analog_data(build record)");
-      record.set_time(uint64_t(locked_analog->time().count()));
+      auto &frame = locked_analog->frame();
+      record.set_time(uint64_t(frame.time.count()));
       record.set_node(name);
-      body->set_time(uint64_t(locked_analog->time().count()));
-      body->set_remote_time(uint64_t(locked_analog->remote_time().count()));
-      auto is_transformed = locked_analog->is_transformed();
+      body->set_time(uint64_t(frame.time.count()));
+      body->set_remote_time(uint64_t(frame.remote_time.count()));
+      auto is_transformed = frame.is_transformed;
       body->set_is_transformed(is_transformed);
-      visit_node(locked_analog, [&]<typename T>(T *wrapper) {
+      visit_frame(frame, [&]<typename T>(T *wrapper) {
         for (auto i = 0; i < wrapper->num_channels(); ++i) {
           auto data = wrapper->data(i);
           if (compress_analog) {
@@ -200,11 +380,10 @@ struct Storage2Node::Impl {
             }
             record = thalamus_grpc::StorageRecord();
             body = record.mutable_analog();
-            record.set_time(uint64_t(locked_analog->time().count()));
+            record.set_time(uint64_t(frame.time.count()));
             record.set_node(name);
-            body->set_time(uint64_t(locked_analog->time().count()));
-            body->set_remote_time(
-                uint64_t(locked_analog->remote_time().count()));
+            body->set_time(uint64_t(frame.time.count()));
+            body->set_remote_time(uint64_t(frame.remote_time.count()));
           }
           auto channel_name_view = wrapper->name(i);
           std::string channel_name(channel_name_view.begin(),
@@ -403,7 +582,8 @@ struct Storage2Node::Impl {
     queue_record(std::move(record));
   }
 
-  std::string prepare_storage(const std::string &filename) {
+  std::string prepare_storage(const std::string &filename,
+                              const ShardLayout &layout) {
     inja::json tdata;
     auto time = graph->get_system_clock_at_start();
     int rec_number = get_rec_number(filename, tdata, time);
@@ -499,12 +679,134 @@ struct Storage2Node::Impl {
     proto_pair->set_key("Commit");
     proto_pair->set_text(THALAMUS_GIT_COMMIT_HASH);
 
-    output_stream = std::ofstream(rendered, std::ios::trunc | std::ios::binary);
-    this->outer->record(output_stream, record);
+    {
+      auto writer = std::make_unique<AsyncWriter>(rendered, writer_options);
+      std::lock_guard<std::mutex> stats_lock(stats_mutex);
+      output_writer = std::move(writer);
+    }
+    auto serialized = record.SerializePartialAsString();
+    auto size = htonll(serialized.size());
+    output_writer->write(reinterpret_cast<char *>(&size), sizeof(size));
+    output_writer->write(serialized.data(), serialized.size());
+
+    if (layout.count() > 0 && !open_shards(rendered_path, layout, record)) {
+      close_file();
+      return "";
+    }
     return std::string(std::move(rendered));
   }
 
-  void close_file() { output_stream.close(); }
+  /**
+   * Opens a file for every shard, each starting with the primary file's
+   * metadata plus its shard number, and writes the manifest.
+   */
+  bool open_shards(const std::filesystem::path &primary,
+                   const ShardLayout &layout,
+                   const thalamus_grpc::StorageRecord &metadata) {
+    boost::json::array files;
+    files.emplace_back(primary.filename().string());
+
+    std::vector<std::unique_ptr<AsyncWriter>> writers;
+    for (size_t i = 1; i <= layout.count(); ++i) {
+      std::filesystem::path shard_path =
+          absl::StrFormat("%s.shard%d", primary.string(), i);
+      if (i - 1 < layout.directories.size() &&
+          !layout.directories[i - 1].empty()) {
+        shard_path = std::filesystem::absolute(layout.directories[i - 1] /
+                                               shard_path.filename());
+        std::error_code ec;
+        std::filesystem::create_directories(shard_path.parent_path(), ec);
+        if (ec) {
+          boost::asio::post(io_context, [this, ec] {
+            thalamus_grpc::Dialog d;
+            d.set_title("Failed to make shard dir");
+            d.set_message(ec.message());
+            d.set_type(thalamus_grpc::Dialog::Type::Dialog_Type_ERROR);
+            graph->dialog(d);
+          });
+          return false;
+        }
+        files.emplace_back(shard_path.string());
+      } else {
+        files.emplace_back(shard_path.filename().string());
+      }
+
+      auto shard_metadata = metadata;
+      auto proto_pair = shard_metadata.mutable_metadata()->add_keyvalues();
+      proto_pair->set_key("Shard");
+      proto_pair->set_integral(int64_t(i));
+      auto serialized = shard_metadata.SerializePartialAsString();
+      auto size = htonll(serialized.size());
+      auto writer = std::make_unique<AsyncWriter>(shard_path, writer_options);
+      writer->write(reinterpret_cast<char *>(&size), sizeof(size));
+      writer->write(serialized.data(), serialized.size());
+      writers.push_back(std::move(writer));
+    }
+
+    // Every shard is written with the same steady clock, the manifest records
+    // where that clock started so the shards can be merged by record time.
+    boost::json::object manifest;
+    manifest["shards"] = std::move(files);
+    manifest["steady_start"] =
+        graph->get_steady_clock_at_start().time_since_epoch().count();
+    manifest["system_start"] =
+        graph->get_system_clock_at_start().time_since_epoch().count();
+    std::ofstream manifest_output(primary.string() + ".manifest.json");
+    manifest_output << boost::json::serialize(manifest);
+
+    std::lock_guard<std::mutex> stats_lock(stats_mutex);
+    shard_writers = std::move(writers);
+    return true;
+  }
+
+  std::atomic_bool write_failed = false;
+
+  /**
+   * Whether the recording or one of its shards can't be written, because the
+   * file couldn't be opened or a write failed.  Called with stats_mutex held
+   * or from the storage thread, which are the only places the writers change.
+   */
+  bool writers_failed() const {
+    auto broken = [](const std::unique_ptr<AsyncWriter> &writer) {
+      return !writer->is_open() || writer->failed();
+    };
+    return (output_writer && broken(output_writer)) ||
+           std::any_of(shard_writers.begin(), shard_writers.end(), broken);
+  }
+
+  /**
+   * Stops recording once a write fails rather than recording into nothing.
+   */
+  void on_write_failure() {
+    if (write_failed.exchange(true)) {
+      return;
+    }
+    boost::asio::post(io_context, [this] {
+      thalamus_grpc::Dialog d;
+      d.set_title("Recording Failed");
+      d.set_message("Writing the recording failed, see the log for the "
+                    "error.  Recording has been stopped.");
+      d.set_type(thalamus_grpc::Dialog::Type::Dialog_Type_ERROR);
+      graph->dialog(d);
+      (*state)["Running"].assign(false);
+    });
+  }
+
+  void close_file() {
+    std::unique_ptr<AsyncWriter> writer;
+    std::vector<std::unique_ptr<AsyncWriter>> shards;
+    {
+      std::lock_guard<std::mutex> stats_lock(stats_mutex);
+      writer.swap(output_writer);
+      shards.swap(shard_writers);
+    }
+    if (writer) {
+      writer->close();
+    }
+    for (auto &shard : shards) {
+      shard->close();
+    }
+  }
 
   std::vector<std::pair<thalamus_grpc::StorageRecord, int>> records;
   std::condition_variable records_condition;
@@ -597,6 +899,38 @@ struct Storage2Node::Impl {
     }
   };
 
+  /**
+   * Compresses each columnar analog block as its own zlib stream so blocks
+   * stay independently decodable.
+   */
+  struct BlockEncoder : public Encoder {
+    std::vector<thalamus_grpc::StorageRecord> in_queue;
+    std::list<thalamus_grpc::StorageRecord> out_queue;
+
+    void work() override;
+    void finish() override {}
+    void push(thalamus_grpc::StorageRecord &&record) override {
+      in_queue.push_back(std::move(record));
+    }
+    std::optional<thalamus_grpc::StorageRecord> pull() override {
+      if (!out_queue.empty()) {
+        std::optional<thalamus_grpc::StorageRecord> result =
+            std::move(out_queue.front());
+        out_queue.pop_front();
+        return result;
+      }
+      return std::nullopt;
+    }
+  };
+
+  enum class VideoCodecId { MPEG4, FFV1, H264 };
+
+  struct VideoEncoderOptions {
+    VideoCodecId codec = VideoCodecId::MPEG4;
+    int threads = 1;
+    int thread_type = FF_THREAD_SLICE;
+  };
+
   struct VideoEncoder : public Encoder {
     const AVCodec *codec;
     AVCodecContext *context;
@@ -604,32 +938,95 @@ struct Storage2Node::Impl {
     AVFrame *frame;
     std::vector<thalamus_grpc::StorageRecord> in_queue;
     std::list<thalamus_grpc::StorageRecord> out_queue;
+    // Records whose frame has been sent to the encoder but whose packet has
+    // not come out yet.  B-frames are disabled so packets leave in order.
+    std::list<thalamus_grpc::StorageRecord> pending;
+    std::optional<thalamus_grpc::StorageRecord> trailing;
+    // The time and size of the last frame a packet was written to, packets
+    // flushed after it belong to that frame.
+    thalamus_grpc::StorageRecord last_frame;
     int pts = 0;
-    struct SwsContext *sws_context;
-    uint8_t *src_data[4], *dst_data[4];
-    int src_linesize[4], dst_linesize[4];
-    uint8_t *dst_data_0;
+    struct SwsContext *sws_context = nullptr;
     std::string node;
     AVPixelFormat src_format;
+    thalamus_grpc::Image::Format image_format;
+    bool copy_planes = false;
+    bool gray_to_yuv = false;
+    std::string extradata;
+
+    static AVPixelFormat encoder_format(thalamus_grpc::Image::Format image_format,
+                                        AVPixelFormat format) {
+      if (image_format != thalamus_grpc::Image::Format::Image_Format_FFV1) {
+        return AV_PIX_FMT_YUV420P;
+      }
+      switch (format) {
+      case AV_PIX_FMT_GRAY8:
+        return AV_PIX_FMT_GRAY8;
+      case AV_PIX_FMT_GRAY16LE:
+      case AV_PIX_FMT_GRAY16BE:
+        return AV_PIX_FMT_GRAY16LE;
+      case AV_PIX_FMT_RGB24:
+        return AV_PIX_FMT_GBRP;
+      default:
+        return AV_PIX_FMT_YUV420P;
+      }
+    }
 
     VideoEncoder(int width, int height, AVPixelFormat format,
-                 AVRational framerate, const std::string &_node)
+                 AVRational framerate, const std::string &_node,
+                 const VideoEncoderOptions &options)
         : node(_node), src_format(format) {
-      codec = avcodec_find_encoder(AV_CODEC_ID_MPEG4);
+      auto codec_id = AV_CODEC_ID_MPEG4;
+      image_format = thalamus_grpc::Image::Format::Image_Format_MPEG4;
+      if (options.codec == VideoCodecId::FFV1) {
+        codec_id = AV_CODEC_ID_FFV1;
+        image_format = thalamus_grpc::Image::Format::Image_Format_FFV1;
+      } else if (options.codec == VideoCodecId::H264) {
+        codec_id = AV_CODEC_ID_H264;
+        image_format = thalamus_grpc::Image::Format::Image_Format_H264;
+      }
+      codec = avcodec_find_encoder(codec_id);
+      if (!codec && options.codec == VideoCodecId::H264) {
+        THALAMUS_LOG(warning)
+            << "No H.264 encoder available, recording " << node
+            << " with FFV1 instead";
+        codec = avcodec_find_encoder(AV_CODEC_ID_FFV1);
+        image_format = thalamus_grpc::Image::Format::Image_Format_FFV1;
+      }
       THALAMUS_ASSERT(codec, "avcodec_find_encoder failed");
       context = avcodec_alloc_context3(codec);
       THALAMUS_ASSERT(context, "avcodec_alloc_context3 failed");
       packet = av_packet_alloc();
       frame = av_frame_alloc();
 
-      context->bit_rate = std::numeric_limits<int>::max();
       context->width = width;
       context->height = height;
       context->framerate = framerate;
       context->time_base = {framerate.den, framerate.num};
       context->gop_size = framerate.num / framerate.den;
+      context->max_b_frames = 0;
+      context->thread_count = options.threads;
+      context->thread_type = options.thread_type;
+      context->pix_fmt = encoder_format(image_format, format);
+      if (format == AV_PIX_FMT_YUVJ420P) {
+        context->color_range = AVCOL_RANGE_JPEG;
+      }
 
-      context->pix_fmt = AV_PIX_FMT_YUV420P;
+      switch (image_format) {
+      case thalamus_grpc::Image::Format::Image_Format_FFV1:
+        // Version 3 is required for slices, which is how FFV1 spreads a frame
+        // across threads.
+        context->level = 3;
+        context->slices = options.threads > 1 ? options.threads : 0;
+        break;
+      case thalamus_grpc::Image::Format::Image_Format_H264:
+        av_opt_set(context->priv_data, "qp", "0", 0);
+        av_opt_set(context->priv_data, "preset", "ultrafast", 0);
+        break;
+      default:
+        context->bit_rate = std::numeric_limits<int>::max();
+        break;
+      }
 
       frame->format = context->pix_fmt;
       frame->width = width;
@@ -637,156 +1034,155 @@ struct Storage2Node::Impl {
 
       auto ret = avcodec_open2(context, codec, nullptr);
       THALAMUS_ASSERT(ret >= 0, "Could not open codec: %d", ret);
+      if (context->extradata_size > 0) {
+        extradata.assign(reinterpret_cast<char *>(context->extradata),
+                         size_t(context->extradata_size));
+      }
 
       ret = av_frame_get_buffer(frame, 0);
       THALAMUS_ASSERT(ret >= 0, "Could not allocate the video frame data");
 
-      sws_context =
-          sws_getContext(width, height, format, width, height, context->pix_fmt,
-                         SWS_BILINEAR, nullptr, nullptr, nullptr);
-      ret = av_image_alloc(src_data, src_linesize, width, height, format, 16);
-      THALAMUS_ASSERT(ret >= 0, "Could not allocate source image");
-      ret = av_image_alloc(dst_data, dst_linesize, width, height,
-                           context->pix_fmt, 16);
-      dst_data_0 = dst_data[0];
-      THALAMUS_ASSERT(ret >= 0, "Could not allocate destination image");
+      auto normalized_format =
+          format == AV_PIX_FMT_YUVJ420P ? AV_PIX_FMT_YUV420P : format;
+      if (normalized_format == context->pix_fmt) {
+        copy_planes = true;
+      } else if (format == AV_PIX_FMT_GRAY8 &&
+                 context->pix_fmt == AV_PIX_FMT_YUV420P) {
+        // Only luma changes between frames; chroma stays neutral and is
+        // carried over by av_frame_make_writable.
+        gray_to_yuv = true;
+        auto chroma_height = (height + 1) / 2;
+        std::fill_n(frame->data[1], frame->linesize[1] * chroma_height, 128);
+        std::fill_n(frame->data[2], frame->linesize[2] * chroma_height, 128);
+      } else {
+        sws_context = sws_getContext(width, height, format, width, height,
+                                     context->pix_fmt, SWS_BILINEAR, nullptr,
+                                     nullptr, nullptr);
+        THALAMUS_ASSERT(sws_context, "sws_getContext failed");
+      }
     }
     ~VideoEncoder() override {
       avcodec_free_context(&context);
       av_packet_free(&packet);
       av_frame_free(&frame);
-      av_freep(&src_data[0]);
-      dst_data[0] = dst_data_0;
-      av_freep(&dst_data[0]);
+      sws_freeContext(sws_context);
     }
+
+    void drain() {
+      auto ret = 0;
+      while (ret >= 0) {
+        ret = avcodec_receive_packet(context, packet);
+#ifdef __clang__
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wold-style-cast"
+#endif
+        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
+          break;
+        }
+#ifdef __clang__
+#pragma clang diagnostic pop
+#endif
+        THALAMUS_ASSERT(ret >= 0, "Error during encoding");
+        if (pending.empty()) {
+          if (!trailing) {
+            trailing.emplace(last_frame);
+            trailing->set_node(node);
+            trailing->mutable_image()->set_format(image_format);
+            trailing->mutable_image()->add_data();
+          }
+          trailing->mutable_image()->mutable_data(0)->append(
+              reinterpret_cast<char *>(packet->data), size_t(packet->size));
+        } else {
+          auto &record = pending.front();
+          auto image = record.mutable_image();
+          image->mutable_data(0)->append(
+              reinterpret_cast<char *>(packet->data), size_t(packet->size));
+          last_frame.set_time(record.time());
+          auto last_image = last_frame.mutable_image();
+          last_image->set_width(image->width());
+          last_image->set_height(image->height());
+          last_image->set_frame_interval(image->frame_interval());
+          out_queue.splice(out_queue.end(), pending, pending.begin());
+        }
+        av_packet_unref(packet);
+      }
+    }
+
     void work() override {
       for (auto &record : in_queue) {
-        auto image = record.image();
- 
+        auto &image = record.image();
+
         thalamus_grpc::StorageRecord compressed_record;
         compressed_record.set_node(node);
         compressed_record.set_time(record.time());
         auto compressed_image = compressed_record.mutable_image();
         compressed_image->set_width(image.width());
         compressed_image->set_height(image.height());
-        compressed_image->set_format(
-            thalamus_grpc::Image::Format::Image_Format_MPEG4);
+        compressed_image->set_format(image_format);
         compressed_image->set_frame_interval(image.frame_interval());
         compressed_image->set_last(image.last());
         compressed_image->set_bigendian(image.bigendian());
+        compressed_image->add_data();
+        if (pts == 0) {
+          // Decoders need the codec's global header before the first packet.
+          compressed_image->set_codec_extradata(extradata);
+        }
 
         auto ret = av_frame_make_writable(frame);
         THALAMUS_ASSERT(ret >= 0, "av_frame_make_writable failed");
 
-        std::array<unsigned int, 3> bps;
-        switch (image.format()) {
-        case thalamus_grpc::Image::Format::Image_Format_Gray:
-          bps = {1, 1, 1};
-          break;
-        case thalamus_grpc::Image::Format::Image_Format_RGB:
-          bps = {3, 3, 3};
-          break;
-        case thalamus_grpc::Image::Format::Image_Format_YUYV422:
-          bps = {1, 2, 1};
-          break;
-        case thalamus_grpc::Image::Format::Image_Format_YUV420P:
-          bps = {1, 1, 1};
-          break;
-        case thalamus_grpc::Image::Format::Image_Format_YUVJ420P:
-          bps = {1, 1, 1};
-          break;
-        case thalamus_grpc::Image::Format::Image_Format_Gray16:
-          bps = {2, 2, 2};
-          break;
-        case thalamus_grpc::Image::Format::Image_Format_RGB16:
-          bps = {6, 6, 6};
-          break;
-        case thalamus_grpc::Image::Format::Image_Format_MPEG1:
-        case thalamus_grpc::Image::Format::Image_Format_MPEG4:
-        case thalamus_grpc::Image::Format::
-            Image_Format_Image_Format_INT_MIN_SENTINEL_DO_NOT_USE_:
-        case thalamus_grpc::Image::Format::
-            Image_Format_Image_Format_INT_MAX_SENTINEL_DO_NOT_USE_:
-          THALAMUS_ASSERT(false, "Unsupported format");
+        auto height = int(std::min(image.height(), uint32_t(frame->height)));
+        auto width = int(std::min(image.width(), uint32_t(frame->width)));
+        auto descriptor = av_pix_fmt_desc_get(src_format);
+        std::array<const uint8_t *, 4> src_data = {nullptr};
+        std::array<int, 4> src_linesize = {0};
+        std::array<int, 4> src_height = {0};
+        for (auto p = 0; p < std::min(image.data_size(), 4); ++p) {
+          src_height[size_t(p)] =
+              p == 1 || p == 2
+                  ? AV_CEIL_RSHIFT(int(image.height()), descriptor->log2_chroma_h)
+                  : int(image.height());
+          src_data[size_t(p)] =
+              reinterpret_cast<const uint8_t *>(image.data(p).data());
+          src_linesize[size_t(p)] =
+              int(image.data(p).size()) / src_height[size_t(p)];
         }
 
-        auto height = std::min(image.height(), uint32_t(frame->height));
-        for (auto p = 0ull; p < size_t(image.data().size()); ++p) {
-          auto linesize = image.data(int(p)).size() / image.height();
-          auto width = std::min(image.width(), uint32_t(frame->width));
-          auto width_bits = width * bps[p];
-          for (auto y = 0u; y < height; ++y) {
-            std::copy_n(image.data(int(p)).data() + y * linesize, width_bits,
-                        src_data[p] + y * uint32_t(src_linesize[p]));
+        if (copy_planes || gray_to_yuv) {
+          auto planes = gray_to_yuv ? 1 : std::min(image.data_size(), 4);
+          for (auto p = 0; p < planes; ++p) {
+            auto rows = p == 1 || p == 2
+                            ? AV_CEIL_RSHIFT(height, descriptor->log2_chroma_h)
+                            : height;
+            av_image_copy_plane(frame->data[p], frame->linesize[p],
+                                src_data[size_t(p)], src_linesize[size_t(p)],
+                                av_image_get_linesize(src_format, width, p),
+                                rows);
           }
-        }
-
-        if (pts > 0 && src_format == AV_PIX_FMT_GRAY8) {
-          dst_data[0] = src_data[0];
         } else {
-          sws_scale(sws_context, src_data, src_linesize, 0, int(height),
-                    dst_data, dst_linesize);
+          sws_scale(sws_context, src_data.data(), src_linesize.data(), 0,
+                    height, frame->data, frame->linesize);
         }
-        std::copy(std::begin(dst_data), std::end(dst_data), frame->data);
-        std::copy(std::begin(dst_linesize), std::end(dst_linesize),
-                  frame->linesize);
 
         frame->pts = pts++;
 
         ret = avcodec_send_frame(context, frame);
         THALAMUS_ASSERT(ret >= 0, "Error sending a frame for encoding");
 
-        auto data = compressed_image->add_data();
-        while (ret >= 0) {
-          ret = avcodec_receive_packet(context, packet);
-#ifdef __clang__
-#pragma clang diagnostic push
-#pragma clang diagnostic ignored "-Wold-style-cast"
-#endif
-          if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-            break;
-          }
-#ifdef __clang__
-#pragma clang diagnostic pop
-#endif
-          THALAMUS_ASSERT(ret >= 0, "Error during encoding");
-          data->append(reinterpret_cast<char *>(packet->data),
-                       size_t(packet->size));
-          av_packet_unref(packet);
-        }
-        out_queue.push_back(compressed_record);
+        pending.push_back(std::move(compressed_record));
+        drain();
       }
       in_queue.clear();
     }
     void finish() override {
-      thalamus_grpc::StorageRecord compressed_record;
-      auto compressed_image = compressed_record.mutable_image();
-      compressed_record.set_node(node);
-      compressed_image->set_format(
-          thalamus_grpc::Image::Format::Image_Format_MPEG4);
-
       auto ret = avcodec_send_frame(context, nullptr);
       THALAMUS_ASSERT(ret >= 0, "Error sending a frame for encoding");
-
-      auto data = compressed_image->add_data();
-      while (ret >= 0) {
-        ret = avcodec_receive_packet(context, packet);
-#ifdef __clang__
-#pragma clang diagnostic push
-#pragma clang diagnostic ignored "-Wold-style-cast"
-#endif
-        if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) {
-#ifdef __clang__
-#pragma clang diagnostic pop
-#endif
-          break;
-        }
-        THALAMUS_ASSERT(ret >= 0, "Error during encoding");
-        data->append(reinterpret_cast<char *>(packet->data),
-                     size_t(packet->size));
-        av_packet_unref(packet);
+      drain();
+      out_queue.splice(out_queue.end(), pending);
+      if (trailing) {
+        out_queue.push_back(std::move(*trailing));
+        trailing.reset();
       }
-      out_queue.push_back(compressed_record);
     }
     void push(thalamus_grpc::StorageRecord &&record) override;
     std::optional<thalamus_grpc::StorageRecord> pull() override {
@@ -973,10 +1369,10 @@ struct Storage2Node::Impl {
     }
   }
 
-  void thread_target(std::string output_file, const boost::json::value& config, const std::vector<std::filesystem::path>& files) {
+  void thread_target(std::string output_file, const boost::json::value& config, const std::vector<std::filesystem::path>& files, const ShardLayout& layout) {
     set_current_thread_name("STORAGE");
 
-    auto filename = prepare_storage(output_file);
+    auto filename = prepare_storage(output_file, layout);
     if(filename.empty()) {
       boost::asio::post(io_context, [this] {
         (*state)["Running"].assign(false);
@@ -1042,11 +1438,24 @@ struct Storage2Node::Impl {
     SimplePool<thalamus_grpc::StorageRecord> record_pool;
 
     IdentityEncoder identity_encoder;
+    BlockEncoder block_encoder;
     std::map<int, std::unique_ptr<ZlibEncoder>> zlib_encoders;
     std::map<std::string, std::unique_ptr<VideoEncoder>> video_encoders;
+    // Compressed analog records only carry their zlib stream, so the shard of
+    // each stream is remembered when its encoder is made.
+    std::map<int, size_t> stream_shards;
+    auto shard_of = [&](const thalamus_grpc::StorageRecord &record) {
+      if (record.body_case() == thalamus_grpc::StorageRecord::kCompressed) {
+        auto i = stream_shards.find(record.compressed().stream());
+        return i == stream_shards.end() ? size_t(0) : i->second;
+      }
+      auto i = layout.nodes.find(record.node());
+      return i == layout.nodes.end() ? size_t(0) : i->second;
+    };
     std::vector<Encoder *> encoders;
     encoders.push_back(&identity_encoder);
-    std::string buffer;
+    encoders.push_back(&block_encoder);
+    std::vector<std::string> buffers(layout.count() + 1);
 
     std::vector<std::pair<double, AVRational>> framerates = {
         {24000.0 / 1001, {24000, 1001}},
@@ -1110,9 +1519,12 @@ struct Storage2Node::Impl {
 
       {
         TRACE_EVENT("thalamus", "serialize");
-        buffer.clear();
+        for (auto &buffer : buffers) {
+          buffer.clear();
+        }
         while (!heap.empty()) {
           std::pop_heap(heap.begin(), heap.end(), comparator);
+          auto &buffer = buffers[shard_of(heap.back().second)];
           auto serialized = heap.back().second.SerializePartialAsString();
           heap.pop_back();
 
@@ -1125,11 +1537,119 @@ struct Storage2Node::Impl {
       }
 
       TRACE_EVENT("thalamus", "write");
-      written_bytes += buffer.size();
-      output_stream.write(buffer.data(), int64_t(buffer.size()));
+      written_bytes += buffers.front().size();
+      output_writer->write(buffers.front().data(), buffers.front().size());
+      for (size_t i = 1; i < buffers.size(); ++i) {
+        written_bytes += buffers[i].size();
+        shard_writers[i - 1]->write(buffers[i].data(), buffers[i].size());
+      }
+      if (writers_failed()) {
+        on_write_failure();
+      }
     };
 
-    while (is_running) {
+    auto encode = [&](thalamus_grpc::StorageRecord &&record, int stream) {
+      auto body_type = record.body_case();
+      if (body_type == thalamus_grpc::StorageRecord::kAnalog &&
+          compress_analog) {
+        if (!zlib_encoders.contains(stream)) {
+          auto encoder = std::make_unique<ZlibEncoder>(stream);
+          encoders.push_back(encoder.get());
+          zlib_encoders[stream] = std::move(encoder);
+          stream_shards[stream] = shard_of(record);
+        }
+        zlib_encoders[stream]->push(std::move(record));
+      } else if (body_type == thalamus_grpc::StorageRecord::kAnalogBlock &&
+                 compress_analog) {
+        block_encoder.push(std::move(record));
+      } else if (body_type == thalamus_grpc::StorageRecord::kImage &&
+                 compress_video) {
+        if (!video_encoders.contains(record.node())) {
+          auto &image = record.image();
+          auto framerate_original = image.frame_interval()
+                                        ? 1e9 / double(image.frame_interval())
+                                        : 60;
+          auto framerate_i = std::lower_bound(
+              framerates.begin(), framerates.end(),
+              std::make_pair(framerate_original, AVRational{1, 1}),
+              [](auto &lhs, auto &rhs) { return lhs.first < rhs.first; });
+
+          AVRational framerate;
+          if (framerate_i == framerates.begin()) {
+            framerate = framerates.front().second;
+          } else if (framerate_i == framerates.end()) {
+            framerate = framerates.back().second;
+          } else {
+            if (framerate_original - (framerate_i - 1)->first <
+                framerate_i->first - framerate_original) {
+              framerate = (framerate_i - 1)->second;
+            } else {
+              framerate = framerate_i->second;
+            }
+          }
+
+          AVPixelFormat format;
+          switch (image.format()) {
+          case thalamus_grpc::Image::Format::Image_Format_Gray:
+            format = AV_PIX_FMT_GRAY8;
+            break;
+          case thalamus_grpc::Image::Format::Image_Format_Gray16:
+            format =
+                image.bigendian() ? AV_PIX_FMT_GRAY16BE : AV_PIX_FMT_GRAY16LE;
+            break;
+          case thalamus_grpc::Image::Format::Image_Format_RGB:
+            format = AV_PIX_FMT_RGB24;
+            break;
+          case thalamus_grpc::Image::Format::Image_Format_YUYV422:
+            format = AV_PIX_FMT_YUYV422;
+            break;
+          case thalamus_grpc::Image::Format::Image_Format_YUV420P:
+            format = AV_PIX_FMT_YUV420P;
+            break;
+          case thalamus_grpc::Image::Format::Image_Format_YUVJ420P:
+            format = AV_PIX_FMT_YUVJ420P;
+            break;
+          case thalamus_grpc::Image::Format::Image_Format_RGB16:
+          case thalamus_grpc::Image::Format::Image_Format_MPEG1:
+          case thalamus_grpc::Image::Format::Image_Format_MPEG4:
+          case thalamus_grpc::Image::Format::Image_Format_FFV1:
+          case thalamus_grpc::Image::Format::Image_Format_H264:
+          case thalamus_grpc::Image::Format::
+              Image_Format_Image_Format_INT_MIN_SENTINEL_DO_NOT_USE_:
+          case thalamus_grpc::Image::Format::
+              Image_Format_Image_Format_INT_MAX_SENTINEL_DO_NOT_USE_:
+            THALAMUS_ASSERT(false, "Usupported image format");
+          }
+
+          auto encoder = std::make_unique<VideoEncoder>(
+              image.width(), image.height(), format, framerate,
+              record.node(), video_options);
+          encoders.push_back(encoder.get());
+          video_encoders[record.node()] = std::move(encoder);
+        }
+        video_encoders[record.node()]->push(std::move(record));
+      } else {
+        identity_encoder.push(std::move(record));
+      }
+    };
+
+    // Triggered mode keeps records from sources here, unencoded, until a
+    // trigger opens a window [open_from, open_until] around it.
+    struct RingEntry {
+      thalamus_grpc::StorageRecord record;
+      int stream;
+      size_t bytes;
+    };
+    std::deque<RingEntry> ring;
+    size_t ring_bytes = 0;
+    uint64_t open_from = 0;
+    uint64_t open_until = 0;
+
+    // Run one more sweep after the node stops so records queued while
+    // stopping (e.g. partially filled columnar blocks) reach the file.
+    auto final_sweep = false;
+    while (!final_sweep) {
+      final_sweep = !is_running;
       std::vector<std::pair<thalamus_grpc::StorageRecord, int>> local_records;
       {
         std::unique_lock<std::mutex> lock(records_mutex);
@@ -1140,79 +1660,54 @@ struct Storage2Node::Impl {
         currently_queued_bytes = 0;
       }
       auto sweep_start = std::chrono::steady_clock::now();
-      for (auto &record_pair : local_records) {
-        auto &[record, stream] = record_pair;
-        auto body_type = record.body_case();
-        if (body_type == thalamus_grpc::StorageRecord::kAnalog &&
-            compress_analog) {
-          if (!zlib_encoders.contains(stream)) {
-            auto encoder = std::make_unique<ZlibEncoder>(stream);
-            encoders.push_back(encoder.get());
-            zlib_encoders[stream] = std::move(encoder);
+      std::vector<uint64_t> local_triggers;
+      if (triggered) {
+        std::lock_guard<std::mutex> lock(records_mutex);
+        local_triggers.swap(triggers);
+      }
+      for (auto trigger : local_triggers) {
+        auto window_start =
+            trigger > uint64_t(pre_trigger.count())
+                ? trigger - uint64_t(pre_trigger.count())
+                : 0;
+        if (window_start > open_until) {
+          open_from = window_start;
+        }
+        open_until = std::max(open_until, trigger + uint64_t(post_trigger.count()));
+        for (auto &entry : ring) {
+          if (entry.record.time() >= open_from) {
+            encode(std::move(entry.record), entry.stream);
           }
-          zlib_encoders[stream]->push(std::move(record));
-        } else if (body_type == thalamus_grpc::StorageRecord::kImage &&
-                   compress_video) {
-          if (!video_encoders.contains(record.node())) {
-            auto &image = record.image();
-            auto framerate_original = image.frame_interval()
-                                          ? 1e9 / double(image.frame_interval())
-                                          : 60;
-            auto framerate_i = std::lower_bound(
-                framerates.begin(), framerates.end(),
-                std::make_pair(framerate_original, AVRational{1, 1}),
-                [](auto &lhs, auto &rhs) { return lhs.first < rhs.first; });
-
-            AVRational framerate;
-            if (framerate_i == framerates.begin()) {
-              framerate = framerates.front().second;
-            } else if (framerate_i == framerates.end()) {
-              framerate = framerates.back().second;
-            } else {
-              if (framerate_original - (framerate_i - 1)->first <
-                  framerate_i->first - framerate_original) {
-                framerate = (framerate_i - 1)->second;
-              } else {
-                framerate = framerate_i->second;
-              }
-            }
-
-            AVPixelFormat format;
-            switch (image.format()) {
-            case thalamus_grpc::Image::Format::Image_Format_Gray:
-              format = AV_PIX_FMT_GRAY8;
-              break;
-            case thalamus_grpc::Image::Format::Image_Format_Gray16:
-              format =
-                  image.bigendian() ? AV_PIX_FMT_GRAY16BE : AV_PIX_FMT_GRAY16LE;
-              break;
-            case thalamus_grpc::Image::Format::Image_Format_RGB:
-              format = AV_PIX_FMT_RGB24;
-              break;
-            case thalamus_grpc::Image::Format::Image_Format_YUYV422:
-            case thalamus_grpc::Image::Format::Image_Format_YUV420P:
-            case thalamus_grpc::Image::Format::Image_Format_YUVJ420P:
-            case thalamus_grpc::Image::Format::Image_Format_RGB16:
-            case thalamus_grpc::Image::Format::Image_Format_MPEG1:
-            case thalamus_grpc::Image::Format::Image_Format_MPEG4:
-            case thalamus_grpc::Image::Format::
-                Image_Format_Image_Format_INT_MIN_SENTINEL_DO_NOT_USE_:
-            case thalamus_grpc::Image::Format::
-                Image_Format_Image_Format_INT_MAX_SENTINEL_DO_NOT_USE_:
-              THALAMUS_ASSERT(false, "Usupported image format");
-            }
+        }
+        ring.clear();
+        ring_bytes = 0;
+      }
 
-            auto encoder = std::make_unique<VideoEncoder>(
-                image.width(), image.height(), format, framerate,
-                record.node());
-            encoders.push_back(encoder.get());
-            video_encoders[record.node()] = std::move(encoder);
-          }
-          video_encoders[record.node()]->push(std::move(record));
-        } else {
-          identity_encoder.push(std::move(record));
+      for (auto &record_pair : local_records) {
+        auto &[record, stream] = record_pair;
+        // Events, logs and columnar schemas are always written, only
+        // records from sources wait in the ring for a trigger.
+        if (!triggered || record.node().empty() ||
+            record.body_case() == thalamus_grpc::StorageRecord::kAnalogSchema ||
+            (open_from <= record.time() && record.time() <= open_until)) {
+          encode(std::move(record), stream);
+          continue;
         }
+        auto bytes = record.ByteSizeLong();
+        ring_bytes += bytes;
+        ring.push_back(RingEntry{std::move(record), stream, bytes});
       }
+      if (!ring.empty()) {
+        auto newest = ring.back().record.time();
+        while (!ring.empty() &&
+               (ring_bytes > ring_limit_bytes ||
+                newest - std::min(newest, ring.front().record.time()) >
+                    uint64_t(pre_trigger.count()))) {
+          ring_bytes -= ring.front().bytes;
+          ring.pop_front();
+        }
+      }
+      current_ring_bytes = ring_bytes;
 
       service_encoders(false);
       auto sweep_end = std::chrono::steady_clock::now();
@@ -1258,6 +1753,29 @@ struct Storage2Node::Impl {
     sweep_count = 0;
     total_sweep_time = 0ns;
     update_metrics_unsafe(0, 4, size_t(average_sweep.count()), [&] { return "Average Sweep (ns)"; });
+    if (triggered) {
+      update_metrics_unsafe(0, 9, current_ring_bytes,
+                            [&] { return "Ring Bytes"; }, false);
+      update_metrics_unsafe(0, 10, trigger_count.exchange(0),
+                            [&] { return "Triggers"; }, false);
+    }
+    if (output_writer) {
+      auto write_stats = output_writer->stats();
+      update_metrics_unsafe(0, 5, size_t(write_stats.average_latency.count()),
+                            [&] { return "Average Write Latency (ns)"; }, false);
+      update_metrics_unsafe(0, 6, size_t(write_stats.max_latency.count()),
+                            [&] { return "Max Write Latency (ns)"; }, false);
+      update_metrics_unsafe(0, 7, write_stats.max_queue_depth,
+                            [&] { return "Write Queue Depth"; }, false);
+      update_metrics_unsafe(0, 8, write_stats.stalls,
+                            [&] { return "Write Stalls"; }, false);
+    }
+    auto failed = writers_failed();
+    update_metrics_unsafe(0, 11, failed ? 1 : 0,
+                          [&] { return "Write Failed"; }, false);
+    if (failed) {
+      on_write_failure();
+    }
 
     auto now = std::chrono::steady_clock::now();
     auto elapsed = now - last_publish;
@@ -1280,6 +1798,7 @@ struct Storage2Node::Impl {
   void start_thread(std::string output_file) {
     stop_thread(true);
     is_running = true;
+    write_failed = false;
     {
       std::lock_guard<std::mutex> lock(records_mutex);
       records.clear();
@@ -1319,7 +1838,7 @@ struct Storage2Node::Impl {
     if(simple) {
       _thread = std::thread([&, output_file, json_object=root->to_json(), files] { simple_thread_target(output_file, json_object, files); });
     } else {
-      _thread = std::thread([&, output_file, json_object=root->to_json(), files] { thread_target(output_file, json_object, files); });
+      _thread = std::thread([&, output_file, json_object=root->to_json(), files, layout=shard_layout] { thread_target(output_file, json_object, files, layout); });
     }
     stats_timer.expires_after(1s);
     stats_timer.async_wait(std::bind(&Impl::on_stats_timer, this, _1));
@@ -1335,6 +1854,68 @@ struct Storage2Node::Impl {
 
   bool compress_analog = false;
   bool compress_video = false;
+  bool columnar_analog = false;
+  std::chrono::nanoseconds block_duration = 1s;
+
+  enum class TriggerType { EVENT, TEXT, ANALOG };
+  bool triggered = false;
+  TriggerType trigger_type = TriggerType::EVENT;
+  std::string trigger_text;
+  std::string trigger_channel;
+  double trigger_threshold = 0;
+  std::optional<bool> trigger_above;
+  std::chrono::nanoseconds pre_trigger = 2s;
+  std::chrono::nanoseconds post_trigger = 2s;
+  size_t ring_limit_bytes = size_t(512) << 20;
+  std::vector<uint64_t> triggers;
+  std::atomic_ullong current_ring_bytes = 0;
+  std::atomic_uint trigger_count = 0;
+
+  void fire_trigger(uint64_t time) {
+    ++trigger_count;
+    std::lock_guard<std::mutex> lock(records_mutex);
+    triggers.push_back(time);
+    records_condition.notify_one();
+  }
+
+  void on_trigger_text(TextNode *locked_text) {
+    if (!is_running || !locked_text->has_text_data()) {
+      return;
+    }
+    if (locked_text->text().find(trigger_text) != std::string_view::npos) {
+      fire_trigger(uint64_t(locked_text->time().count()));
+    }
+  }
+
+  /**
+   * Fires on every upward crossing of Trigger Threshold, timestamped with the
+   * sample that crossed it.
+   */
+  void on_trigger_analog(AnalogNode *locked_analog) {
+    if (!is_running || !locked_analog->has_analog_data()) {
+      return;
+    }
+    visit_node(locked_analog, [&]<typename T>(T *wrapper) {
+      for (auto i = 0; i < wrapper->num_channels(); ++i) {
+        if (wrapper->name(i) != trigger_channel) {
+          continue;
+        }
+        auto data = wrapper->data(i);
+        auto interval = wrapper->sample_interval(i);
+        for (size_t k = 0; k < data.size(); ++k) {
+          auto above = double(data[k]) >= trigger_threshold;
+          if (above && trigger_above == false) {
+            auto time = wrapper->time() -
+                        int64_t(data.size() - 1 - k) * interval;
+            fire_trigger(uint64_t(time.count()));
+          }
+          trigger_above = above;
+        }
+        return;
+      }
+    });
+  }
+  VideoEncoderOptions video_options;
 
   void on_change(ObservableCollection::Action,
                  const ObservableCollection::Key &key,
@@ -1355,7 +1936,11 @@ struct Storage2Node::Impl {
     if (!state->contains("Running")) {
       return;
     }
-    is_running = static_cast<bool>(state->at("Running"));
+    auto new_running = static_cast<bool>(state->at("Running"));
+    if (!new_running && is_running) {
+      flush_columnar();
+    }
+    is_running = new_running;
     if (!is_running) {
       stop_thread(false);
       return;
@@ -1372,6 +1957,133 @@ struct Storage2Node::Impl {
                           : false;
     compress_video =
         state->contains("Compress Video") ? state->at("Compress Video") : false;
+    columnar_analog = state->contains("Columnar Analog")
+                          ? state->at("Columnar Analog")
+                          : false;
+    if (state->contains("Block Duration")) {
+      double seconds = state->at("Block Duration");
+      block_duration = std::chrono::nanoseconds(
+          std::max(int64_t(seconds * 1e9), int64_t(1'000'000)));
+    }
+    columnar_sources.clear();
+    video_options = VideoEncoderOptions();
+    if (state->contains("Video Codec")) {
+      std::string codec = state->at("Video Codec");
+      if (codec == "FFV1") {
+        video_options.codec = VideoCodecId::FFV1;
+      } else if (codec == "H.264 Lossless") {
+        video_options.codec = VideoCodecId::H264;
+      }
+    }
+    if (state->contains("Encoder Threads")) {
+      int64_t threads = state->at("Encoder Threads");
+      video_options.threads = int(std::max(threads, int64_t(0)));
+    }
+    writer_options = AsyncWriter::Options();
+    if (state->contains("Writer")) {
+      std::string writer = state->at("Writer");
+      if (writer == "Thread") {
+        writer_options.backend = AsyncWriter::Backend::THREAD;
+      } else if (writer == "io_uring") {
+        writer_options.backend = AsyncWriter::Backend::IO_URING;
+      }
+    }
+    writer_options.direct =
+        state->contains("Direct IO") ? state->at("Direct IO") : false;
+    if (state->contains("Write Slabs")) {
+      int64_t slabs = state->at("Write Slabs");
+      writer_options.slab_count = size_t(std::max(slabs, int64_t(2)));
+    }
+    if (state->contains("Slab Size (MB)")) {
+      int64_t megabytes = state->at("Slab Size (MB)");
+      writer_options.slab_size = size_t(std::max(megabytes, int64_t(1))) << 20;
+    }
+    if (state->contains("Sync Interval")) {
+      double seconds = state->at("Sync Interval");
+      writer_options.sync_interval =
+          std::chrono::nanoseconds(std::max(int64_t(seconds * 1e9), int64_t(0)));
+    }
+    triggered = state->contains("Triggered") ? state->at("Triggered") : false;
+    trigger_type = TriggerType::EVENT;
+    if (state->contains("Trigger Type")) {
+      std::string type = state->at("Trigger Type");
+      if (type == "Text") {
+        trigger_type = TriggerType::TEXT;
+      } else if (type == "Analog") {
+        trigger_type = TriggerType::ANALOG;
+      }
+    }
+    trigger_text.clear();
+    if (state->contains("Trigger Text")) {
+      std::string text = state->at("Trigger Text");
+      trigger_text = text;
+    }
+    trigger_channel.clear();
+    if (state->contains("Trigger Channel")) {
+      std::string channel = state->at("Trigger Channel");
+      trigger_channel = channel;
+    }
+    trigger_threshold = 0;
+    if (state->contains("Trigger Threshold")) {
+      double threshold = state->at("Trigger Threshold");
+      trigger_threshold = threshold;
+    }
+    trigger_above.reset();
+    if (state->contains("Pre Trigger")) {
+      double seconds = state->at("Pre Trigger");
+      pre_trigger = std::chrono::nanoseconds(
+          std::max(int64_t(seconds * 1e9), int64_t(0)));
+    }
+    if (state->contains("Post Trigger")) {
+      double seconds = state->at("Post Trigger");
+      post_trigger = std::chrono::nanoseconds(
+          std::max(int64_t(seconds * 1e9), int64_t(0)));
+    }
+    if (state->contains("Ring Limit (MB)")) {
+      int64_t megabytes = state->at("Ring Limit (MB)");
+      ring_limit_bytes = size_t(std::max(megabytes, int64_t(1))) << 20;
+    }
+    {
+      std::lock_guard<std::mutex> lock(records_mutex);
+      triggers.clear();
+    }
+    if (state->contains("Encoder Threading")) {
+      std::string threading = state->at("Encoder Threading");
+      if (threading == "Frame") {
+        video_options.thread_type = FF_THREAD_FRAME;
+      } else if (threading == "Slice and Frame") {
+        video_options.thread_type = FF_THREAD_SLICE | FF_THREAD_FRAME;
+      }
+    }
+    shard_layout = ShardLayout();
+    if (state->contains("Sources")) {
+      ObservableListPtr sources_list = state->at("Sources");
+      for (auto source_wrapper : *sources_list) {
+        ObservableDictPtr source_dict = source_wrapper;
+        if (!source_dict->contains("Shard")) {
+          continue;
+        }
+        int64_t shard = source_dict->at("Shard");
+        if (shard > 0) {
+          std::string node = source_dict->at("Node");
+          shard_layout.nodes[node] = size_t(shard);
+        }
+      }
+    }
+    if (state->contains("Shard Directories")) {
+      std::string directories = state->at("Shard Directories");
+      for (auto directory :
+           absl::StrSplit(directories, ',', absl::SkipWhitespace())) {
+        shard_layout.directories.emplace_back(
+            std::string(absl::StripAsciiWhitespace(directory)));
+      }
+    }
+    // Each shard gets a writer thread so one slow disk doesn't hold up the
+    // others.
+    if (shard_layout.count() > 0 &&
+        writer_options.backend == AsyncWriter::Backend::STREAM) {
+      writer_options.backend = AsyncWriter::Backend::THREAD;
+    }
 
     if (is_running) {
       start_thread(output_file);
@@ -1433,6 +2145,32 @@ struct Storage2Node::Impl {
         });
       }
     }
+
+    if (triggered && trigger_type != TriggerType::EVENT &&
+        state->contains("Trigger Node")) {
+      std::string trigger_node = state->at("Trigger Node");
+      graph->get_node(trigger_node, [this](auto source) {
+        auto locked_source = source.lock();
+        if (!locked_source) {
+          return;
+        }
+        if (trigger_type == TriggerType::TEXT) {
+          auto text_source = node_cast<TextNode *>(locked_source.get());
+          if (text_source) {
+            source_connections.push_back(locked_source->ready.connect(
+                [this, text_source](auto) { on_trigger_text(text_source); }));
+          }
+        } else {
+          auto analog_source = node_cast<AnalogNode *>(locked_source.get());
+          if (analog_source) {
+            source_connections.push_back(locked_source->ready.connect(
+                [this, analog_source](auto) {
+                  on_trigger_analog(analog_source);
+                }));
+          }
+        }
+      });
+    }
   }
 };
 
@@ -1444,6 +2182,25 @@ void Storage2Node::Impl::VideoEncoder::push(thalamus_grpc::StorageRecord &&recor
   in_queue.push_back(std::move(record));
 }
 void Storage2Node::Impl::IdentityEncoder::work() {}
+void Storage2Node::Impl::BlockEncoder::work() {
+  std::string compressed;
+  for (auto &record : in_queue) {
+    auto block = record.mutable_analog_block();
+    auto &data = block->data();
+    auto bound = compressBound(uLong(data.size()));
+    compressed.resize(bound);
+    auto error = compress2(reinterpret_cast<Bytef *>(compressed.data()), &bound,
+                           reinterpret_cast<const Bytef *>(data.data()),
+                           uLong(data.size()), 1);
+    THALAMUS_ASSERT(error == Z_OK, "ZLIB Error: %d", error);
+    compressed.resize(bound);
+    block->set_size(data.size());
+    block->set_compressed(true);
+    block->mutable_data()->swap(compressed);
+    out_queue.push_back(std::move(record));
+  }
+  in_queue.clear();
+}
 
 Storage2Node::Storage2Node(ObservableDictPtr state,
                          boost::asio::io_context &io_context, NodeGraph *graph)
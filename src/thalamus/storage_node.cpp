@@ -86,7 +86,7 @@ struct StorageNode::Impl {
   ObservableDictPtr state;
   boost::signals2::scoped_connection state_connection;
   std::atomic_bool is_running = false;
-  thalamus::vector<boost::signals2::scoped_connection> source_connections;
+  thalamus::vector<ScopedConnection> source_connections;
   size_t changes_written;
   int recording_number = 0;
   NodeGraph *graph;
@@ -588,6 +588,8 @@ struct StorageNode::Impl {
           break;
         case thalamus_grpc::Image::Format::Image_Format_MPEG1:
         case thalamus_grpc::Image::Format::Image_Format_MPEG4:
+        case thalamus_grpc::Image::Format::Image_Format_FFV1:
+        case thalamus_grpc::Image::Format::Image_Format_H264:
         case thalamus_grpc::Image::Format::
             Image_Format_Image_Format_INT_MIN_SENTINEL_DO_NOT_USE_:
         case thalamus_grpc::Image::Format::
@@ -947,6 +949,8 @@ struct StorageNode::Impl {
             case thalamus_grpc::Image::Format::Image_Format_RGB16:
             case thalamus_grpc::Image::Format::Image_Format_MPEG1:
             case thalamus_grpc::Image::Format::Image_Format_MPEG4:
+            case thalamus_grpc::Image::Format::Image_Format_FFV1:
+            case thalamus_grpc::Image::Format::Image_Format_H264:
             case thalamus_grpc::Image::Format::
                 Image_Format_Image_Format_INT_MIN_SENTINEL_DO_NOT_USE_:
             case thalamus_grpc::Image::Format::
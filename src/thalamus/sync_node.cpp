@@ -1,9 +1,59 @@
 #include <cstdint>
+#include <thalamus/correlation.hpp>
 #include <thalamus/modalities_util.hpp>
 #include <thalamus/sync_node.hpp>
+#include <thalamus/thread_pool.hpp>
 #include <vector>
 
 namespace thalamus {
+namespace {
+/**
+ * The lag in seconds of data1 relative to data2.  The coarser signal is held
+ * onto the finer one's sample grid before they are correlated.
+ */
+double estimate_lag(std::vector<double> data1, std::vector<double> data2,
+                    std::chrono::nanoseconds sample_interval1,
+                    std::chrono::nanoseconds sample_interval2) {
+  auto i = 0ull;
+  auto j = 0ull;
+  auto time1 = 0ns;
+  auto time2 = 0ns;
+  std::vector<double> resampled;
+  if (sample_interval1 < sample_interval2) {
+    while (resampled.size() < data1.size()) {
+      if (time1 > time2 + sample_interval2) {
+        time2 += sample_interval2;
+        ++j;
+      }
+      time1 += sample_interval1;
+      if (j < data2.size()) {
+        resampled.push_back(data2[j]);
+      } else {
+        resampled.push_back(resampled.back());
+      }
+    }
+    data2.swap(resampled);
+  } else if (sample_interval1 > sample_interval2) {
+    while (resampled.size() < data2.size()) {
+      if (time2 > time1 + sample_interval1) {
+        time1 += sample_interval1;
+        ++i;
+      }
+      time2 += sample_interval2;
+      if (i < data1.size()) {
+        resampled.push_back(data1[i]);
+      } else {
+        resampled.push_back(resampled.back());
+      }
+    }
+    data1.swap(resampled);
+  }
+  auto peak = find_correlation_peak(data1, data2);
+  auto sample_interval = std::min(sample_interval1, sample_interval2);
+  return peak.lag * double(sample_interval.count()) / 1e9;
+}
+} // namespace
+
 struct SyncNode::Impl {
   ObservableDictPtr state;
   boost::signals2::scoped_connection state_connection;
@@ -59,18 +109,24 @@ struct SyncNode::Impl {
     std::chrono::nanoseconds sample_interval2;
     double lag = 0;
     std::string out_channel_name;
+    // The cross correlation in flight on the thread pool, 0 if there is none
+    uint64_t job = 0;
   };
   std::vector<Pair> pairs;
-  std::map<std::string, boost::signals2::scoped_connection> data_connections;
-  std::map<std::string, boost::signals2::scoped_connection>
+  uint64_t next_job = 0;
+  std::map<std::string, ScopedConnection> data_connections;
+  std::map<std::string, ScopedConnection>
       channels_connections;
   std::map<std::string, boost::signals2::scoped_connection> node_connections;
   ObservableCollection *pairs_state;
+  boost::asio::io_context &io_context;
+  ThreadPool &pool;
 
 public:
-  Impl(ObservableDictPtr _state, boost::asio::io_context &, NodeGraph *_graph,
-       SyncNode *_outer)
-      : state(_state), outer(_outer), graph(_graph) {
+  Impl(ObservableDictPtr _state, boost::asio::io_context &_io_context,
+       NodeGraph *_graph, SyncNode *_outer)
+      : state(_state), outer(_outer), graph(_graph), io_context(_io_context),
+        pool(_graph->get_thread_pool()) {
 
     state_connection = state->recursive_changed.connect(
         std::bind(&Impl::on_change, this, _1, _2, _3, _4));
@@ -151,7 +207,7 @@ public:
           p.cross2 = 0ns;
           publish = true;
         }
-      } else {
+      } else if (!p.data1.empty() && !p.data2.empty()) {
         int64_t data1_size = int64_t(p.data1.size());
         int64_t data2_size = int64_t(p.data2.size());
         auto window1_size = p.sample_interval1 > 0ns
@@ -167,60 +223,11 @@ public:
                                     ? p.sample_interval2
                                     : (window2_size / data2_size);
         if (window1_size > p.window && window2_size > p.window) {
-          auto data1 = &p.data1;
-          auto data2 = &p.data2;
-          auto i = 0ull;
-          auto j = 0ull;
-          auto time1 = 0ns;
-          auto time2 = 0ns;
-          std::vector<double> resampled;
-          if (sample_interval1 < sample_interval2) {
-            while (resampled.size() < data1->size()) {
-              if (time1 > time2 + sample_interval2) {
-                time2 += sample_interval2;
-                ++j;
-              }
-              time1 += sample_interval1;
-              if (j < data2->size()) {
-                resampled.push_back((*data2)[j]);
-              } else {
-                resampled.push_back(resampled.back());
-              }
-            }
-            data2 = &resampled;
-          } else if (sample_interval1 > sample_interval2) {
-            while (resampled.size() < data2->size()) {
-              if (time2 > time1 + sample_interval1) {
-                time1 += sample_interval1;
-                ++i;
-              }
-              time2 += sample_interval2;
-              if (i < data1->size()) {
-                resampled.push_back((*data1)[i]);
-              } else {
-                resampled.push_back(resampled.back());
-              }
-            }
-            data1 = &resampled;
+          // A window that ends while the last is still being correlated is
+          // dropped rather than queued behind it.
+          if (!p.job) {
+            correlate(p, sample_interval1, sample_interval2, analog->time());
           }
-          auto max = 0.0;
-          auto max_index = 0;
-          for (auto lag = -(int(data2->size()) - 1); lag < int(data1->size());
-               ++lag) {
-            i = size_t(std::max(0, -lag));
-            j = size_t(std::max(0, lag));
-            auto count = std::min(data2->size() - i, data1->size() - j);
-            auto sum = 0.0;
-            for (auto k = 0ull; k < count; ++k) {
-              sum += (*data2)[i + k] * (*data1)[j + k];
-            }
-            if (sum > max) {
-              max = sum;
-              max_index = lag;
-            }
-          }
-          p.lag = double((max_index * sample_interval1).count()) / 1e9;
-          publish = true;
           p.data1.clear();
           p.data2.clear();
         }
@@ -232,6 +239,42 @@ public:
     }
   }
 
+  /**
+   * Moves the pair's windows to the thread pool, the cross correlation is
+   * O(N log N) but long windows would still stall the io_context.  The lag is
+   * published when the result is posted back.
+   */
+  void correlate(Pair &p, std::chrono::nanoseconds sample_interval1,
+                 std::chrono::nanoseconds sample_interval2,
+                 std::chrono::nanoseconds time) {
+    auto job = p.job = ++next_job;
+    pool.push([job, time, sample_interval1, sample_interval2,
+               data1 = std::move(p.data1), data2 = std::move(p.data2), this,
+               c_outer = outer->shared_from_this()]() mutable {
+      auto lag = estimate_lag(std::move(data1), std::move(data2),
+                              sample_interval1, sample_interval2);
+      boost::asio::post(io_context, [job, time, lag, this, c_outer] {
+        on_lag(job, lag, time);
+      });
+    });
+  }
+
+  /**
+   * Publishes a lag from the thread pool unless its pair was removed or
+   * changed since.
+   */
+  void on_lag(uint64_t job, double lag, std::chrono::nanoseconds time) {
+    for (auto &p : pairs) {
+      if (p.job == job) {
+        p.job = 0;
+        p.lag = lag;
+        current_time = time;
+        outer->ready(outer);
+        return;
+      }
+    }
+  }
+
   void on_channels_changed(AnalogNode *) {
     for (auto &p : pairs) {
       p.channel1_index = -1;
@@ -322,6 +365,17 @@ public:
         auto &pair = get_pair(source);
         auto milliseconds = int64_t(1e3 * std::get<double>(v));
         pair.window = std::chrono::milliseconds(milliseconds);
+      } else if (key_str == "Algorithm") {
+        auto &pair = get_pair(source);
+        auto value_str = std::get<std::string>(v);
+        pair.algo = value_str == "Cross Correlation"
+                        ? Pair::Algo::CROSS_CORRELATION
+                        : Pair::Algo::THRESHOLD;
+        pair.data1.clear();
+        pair.data2.clear();
+        pair.cross1 = 0ns;
+        pair.cross2 = 0ns;
+        pair.job = 0;
       }
     }
   }
@@ -9,7 +9,7 @@ using namespace thalamus;
 struct TestPulseNode::Impl {
   ObservableDictPtr state;
   boost::signals2::scoped_connection state_connection;
-  boost::signals2::scoped_connection source_connection;
+  ScopedConnection source_connection;
   boost::signals2::scoped_connection get_input_connection;
   boost::signals2::scoped_connection get_output_connection;
   NodeGraph *graph;
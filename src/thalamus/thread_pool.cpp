@@ -22,6 +22,9 @@ void ThreadPool::thread_target(std::string thread_name) {
     {
       std::unique_lock<std::mutex> lock(mutex);
       --num_busy_threads;
+      if (num_busy_threads == 0 && jobs.empty()) {
+        idle_condition.notify_all();
+      }
       condition.wait(lock, [&]() { return !running || !jobs.empty(); });
       ++num_busy_threads;
       if (!running) {
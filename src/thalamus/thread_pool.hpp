@@ -5,6 +5,7 @@
 #include <condition_variable>
 #include <functional>
 #include <list>
+#include <map>
 #include <mutex>
 #include <thread>
 #include <vector>
@@ -15,6 +16,8 @@ class ThreadPool : public std::enable_shared_from_this<ThreadPool> {
   std::vector<std::thread> threads;
   std::list<std::function<void()>> jobs;
   std::condition_variable condition;
+  std::condition_variable idle_condition;
+  std::map<const Node *, size_t> dropped;
   mutable std::mutex mutex;
   const std::string name;
 
@@ -39,6 +42,31 @@ public:
     return int(num_threads - num_busy_threads);
   }
 
+  /**
+   * Blocks until every pushed job has finished.  Returns immediately if the
+   * pool isn't running.
+   */
+  void wait_idle() {
+    std::unique_lock<std::mutex> lock(mutex);
+    idle_condition.wait(lock, [&] {
+      return !running || (jobs.empty() && num_busy_threads == 0);
+    });
+  }
+
+  /**
+   * Records that node dropped work because the pool was full.
+   */
+  void count_drop(const Node *node) {
+    std::lock_guard<std::mutex> lock(mutex);
+    ++dropped[node];
+  }
+
+  size_t drops(const Node *node) const {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto i = dropped.find(node);
+    return i == dropped.end() ? 0 : i->second;
+  }
+
   void push(std::function<void()> &&job) {
     std::lock_guard<std::mutex> lock(mutex);
     jobs.push_back(job);
@@ -84,6 +112,7 @@ public:
       }
       running = false;
       condition.notify_all();
+      idle_condition.notify_all();
     }
     for (auto &t : threads) {
       t.join();
@@ -1,5 +1,10 @@
 #include <thalamus/tracing.hpp>
 #include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <thalamus/async.hpp>
 #include <thalamus/modalities_util.hpp>
 #include <thalamus/thread.hpp>
 #include <thalamus/video_node.hpp>
@@ -89,7 +94,199 @@ struct VideoNode::Impl {
 
   static std::atomic_int frame_id;
 
-  void ffmpeg_target(const std::string input_name) {
+  struct DecodedFrame {
+    std::shared_ptr<AVFrame> frame;
+    std::chrono::nanoseconds pts;
+    int bits;
+    unsigned int epoch;
+  };
+
+  // Decoded frames waiting for their presentation time.  The decode thread
+  // fills it up to prefetch_frames ahead of the presentation thread.
+  std::mutex ring_mutex;
+  std::condition_variable ring_condition;
+  std::deque<DecodedFrame> ring;
+  size_t prefetch_frames = 8;
+  bool decode_finished = false;
+  unsigned int epoch = 0;
+  std::atomic<double> seek_target = -1;
+  std::shared_ptr<AVFrame> current_frame;
+  double buffered_frames = 0;
+
+  bool set_planes(AVFrame *frame) {
+    data.clear();
+    auto chroma_height = (frame->height + 1) / 2;
+    switch (frame->format) {
+    case AV_PIX_FMT_GRAY8:
+      format = Format::Gray;
+      data.emplace_back(frame->data[0],
+                        frame->data[0] + frame->height * frame->linesize[0]);
+      break;
+    case AV_PIX_FMT_RGB24:
+      format = Format::RGB;
+      data.emplace_back(frame->data[0],
+                        frame->data[0] + frame->height * frame->linesize[0]);
+      break;
+    case AV_PIX_FMT_YUYV422:
+      format = Format::YUYV422;
+      data.emplace_back(frame->data[0],
+                        frame->data[0] + frame->height * frame->linesize[0]);
+      break;
+    case AV_PIX_FMT_YUVJ420P:
+    case AV_PIX_FMT_YUV420P:
+      format = frame->format == AV_PIX_FMT_YUVJ420P ? Format::YUVJ420P
+                                                    : Format::YUV420P;
+      data.emplace_back(frame->data[0],
+                        frame->data[0] + frame->height * frame->linesize[0]);
+      data.emplace_back(frame->data[1],
+                        frame->data[1] + chroma_height * frame->linesize[1]);
+      data.emplace_back(frame->data[2],
+                        frame->data[2] + chroma_height * frame->linesize[2]);
+      break;
+    default:
+      return false;
+    }
+    return true;
+  }
+
+  /**
+   * Reads and decodes packets into the prefetch ring.  Runs on its own thread
+   * so that decoding the next frames overlaps with waiting on the current
+   * frame's presentation time.
+   */
+  void decode_target(VideoContext &context, int stream_index) {
+    set_current_thread_name("FFMPEG Decode");
+    auto stream = context.format_context->streams[stream_index];
+    auto time_base = stream->time_base;
+
+    // Keyframe timestamps, seeded from the container index and extended with
+    // every keyframe packet we read.
+    std::set<int64_t> keyframes;
+    auto index_entries = avformat_index_get_entries_count(stream);
+    for (auto i = 0; i < index_entries; ++i) {
+      auto entry = avformat_index_get_entry(stream, i);
+      if (entry->flags & AVINDEX_KEYFRAME) {
+        keyframes.insert(entry->timestamp);
+      }
+    }
+
+    auto last_timestamp = 0ll;
+    auto to_nanoseconds = [&](int64_t ts) {
+      if (ts == AV_NOPTS_VALUE) {
+        ts = last_timestamp;
+      }
+      last_timestamp = ts;
+      return std::chrono::nanoseconds(
+          av_rescale_q(ts, time_base, AVRational{1, 1'000'000'000}));
+    };
+
+    auto push = [&](std::shared_ptr<AVFrame> frame, int bits) {
+      std::unique_lock<std::mutex> lock(ring_mutex);
+      ring_condition.wait(lock, [&] {
+        return ring.size() < prefetch_frames || !running ||
+               seek_target >= 0;
+      });
+      if (!running || seek_target >= 0) {
+        return;
+      }
+      ring.push_back(DecodedFrame{frame,
+                                  to_nanoseconds(frame->best_effort_timestamp),
+                                  bits, epoch});
+      ring_condition.notify_all();
+    };
+
+    auto receive = [&](int bits) {
+      while (true) {
+        auto frame = std::shared_ptr<AVFrame>(
+            av_frame_alloc(), [](AVFrame *self) { av_frame_free(&self); });
+        int err;
+        {
+          TRACE_EVENT("thalamus", "avcodec_receive_frame");
+          err = avcodec_receive_frame(context.codec, frame.get());
+        }
+        if (err == AVERROR(EAGAIN) || err == AVERROR_EOF) {
+          return true;
+        } else if (err < 0) {
+          THALAMUS_LOG(error)
+              << "Failed to receive decode frame, stopping Video capture";
+          return false;
+        }
+        if (frame->pict_type == AV_PICTURE_TYPE_NONE) {
+          continue;
+        }
+        push(frame, bits);
+        bits = 0;
+      }
+    };
+
+    auto finish = [&] {
+      std::lock_guard<std::mutex> lock(ring_mutex);
+      decode_finished = true;
+      ring_condition.notify_all();
+    };
+
+    while (running) {
+      double seek_seconds = seek_target.exchange(-1);
+      if (seek_seconds >= 0) {
+        TRACE_EVENT("thalamus", "VideoNode::seek");
+        auto target = int64_t(seek_seconds * time_base.den / time_base.num);
+        auto keyframe = keyframes.upper_bound(target);
+        if (keyframe != keyframes.begin()) {
+          target = *std::prev(keyframe);
+        }
+        auto err = av_seek_frame(context.format_context, stream_index, target,
+                                 AVSEEK_FLAG_BACKWARD);
+        if (err < 0) {
+          THALAMUS_LOG(warning) << "Failed to seek to " << seek_seconds << "s";
+        }
+        avcodec_flush_buffers(context.codec);
+        std::lock_guard<std::mutex> lock(ring_mutex);
+        ring.clear();
+        ++epoch;
+        ring_condition.notify_all();
+      }
+
+      int err;
+      {
+        TRACE_EVENT("thalamus", "av_read_frame");
+        err = av_read_frame(context.format_context, context.packet);
+      }
+      if (err < 0) {
+        avcodec_send_packet(context.codec, nullptr);
+        receive(0);
+        finish();
+        return;
+      }
+      if (context.packet->stream_index != stream_index) {
+        av_packet_unref(context.packet);
+        continue;
+      }
+      if (context.packet->flags & AV_PKT_FLAG_KEY &&
+          context.packet->pts != AV_NOPTS_VALUE) {
+        keyframes.insert(context.packet->pts);
+      }
+
+      auto bits = 8 * context.packet->size;
+      {
+        TRACE_EVENT("thalamus", "avcodec_send_packet");
+        err = avcodec_send_packet(context.codec, context.packet);
+      }
+      av_packet_unref(context.packet);
+      if (err < 0) {
+        THALAMUS_LOG(error) << "Failed to decode frame, stopping Video capture";
+        finish();
+        return;
+      }
+      if (!receive(bits)) {
+        finish();
+        return;
+      }
+    }
+    finish();
+  }
+
+  void ffmpeg_target(const std::string input_name, int decoder_threads,
+                     std::string decoder_thread_type) {
     set_current_thread_name("FFMPEG");
     VideoContext context;
     context.format_context = avformat_alloc_context();
@@ -113,7 +310,6 @@ struct VideoNode::Impl {
         context.codec, context.format_context->streams[stream_index]->codecpar);
     context.codec->pkt_timebase =
         context.format_context->streams[stream_index]->time_base;
-    auto time_base = context.codec->pkt_timebase;
     auto av_frame_rate =
         context.format_context->streams[stream_index]->avg_frame_rate;
     std::chrono::nanoseconds new_frame_interval(
@@ -132,8 +328,14 @@ struct VideoNode::Impl {
         return;
       }
 
-      if (!av_dict_get(sub_context.options, "threads", nullptr, 0))
-        av_dict_set(&sub_context.options, "threads", "auto", 0);
+      if (!av_dict_get(sub_context.options, "threads", nullptr, 0)) {
+        av_dict_set(&sub_context.options, "threads",
+                    decoder_threads > 0 ? std::to_string(decoder_threads).c_str()
+                                        : "auto",
+                    0);
+      }
+      av_dict_set(&sub_context.options, "thread_type",
+                  decoder_thread_type.c_str(), 0);
 
       av_dict_set(&sub_context.options, "flags", "+copy_opaque",
                   AV_DICT_MULTIKEY);
@@ -147,192 +349,147 @@ struct VideoNode::Impl {
 
     context.packet = av_packet_alloc();
 
+    {
+      std::lock_guard<std::mutex> lock(ring_mutex);
+      ring.clear();
+      decode_finished = false;
+    }
+    std::thread decode_thread(std::bind(&Impl::decode_target, this,
+                                        std::ref(context), stream_index));
+    Finally join_decoder([&] {
+      {
+        std::lock_guard<std::mutex> lock(ring_mutex);
+        ring_condition.notify_all();
+      }
+      decode_thread.join();
+    });
+
     auto stop = [this] { (*state)["Running"].assign(false, [&] {}); };
-    int64_t start_pts = -1;
+    auto start_pts = std::chrono::nanoseconds(-1);
     auto start_time = std::chrono::steady_clock::now();
+    auto presented_epoch = 0u;
     std::set<std::chrono::steady_clock::time_point> frame_times;
     std::set<std::pair<std::chrono::steady_clock::time_point, int>> time_bits;
     while (running) {
       TRACE_EVENT("thalamus", "loop");
+      DecodedFrame next;
+      size_t buffered;
       {
-        TRACE_EVENT("thalamus", "av_read_frame");
-        err = av_read_frame(context.format_context, context.packet);
-      }
-      if (err < 0) {
-        THALAMUS_LOG(error) << "Failed to read frame, stopping Video capture";
-        boost::asio::post(io_context, stop);
-        return;
-      }
-      if (context.packet->stream_index != stream_index) {
-#ifdef __clang__
-        TRACE_EVENT_INSTANT("thalamus", "wrong stream");
-#endif
-        av_packet_unref(context.packet);
-        continue;
+        std::unique_lock<std::mutex> lock(ring_mutex);
+        ring_condition.wait(lock, [&] {
+          return !ring.empty() || decode_finished || !running;
+        });
+        if (!running) {
+          break;
+        }
+        if (ring.empty()) {
+          THALAMUS_LOG(info) << "End of video, stopping Video capture";
+          boost::asio::post(io_context, stop);
+          break;
+        }
+        next = std::move(ring.front());
+        ring.pop_front();
+        buffered = ring.size();
+        ring_condition.notify_all();
       }
 
       auto now = std::chrono::steady_clock::now();
-      time_bits.emplace(now, 8 * context.packet->size);
+      time_bits.emplace(now, next.bits);
 
-      auto sleep_time = 0ns;
-      if (start_pts < 0) {
-        start_pts = context.packet->pts;
+      if (start_pts.count() < 0 || next.epoch != presented_epoch) {
+        start_pts = next.pts;
         start_time = now;
+        presented_epoch = next.epoch;
       } else {
-        auto pts =
-            1'000'000'000 * (context.packet->pts - start_pts) * time_base.num;
-        pts /= time_base.den;
-        auto target = start_time + std::chrono::nanoseconds(pts);
-        sleep_time = target - now;
+        auto target = start_time + (next.pts - start_pts);
         if (now < target) {
           TRACE_EVENT("thalamus", "sleep_for");
           std::this_thread::sleep_for(target - now);
+          now = std::chrono::steady_clock::now();
         }
       }
 
-      {
-        TRACE_EVENT("thalamus", "avcodec_send_packet");
-        err = avcodec_send_packet(context.codec, context.packet);
+      if (frame_pending) {
+        continue;
       }
-      if (err < 0) {
-        THALAMUS_LOG(error) << "Failed to decode frame, stopping Video capture";
+
+      auto id = get_unique_id();
+      TRACE_EVENT_BEGIN("thalamus", "read frame",
+                        perfetto::Flow::ProcessScoped(id));
+      if (!set_planes(next.frame.get())) {
+        TRACE_EVENT_END("thalamus");
+        THALAMUS_LOG(error)
+            << "Unsupported pixel format: " << next.frame->format;
         boost::asio::post(io_context, stop);
-        return;
+        break;
       }
-      av_packet_unref(context.packet);
 
-      while (true) {
-        auto id = get_unique_id();
-        TRACE_EVENT_BEGIN("thalamus", "read frame",
-                          perfetto::Flow::ProcessScoped(id));
-        {
-          TRACE_EVENT("thalamus", "avcodec_receive_frame");
-          err = avcodec_receive_frame(context.codec, context.frame.get());
-        }
-        if (err == AVERROR(EAGAIN)) {
-          TRACE_EVENT_END("thalamus");
-          break;
-        } else if (err < 0) {
-          TRACE_EVENT_END("thalamus");
-          THALAMUS_LOG(error)
-              << "Failed to receive decode frame, stopping Video capture";
-          boost::asio::post(io_context, stop);
-          return;
-        }
-
-        if (frame_pending || context.frame->pict_type == AV_PICTURE_TYPE_NONE) {
-          TRACE_EVENT_END("thalamus");
-          continue;
-        }
-
-        data.clear();
-        switch (context.frame->format) {
-        case AV_PIX_FMT_GRAY8:
-          format = Format::Gray;
-          data.emplace_back(context.frame->data[0],
-                            context.frame->data[0] +
-                                context.frame->height *
-                                    context.frame->linesize[0]);
-          break;
-        case AV_PIX_FMT_RGB24:
-          format = Format::RGB;
-          data.emplace_back(context.frame->data[0],
-                            context.frame->data[0] +
-                                context.frame->height *
-                                    context.frame->linesize[0]);
-          break;
-        case AV_PIX_FMT_YUYV422:
-          format = Format::YUYV422;
-          data.emplace_back(context.frame->data[0],
-                            context.frame->data[0] +
-                                context.frame->height *
-                                    context.frame->linesize[0]);
-          break;
-        case AV_PIX_FMT_YUVJ420P:
-          format = Format::YUVJ420P;
-          data.emplace_back(context.frame->data[0],
-                            context.frame->data[0] +
-                                context.frame->height *
-                                    context.frame->linesize[0]);
-          data.emplace_back(context.frame->data[1],
-                            context.frame->data[1] +
-                                context.frame->height / 2 *
-                                    context.frame->linesize[1]);
-          data.emplace_back(context.frame->data[2],
-                            context.frame->data[2] +
-                                context.frame->height / 2 *
-                                    context.frame->linesize[2]);
-          break;
-        case AV_PIX_FMT_YUV420P:
-          format = Format::YUV420P;
-          data.emplace_back(context.frame->data[0],
-                            context.frame->data[0] +
-                                context.frame->height *
-                                    context.frame->linesize[0]);
-          data.emplace_back(context.frame->data[1],
-                            context.frame->data[1] +
-                                context.frame->height / 2 *
-                                    context.frame->linesize[1]);
-          data.emplace_back(context.frame->data[2],
-                            context.frame->data[2] +
-                                context.frame->height / 2 *
-                                    context.frame->linesize[2]);
-          break;
-        default:
-          TRACE_EVENT_END("thalamus");
-          THALAMUS_LOG(error)
-              << "Unsupported pixel format: " << context.frame->format;
-          boost::asio::post(io_context, stop);
-          return;
-        }
-
-        while (!frame_times.empty() && now - *frame_times.begin() > 1s) {
-          frame_times.erase(frame_times.begin());
-        }
-        frame_times.insert(now);
-
-        while (!time_bits.empty() && now - time_bits.begin()->first > 1s) {
-          time_bits.erase(time_bits.begin());
-        }
-
-        auto new_bps =
-            std::accumulate(time_bits.begin(), time_bits.end(), 0.0,
-                            [](auto a, auto b) { return a + b.second; });
-
-        width = size_t(context.frame->width);
-        height = size_t(context.frame->height);
+      while (!frame_times.empty() && now - *frame_times.begin() > 1s) {
+        frame_times.erase(frame_times.begin());
+      }
+      frame_times.insert(now);
 
-        auto frame_copy = context.frame;
-        context.new_frame();
-        frame_pending = true;
-        TRACE_EVENT_END("thalamus");
-        boost::asio::post(io_context, [&, now, frame_copy,
-                                       new_framerate = frame_times.size(),
-                                       new_bps, id] {
-          TRACE_EVENT("thalamus", "VideoNode Post Main",
-                      perfetto::TerminatingFlow::ProcessScoped(id));
-          this->time = now.time_since_epoch();
-          this->has_image = true;
-          this->has_analog = true;
-          this->framerate = double(new_framerate);
-          this->bps = new_bps;
-          frame_pending = false;
-          TRACE_EVENT("thalamus", "VideoNode_ready");
-          outer->ready(outer);
-        });
+      while (!time_bits.empty() && now - time_bits.begin()->first > 1s) {
+        time_bits.erase(time_bits.begin());
       }
+
+      auto new_bps =
+          std::accumulate(time_bits.begin(), time_bits.end(), 0.0,
+                          [](auto a, auto b) { return a + b.second; });
+
+      width = size_t(next.frame->width);
+      height = size_t(next.frame->height);
+
+      frame_pending = true;
+      TRACE_EVENT_END("thalamus");
+      boost::asio::post(io_context, [&, now, frame_copy = next.frame,
+                                     new_framerate = frame_times.size(),
+                                     new_bps, buffered, id] {
+        TRACE_EVENT("thalamus", "VideoNode Post Main",
+                    perfetto::TerminatingFlow::ProcessScoped(id));
+        this->time = now.time_since_epoch();
+        this->has_image = true;
+        this->has_analog = true;
+        this->framerate = double(new_framerate);
+        this->bps = new_bps;
+        this->buffered_frames = double(buffered);
+        current_frame = frame_copy;
+        frame_pending = false;
+        TRACE_EVENT("thalamus", "VideoNode_ready");
+        outer->ready(outer);
+      });
     }
   }
 
   void start() {
     std::string filename =
         state->contains("File Name") ? state->at("File Name") : std::string();
+    int64_t decoder_threads =
+        state->contains("Decoder Threads") ? state->at("Decoder Threads")
+                                           : int64_t(0);
+    std::string threading = state->contains("Decoder Threading")
+                                ? state->at("Decoder Threading")
+                                : std::string("Slice and Frame");
+    int64_t prefetch = state->contains("Prefetch Frames")
+                           ? state->at("Prefetch Frames")
+                           : int64_t(8);
+    prefetch_frames = size_t(std::max(prefetch, int64_t(1)));
+    std::string thread_type = "slice+frame";
+    if (threading == "Slice") {
+      thread_type = "slice";
+    } else if (threading == "Frame") {
+      thread_type = "frame";
+    }
 
-    ffmpeg_thread =
-        std::thread(std::bind(&Impl::ffmpeg_target, this, filename));
+    ffmpeg_thread = std::thread(std::bind(&Impl::ffmpeg_target, this, filename,
+                                          int(decoder_threads), thread_type));
   }
 
   void stop() {
+    {
+      std::lock_guard<std::mutex> lock(ring_mutex);
+      ring_condition.notify_all();
+    }
     if (ffmpeg_thread.joinable()) {
       ffmpeg_thread.join();
     }
@@ -349,6 +506,13 @@ struct VideoNode::Impl {
       } else {
         stop();
       }
+    } else if (key_str == "Seek") {
+      auto seconds = std::holds_alternative<double>(v)
+                         ? std::get<double>(v)
+                         : double(std::get<int64_t>(v));
+      seek_target = std::max(seconds, 0.0);
+      std::lock_guard<std::mutex> lock(ring_mutex);
+      ring_condition.notify_all();
     }
   }
 };
@@ -391,11 +555,14 @@ std::span<const double> VideoNode::data(int index) const {
     return std::span<const double>(&impl->framerate, &impl->framerate + 1);
   } else if (index == 1) {
     return std::span<const double>(&impl->bps, &impl->bps + 1);
+  } else if (index == 2) {
+    return std::span<const double>(&impl->buffered_frames,
+                                   &impl->buffered_frames + 1);
   }
   return {};
 }
 
-int VideoNode::num_channels() const { return 2; }
+int VideoNode::num_channels() const { return 3; }
 
 std::chrono::nanoseconds VideoNode::sample_interval(int) const {
   return impl->frame_interval;
@@ -406,6 +573,8 @@ std::string_view VideoNode::name(int channel) const {
     return "Framerate";
   } else if (channel == 1) {
     return "BPS";
+  } else if (channel == 2) {
+    return "Buffered Frames";
   }
   return "";
 }
@@ -231,6 +231,47 @@ class DataFrameTest(unittest.TestCase):
       numpy.testing.assert_array_equal(df.one.to_numpy(), numpy.array([1, 3]))
       numpy.testing.assert_array_equal(df.two.to_numpy(), numpy.array([2, 4]))
 
+  @unittest.skipIf(thalamus.dataframe._record_reader is None, 'native record reader not built')
+  def test_native_read(self):
+    with tempfile.NamedTemporaryFile() as temp_file:
+      record = StorageRecord(
+        node='This',
+        time=2,
+        analog=AnalogResponse(
+          data = [1, 2, 3, 4, 10, 11],
+          spans=[
+            Span(name='one', begin=0, end=2), Span(name='two', begin=2, end=4), Span(name='three', begin=10, end=11)
+          ],
+          sample_intervals=[2, 2, 2],
+          time=2
+        )
+      )
+      write_record(temp_file, record)
+      record.time += 4
+      record.analog.time += 4
+      record.analog.data[:] = [5, 6, 7, 8]
+      write_record(temp_file, record)
+      record.node='That'
+      write_record(temp_file, record)
+      write_record(temp_file, StorageRecord(node='This',text=Text(text='One', time=3)))
+      temp_file.flush()
+
+      builder = DataFrameBuilder('This', DataFrameBuilder.Type.Analog, 'one|two')
+      builder.read(temp_file.name)
+      df = builder.build()
+
+      numpy.testing.assert_array_equal(df.index.to_numpy(), numpy.array([0, 2, 4, 6]))
+      numpy.testing.assert_array_equal(df.one.to_numpy(), numpy.array([1, 2, 5, 6]))
+      numpy.testing.assert_array_equal(df.two.to_numpy(), numpy.array([3, 4, 7, 8]))
+      self.assertNotIn('three', df.columns)
+
+      builder = DataFrameBuilder('This', DataFrameBuilder.Type.Text)
+      builder.read(temp_file.name)
+      df = builder.build()
+
+      numpy.testing.assert_array_equal(df.index.to_numpy(), numpy.array([3]))
+      numpy.testing.assert_array_equal(df.text.to_list(), ['One'])
+
   def test_main_analog(self):
     with tempfile.NamedTemporaryFile() as temp_file:
       record = StorageRecord(
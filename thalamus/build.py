@@ -274,7 +274,7 @@ def build_wheel(wheel_directory, config_settings=None, metadata_directory=None):
       is_dir = not path.is_file()
       in_ignored_dir = any(d in ("__pycache__", '.vs') for d in parents)
       has_ignored_suffix = path.suffix not in ('.py', '.pyi', '.vert', '.proto', '.comp', '.frag', '.exe', '.h', '.wav')
-      is_native_executable = path.stem == 'native'
+      is_native_executable = path.stem == 'native' or path.name.startswith('_record_reader.')
       is_crashpad_handler = path.stem == 'crashpad_handler'
       is_dotnet_file = "dotnet" in parents
       if is_dir or in_ignored_dir or has_ignored_suffix and not is_native_executable and not is_crashpad_handler and not is_dotnet_file:
@@ -0,0 +1,118 @@
+"""
+Expands Storage2Node's columnar analog capture (AnalogSchema/AnalogBlock records)
+back into per-update analog records so readers see the same records as a
+row-oriented capture.
+"""
+import zlib
+import typing
+
+import numpy
+
+from thalamus.thalamus_pb2 import StorageRecord, AnalogSchema
+
+DTYPES = {
+  AnalogSchema.SampleType.FLOAT64: numpy.dtype('<f8'),
+  AnalogSchema.SampleType.INT16: numpy.dtype('<i2'),
+  AnalogSchema.SampleType.INT32: numpy.dtype('<i4'),
+  AnalogSchema.SampleType.UINT64: numpy.dtype('<u8'),
+}
+
+class ColumnarExpander:
+  """
+  Storage2Node writes every channel's block of a flush together, so a node's
+  blocks are buffered until every channel has one, a channel repeats or the
+  node's schema changes, and then merged into one record per update with a
+  span for every channel, in the order the updates happened.
+  """
+  def __init__(self):
+    self.schemas: typing.Dict[int, AnalogSchema] = {}
+    self.pending: typing.Dict[str, typing.Tuple[int, typing.Dict[int, typing.Any]]] = {}
+
+  def feed(self, record: StorageRecord) -> typing.List[StorageRecord]:
+    """
+    Returns the records to hand to the caller in place of record: the updates
+    of any flush it completes for a schema or block, and record itself otherwise.
+    """
+    body_type = record.WhichOneof('body')
+    if body_type == 'analog_schema':
+      result = self.expand(record.node)
+      self.schemas[record.analog_schema.id] = record.analog_schema
+      return result
+    elif body_type != 'analog_block':
+      return [record]
+
+    block = record.analog_block
+    schema = self.schemas.get(block.schema)
+    if schema is None or block.channel >= len(schema.channels):
+      print('Analog block references unknown schema', block.schema)
+      return []
+
+    result = []
+    pending = self.pending.get(record.node)
+    if pending is not None and (pending[0] != block.schema or block.channel in pending[1]):
+      result = self.expand(record.node)
+    _, blocks = self.pending.setdefault(record.node, (block.schema, {}))
+    blocks[block.channel] = block
+    if len(blocks) == len(schema.channels):
+      result.extend(self.expand(record.node))
+    return result
+
+  def flush(self) -> typing.List[StorageRecord]:
+    """
+    Returns the updates of every node's buffered blocks, for the end of the capture.
+    """
+    result = []
+    for node in list(self.pending):
+      result.extend(self.expand(node))
+    return result
+
+  def expand(self, node: str) -> typing.List[StorageRecord]:
+    if node not in self.pending:
+      return []
+    schema_id, blocks = self.pending.pop(node)
+    schema = self.schemas[schema_id]
+    dtype = DTYPES[schema.sample_type]
+    columns = []
+    for c, channel in enumerate(schema.channels):
+      block = blocks.get(c)
+      if block is None:
+        columns.append((channel, [], [], [], numpy.zeros(0, dtype=dtype)))
+        continue
+      data = zlib.decompress(block.data) if block.compressed else block.data
+      columns.append((channel, list(block.chunk_ends), list(block.chunk_times),
+                      list(block.chunk_remote_times), numpy.frombuffer(data, dtype=dtype)))
+
+    cursors = [0]*len(columns)
+    begins = [0]*len(columns)
+    result = []
+    while True:
+      times = [column[2][cursors[i]] for i, column in enumerate(columns) if cursors[i] < len(column[1])]
+      if not times:
+        break
+      now = min(times)
+      expanded = StorageRecord(node=node, time=now)
+      analog = expanded.analog
+      analog.time = now
+      analog.is_transformed = schema.is_transformed
+      is_int = schema.sample_type in (AnalogSchema.SampleType.INT16, AnalogSchema.SampleType.INT32)
+      is_ulong = schema.sample_type == AnalogSchema.SampleType.UINT64
+      analog.is_int_data = is_int
+      analog.is_ulong_data = is_ulong
+      output = analog.int_data if is_int else analog.ulong_data if is_ulong else analog.data
+      for i, (channel, ends, chunk_times, remote_times, samples) in enumerate(columns):
+        k = cursors[i]
+        values = []
+        if k < len(ends) and chunk_times[k] == now:
+          values = samples[begins[i]:ends[k]].tolist()
+          if k < len(remote_times):
+            analog.remote_time = remote_times[k]
+          begins[i] = ends[k]
+          cursors[i] += 1
+        span = analog.spans.add(begin=len(output), end=len(output) + len(values), name=channel.name)
+        if schema.is_transformed:
+          span.scale = channel.scale
+          span.offset = channel.offset
+        analog.sample_intervals.append(channel.sample_interval)
+        output.extend(values)
+      result.append(expanded)
+    return result
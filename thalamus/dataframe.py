@@ -13,6 +13,11 @@ from pprint import pformat
 
 from .record_reader2 import RecordReader
 
+try:
+  from . import _record_reader
+except ImportError:
+  _record_reader = None
+
 class DataFrameBuilder:
   class Type(enum.Enum):
     Analog = enum.auto()
@@ -32,15 +37,17 @@ class DataFrameBuilder:
     self.text_time = []
     self.text = []
     self.warn = warn
+    self.index = None
 
   def build(self):
     if self.__type == DataFrameBuilder.Type.Analog:
-      if not self.counts:
+      if self.index is not None:
+        self.data['counter'] = self.index
+      elif not self.counts:
         return pandas.DataFrame({'counter': []})
-      
-      interpolated_times = numpy.interp(numpy.arange(0, self.counts[-1]+1), self.counts, self.times).astype(int)
-
-      self.data['counter'] = interpolated_times
+      else:
+        interpolated_times = numpy.interp(numpy.arange(0, self.counts[-1]+1), self.counts, self.times).astype(int)
+        self.data['counter'] = interpolated_times
       #print(self.counts)
       #print(self.times)
       #pprint({k: len(v) for k, v in self.data.items()})
@@ -60,6 +67,45 @@ class DataFrameBuilder:
     else:
       return pandas.DataFrame({'counter': []})
 
+  def read(self, path: pathlib.Path):
+    """
+    Reads the node's data from a capture file.  Uses the native reader when the
+    _record_reader extension is available, which decompresses and splits the
+    capture in C++ without holding the GIL, and falls back to update otherwise.
+    """
+    if _record_reader is None:
+      with RecordReader(path) as reader:
+        for record in reader:
+          self.update(record)
+      return
+
+    is_analog = self.__type == DataFrameBuilder.Type.Analog
+    is_text = self.__type == DataFrameBuilder.Type.Text
+    captured = _record_reader.read(path, nodes=[self.node], channels=self.channel_pattern, analog=is_analog, text=is_text)
+    node = captured.get(self.node)
+    if node is None:
+      return
+
+    if is_analog and node['analog']:
+      for name, channel in node['analog'].items():
+        sample_interval = channel['sample_interval']
+        if self.ref_interval is None:
+          self.ref_interval = sample_interval
+          self.index = channel['time']
+        self.sample_intervals[name] = sample_interval
+        self.data[name] = channel['data']
+      if len(set(self.sample_intervals.values())) > 1:
+        formatted = pformat(self.sample_intervals)
+        message = (f'All Channels must have the same sample interval.  Expected {self.ref_interval}. '
+                   f'Filter out channels with the channel_pattern parameter.  Got:\n{formatted}')
+        if self.warn:
+          warnings.warn(message)
+        else:
+          raise ValueError(message)
+    elif is_text:
+      self.text_time = node['text_time']
+      self.text = node['text']
+
   def update(self, record):
     if record.node != self.node:
       return False
@@ -153,9 +199,7 @@ def main(argv):
     data_type = DataFrameBuilder.Type.Text
   
   builder = DataFrameBuilder(args.node, data_type, args.channels)
-  with RecordReader(args.input) as reader:
-    for record in reader:
-      builder.update(record)
+  builder.read(args.input)
 
   dataframe = builder.build()
   output = args.output if args.output is not None else default_output(args.format, args.input)
@@ -0,0 +1,71 @@
+"""
+Wraps encoded video packets in a streamable Matroska container.  Codecs such
+as FFV1 have no raw bitstream format, so ffmpeg can only read their packets
+from a pipe inside a container that carries the packet boundaries and the
+codec's extradata.
+"""
+import struct
+import typing
+
+from thalamus.thalamus_pb2 import Image
+
+CODEC_IDS = {
+  Image.Format.FFV1: 'V_FFV1',
+}
+
+UNKNOWN_SIZE = b'\x01\xff\xff\xff\xff\xff\xff\xff'
+
+def _element(id: int, payload: bytes) -> bytes:
+  # Sizes are always written as 8 byte vints, which every reader accepts
+  return id.to_bytes((id.bit_length() + 7) // 8, 'big') + b'\x01' + len(payload).to_bytes(7, 'big') + payload
+
+def _uint(id: int, value: int) -> bytes:
+  return _element(id, value.to_bytes(max(1, (value.bit_length() + 7) // 8), 'big'))
+
+def _string(id: int, value: str) -> bytes:
+  return _element(id, value.encode())
+
+class MatroskaWriter:
+  """
+  Writes one video track to output.  Every packet goes in its own cluster
+  and is marked as a keyframe, which holds for the intra only codecs in
+  CODEC_IDS.  Times are in nanoseconds and are stored in microseconds
+  relative to the first packet, clamped so they never go backwards.
+  """
+  def __init__(self, output: typing.BinaryIO, image: Image):
+    self.output = output
+    self.first_time: typing.Optional[int] = None
+    self.last_timestamp = 0
+    header = _element(0x1A45DFA3,
+      _uint(0x4286, 1) +
+      _uint(0x42F7, 1) +
+      _uint(0x42F2, 4) +
+      _uint(0x42F3, 8) +
+      _string(0x4282, 'matroska') +
+      _uint(0x4287, 4) +
+      _uint(0x4285, 2))
+    info = _element(0x1549A966,
+      _uint(0x2AD7B1, 1000) +
+      _string(0x4D80, 'thalamus') +
+      _string(0x5741, 'thalamus'))
+    video = _element(0xE0, _uint(0xB0, image.width) + _uint(0xBA, image.height))
+    track = (_uint(0xD7, 1) +
+             _uint(0x73C5, 1) +
+             _uint(0x83, 1) +
+             _string(0x86, CODEC_IDS[image.format]))
+    if image.codec_extradata:
+      track += _element(0x63A2, image.codec_extradata)
+    track += video
+    tracks = _element(0x1654AE6B, _element(0xAE, track))
+    # The segment's size is unknown since it is written as the capture is read
+    output.write(header + bytes.fromhex('18538067') + UNKNOWN_SIZE + info + tracks)
+
+  def write(self, packet: bytes, time: int):
+    if not packet:
+      return
+    if self.first_time is None:
+      self.first_time = time
+    timestamp = max(self.last_timestamp, (time - self.first_time) // 1000)
+    self.last_timestamp = timestamp
+    block = b'\x81' + struct.pack('>hB', 0, 0x80) + packet
+    self.output.write(_element(0x1F43B675, _uint(0xE7, timestamp) + _element(0xA3, block)))
@@ -80,7 +80,8 @@ class Storage2Widget(QWidget):
       'Time Series',
       'Image',
       'Motion',
-      'Text'
+      'Text',
+      'Shard'
     ]
 
     if 'Files' not in config:
@@ -123,7 +124,8 @@ class Storage2Widget(QWidget):
         'Time Series': True,
         'Image': True,
         'Motion': True,
-        'Text': True
+        'Text': True,
+        'Shard': 0
       })
 
     def on_remove():
@@ -78,6 +78,10 @@ class Delegate(TreeObservableCollectionDelegate):
       combo = QComboBox(parent)
       combo.setModel(self.node_model)
       return combo
+    elif key == 'Algorithm':
+      combo = QComboBox(parent)
+      combo.addItems(['Threshold', 'Cross Correlation'])
+      return combo
     else:
       return super().createEditor(parent, option, index)
 
@@ -131,6 +135,7 @@ class SyncWidget(QWidget):
         'Channel 2': '',
         'Window (s)': .5,
         'Threshold': .5,
+        'Algorithm': 'Threshold',
       })
     add_button.clicked.connect(on_add)
 
@@ -146,7 +151,7 @@ class SyncWidget(QWidget):
 
   def __prepare(self, pairs: ObservableList):
     self.pairs = pairs
-    model = TreeObservableCollectionModel(pairs, key_column='#', columns=['Node 1', 'Channel 1', 'Node 2', 'Channel 2', 'Window (s)', 'Threshold'],
+    model = TreeObservableCollectionModel(pairs, key_column='#', columns=['Node 1', 'Channel 1', 'Node 2', 'Channel 2', 'Window (s)', 'Threshold', 'Algorithm'],
                                           show_extra_values=False,
                                           is_editable = lambda o, k: True)
     delegate = Delegate(self.nodes, self.stub, model)
@@ -304,6 +304,26 @@ FACTORIES = {
     UserData(UserDataType.SAVE_FILE, 'Output File', 'test.tha', []),
     UserData(UserDataType.CHECK_BOX, 'Compress Analog', False, []),
     UserData(UserDataType.CHECK_BOX, 'Compress Video', True, []),
+    UserData(UserDataType.COMBO_BOX, 'Video Codec', 'MPEG4', ['MPEG4', 'FFV1', 'H.264 Lossless']),
+    UserData(UserDataType.SPINBOX, 'Encoder Threads', 1, []),
+    UserData(UserDataType.COMBO_BOX, 'Encoder Threading', 'Slice', ['Slice', 'Frame', 'Slice and Frame']),
+    UserData(UserDataType.CHECK_BOX, 'Columnar Analog', False, []),
+    UserData(UserDataType.DOUBLE_SPINBOX, 'Block Duration', 1.0, []),
+    UserData(UserDataType.COMBO_BOX, 'Writer', 'Stream', ['Stream', 'Thread', 'io_uring']),
+    UserData(UserDataType.CHECK_BOX, 'Direct IO', False, []),
+    UserData(UserDataType.SPINBOX, 'Write Slabs', 4, []),
+    UserData(UserDataType.SPINBOX, 'Slab Size (MB)', 4, []),
+    UserData(UserDataType.DOUBLE_SPINBOX, 'Sync Interval', 0.0, []),
+    UserData(UserDataType.DEFAULT, 'Shard Directories', '', []),
+    UserData(UserDataType.CHECK_BOX, 'Triggered', False, []),
+    UserData(UserDataType.COMBO_BOX, 'Trigger Type', 'Event', ['Event', 'Text', 'Analog']),
+    UserData(UserDataType.DEFAULT, 'Trigger Node', '', []),
+    UserData(UserDataType.DEFAULT, 'Trigger Text', '', []),
+    UserData(UserDataType.DEFAULT, 'Trigger Channel', '', []),
+    UserData(UserDataType.DOUBLE_SPINBOX, 'Trigger Threshold', 0.0, []),
+    UserData(UserDataType.DOUBLE_SPINBOX, 'Pre Trigger', 2.0, []),
+    UserData(UserDataType.DOUBLE_SPINBOX, 'Post Trigger', 2.0, []),
+    UserData(UserDataType.SPINBOX, 'Ring Limit (MB)', 512, []),
     UserData(UserDataType.CHECK_BOX, 'Simple Copy', False, []),
   ]),
   'STARTER': Factory(None, [
@@ -339,6 +359,10 @@ FACTORIES = {
     UserData(UserDataType.DEFAULT, 'File Name', '', []),
     UserData(UserDataType.CHECK_BOX, 'Running', False, []),
     UserData(UserDataType.CHECK_BOX, 'View', False, []),
+    UserData(UserDataType.SPINBOX, 'Decoder Threads', 0, []),
+    UserData(UserDataType.COMBO_BOX, 'Decoder Threading', 'Slice and Frame', ['Slice', 'Frame', 'Slice and Frame']),
+    UserData(UserDataType.SPINBOX, 'Prefetch Frames', 8, []),
+    UserData(UserDataType.DOUBLE_SPINBOX, 'Seek', 0.0, []),
   ]),
   'ANALOG': Factory(AnalogWidget, [
     UserData(UserDataType.CHECK_BOX, 'Widget is Touchpad', False, [])
@@ -354,6 +378,7 @@ FACTORIES = {
     UserData(UserDataType.COMBO_BOX, 'Source', '', get_node_names),
     UserData(UserDataType.CHECK_BOX, 'Computing', False, []),
     UserData(UserDataType.CHECK_BOX, 'Render Thresholded', False, []),
+    UserData(UserDataType.CHECK_BOX, 'Fast Path', False, []),
     UserData(UserDataType.CHECK_BOX, 'View', False, []),
   ]),
   'DISTORTION': Factory(lambda c, s: DistortionWidget(c, s), [
@@ -383,6 +408,33 @@ FACTORIES = {
     UserData(UserDataType.SPINBOX, 'Min', 0.0, []),
     UserData(UserDataType.SPINBOX, 'Max', 1.0, []),
   ]),
+  'FILTER': Factory(None, [
+    UserData(UserDataType.DEFAULT, 'Source', '', []),
+    UserData(UserDataType.COMBO_BOX, 'Filter', 'Band Pass', ['None', 'Low Pass', 'High Pass', 'Band Pass', 'Band Stop']),
+    UserData(UserDataType.COMBO_BOX, 'Design', 'Butterworth', ['Butterworth', 'FIR']),
+    UserData(UserDataType.SPINBOX, 'Order', 4, []),
+    UserData(UserDataType.SPINBOX, 'Taps', 101, []),
+    UserData(UserDataType.DOUBLE_SPINBOX, 'Low Cutoff (Hz)', 300.0, []),
+    UserData(UserDataType.DOUBLE_SPINBOX, 'High Cutoff (Hz)', 3000.0, []),
+    UserData(UserDataType.DOUBLE_SPINBOX, 'Notch (Hz)', 0.0, []),
+    UserData(UserDataType.DOUBLE_SPINBOX, 'Notch Q', 30.0, []),
+    UserData(UserDataType.SPINBOX, 'Notch Harmonics', 1, []),
+  ]),
+  'SPIKE_DETECT': Factory(None, [
+    UserData(UserDataType.DEFAULT, 'Source', '', []),
+    UserData(UserDataType.DOUBLE_SPINBOX, 'Threshold (SD)', 4.5, []),
+    UserData(UserDataType.COMBO_BOX, 'Polarity', 'Negative', ['Negative', 'Positive', 'Both']),
+    UserData(UserDataType.DOUBLE_SPINBOX, 'Refractory (ms)', 1.0, []),
+    UserData(UserDataType.DOUBLE_SPINBOX, 'Noise Window (s)', 1.0, []),
+    UserData(UserDataType.DOUBLE_SPINBOX, 'Rate Bin (ms)', 10.0, []),
+    UserData(UserDataType.DOUBLE_SPINBOX, 'Rate Window (s)', 1.0, []),
+  ]),
+  'DECIMATE': Factory(None, [
+    UserData(UserDataType.DEFAULT, 'Source', '', []),
+    UserData(UserDataType.SPINBOX, 'Ratio', 30, []),
+    UserData(UserDataType.DOUBLE_SPINBOX, 'Passband (Hz)', 300.0, []),
+    UserData(UserDataType.SPINBOX, 'Taps', 0, []),
+  ]),
   'ALGEBRA': Factory(lambda c, s: AlgebraWidget(c, s), [
     UserData(UserDataType.DEFAULT, 'Source', '', []),
     UserData(UserDataType.DEFAULT, 'Equation', '', [])]),
@@ -398,6 +450,17 @@ FACTORIES = {
     UserData(UserDataType.SPINBOX, 'Probe Size', 128, []),
     UserData(UserDataType.CHECK_BOX, 'View', False, []),
     UserData(UserDataType.CHECK_BOX, 'Running', False, [])]),
+  'REPLAY': Factory(None, [
+    UserData(UserDataType.DEFAULT, 'File', '', []),
+    UserData(UserDataType.DEFAULT, 'Nodes', '', []),
+    UserData(UserDataType.COMBO_BOX, 'Clock', 'Real Time', ['Real Time', 'Speed', 'As Fast As Possible']),
+    UserData(UserDataType.DOUBLE_SPINBOX, 'Speed', 1.0, []),
+    UserData(UserDataType.DOUBLE_SPINBOX, 'Seek', 0.0, []),
+    UserData(UserDataType.SPINBOX, 'Prefetch Records', 4096, []),
+    UserData(UserDataType.CHECK_BOX, 'Virtual Clock', False, []),
+    UserData(UserDataType.CHECK_BOX, 'Running', False, [])]),
+  'REPLAY_SOURCE': Factory(None, [
+    UserData(UserDataType.CHECK_BOX, 'View', False, [])]),
   'REMOTE_LOG': Factory(None, [
     UserData(UserDataType.DEFAULT, 'Address', '', []),
     UserData(UserDataType.DOUBLE_SPINBOX, 'Probe Frequency', 10.0, []),
@@ -433,6 +496,8 @@ FACTORIES = {
     UserData(UserDataType.CHECK_BOX, 'Running', False, []),
     UserData(UserDataType.CHECK_BOX, 'Marker Mode', False, []),
     UserData(UserDataType.CHECK_BOX, 'View', False, []),
+    UserData(UserDataType.CHECK_BOX, 'Tracking', False, []),
+    UserData(UserDataType.SPINBOX, 'Full Search Interval', 10, []),
     UserData(UserDataType.DEFAULT, 'Source', '', []),
     UserData(UserDataType.COMBO_BOX, 'Dictionary',  "DICT_4X4_50", [
       "DICT_4X4_50",
@@ -1515,7 +1580,8 @@ class ItemModel(QAbstractItemModel):
               bin_ns = int(10e9/1920)
               request = thalamus_pb2.GraphRequest(
                 node = thalamus_pb2.NodeSelector(name = node["name"]),
-                bin_ns = bin_ns
+                bin_ns = bin_ns,
+                backfill_ns = int(10e9)
               )
               self.plots[id(node)] = PlotStack(node, self.stub.graph(request), bin_ns)
           create_task_with_exc_handling(create_widget())
@@ -1642,8 +1708,10 @@ class ThalamusWindow(QMainWindow):
     self.done_future.set_result(None)
 
   async def load(self):
-    for key in list(FACTORIES.keys()):
-      response = await self.stub.get_type_name(thalamus_pb2.StringMessage(value=key))
+    # Each request waits for its type to be prepared, so they run concurrently
+    keys = list(FACTORIES.keys())
+    responses = await asyncio.gather(*(self.stub.get_type_name(thalamus_pb2.StringMessage(value=key)) for key in keys))
+    for key, response in zip(keys, responses):
       LOGGER.debug('%s %s', key, response)
       if response.value:
         FACTORY_NAMES[key] = response.value
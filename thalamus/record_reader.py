@@ -23,6 +23,8 @@ import numpy
 import scipy.io
 
 from thalamus.thalamus_pb2 import StorageRecord, Image, Compressed
+from thalamus.columnar import ColumnarExpander
+from thalamus.matroska import MatroskaWriter
 import google.protobuf.message
 
 EXECUTABLE_EXTENSION = '.exe' if sys.platform == 'win32' else ''
@@ -149,6 +151,8 @@ class RecordReader:
 
   def reader_thread(self):
     muxers: typing.Dict[str, subprocess.Popen] = {}
+    containers: typing.Dict[str, MatroskaWriter] = {}
+    columnar = ColumnarExpander()
     assert self.reader is not None
     try:
       #print('reader', self.reader.tell(), self.size)
@@ -163,6 +167,7 @@ class RecordReader:
         #print('reader', record)
         if record is None:
           with self.lock:
+            self.records.extend((position, r) for r in columnar.flush())
             self.records.append((self.size, None))
           return
         
@@ -189,12 +194,18 @@ class RecordReader:
             self.records.append((position, PendingMessage(compressed.size, compressed.type, compressed.stream)))
         elif body_type == 'image':
           image = record.image
-          if image.format in (Image.Format.MPEG1, Image.Format.MPEG4, Image.Format.Gray, Image.Format.RGB) and self.mux:
+          if image.format in (Image.Format.MPEG1, Image.Format.MPEG4, Image.Format.H264, Image.Format.FFV1, Image.Format.Gray, Image.Format.RGB) and self.mux:
             if record.node not in muxers:
               self.image_nodes.append(record.node)
               output_file = f'{self.filename}.{record.node}.avi'
-              if image.format in (Image.Format.MPEG1, Image.Format.MPEG4,):
+              if image.format in (Image.Format.MPEG1, Image.Format.MPEG4, Image.Format.H264):
                 muxers[record.node] = subprocess.Popen(f'ffmpeg -y -i pipe: -c:v copy "{output_file}"', stdin=subprocess.PIPE, shell=True)
+                assert muxers[record.node].stdin is not None
+                muxers[record.node].stdin.write(image.codec_extradata)
+              elif image.format == Image.Format.FFV1:
+                muxers[record.node] = subprocess.Popen(f'ffmpeg -y -f matroska -i pipe: -c:v copy "{output_file}"', stdin=subprocess.PIPE, shell=True)
+                assert muxers[record.node].stdin is not None
+                containers[record.node] = MatroskaWriter(muxers[record.node].stdin, image)
               elif image.format in (Image.Format.Gray, Image.Format.RGB):
                 framerates = [
                   (24000.0 / 1001, "24000/1001"),
@@ -224,13 +235,20 @@ class RecordReader:
             muxer = muxers[record.node]
             assert muxer.stdin is not None
             if len(image.data) > 0:
-              muxer.stdin.write(image.data[0])
+              if record.node in containers:
+                containers[record.node].write(image.data[0], record.time)
+              else:
+                muxer.stdin.write(image.data[0])
             if image.width > 0:
               with self.lock:
                 self.records.append((position, record))
           else:
             with self.lock:
               self.records.append((position, record))
+        elif body_type in ('analog_schema', 'analog_block'):
+          expanded = columnar.feed(record)
+          with self.lock:
+            self.records.extend((position, r) for r in expanded)
         else:
           with self.lock:
             self.records.append((position, record))
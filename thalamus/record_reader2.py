@@ -15,6 +15,8 @@ from pprint import pprint
 from multiprocessing.pool import ThreadPool, AsyncResult
 
 from thalamus.thalamus_pb2 import StorageRecord, Image, Compressed
+from thalamus.columnar import ColumnarExpander
+from thalamus.matroska import MatroskaWriter
 import google.protobuf.message
 
 EXECUTABLE_EXTENSION = '.exe' if sys.platform == 'win32' else ''
@@ -117,6 +119,8 @@ class SimpleRecordReader:
     self.size = 0
     self.node_filter = node
     self.current_position = 0
+    self.columnar = ColumnarExpander()
+    self.pending: collections.deque[StorageRecord] = collections.deque()
     if isinstance(file_arg, (str, pathlib.Path)):
       self.owns_reader = True
       self.filename = pathlib.Path(file_arg) if isinstance(file_arg, str) else file_arg
@@ -128,9 +132,15 @@ class SimpleRecordReader:
       self.measure()
 
   def get_record(self) -> typing.Optional[StorageRecord]:
-    temp = self.__read_record()
-    if temp is not None:
-      return temp[0]
+    while not self.pending:
+      temp = self.__read_record()
+      if temp is None:
+        self.pending.extend(self.columnar.flush())
+        if not self.pending:
+          return None
+        break
+      self.pending.extend(self.columnar.feed(temp[0]))
+    return self.pending.popleft()
     
   def progress(self):
     return self.current_position/self.size
@@ -226,6 +236,8 @@ class RecordReader:
 
   def reader_thread(self):
     muxers: typing.Dict[str, subprocess.Popen] = {}
+    containers: typing.Dict[str, MatroskaWriter] = {}
+    columnar = ColumnarExpander()
     decoder_threads: typing.Dict[str, threading.Thread] = {}
     decoder_queues: typing.Dict[str, queue.Queue] = {}
 
@@ -278,6 +290,7 @@ class RecordReader:
         #print('reader', record)
         if record is None:
           with self.lock:
+            self.records.extend((position, r.time, r) for r in columnar.flush())
             self.records.append((self.size, 0, None))
           return
         
@@ -307,9 +320,15 @@ class RecordReader:
             self.records.append((position, record.time, PendingMessage(compressed.size, compressed.type, compressed.stream)))
         elif body_type == 'image':
           image = record.image
-          if self.decode_video and image.format in (Image.Format.MPEG1, Image.Format.MPEG4):
+          if self.decode_video and image.format in (Image.Format.MPEG1, Image.Format.MPEG4, Image.Format.H264, Image.Format.FFV1):
             if record.node not in muxers:
-              muxers[record.node] = subprocess.Popen(f'ffmpeg -hide_banner -loglevel error -y -i pipe: -f rawvideo -pix_fmt gray pipe:', stdin=subprocess.PIPE, stdout=subprocess.PIPE, shell=True)
+              # FFV1 has no raw bitstream format so its packets go in a container
+              input_format = '-f matroska ' if image.format == Image.Format.FFV1 else ''
+              muxers[record.node] = subprocess.Popen(f'ffmpeg -hide_banner -loglevel error -y {input_format}-i pipe: -f rawvideo -pix_fmt gray pipe:', stdin=subprocess.PIPE, stdout=subprocess.PIPE, shell=True)
+              if image.format == Image.Format.FFV1:
+                containers[record.node] = MatroskaWriter(muxers[record.node].stdin, image)
+              else:
+                muxers[record.node].stdin.write(image.codec_extradata)
               decoder_queues[record.node] = queue.Queue()
               prototype = StorageRecord(
                 node=record.node,
@@ -325,13 +344,20 @@ class RecordReader:
               )
               decoder_threads[record.node] = threading.Thread(target=decoder,args=(muxers[record.node], decoder_queues[record.node], prototype))
               decoder_threads[record.node].start()
-            muxers[record.node].stdin.write(image.data[0])
+            if record.node in containers:
+              containers[record.node].write(image.data[0], record.time)
+            else:
+              muxers[record.node].stdin.write(image.data[0])
             if image.width > 0:
               with self.lock:
                 self.records.append((position, record.time, decoder_queues[record.node]))
           else:
             with self.lock:
               self.records.append((position, record.time, record))
+        elif body_type in ('analog_schema', 'analog_block'):
+          expanded = columnar.feed(record)
+          with self.lock:
+            self.records.extend((position, r.time, r) for r in expanded)
         else:
           with self.lock:
             self.records.append((position, record.time, record))
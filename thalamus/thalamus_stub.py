@@ -134,6 +134,8 @@ class ThalamusStub():
     return self.stub.spectrogram(request)
   def get_type_name(self, request: thalamus_pb2.StringMessage) -> thalamus_pb2.StringMessage:
     return self.stub.get_type_name(request)
+  def startup_report(self, request: thalamus_pb2.Empty) -> thalamus_pb2.StartupReport:
+    return self.stub.startup_report(request)
   def replay(self, request: thalamus_pb2.ReplayRequest) -> thalamus_pb2.Empty:
     return self.stub.replay(request)
   def notification (self, request: thalamus_pb2.Empty) -> typing.AsyncIterable[thalamus_pb2.Notification]: